@@ -0,0 +1,360 @@
+#ifndef FusedNormalizedGaussianConvolutionImageFilter_hxx
+#define FusedNormalizedGaussianConvolutionImageFilter_hxx
+
+#include <algorithm>
+
+#include "itkMultiThreader.h"
+
+#include "ife/Numerics/RecursiveGaussian.h"
+#include "FusedNormalizedGaussianConvolutionImageFilter.h"
+
+namespace itk {
+
+  template< typename TInputImage, typename TOutputImage >
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::FusedNormalizedGaussianConvolutionImageFilter()
+  {
+    this->SetNumberOfRequiredInputs(2);
+    m_SigmaArray.Fill( 1.0 );
+    m_InputImageIsWeighted = false;
+    m_SmoothingMethod = RecursiveGaussianSmoothing;
+    m_GenerateSmoothedCertainty = false;
+    this->SetNumberOfIndexedOutputs(2);
+    this->SetNthOutput( 1, this->MakeOutput(1) );
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputImage(const TInputImage* image) {
+    this->SetNthInput(0, const_cast<TInputImage*>(image));
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputCertainty(const TOutputImage* mask)
+  {
+    this->SetNthInput(1, const_cast<TOutputImage*>(mask));
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetSigma( ScalarRealType sigma )
+  {
+    SigmaArrayType sigmas;
+    sigmas.Fill( sigma );
+    this->SetSigmaArray( sigmas );
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  typename FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >::ScalarRealType
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GetSigma() const
+  {
+    return m_SigmaArray[0];
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputSmoothedCertainty(const TOutputImage* image)
+  {
+    this->SetNthInput(2, const_cast<TOutputImage*>(image));
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  TOutputImage* FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GetSmoothedCertaintyOutput()
+  {
+    return this->GetOutput(1);
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GenerateInputRequestedRegion()
+  {
+    this->Superclass::GenerateInputRequestedRegion();
+    // The image and the certainties can have different pixel types
+    for ( unsigned int i = 0; i < this->GetNumberOfIndexedInputs(); ++i ) {
+      DataObject *input = this->ProcessObject::GetInput(i);
+      if ( input ) {
+	input->SetRequestedRegionToLargestPossibleRegion();
+      }
+    }
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::EnlargeOutputRequestedRegion( DataObject *output )
+  {
+    this->Superclass::EnlargeOutputRequestedRegion( output );
+    output->SetRequestedRegionToLargestPossibleRegion();
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GenerateData()
+  {
+    const InputImageType *image = static_cast< const InputImageType * >( this->ProcessObject::GetInput(0) );
+    const ImageType *certainty = static_cast< const ImageType * >( this->ProcessObject::GetInput(1) );
+    const RegionType region = image->GetBufferedRegion();
+    if ( region != certainty->GetBufferedRegion() ) {
+      itkExceptionMacro( << "Image and certainty must have the same buffered region."
+			 << " Image: " << region
+			 << " Certainty: " << certainty->GetBufferedRegion() );
+    }
+    const ImageType *smoothedCertainty =
+      static_cast< const ImageType * >( this->ProcessObject::GetInput(2) );
+    if ( smoothedCertainty && region != smoothedCertainty->GetBufferedRegion() ) {
+      itkExceptionMacro( << "Image and smoothed certainty must have the same buffered region."
+			 << " Image: " << region
+			 << " Smoothed certainty: " << smoothedCertainty->GetBufferedRegion() );
+    }
+    for ( unsigned int d = 0; d < ImageDimension; ++d ) {
+      if ( region.GetSize(d) < 4 ) {
+	itkExceptionMacro( << "The number of pixels along direction " << d
+			   << " is less than 4. This filter requires a minimum"
+			   << " of four pixels along the dimension to be processed." );
+      }
+    }
+
+    ImageType *output = this->GetOutput();
+    output->SetBufferedRegion( region );
+    output->Allocate();
+    if ( m_GenerateSmoothedCertainty && !smoothedCertainty ) {
+      this->GetSmoothedCertaintyOutput()->SetBufferedRegion( region );
+      this->GetSmoothedCertaintyOutput()->Allocate();
+    }
+
+    m_Pairs.resize( ( smoothedCertainty ? 1 : 2 ) * region.GetNumberOfPixels() );
+
+    // One pass for each direction. The first pass reads the inputs and the
+    // last pass writes the output.
+    PassStruct str;
+    str.Filter = this;
+    for ( unsigned int d = 0; d < ImageDimension; ++d ) {
+      str.Direction = d;
+      this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+      this->GetMultiThreader()->SetSingleMethod( PassCallback, &str );
+      this->GetMultiThreader()->SingleMethodExecute();
+    }
+
+    // Release the pairs
+    std::vector< PixelType >().swap( m_Pairs );
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  ITK_THREAD_RETURN_TYPE
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::PassCallback( void *arg )
+  {
+    MultiThreader::ThreadInfoStruct *info =
+      static_cast< MultiThreader::ThreadInfoStruct * >( arg );
+    PassStruct *str = static_cast< PassStruct * >( info->UserData );
+    str->Filter->ThreadedPass( str->Direction, info->ThreadID, info->NumberOfThreads );
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::ThreadedPass( unsigned int direction,
+		  ThreadIdType threadId,
+		  ThreadIdType numberOfThreads )
+  {
+    const ScalarRealType sigma = m_SigmaArray[direction] / this->GetOutput()->GetSpacing()[direction];
+    const bool pairs = this->ProcessObject::GetInput(2) == ITK_NULLPTR;
+    if ( m_SmoothingMethod == BoxGaussianSmoothing ) {
+      const IteratedBoxFilterType gaussian( sigma );
+      if ( pairs ) {
+	this->template ThreadedPass< 2 >( gaussian, direction, threadId, numberOfThreads );
+      }
+      else {
+	this->template ThreadedPass< 1 >( gaussian, direction, threadId, numberOfThreads );
+      }
+    }
+    else {
+      const RecursiveGaussianType gaussian( sigma );
+      if ( pairs ) {
+	this->template ThreadedPass< 2 >( gaussian, direction, threadId, numberOfThreads );
+      }
+      else {
+	this->template ThreadedPass< 1 >( gaussian, direction, threadId, numberOfThreads );
+      }
+    }
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  template< unsigned int NValues, typename TLineFilter >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::ThreadedPass( const TLineFilter& gaussian,
+		  unsigned int direction,
+		  ThreadIdType threadId,
+		  ThreadIdType numberOfThreads )
+  {
+    typedef typename ImageType::OffsetValueType OffsetValueType;
+
+    ImageType *output = this->GetOutput();
+    const RegionType region = output->GetBufferedRegion();
+    const OffsetValueType *offsetTable = output->GetOffsetTable();
+
+    const bool firstPass = direction == 0;
+    const bool lastPass = direction + 1 == ImageDimension;
+
+    // The x-lines are filtered one at a time. The lines along the other
+    // directions are grouped in blocks of neighbours along x, and a row of
+    // nx lines has nx / LinesPerBlock full blocks and the rest are filtered
+    // one at a time. The blocks, or lines, are split evenly between the
+    // threads.
+    const size_t n = region.GetSize( direction );
+    const OffsetValueType stride = offsetTable[direction];
+    const size_t nx = region.GetSize( 0 );
+    const size_t blockWidth = direction == 0 ? 1 : LinesPerBlock;
+    const size_t blocksPerRow = direction == 0 ? 1 : ( nx + blockWidth - 1 ) / blockWidth;
+    const size_t nRows = region.GetNumberOfPixels() / n / ( direction == 0 ? 1 : nx );
+    const size_t nBlocks = nRows * blocksPerRow;
+    const size_t blocksPerThread = ( nBlocks + numberOfThreads - 1 ) / numberOfThreads;
+    const size_t blockBegin = std::min( nBlocks, threadId * blocksPerThread );
+    const size_t blockEnd = std::min( nBlocks, blockBegin + blocksPerThread );
+
+    std::vector< ScalarRealType > line( NValues * blockWidth * n );
+    std::vector< ScalarRealType > smoothed( NValues * blockWidth * n );
+    std::vector< ScalarRealType > scratch( NValues * blockWidth * n );
+
+    for ( size_t b = blockBegin; b < blockEnd; ++b ) {
+      // Offset of the first pixel in the first line of the block. The rows
+      // are enumerated over the directions other than direction, and for the
+      // blocked passes also other than x.
+      const size_t x = ( b % blocksPerRow ) * blockWidth;
+      OffsetValueType base = direction == 0 ? 0 : x;
+      size_t rest = b / blocksPerRow;
+      for ( unsigned int k = 0; k < ImageDimension; ++k ) {
+	if ( k != direction && ( direction == 0 || k != 0 ) ) {
+	  base += ( rest % region.GetSize(k) ) * offsetTable[k];
+	  rest /= region.GetSize(k);
+	}
+      }
+
+      if ( direction != 0 && x + LinesPerBlock <= nx ) {
+	this->template FilterLines< LinesPerBlock, NValues >( gaussian, base, stride, n,
+							      firstPass, lastPass,
+							      &line[0], &smoothed[0], &scratch[0] );
+      }
+      else {
+	const size_t width = std::min( blockWidth, nx - x );
+	for ( size_t i = 0; i < width; ++i ) {
+	  this->template FilterLines< 1, NValues >( gaussian, base + i, stride, n,
+						    firstPass, lastPass,
+						    &line[0], &smoothed[0], &scratch[0] );
+	}
+      }
+    }
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  template< unsigned int NLines, unsigned int NValues, typename TLineFilter >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::FilterLines( const TLineFilter& gaussian,
+		 typename ImageType::OffsetValueType base,
+		 typename ImageType::OffsetValueType stride,
+		 size_t n, bool firstPass, bool lastPass,
+		 ScalarRealType *line, ScalarRealType *smoothed,
+		 ScalarRealType *scratch )
+  {
+    typedef typename ImageType::OffsetValueType OffsetValueType;
+    const size_t C = NValues * NLines;
+
+    const InputImageType *image = static_cast< const InputImageType * >( this->ProcessObject::GetInput(0) );
+    const ImageType *certainty = static_cast< const ImageType * >( this->ProcessObject::GetInput(1) );
+    const InputPixelType *T = image->GetBufferPointer();
+    const PixelType *c = certainty->GetBufferPointer();
+    PixelType *out = this->GetOutput()->GetBufferPointer();
+    PixelType *pairs = &m_Pairs[0];
+
+    // The smoothed certainty is either an input or the second value of the
+    // pairs, and it is only written when it is smoothed here
+    const PixelType *D = NValues == 1
+      ? static_cast< const ImageType * >( this->ProcessObject::GetInput(2) )->GetBufferPointer()
+      : ITK_NULLPTR;
+    PixelType *smoothedCertaintyOut = NValues == 2 && m_GenerateSmoothedCertainty
+      ? this->GetSmoothedCertaintyOutput()->GetBufferPointer()
+      : ITK_NULLPTR;
+
+    // Sample i of line k is at base + k + i*stride, so sample i of all the
+    // lines is a contiguous run of NLines pairs, which is channel 2k and
+    // 2k+1 of sample i in line. Without the certainty channel k is the
+    // numerator of line k. An integer image is converted here, so it is
+    // never copied to a real image.
+    if ( firstPass ) {
+      for ( size_t i = 0; i < n; ++i ) {
+	const OffsetValueType j = base + i * stride;
+	for ( size_t k = 0; k < NLines; ++k ) {
+	  const PixelType t = static_cast< PixelType >( T[j+k] );
+	  line[i*C + NValues*k] = m_InputImageIsWeighted ? t : c[j+k] * t;
+	  if ( NValues == 2 ) {
+	    line[i*C + NValues*k + 1] = c[j+k];
+	  }
+	}
+      }
+    }
+    else {
+      for ( size_t i = 0; i < n; ++i ) {
+	const PixelType *p = pairs + NValues * ( base + i * stride );
+	std::copy( p, p + C, line + i*C );
+      }
+    }
+
+    gaussian.template filter< C >( line, smoothed, scratch, n );
+
+    if ( lastPass ) {
+      for ( size_t i = 0; i < n; ++i ) {
+	const OffsetValueType j = base + i * stride;
+	PixelType *o = out + j;
+	for ( size_t k = 0; k < NLines; ++k ) {
+	  const ScalarRealType numerator = smoothed[i*C + NValues*k];
+	  const ScalarRealType denominator = NValues == 2
+	    ? smoothed[i*C + NValues*k + 1] : D[j+k];
+	  o[k] = denominator > 0 ? numerator / denominator : 0;
+	  if ( smoothedCertaintyOut ) {
+	    smoothedCertaintyOut[j+k] = denominator;
+	  }
+	}
+      }
+    }
+    else {
+      for ( size_t i = 0; i < n; ++i ) {
+	std::copy( smoothed + i*C, smoothed + (i+1)*C, pairs + NValues * ( base + i * stride ) );
+      }
+    }
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  FusedNormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::PrintSelf( std::ostream& os, Indent indent ) const
+  {
+    Superclass::PrintSelf(os,indent);
+
+    os << indent << "SigmaArray:" << this->m_SigmaArray
+       << std::endl;
+    os << indent << "InputImageIsWeighted:" << this->m_InputImageIsWeighted
+       << std::endl;
+    os << indent << "SmoothingMethod:" << this->m_SmoothingMethod
+       << std::endl;
+    os << indent << "GenerateSmoothedCertainty:" << this->m_GenerateSmoothedCertainty
+       << std::endl;
+  }
+
+} // end namespace itk
+
+#endif
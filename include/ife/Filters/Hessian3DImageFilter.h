@@ -4,18 +4,30 @@
 #ifndef __Hessian3DImageFilter_h
 #define __Hessian3DImageFilter_h
 
-#include "itkDerivativeImageFilter.h"
-#include "itkComposeImageFilter.h"
+#include <vector>
+
+#include "itkImageToImageFilter.h"
+#include "itkVectorImage.h"
 #include "itkPixelTraits.h"
 
 namespace itk
 {
 /** \class Hessian3DImageFilter
- * \brief Computes the Hessian matrix of an image by applying a 
+ * \brief Computes the Hessian matrix of an image by applying a
  *        second order differential operators.
  *
+ * The Hessian is estimated by central differences scaled by the spacing,
+ * with the same result as composing DerivativeImageFilter for Dxx, Dyy, Dzz
+ * and Dx->Dy, Dx->Dz, Dy->Dz with the ZeroFluxNeumannBoundaryCondition.
+ * Instead of eight intermediate volumes, each thread reads the 3x3x3
+ * neighbourhood of its voxels and writes the six components
+ *   Dxx, Dxy, Dxz, Dyy, Dyz, Dzz
+ * directly. A line along x is handled at a time, the rows needed for the
+ * x differences are copied to edge extended buffers and each component is
+ * computed by a loop over the line that can be vectorized.
  *
- * This filter is implemented using the DerivativeImageFilter
+ * With ComputeGradientMagnitudeOn() the gradient magnitude from the same
+ * central differences is written as a seventh component.
  */
 // NOTE that the typename macro has to be used here in lieu
 // of "typename" because VC++ doesn't like the typename keyword
@@ -40,46 +52,43 @@ public:
   /** Pixel Type of the output image */
   typedef TOutputImage                                       OutputImageType;
   typedef typename OutputImageType::PixelType                OutputPixelType;
-  
+  typedef typename OutputImageType::InternalPixelType        OutputInternalPixelType;
+  typedef typename OutputImageType::RegionType               OutputImageRegionType;
+
+  // The stencil is written for 3D
+  static_assert( InputImageType::ImageDimension == 3,
+		 "Hessian3DImageFilter requires 3D images" );
+
   /** Run-time type information (and related methods).   */
   itkTypeMacro(Hessian3DImageFilter, ImageToImageFilter);
 
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
 
-  
-  virtual void GenerateOutputInformation(void) ITK_OVERRIDE;
+  /** Get/Set if the gradient magnitude should be written as a seventh
+      component. Default is off. */
+  itkGetConstMacro( ComputeGradientMagnitude, bool );
+  itkSetMacro( ComputeGradientMagnitude, bool );
+  itkBooleanMacro( ComputeGradientMagnitude );
 
-protected:
-  typedef itk::DerivativeImageFilter< InputImageType, InputImageType >
-  DerivativeFilterType;
+  virtual void GenerateOutputInformation(void) ITK_OVERRIDE;
 
-  typedef itk::ComposeImageFilter< InputImageType, OutputImageType >
-  ComposeFilterType;
+  /** The stencil needs one voxel around the output region */
+  virtual void GenerateInputRequestedRegion(void) ITK_OVERRIDE;
 
+protected:
   Hessian3DImageFilter();
   virtual ~Hessian3DImageFilter() {}
   void PrintSelf(std::ostream & os, Indent indent) const ITK_OVERRIDE;
 
-  /** Generate Data */
-  void GenerateData(void) ITK_OVERRIDE;
+  void ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
+			     ThreadIdType threadId ) ITK_OVERRIDE;
 
 private:
   Hessian3DImageFilter(const Self &); // purposely not implemented
   void operator=(const Self &);       // purposely not implemented
 
-  typename DerivativeFilterType::Pointer m_DxxFilter;
-  typename DerivativeFilterType::Pointer m_DxyFilter;
-  typename DerivativeFilterType::Pointer m_DxzFilter;
-  typename DerivativeFilterType::Pointer m_DyyFilter;
-  typename DerivativeFilterType::Pointer m_DyzFilter;
-  typename DerivativeFilterType::Pointer m_DzzFilter;
-
-  typename DerivativeFilterType::Pointer m_DxFilter;
-  typename DerivativeFilterType::Pointer m_DyFilter;
-
-  typename ComposeFilterType::Pointer m_ComposeFilter;
-
+  bool m_ComputeGradientMagnitude;
   };
 } // end namespace itk
 
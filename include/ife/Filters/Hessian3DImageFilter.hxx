@@ -1,6 +1,9 @@
 #ifndef __Hessian3DImageFilter_hxx
 #define __Hessian3DImageFilter_hxx
 
+#include <algorithm>
+#include <cmath>
+
 #include "Hessian3DImageFilter.h"
 
 namespace itk
@@ -12,54 +15,10 @@ template< typename TInputImage, typename TOutputImage >
 Hessian3DImageFilter< TInputImage, TOutputImage >
 ::Hessian3DImageFilter()
 {
-
-  // I think the way to do this is with a map, where the keys are
-  // (direction, order)
-  
-  m_DxxFilter = DerivativeFilterType::New();
-  m_DyyFilter = DerivativeFilterType::New();
-  m_DzzFilter = DerivativeFilterType::New();
-  
-  m_DxxFilter->SetOrder(2);
-  m_DxxFilter->SetDirection(0);
-  m_DyyFilter->SetOrder(2);
-  m_DyyFilter->SetDirection(1);
-  m_DzzFilter->SetOrder(2);
-  m_DzzFilter->SetDirection(2);
-
-  
-  m_DxFilter = DerivativeFilterType::New();
-  m_DyFilter = DerivativeFilterType::New();
-
-  m_DxFilter->SetOrder(1);
-  m_DxFilter->SetDirection(0);
-  m_DyFilter->SetOrder(1);
-  m_DyFilter->SetDirection(1);
-  
-  m_DxyFilter = DerivativeFilterType::New();
-  m_DxzFilter = DerivativeFilterType::New();
-  m_DyzFilter = DerivativeFilterType::New();
-
-  m_DxyFilter->SetOrder(1);
-  m_DxyFilter->SetDirection(1);
-  m_DxyFilter->SetInput( m_DxFilter->GetOutput() );
-  m_DxzFilter->SetOrder(1);
-  m_DxzFilter->SetDirection(2);
-  m_DxzFilter->SetInput( m_DxFilter->GetOutput() );
-  m_DyzFilter->SetOrder(1);
-  m_DyzFilter->SetDirection(2);
-  m_DyzFilter->SetInput( m_DyFilter->GetOutput() );
-
-  m_ComposeFilter = ComposeFilterType::New();
-  m_ComposeFilter->SetInput( 0, m_DxxFilter->GetOutput() );
-  m_ComposeFilter->SetInput( 1, m_DxyFilter->GetOutput() );
-  m_ComposeFilter->SetInput( 2, m_DxzFilter->GetOutput() );
-  m_ComposeFilter->SetInput( 3, m_DyyFilter->GetOutput() );
-  m_ComposeFilter->SetInput( 4, m_DyzFilter->GetOutput() );
-  m_ComposeFilter->SetInput( 5, m_DzzFilter->GetOutput() ); 
+  m_ComputeGradientMagnitude = false;
 }
 
-  
+
 template< typename TInputImage, typename TOutputImage >
 void
 Hessian3DImageFilter< TInputImage, TOutputImage >
@@ -69,39 +28,190 @@ Hessian3DImageFilter< TInputImage, TOutputImage >
   this->Superclass::GenerateOutputInformation();
 
   OutputImageType *output = this->GetOutput();
-  output->SetNumberOfComponentsPerPixel( m_ComposeFilter->GetNumberOfIndexedInputs() );
+  output->SetNumberOfComponentsPerPixel( m_ComputeGradientMagnitude ? 7 : 6 );
+}
+
+
+template< typename TInputImage, typename TOutputImage >
+void
+Hessian3DImageFilter< TInputImage, TOutputImage >
+::GenerateInputRequestedRegion(void)
+{
+  this->Superclass::GenerateInputRequestedRegion();
+
+  InputImageType *input = const_cast< InputImageType * >( this->GetInput() );
+  if ( !input ) {
+    return;
+  }
+
+  typename InputImageType::RegionType requestedRegion = input->GetRequestedRegion();
+  requestedRegion.PadByRadius( 1 );
+  if ( !requestedRegion.Crop( input->GetLargestPossibleRegion() ) ) {
+    input->SetRequestedRegion( requestedRegion );
+    InvalidRequestedRegionError e(__FILE__, __LINE__);
+    e.SetLocation(ITK_LOCATION);
+    e.SetDescription("Requested region is (at least partially) outside the largest possible region.");
+    e.SetDataObject(input);
+    throw e;
+  }
+  input->SetRequestedRegion( requestedRegion );
 }
-  
 
 
 template< typename TInputImage, typename TOutputImage >
 void
 Hessian3DImageFilter< TInputImage, TOutputImage >
-::GenerateData(void)
+::ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
+			ThreadIdType itkNotUsed(threadId) )
 {
-  itkDebugMacro(<< "Hessian3DImageFilter generating data ");
-
-  // Need to graft it
-  typename InputImageType::Pointer inputImage = InputImageType::New();
-  inputImage->Graft( const_cast< InputImageType * >( this->GetInput() ));
-  
-  m_DxxFilter->SetInput( inputImage );
-  m_DyyFilter->SetInput( inputImage );
-  m_DzzFilter->SetInput( inputImage );
-  m_DxFilter->SetInput( inputImage );
-  m_DyFilter->SetInput( inputImage );
-
-  m_ComposeFilter->GraftOutput( this->GetOutput() );
-  m_ComposeFilter->Update();
-  this->GraftOutput( m_ComposeFilter->GetOutput() );
+  typedef typename InputImageType::IndexType IndexType;
+  typedef typename InputImageType::SizeType SizeType;
+  typedef typename InputImageType::SpacingType SpacingType;
+  typedef typename InputImageType::OffsetValueType OffsetValueType;
+  typedef OutputInternalPixelType RealType;
+
+  const InputImageType *input = this->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  const PixelType *in = input->GetBufferPointer();
+  OutputInternalPixelType *out = output->GetBufferPointer();
+  const size_t nComponents = output->GetNumberOfComponentsPerPixel();
+
+  // Neighbours are found by clamping the index to the buffered region, which
+  // is the same as the ZeroFluxNeumannBoundaryCondition
+  const IndexType bufferStart = input->GetBufferedRegion().GetIndex();
+  const SizeType bufferSize = input->GetBufferedRegion().GetSize();
+  const OffsetValueType *offsetTable = input->GetOffsetTable();
+  const OffsetValueType xLast = bufferSize[0] - 1;
+  const OffsetValueType yLast = bufferSize[1] - 1;
+  const OffsetValueType zLast = bufferSize[2] - 1;
+
+  // Central difference coefficients scaled by the spacing, as done by
+  // DerivativeImageFilter
+  const SpacingType spacing = input->GetSpacing();
+  const RealType hx = 0.5 / spacing[0];
+  const RealType hy = 0.5 / spacing[1];
+  const RealType hz = 0.5 / spacing[2];
+  const RealType hxx = 1.0 / ( spacing[0] * spacing[0] );
+  const RealType hyy = 1.0 / ( spacing[1] * spacing[1] );
+  const RealType hzz = 1.0 / ( spacing[2] * spacing[2] );
+  const RealType hxy = hx * hy;
+  const RealType hxz = hx * hz;
+  const RealType hyz = hy * hz;
+
+  // Loop bounds relative to the start of the buffered region
+  const OffsetValueType xBegin = outputRegionForThread.GetIndex(0) - bufferStart[0];
+  const OffsetValueType yBegin = outputRegionForThread.GetIndex(1) - bufferStart[1];
+  const OffsetValueType zBegin = outputRegionForThread.GetIndex(2) - bufferStart[2];
+  const OffsetValueType yEnd = yBegin + outputRegionForThread.GetSize(1);
+  const OffsetValueType zEnd = zBegin + outputRegionForThread.GetSize(2);
+
+  // The rows that are differentiated along x are copied with one voxel of
+  // edge extension on each side, so sample i of the line is at i+1 and its
+  // neighbours at i and i+2. The components are computed as a structure of
+  // arrays and interleaved into the output at the end of the line.
+  const size_t n = outputRegionForThread.GetSize(0);
+  std::vector< RealType > rowBuffer( 5 * ( n + 2 ) );
+  std::vector< RealType > lineBuffer( nComponents * n );
+  RealType *rows[5];
+  RealType *components[7];
+  for ( size_t k = 0; k < 5; ++k ) {
+    rows[k] = &rowBuffer[k * ( n + 2 )];
+  }
+  for ( size_t k = 0; k < nComponents; ++k ) {
+    components[k] = &lineBuffer[k * n];
+  }
+
+  IndexType index = outputRegionForThread.GetIndex();
+  for ( OffsetValueType zc = zBegin; zc < zEnd; ++zc ) {
+    const OffsetValueType zm = std::max< OffsetValueType >( zc - 1, 0 ) * offsetTable[2];
+    const OffsetValueType zp = std::min< OffsetValueType >( zc + 1, zLast ) * offsetTable[2];
+    const OffsetValueType z0 = zc * offsetTable[2];
+    index[2] = bufferStart[2] + zc;
+
+    for ( OffsetValueType yc = yBegin; yc < yEnd; ++yc ) {
+      const OffsetValueType ym = std::max< OffsetValueType >( yc - 1, 0 ) * offsetTable[1];
+      const OffsetValueType yp = std::min< OffsetValueType >( yc + 1, yLast ) * offsetTable[1];
+      const OffsetValueType y0 = yc * offsetTable[1];
+      index[1] = bufferStart[1] + yc;
+
+      // The centre row and its four neighbours in the y-z plane are
+      // differentiated along x. The corners are only needed at the voxel
+      // itself for Dyz.
+      const PixelType *source[5] = {
+	in + z0 + y0, in + z0 + ym, in + z0 + yp, in + zm + y0, in + zp + y0
+      };
+      for ( size_t k = 0; k < 5; ++k ) {
+	for ( size_t i = 0; i < n + 2; ++i ) {
+	  const OffsetValueType x =
+	    std::min( std::max< OffsetValueType >( xBegin + OffsetValueType(i) - 1, 0 ), xLast );
+	  rows[k][i] = source[k][x];
+	}
+      }
+      const RealType *r00 = rows[0];
+      const RealType *rm0 = rows[1];
+      const RealType *rp0 = rows[2];
+      const RealType *r0m = rows[3];
+      const RealType *r0p = rows[4];
+      const PixelType *rmm = in + zm + ym + xBegin;
+      const PixelType *rpm = in + zm + yp + xBegin;
+      const PixelType *rmp = in + zp + ym + xBegin;
+      const PixelType *rpp = in + zp + yp + xBegin;
+
+      RealType *dxx = components[0];
+      RealType *dxy = components[1];
+      RealType *dxz = components[2];
+      RealType *dyy = components[3];
+      RealType *dyz = components[4];
+      RealType *dzz = components[5];
+      for ( size_t i = 0; i < n; ++i ) {
+	dxx[i] = hxx * ( r00[i+2] - 2 * r00[i+1] + r00[i] );
+      }
+      for ( size_t i = 0; i < n; ++i ) {
+	dxy[i] = hxy * ( ( rp0[i+2] - rp0[i] ) - ( rm0[i+2] - rm0[i] ) );
+      }
+      for ( size_t i = 0; i < n; ++i ) {
+	dxz[i] = hxz * ( ( r0p[i+2] - r0p[i] ) - ( r0m[i+2] - r0m[i] ) );
+      }
+      for ( size_t i = 0; i < n; ++i ) {
+	dyy[i] = hyy * ( rp0[i+1] - 2 * r00[i+1] + rm0[i+1] );
+      }
+      for ( size_t i = 0; i < n; ++i ) {
+	dyz[i] = hyz * ( ( RealType(rpp[i]) - RealType(rmp[i]) )
+			 - ( RealType(rpm[i]) - RealType(rmm[i]) ) );
+      }
+      for ( size_t i = 0; i < n; ++i ) {
+	dzz[i] = hzz * ( r0p[i+1] - 2 * r00[i+1] + r0m[i+1] );
+      }
+      if ( m_ComputeGradientMagnitude ) {
+	RealType *gradientMagnitude = components[6];
+	for ( size_t i = 0; i < n; ++i ) {
+	  const RealType dx = hx * ( r00[i+2] - r00[i] );
+	  const RealType dy = hy * ( rp0[i+1] - rm0[i+1] );
+	  const RealType dz = hz * ( r0p[i+1] - r0m[i+1] );
+	  gradientMagnitude[i] = std::sqrt( dx*dx + dy*dy + dz*dz );
+	}
+      }
+
+      OutputInternalPixelType *o = out + output->ComputeOffset( index ) * nComponents;
+      for ( size_t i = 0; i < n; ++i, o += nComponents ) {
+	for ( size_t k = 0; k < nComponents; ++k ) {
+	  o[k] = components[k][i];
+	}
+      }
+    }
+  }
 }
 
+
 template< typename TInputImage, typename TOutputImage >
 void
 Hessian3DImageFilter< TInputImage, TOutputImage >
 ::PrintSelf(std::ostream & os, Indent indent) const
 {
   Superclass::PrintSelf(os, indent);
+  os << indent << "ComputeGradientMagnitude:" << this->m_ComputeGradientMagnitude
+     << std::endl;
 }
 
 } // end namespace itk
@@ -5,16 +5,95 @@
   Extract features used for estimating emphysema in CT lung scans.
   See: ... TODO ...
 
+  The features are computed from the normalized convolution of the image with
+  a Gaussian at scale sigma. By default everything after the smoothing is done
+  in a single multithreaded sweep over the smoothed image, that computes the
+  gradient magnitude, the Hessian by central differences, the eigenvalue
+  features and masks the result directly into the output. The eigenvalues are
+  found with Symmetric3x3EigenvalueBatchSolver for a line at a time, see that
+  file for the accuracy compared to the reference. The original
+  composition of ITK filters is kept as a reference and can be enabled with
+  UseFusedComputationOff().
+  The features are only calculated in the mask, the fused computation walks
+  the foreground runs of the mask along x and only zeroes the voxels between
+  them.
+  The fused computation smooths with FusedNormalizedGaussianConvolutionImageFilter,
+  that smooths the numerator and denominator of the normalized convolution
+  together, the reference uses NormalizedGaussianConvolutionImageFilter.
+  With UseGaussianDerivativesOn() the fused computation instead takes the
+  gradient and Hessian from NormalizedGaussianDerivativeConvolutionImageFilter,
+  that convolves with derivatives of the Gaussian instead of taking central
+  differences of the smoothed image.
+  SetSmoothingMethod( BoxGaussianSmoothing ) approximates the Gaussian by
+  iterated box filters in both the fused and the reference computation, which
+  is faster for large sigma. The Gaussian derivatives are always recursive.
+
+  Large scales are oversampled by the image grid. With
+  SetPyramidSamplesPerSigma the fused computation calculates such scales on
+  a grid that is 2^k times coarser, where k is the largest level at which
+  sigma still covers the given number of coarse voxels along every axis. The
+  weighted image and the certainty are block averaged, the features are
+  calculated on the coarse grid and interpolated trilinearly to the mask
+  voxels from the coarse voxels with certainty. This does about 8^k times
+  less work for the scale, and the features deviate from the fine grid
+  features by the interpolation error, which is small when sigma covers a
+  few coarse voxels. The blocks are aligned with the padded requested region,
+  so streamed output of a coarse scale differs from the unstreamed output by
+  up to the interpolation error.
+
+  Several scales can be calculated in one update with SetSigmas. The mask
+  cast is calculated once and shared by all scales, and the intermediate
+  images of a scale are released before the next scale is calculated.
+
+  The image can have an integer pixel type, such as the short values of a
+  CT scan, which takes half the memory of float. Everything after the input
+  has the real pixel type PixelType, which is the float type of the input
+  pixel type. The fused computation multiplies the image by the mask and
+  converts it in the first pass of the smoothing, so the image is never
+  copied to a real image. The reference composition and the coarse levels of
+  the pyramid smooth the product of image and mask, which is calculated once
+  and shared by all scales.
+
+  The smoothed mask only depends on the mask and the scale. With
+  SetSmoothedCertaintyCache the smoothed masks are kept in the cache, and
+  later updates with the same mask and scales, also with another image, only
+  smooth the image. The Gaussian derivatives and the coarse levels of the
+  pyramid do not use the cache.
+
+  The vector output interleaves the components of a voxel. With
+  PlanarOutputOn() each feature of each scale is instead written to its own
+  scalar image, GetFeatureOutput, so a feature is one contiguous buffer that
+  can be read a line at a time, e.g. by the kernels in
+  Statistics/MaskedRegionHistogram.h, without gathering the components of
+  every voxel.
+
+  The filter supports streaming. The image and mask are requested for the
+  output region padded by 4 times the largest sigma and one voxel for the
+  central differences, and the padded region is processed as if it was the
+  entire image, see RequestedRegion.h. The streamed output matches the
+  unstreamed output up to the part of the Gaussian beyond the padding.
  */
+#include <string>
+#include <vector>
+
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkBinShrinkImageFilter.h"
 #include "itkGradientMagnitudeImageFilter.h"
+#include "itkImage.h"
 #include "itkComposeImageFilter.h"
+#include "itkMultiplyImageFilter.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
 #include "itkUnaryFunctorImageFilter.h"
 #include "itkMaskImageFilter.h"
 
 #include "ife/Numerics/EigenvalueFeaturesFunctor.h"
+#include "ife/Numerics/Symmetric3x3EigenvalueBatchSolver.h"
+#include "ife/Util/MaskRuns.h"
+#include "ife/Util/SmoothedCertaintyCache.h"
 #include "ife/Filters/Hessian3DImageFilter.h"
 #include "ife/Filters/NormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Filters/FusedNormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Filters/NormalizedGaussianDerivativeConvolutionImageFilter.h"
 
 namespace itk {
   
@@ -34,11 +113,28 @@ namespace itk {
     typedef TInputMask InputMaskType;
     typedef TOutputImage OutputImageType;
 
-    typedef typename InputImageType::PixelType PixelType;
+    typedef typename InputImageType::PixelType InputPixelType;
+    typedef typename InputMaskType::PixelType MaskPixelType;
     typedef typename OutputImageType::PixelType OutputPixelType;
+    typedef typename OutputImageType::InternalPixelType OutputInternalPixelType;
+    typedef typename OutputImageType::RegionType OutputImageRegionType;
+    typedef typename OutputImageType::OffsetValueType OffsetValueType;
 
-    // We must have scalar valued input
+    // We must have scalar valued input. The smoothed image and the features
+    // are calculated with the real type of the input pixel type.
+    typedef typename NumericTraits< InputPixelType >::FloatType PixelType;
+    typedef Image< PixelType, InputImageType::ImageDimension > RealImageType;
     typedef PixelType ScalarRealType;
+    typedef std::vector< ScalarRealType > SigmasType;
+    typedef FixedArray< ScalarRealType, InputImageType::ImageDimension > SigmaArrayType;
+    typedef SmoothedCertaintyCache< RealImageType > SmoothedCertaintyCacheType;
+
+    /** A single component of the output when PlanarOutput is on */
+    typedef Image< OutputInternalPixelType, InputImageType::ImageDimension > FeatureImageType;
+
+    // The Hessian features only make sense in 3D
+    static_assert( InputImageType::ImageDimension == 3,
+		   "ImageToEmphysemaFeaturesFilter requires 3D images" );
     
     /** Method for creation through object factory */
     itkNewMacro(Self);
@@ -58,33 +154,175 @@ namespace itk {
     itkGetMacro( Sigma, ScalarRealType );
     itkSetMacro( Sigma, ScalarRealType );
 
+    /** Get/Set the scales in mm at which to calculate features. All scales
+	are calculated in one update, and the output has
+	GetNumberOfSelectedFeatures() components for each scale, such that
+	feature k at scale i is component
+	  i * GetNumberOfSelectedFeatures() + k
+	When the list is not empty Sigma is not used. */
+    void SetSigmas( const SigmasType& sigmas );
+    itkGetConstReferenceMacro( Sigmas, SigmasType );
+
+    /** The scales that are calculated, either Sigmas or Sigma */
+    SigmasType GetScales() const;
+
+    /** Get/Set if the fused single pass kernel should be used. When off the
+	reference composition of ITK filters is used. Default is on. */
+    itkGetConstMacro( UseFusedComputation, bool );
+    itkSetMacro( UseFusedComputation, bool );
+    itkBooleanMacro( UseFusedComputation );
+
+    /** Get/Set if the fused computation should find the gradient and Hessian
+	by normalized convolution with derivatives of the Gaussian. When off
+	they are central differences of the smoothed image, like in the
+	reference composition. Not used by the reference composition.
+	Default is off. */
+    itkGetConstMacro( UseGaussianDerivatives, bool );
+    itkSetMacro( UseGaussianDerivatives, bool );
+    itkBooleanMacro( UseGaussianDerivatives );
+
+    /** Get/Set how the Gaussian smoothing is approximated. Not used for the
+	Gaussian derivatives. Default is RecursiveGaussianSmoothing. */
+    itkGetConstMacro( SmoothingMethod, GaussianSmoothingMethod );
+    itkSetMacro( SmoothingMethod, GaussianSmoothingMethod );
+
+    /** Get/Set the number of voxels per sigma below which a scale is not
+	calculated on a coarser level of the pyramid. Zero turns the pyramid
+	off. A level is also not used when its block average alone smooths
+	more than sigma, which limits values below 1/sqrt(12). Only used by
+	the fused computation. Default is 0. */
+    itkGetConstMacro( PyramidSamplesPerSigma, ScalarRealType );
+    itkSetMacro( PyramidSamplesPerSigma, ScalarRealType );
+
+    /** Get/Set the cache of smoothed masks, which can be shared between
+	filters. Default is null, which smooths the mask in every update. */
+    itkSetObjectMacro( SmoothedCertaintyCache, SmoothedCertaintyCacheType );
+    itkGetModifiableObjectMacro( SmoothedCertaintyCache, SmoothedCertaintyCacheType );
+
     /** We calculate 8 different features */
     static const size_t numFeatures = 8;
+
+    /** Flags for selecting features. The flag of feature i is 1 << i, in the
+	order of the output components. */
+    enum FeatureFlags {
+      GaussianFeature          = 1 << 0,
+      GradientMagnitudeFeature = 1 << 1,
+      Eigenvalue1Feature       = 1 << 2,
+      Eigenvalue2Feature       = 1 << 3,
+      Eigenvalue3Feature       = 1 << 4,
+      LaplacianFeature         = 1 << 5,
+      GaussianCurvatureFeature = 1 << 6,
+      FrobeniusNormFeature     = 1 << 7,
+      EigenvalueFeatures       = Eigenvalue1Feature | Eigenvalue2Feature | Eigenvalue3Feature,
+      InvariantFeatures        = LaplacianFeature | GaussianCurvatureFeature | FrobeniusNormFeature,
+      AllFeatures              = ( 1 << numFeatures ) - 1
+    };
+
+    /** Get/Set the features to calculate as a combination of FeatureFlags.
+	The output has one component for each selected feature, in the order
+	of the flags. Stages that are not needed for the selected features are
+	not executed. The fused computation only solves for the eigenvalues when
+	one of eig1, eig2, eig3 is selected, Laplacian, Gaussian curvature and
+	Frobenius norm are calculated as trace, determinant and Frobenius norm
+	of the Hessian.
+	Default is AllFeatures. */
+    itkGetConstMacro( Features, unsigned int );
+    itkSetMacro( Features, unsigned int );
+
+    /** Number of selected features, which is the number of components in
+	the output */
+    size_t GetNumberOfSelectedFeatures() const;
+
+    /** Get/Set if every component is written to its own image,
+	GetFeatureOutput, instead of to the vector output, which is then
+	left empty. Default is off. */
+    itkGetConstMacro( PlanarOutput, bool );
+    itkSetMacro( PlanarOutput, bool );
+    itkBooleanMacro( PlanarOutput );
+
+    /** Component c of the output when PlanarOutput is on, so feature k at
+	scale i is GetFeatureOutput( i * GetNumberOfSelectedFeatures() + k ).
+	The images are created when the output information is updated, before
+	that, or when PlanarOutput is off, null is returned. */
+    FeatureImageType* GetFeatureOutput( size_t c );
+
+    /** Names of the features in the order of the flags */
+    static const std::vector< std::string >& GetFeatureNames();
+
+    /** The flag of the feature with the given name. Returns 0 if there is no
+	feature with that name */
+    static unsigned int GetFeatureFlag( const std::string& name );
     
     virtual void GenerateOutputInformation(void) ITK_OVERRIDE;
+
+    /** The image and mask are needed in the output region padded by the
+	support of the largest Gaussian and the central differences */
+    virtual void GenerateInputRequestedRegion(void) ITK_OVERRIDE;
+
+    /** Output 0 is the vector output, the rest are the planar components */
+    typedef ProcessObject::DataObjectPointerArraySizeType DataObjectPointerArraySizeType;
+    using Superclass::MakeOutput;
+    virtual DataObject::Pointer MakeOutput( DataObjectPointerArraySizeType idx ) ITK_OVERRIDE;
     
   protected:
     /** Smoothing filter */
     typedef NormalizedGaussianConvolutionImageFilter<
-    InputImageType > SmoothingFilterType;
+    RealImageType > SmoothingFilterType;
+
+    /** Smoothing filter used by the fused computation, which reads the
+	input image */
+    typedef FusedNormalizedGaussianConvolutionImageFilter<
+    InputImageType,
+    RealImageType > FusedSmoothingFilterType;
+
+    /** Value, gradient and Hessian used by the fused computation when
+	UseGaussianDerivatives is on */
+    typedef NormalizedGaussianDerivativeConvolutionImageFilter<
+    InputImageType > DerivativeFilterType;
+    typedef typename DerivativeFilterType::OutputImageType DerivativeImageType;
+
+    /** Block averages for the coarse levels of the pyramid */
+    typedef BinShrinkImageFilter<
+      RealImageType,
+      RealImageType > ShrinkFilterType;
+
+    /** The coarse voxels with certainty */
+    typedef BinaryThresholdImageFilter<
+      RealImageType,
+      InputMaskType > CoarseMaskFilterType;
+
+    /** Smoothing and derivatives of the coarse levels of the pyramid */
+    typedef FusedNormalizedGaussianConvolutionImageFilter<
+    RealImageType > CoarseSmoothingFilterType;
+    typedef NormalizedGaussianDerivativeConvolutionImageFilter<
+    RealImageType,
+    DerivativeImageType > CoarseDerivativeFilterType;
 
     
     /** We need to ensure that the mask is treated the same way as the
 	image when we do normalized convolution */
     typedef CastImageFilter<
       InputMaskType,
-      InputImageType > CastFilterType;
+      RealImageType > CastFilterType;
+
+    /** The product of image and mask does not depend on the scale, so it is
+	calculated once and given to the smoothing filter as a weighted
+	image. */
+    typedef MultiplyImageFilter<
+      InputImageType,
+      RealImageType,
+      RealImageType > MultiplyFilterType;
 
    
     /** Filter that calculates gradient magnitude without smoothing */
     typedef GradientMagnitudeImageFilter<
-      InputImageType,
-      InputImageType > GradientMagnitudeFilterType;
+      RealImageType,
+      RealImageType > GradientMagnitudeFilterType;
 
     
     /** Filter that calculates the Hessian without smoothing */
     typedef Hessian3DImageFilter<
-      InputImageType,
+      RealImageType,
       OutputImageType > HessianFilterType;
 
     
@@ -97,31 +335,106 @@ namespace itk {
       OutputImageType,
       FunctorType > EigenvalueFilterType;
 
+    /** The fused computation solves the eigenvalues for a line at a time */
+    typedef Symmetric3x3EigenvalueBatchSolver< PixelType > BatchSolverType;
+
+    /** The fused computation only visits the foreground runs of the mask */
+    typedef MaskRuns< MaskPixelType > MaskRunsType;
+    typedef typename MaskRunsType::Run MaskRunType;
+
     
     /** Filter that extracts indivual features from the feature filters */
     typedef VectorIndexSelectionCastImageFilter<
       OutputImageType,
-      InputImageType > IndexSelectionFilterType;
+      RealImageType > IndexSelectionFilterType;
 
     
     /** Filter that masks the feature images with the mask */
     typedef MaskImageFilter<
-      InputImageType,
+      RealImageType,
       InputMaskType,
-      InputImageType > MaskFilterType;
+      RealImageType > MaskFilterType;
 
     
     /** Filter that combines the feature images into a single image */
     typedef ComposeImageFilter<
-      InputImageType,
+      RealImageType,
       OutputImageType > ComposeFilterType;
 
     
+    /** Where the features are written. Component c of the voxel at offset i
+	in the buffered region of Grid is Components[c][i * PixelStride]. The
+	components of a VectorImage are interleaved with PixelStride equal to
+	the number of components, the planar output has one buffer per
+	component and PixelStride 1. */
+    struct FeatureLayout {
+      const ImageBase< InputImageType::ImageDimension > *Grid;
+      std::vector< OutputInternalPixelType * > Components;
+      OffsetValueType PixelStride;
+    };
+
+    /** The layout of a vector image */
+    static FeatureLayout GetFeatureLayout( OutputImageType *image );
+
     ImageToEmphysemaFeaturesFilter();
     virtual ~ImageToEmphysemaFeaturesFilter(){};
   
     virtual void GenerateData() ITK_OVERRIDE;
 
+    /** The planar components are allocated instead of the vector output
+	when PlanarOutput is on. Sets m_OutputLayout. */
+    virtual void AllocateOutputs() ITK_OVERRIDE;
+
+    /** Graft the inputs and connect them to the part of the pipeline that
+	does not depend on the scale */
+    void PrepareInputs();
+
+    /** The fused computation, which is run once for each scale. The
+	smoothing is done before the threads are started, the threads then
+	compute all features for their part of the output region from the
+	smoothed image. */
+    virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
+    virtual void ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
+				       ThreadIdType threadId ) ITK_OVERRIDE;
+    virtual void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+    /** Calculate the features of region from either the smoothed image or
+	the derivatives, which ever is not null, and store them in output from
+	component scaleOffset. Only the voxels in maskRuns are calculated, the
+	rest are set to zero. The runs, the smoothed image and the derivatives
+	have the same buffered region. */
+    void ComputeFeatures( const OutputImageRegionType& region,
+			  const RealImageType *smoothedImage,
+			  const DerivativeImageType *derivativeImage,
+			  const MaskRunsType& maskRuns,
+			  const FeatureLayout& output,
+			  size_t scaleOffset );
+
+    /** The level of the pyramid that scale sigma is calculated at */
+    unsigned int GetPyramidLevel( ScalarRealType sigma ) const;
+
+    /** The variance, in physical units, that the block average of the given
+	level smooths with along each axis */
+    SigmaArrayType GetPyramidBlockVariance( unsigned int level ) const;
+
+    /** Calculate the features at scale sigma on the given level of the
+	pyramid, which are then interpolated by the threads */
+    void GenerateCoarseFeatures( ScalarRealType sigma, unsigned int level );
+    void InterpolateCoarseFeatures( const OutputImageRegionType& region,
+				    size_t scaleOffset );
+
+    struct CoarseStruct {
+      Self *Filter;
+      const RealImageType *Smoothed;
+      const DerivativeImageType *Derivatives;
+      FeatureLayout Layout;
+    };
+    static ITK_THREAD_RETURN_TYPE CoarseCallback( void *arg );
+
+    /** The reference computation using the composition of ITK filters. The
+	composition is updated once for each scale. */
+    void GenerateDataWithReferencePipeline();
+
     /** Display */
     void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
     
@@ -131,7 +444,15 @@ namespace itk {
 
     // The filters
     typename SmoothingFilterType::Pointer m_SmoothingFilter;
+    typename FusedSmoothingFilterType::Pointer m_FusedSmoothingFilter;
+    typename DerivativeFilterType::Pointer m_DerivativeFilter;
     typename CastFilterType::Pointer m_CastFilter;
+    typename MultiplyFilterType::Pointer m_MultiplyFilter;
+    typename ShrinkFilterType::Pointer m_ShrinkImageFilter;
+    typename ShrinkFilterType::Pointer m_ShrinkCertaintyFilter;
+    typename CoarseMaskFilterType::Pointer m_CoarseMaskFilter;
+    typename CoarseSmoothingFilterType::Pointer m_CoarseSmoothingFilter;
+    typename CoarseDerivativeFilterType::Pointer m_CoarseDerivativeFilter;
     
     typename GradientMagnitudeFilterType::Pointer m_GradientMagnitudeFilter;
     typename HessianFilterType::Pointer m_HessianFilter;
@@ -140,8 +461,34 @@ namespace itk {
     std::vector< typename MaskFilterType::Pointer > m_MaskFilters;
     typename ComposeFilterType::Pointer m_ComposeFilter;
 
+    // The smoothed image, or the derivatives, used by the fused computation
+    // and the scale they are calculated at
+    typename RealImageType::Pointer m_SmoothedImage;
+    typename DerivativeImageType::Pointer m_DerivativeImage;
+    size_t m_CurrentScaleIndex;
+    MaskRunsType m_MaskRuns;
+
+    // Where the threads write the features of the output
+    FeatureLayout m_OutputLayout;
+
+    // The features of the current scale on the coarse grid, when the scale
+    // is calculated on a coarse level of the pyramid
+    typename OutputImageType::Pointer m_CoarseFeatures;
+    MaskRunsType m_CoarseMaskRuns;
+
+    // The smoothed masks and the key of the current mask
+    typename SmoothedCertaintyCacheType::Pointer m_SmoothedCertaintyCache;
+    typename SmoothedCertaintyCacheType::KeyType m_CertaintyKey;
+    
     // The parameters
     ScalarRealType m_Sigma;
+    SigmasType m_Sigmas;
+    bool m_UseFusedComputation;
+    bool m_UseGaussianDerivatives;
+    GaussianSmoothingMethod m_SmoothingMethod;
+    ScalarRealType m_PyramidSamplesPerSigma;
+    unsigned int m_Features;
+    bool m_PlanarOutput;
   };
 
 } // end namespace itk
@@ -1,6 +1,14 @@
 #ifndef __ImageToEmphysemaFeaturesFilter_hxx
 #define __ImageToEmphysemaFeaturesFilter_hxx
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+
+#include "ife/Util/RequestedRegion.h"
 #include "ImageToEmphysemaFeaturesFilter.h"
 
 namespace itk
@@ -16,14 +24,65 @@ namespace itk
 {
   // Default scale
   m_Sigma = 1.0;
+
+  m_UseFusedComputation = true;
+
+  m_UseGaussianDerivatives = false;
+
+  m_SmoothingMethod = RecursiveGaussianSmoothing;
+
+  m_PyramidSamplesPerSigma = 0;
+
+  m_Features = AllFeatures;
+
+  m_PlanarOutput = false;
+
+  m_CurrentScaleIndex = 0;
   
   // Set mask input to cast filter in GenerateData
   m_CastFilter = CastFilterType::New();
 
-  // Set image input to smoothing filter in GenerateData
+  // Set image input to multiply filter in GenerateData
+  m_MultiplyFilter = MultiplyFilterType::New();
+  m_MultiplyFilter->SetInput2( m_CastFilter->GetOutput() );
+  
   m_SmoothingFilter = SmoothingFilterType::New();
+  m_SmoothingFilter->InputImageIsWeightedOn();
+  m_SmoothingFilter->SetInputImage( m_MultiplyFilter->GetOutput() );
   m_SmoothingFilter->SetInputCertainty( m_CastFilter->GetOutput() );
 
+  // The fused filters multiply and convert the image themselves, so they
+  // get the image in PrepareInputs instead of the product
+  m_FusedSmoothingFilter = FusedSmoothingFilterType::New();
+  m_FusedSmoothingFilter->SetInputCertainty( m_CastFilter->GetOutput() );
+
+  m_DerivativeFilter = DerivativeFilterType::New();
+  m_DerivativeFilter->SetInputCertainty( m_CastFilter->GetOutput() );
+
+  // The coarse levels of the pyramid are block averages of the weighted
+  // image and the certainty. The shrink factors are set for each scale.
+  m_ShrinkImageFilter = ShrinkFilterType::New();
+  m_ShrinkImageFilter->SetInput( m_MultiplyFilter->GetOutput() );
+  m_ShrinkCertaintyFilter = ShrinkFilterType::New();
+  m_ShrinkCertaintyFilter->SetInput( m_CastFilter->GetOutput() );
+
+  m_CoarseMaskFilter = CoarseMaskFilterType::New();
+  m_CoarseMaskFilter->SetInput( m_ShrinkCertaintyFilter->GetOutput() );
+  m_CoarseMaskFilter->SetLowerThreshold( NumericTraits< PixelType >::min() );
+  m_CoarseMaskFilter->SetUpperThreshold( NumericTraits< PixelType >::max() );
+  m_CoarseMaskFilter->SetInsideValue( 1 );
+  m_CoarseMaskFilter->SetOutsideValue( 0 );
+
+  m_CoarseSmoothingFilter = CoarseSmoothingFilterType::New();
+  m_CoarseSmoothingFilter->InputImageIsWeightedOn();
+  m_CoarseSmoothingFilter->SetInputImage( m_ShrinkImageFilter->GetOutput() );
+  m_CoarseSmoothingFilter->SetInputCertainty( m_ShrinkCertaintyFilter->GetOutput() );
+
+  m_CoarseDerivativeFilter = CoarseDerivativeFilterType::New();
+  m_CoarseDerivativeFilter->InputImageIsWeightedOn();
+  m_CoarseDerivativeFilter->SetInputImage( m_ShrinkImageFilter->GetOutput() );
+  m_CoarseDerivativeFilter->SetInputCertainty( m_ShrinkCertaintyFilter->GetOutput() );
+
   m_GradientMagnitudeFilter = GradientMagnitudeFilterType::New();
   m_GradientMagnitudeFilter->SetInput( m_SmoothingFilter->GetOutput() );
   
@@ -40,11 +99,10 @@ namespace itk
     m_IndexSelectionFilters[i]->SetIndex(i);
   }
 
-  // Set the mask input to mask filter in GenerateData
-  m_ComposeFilter = ComposeFilterType::New();
-  for ( size_t i = 0; i < 8; ++i ) {
+  // Set the mask input to mask filter in PrepareInputs and the inputs to the
+  // compose filter in GenerateDataWithReferencePipeline
+  for ( size_t i = 0; i < numFeatures; ++i ) {
     m_MaskFilters.emplace_back( MaskFilterType::New() );
-    m_ComposeFilter->SetInput( i, m_MaskFilters[i]->GetOutput() );
   }
 
   m_MaskFilters[0]->SetInput( m_SmoothingFilter->GetOutput() );
@@ -75,6 +133,129 @@ namespace itk
   }
 
   
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::SetSigmas( const SigmasType& sigmas )
+  {
+    if ( m_Sigmas != sigmas ) {
+      m_Sigmas = sigmas;
+      this->Modified();
+    }
+  }
+
+  
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  typename ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >::SigmasType
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetScales() const
+  {
+    if ( m_Sigmas.empty() ) {
+      return SigmasType( 1, m_Sigma );
+    }
+    return m_Sigmas;
+  }
+
+  
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  size_t
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetNumberOfSelectedFeatures() const
+  {
+    size_t n = 0;
+    for ( size_t i = 0; i < numFeatures; ++i ) {
+      if ( m_Features & ( 1u << i ) ) {
+	++n;
+      }
+    }
+    return n;
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  typename ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >::FeatureImageType *
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetFeatureOutput( size_t c )
+  {
+    if ( !m_PlanarOutput || c + 1 >= this->GetNumberOfIndexedOutputs() ) {
+      return ITK_NULLPTR;
+    }
+    return static_cast< FeatureImageType * >( this->ProcessObject::GetOutput( c + 1 ) );
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  DataObject::Pointer
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::MakeOutput( DataObjectPointerArraySizeType idx )
+  {
+    if ( idx == 0 ) {
+      return Superclass::MakeOutput( idx );
+    }
+    return FeatureImageType::New().GetPointer();
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  typename ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >::FeatureLayout
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetFeatureLayout( OutputImageType *image )
+  {
+    FeatureLayout layout;
+    layout.Grid = image;
+    layout.PixelStride = image->GetNumberOfComponentsPerPixel();
+    for ( OffsetValueType c = 0; c < layout.PixelStride; ++c ) {
+      layout.Components.push_back( image->GetBufferPointer() + c );
+    }
+    return layout;
+  }
+
+  
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  const std::vector< std::string >&
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetFeatureNames()
+  {
+    static const std::vector< std::string > names{
+      "GaussianBlur", "GradientMagnitude",
+	"Eigenvalue1", "Eigenvalue2", "Eigenvalue3",
+	"LaplacianOfGaussian", "GaussianCurvature", "FrobeniusNorm"
+	};
+    return names;
+  }
+
+  
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  unsigned int
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetFeatureFlag( const std::string& name )
+  {
+    const std::vector< std::string >& names = GetFeatureNames();
+    for ( size_t i = 0; i < names.size(); ++i ) {
+      if ( names[i] == name ) {
+	return 1u << i;
+      }
+    }
+    return 0;
+  }
+
+  
   template< typename TInputImage,
 	    typename TInputMask,
 	    typename TOutputImage >
@@ -82,13 +263,59 @@ namespace itk
   ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
 ::GenerateOutputInformation(void)
 {
+  if ( ( m_Features & AllFeatures ) == 0 ) {
+    itkExceptionMacro( << "No features selected." );
+  }
+
+  // With planar output every component has an output after the vector
+  // output. They are created here, because the number of components depends
+  // on the features and the scales.
+  const size_t nComponents = GetNumberOfSelectedFeatures() * GetScales().size();
+  const DataObjectPointerArraySizeType nOutputs = m_PlanarOutput ? nComponents + 1 : 1;
+  if ( this->GetNumberOfIndexedOutputs() != nOutputs ) {
+    this->SetNumberOfIndexedOutputs( nOutputs );
+    for ( DataObjectPointerArraySizeType i = 1; i < nOutputs; ++i ) {
+      if ( !this->ProcessObject::GetOutput( i ) ) {
+	this->SetNthOutput( i, this->MakeOutput( i ) );
+      }
+    }
+  }
+
   // Apparently we need to set the numberOfComponentsPerPixel explicitly
   this->Superclass::GenerateOutputInformation();
 
   OutputImageType *output = this->GetOutput();
-  output->SetNumberOfComponentsPerPixel( m_ComposeFilter->GetNumberOfIndexedInputs() );
+  output->SetNumberOfComponentsPerPixel( nComponents );
 }
-  
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GenerateInputRequestedRegion(void)
+  {
+    this->Superclass::GenerateInputRequestedRegion();
+
+    // The mask is used as certainty, so it is needed in the same region as
+    // the image. The extra voxel is for the central differences of the
+    // smoothed image.
+    const SigmasType sigmas = this->GetScales();
+    const ScalarRealType sigma = *std::max_element( sigmas.begin(), sigmas.end() );
+    InputImageType *image =
+      const_cast< InputImageType * >( static_cast< const InputImageType * >( this->ProcessObject::GetInput(0) ) );
+    if ( image ) {
+      padRequestedRegion( image, gaussianSupportRadius( image, sigma, 1 ) );
+    }
+    
+    InputMaskType *mask =
+      const_cast< InputMaskType * >( static_cast< const InputMaskType * >( this->ProcessObject::GetInput(1) ) );
+    if ( mask ) {
+      padRequestedRegion( mask, gaussianSupportRadius( mask, sigma, 1 ) );
+    }
+  }
+
 
 
   template< typename TInputImage,
@@ -100,24 +327,761 @@ namespace itk
   {
     itkDebugMacro(<< "ImageToEmphysemaFeaturesFilter generating data ");
 
-    // Need to graft the inputs
-    typename InputImageType::Pointer image = InputImageType::New();
-    image->Graft( static_cast<const InputImageType * >( this->ProcessObject::GetInput(0) ));
+    this->PrepareInputs();
+    
+    if ( m_UseFusedComputation ) {
+      // This is ImageSource::GenerateData, except that the threaded methods
+      // are run once for each scale.
+      this->AllocateOutputs();
 
-    typename InputMaskType::Pointer mask = InputMaskType::New();
-    mask->Graft( static_cast<const InputMaskType * >( this->ProcessObject::GetInput(1) ));
+      // The foreground runs of the mask are shared by all scales
+      const InputMaskType *mask = m_CastFilter->GetInput();
+      const typename InputMaskType::SizeType maskSize = mask->GetBufferedRegion().GetSize();
+      m_MaskRuns.initialize( mask->GetBufferPointer(), maskSize[0], maskSize[1] * maskSize[2] );
 
-    m_CastFilter->SetInput( mask );
-    m_SmoothingFilter->SetInputImage( image );
-    m_SmoothingFilter->SetSigma( m_Sigma );
+      const size_t nScales = this->GetScales().size();
+      for ( m_CurrentScaleIndex = 0; m_CurrentScaleIndex < nScales; ++m_CurrentScaleIndex ) {
+	this->BeforeThreadedGenerateData();
 
+	typename Superclass::ThreadStruct str;
+	str.Filter = this;
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	this->GetMultiThreader()->SetSingleMethod( this->ThreaderCallback, &str );
+	this->GetMultiThreader()->SingleMethodExecute();
+
+	this->AfterThreadedGenerateData();
+      }
+      m_MaskRuns = MaskRunsType();
+    }
+    else {
+      this->GenerateDataWithReferencePipeline();
+    }
+    m_OutputLayout = FeatureLayout();
+
+    // The scale independent images are not needed anymore
+    m_MultiplyFilter->GetOutput()->ReleaseData();
+    m_CastFilter->GetOutput()->ReleaseData();
+    m_ShrinkImageFilter->GetOutput()->ReleaseData();
+    m_ShrinkCertaintyFilter->GetOutput()->ReleaseData();
+    m_CoarseMaskFilter->GetOutput()->ReleaseData();
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::PrepareInputs(void)
+  {
+    // Need to graft the inputs. The requested regions are processed as if
+    // they were the entire image, so the internal filters can smooth along
+    // the whole largest possible region.
+    typename InputImageType::Pointer image =
+      graftRequestedRegion( static_cast<const InputImageType * >( this->ProcessObject::GetInput(0) ));
+
+    typename InputMaskType::Pointer mask =
+      graftRequestedRegion( static_cast<const InputMaskType * >( this->ProcessObject::GetInput(1) ));
+
+    if ( image->GetBufferedRegion() != mask->GetBufferedRegion() ) {
+      itkExceptionMacro( << "Image and mask must have the same buffered region."
+			 << " Image: " << image->GetBufferedRegion()
+			 << " Mask: " << mask->GetBufferedRegion() );
+    }
+
+    m_CastFilter->SetInput( mask );
+    m_MultiplyFilter->SetInput1( image );
+    m_FusedSmoothingFilter->SetInputImage( image );
+    m_DerivativeFilter->SetInputImage( image );
     for ( auto& maskFilter : m_MaskFilters ) {
       maskFilter->SetMaskImage( mask );
     }
+
+    // The smoothed certainties in the cache are found by the cast mask,
+    // which is what the smoothing filters see
+    if ( m_SmoothedCertaintyCache ) {
+      m_CastFilter->UpdateLargestPossibleRegion();
+      m_CertaintyKey = SmoothedCertaintyCacheType::MakeKey( m_CastFilter->GetOutput(),
+							    0,
+							    m_SmoothingMethod,
+							    SmoothedCertaintyCacheType::FusedImplementation );
+    }
+  }
+
+  
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::AllocateOutputs(void)
+  {
+    if ( !m_PlanarOutput ) {
+      this->Superclass::AllocateOutputs();
+      m_OutputLayout = GetFeatureLayout( this->GetOutput() );
+      return;
+    }
+
+    // The vector output keeps its information but has no buffer, and the
+    // components are allocated with the requested region
+    const size_t nComponents = this->GetOutput()->GetNumberOfComponentsPerPixel();
+    this->GetOutput()->Initialize();
+    m_OutputLayout = FeatureLayout();
+    m_OutputLayout.PixelStride = 1;
+    for ( size_t c = 0; c < nComponents; ++c ) {
+      FeatureImageType *component = this->GetFeatureOutput( c );
+      component->SetBufferedRegion( component->GetRequestedRegion() );
+      component->Allocate();
+      m_OutputLayout.Components.push_back( component->GetBufferPointer() );
+    }
+    m_OutputLayout.Grid = this->GetFeatureOutput( 0 );
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GenerateDataWithReferencePipeline(void)
+  {
+    // Only the selected features are composed, so the stages that do not feed
+    // a selected feature are never executed.
+    m_ComposeFilter = ComposeFilterType::New();
+    for ( size_t i = 0, j = 0; i < numFeatures; ++i ) {
+      if ( m_Features & ( 1u << i ) ) {
+	m_ComposeFilter->SetInput( j++, m_MaskFilters[i]->GetOutput() );
+      }
+    }
+
+    m_SmoothingFilter->SetSmoothingMethod( m_SmoothingMethod );
+    m_SmoothingFilter->SetSmoothedCertaintyCache( m_SmoothedCertaintyCache );
+    const SigmasType scales = this->GetScales();
+    if ( scales.size() == 1 && !m_PlanarOutput ) {
+      // Grafting the result back sets the largest possible region of the
+      // output to the padded input region, so it is restored.
+      const OutputImageRegionType largestRegion = this->GetOutput()->GetLargestPossibleRegion();
+      m_SmoothingFilter->SetSigma( scales[0] );
+      m_ComposeFilter->GraftOutput( this->GetOutput() );
+      m_ComposeFilter->Update();
+      this->GraftOutput( m_ComposeFilter->GetOutput() );
+      this->GetOutput()->SetLargestPossibleRegion( largestRegion );
+      return;
+    }
+
+    // With several scales, or planar output, the composed features of each
+    // scale are copied to their components in the output. The region is the
+    // buffered region of the output, so the voxels are visited in the order
+    // of the buffer.
+    this->AllocateOutputs();
+    const OutputImageRegionType region = m_OutputLayout.Grid->GetBufferedRegion();
+    const size_t nSelected = this->GetNumberOfSelectedFeatures();
+    const OffsetValueType stride = m_OutputLayout.PixelStride;
+    for ( size_t i = 0; i < scales.size(); ++i ) {
+      m_SmoothingFilter->SetSigma( scales[i] );
+      m_ComposeFilter->GetOutput()->SetRequestedRegion( region );
+      m_ComposeFilter->Update();
+
+      OutputInternalPixelType * const *components = &m_OutputLayout.Components[i * nSelected];
+      ImageRegionConstIterator< OutputImageType > inIter( m_ComposeFilter->GetOutput(), region );
+      for ( OffsetValueType offset = 0; !inIter.IsAtEnd(); ++inIter, ++offset ) {
+	const OutputPixelType features = inIter.Get();
+	for ( size_t k = 0; k < nSelected; ++k ) {
+	  components[k][offset * stride] = features[k];
+	}
+      }
+      m_ComposeFilter->GetOutput()->ReleaseData();
+      m_SmoothingFilter->GetOutput()->ReleaseData();
+    }
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::BeforeThreadedGenerateData(void)
+  {
+    const ScalarRealType sigma = this->GetScales()[m_CurrentScaleIndex];
+    const unsigned int level = this->GetPyramidLevel( sigma );
+    if ( level > 0 ) {
+      this->GenerateCoarseFeatures( sigma, level );
+    }
+    else if ( m_UseGaussianDerivatives ) {
+      m_DerivativeFilter->SetSigma( sigma );
+      m_DerivativeFilter->UpdateLargestPossibleRegion();
+      m_DerivativeImage = m_DerivativeFilter->GetOutput();
+    }
+    else {
+      // Only the numerator is smoothed when the denominator is in the cache
+      typename RealImageType::Pointer smoothedCertainty;
+      if ( m_SmoothedCertaintyCache ) {
+	m_CertaintyKey.Sigma = sigma;
+	smoothedCertainty = m_SmoothedCertaintyCache->Find( m_CertaintyKey, m_CastFilter->GetOutput() );
+      }
+      m_FusedSmoothingFilter->SetInputSmoothedCertainty( smoothedCertainty );
+      m_FusedSmoothingFilter->SetGenerateSmoothedCertainty( m_SmoothedCertaintyCache && !smoothedCertainty );
+      m_FusedSmoothingFilter->SetSigma( sigma );
+      m_FusedSmoothingFilter->SetSmoothingMethod( m_SmoothingMethod );
+      m_FusedSmoothingFilter->UpdateLargestPossibleRegion();
+      m_SmoothedImage = m_FusedSmoothingFilter->GetOutput();
+      if ( m_FusedSmoothingFilter->GetGenerateSmoothedCertainty() ) {
+	smoothedCertainty = m_FusedSmoothingFilter->GetSmoothedCertaintyOutput();
+	smoothedCertainty->DisconnectPipeline();
+	m_SmoothedCertaintyCache->Add( m_CertaintyKey, m_CastFilter->GetOutput(), smoothedCertainty );
+      }
+    }
+  }
+
   
-    m_ComposeFilter->GraftOutput( this->GetOutput() );
-    m_ComposeFilter->Update();
-    this->GraftOutput( m_ComposeFilter->GetOutput() );
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  unsigned int
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetPyramidLevel( ScalarRealType sigma ) const
+  {
+    if ( m_PyramidSamplesPerSigma <= 0 ) {
+      return 0;
+    }
+    // The coarse grid must have enough samples per sigma along every axis,
+    // and at least four voxels along every axis for the smoothing. The block
+    // average must smooth less than sigma along every axis, otherwise there
+    // is nothing left for the Gaussian on the coarse grid, which happens for
+    // less than 1/sqrt(12) samples per sigma.
+    const InputMaskType *mask = m_CastFilter->GetInput();
+    const typename InputMaskType::SpacingType spacing = mask->GetSpacing();
+    const typename InputMaskType::SizeType size = mask->GetBufferedRegion().GetSize();
+    unsigned int level = 0;
+    for ( ;; ++level ) {
+      const unsigned int factor = 2u << level;
+      const SigmaArrayType blockVariance = this->GetPyramidBlockVariance( level + 1 );
+      bool coarser = true;
+      for ( unsigned int d = 0; d < InputImageType::ImageDimension; ++d ) {
+	coarser = coarser
+	  && blockVariance[d] < sigma * sigma
+	  && sigma / ( factor * spacing[d] ) >= m_PyramidSamplesPerSigma
+	  && size[d] / factor >= 4;
+      }
+      if ( !coarser ) {
+	return level;
+      }
+    }
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  typename ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >::SigmaArrayType
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GetPyramidBlockVariance( unsigned int level ) const
+  {
+    // The block average of f voxels has variance (f^2 - 1)/12 voxels^2
+    const ScalarRealType factor = 1u << level;
+    const typename InputMaskType::SpacingType spacing = m_CastFilter->GetInput()->GetSpacing();
+    SigmaArrayType blockVariance;
+    for ( unsigned int d = 0; d < InputImageType::ImageDimension; ++d ) {
+      blockVariance[d] = spacing[d] * spacing[d] * ( factor * factor - 1 ) / 12;
+    }
+    return blockVariance;
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::GenerateCoarseFeatures( ScalarRealType sigma, unsigned int level )
+  {
+    const unsigned int factor = 1u << level;
+    m_ShrinkImageFilter->SetShrinkFactors( factor );
+    m_ShrinkCertaintyFilter->SetShrinkFactors( factor );
+    m_CoarseMaskFilter->UpdateLargestPossibleRegion();
+
+    // The block average already smooths with variance (f^2 - 1)/12 voxels^2
+    // along each axis, which is removed from the Gaussian along that axis, so
+    // every axis is smoothed with sigma. GetPyramidLevel only chooses levels
+    // where it is less than sigma^2 along every axis.
+    const SigmaArrayType blockVariance = this->GetPyramidBlockVariance( level );
+    typename CoarseSmoothingFilterType::SigmaArrayType coarseSigmas;
+    for ( unsigned int d = 0; d < InputImageType::ImageDimension; ++d ) {
+      coarseSigmas[d] = std::sqrt( sigma * sigma - blockVariance[d] );
+    }
+
+    const RealImageType *coarseSmoothed = ITK_NULLPTR;
+    const DerivativeImageType *coarseDerivatives = ITK_NULLPTR;
+    if ( m_UseGaussianDerivatives ) {
+      m_CoarseDerivativeFilter->SetSigmaArray( coarseSigmas );
+      m_CoarseDerivativeFilter->UpdateLargestPossibleRegion();
+      coarseDerivatives = m_CoarseDerivativeFilter->GetOutput();
+    }
+    else {
+      m_CoarseSmoothingFilter->SetSigmaArray( coarseSigmas );
+      m_CoarseSmoothingFilter->SetSmoothingMethod( m_SmoothingMethod );
+      m_CoarseSmoothingFilter->UpdateLargestPossibleRegion();
+      coarseSmoothed = m_CoarseSmoothingFilter->GetOutput();
+    }
+
+    // Every coarse voxel with some certainty gets features
+    const InputMaskType *coarseMask = m_CoarseMaskFilter->GetOutput();
+    const typename InputMaskType::RegionType coarseRegion = coarseMask->GetBufferedRegion();
+    m_CoarseMaskRuns.initialize( coarseMask->GetBufferPointer(),
+				 coarseRegion.GetSize(0),
+				 coarseRegion.GetSize(1) * coarseRegion.GetSize(2) );
+
+    m_CoarseFeatures = OutputImageType::New();
+    m_CoarseFeatures->CopyInformation( coarseMask );
+    m_CoarseFeatures->SetRegions( coarseRegion );
+    m_CoarseFeatures->SetNumberOfComponentsPerPixel( this->GetNumberOfSelectedFeatures() );
+    m_CoarseFeatures->Allocate();
+
+    // The slices of the coarse grid are split between the threads
+    CoarseStruct str;
+    str.Filter = this;
+    str.Smoothed = coarseSmoothed;
+    str.Derivatives = coarseDerivatives;
+    str.Layout = GetFeatureLayout( m_CoarseFeatures );
+    this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+    this->GetMultiThreader()->SetSingleMethod( CoarseCallback, &str );
+    this->GetMultiThreader()->SingleMethodExecute();
+
+    m_CoarseMaskRuns = MaskRunsType();
+    m_CoarseSmoothingFilter->GetOutput()->ReleaseData();
+    m_CoarseDerivativeFilter->GetOutput()->ReleaseData();
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  ITK_THREAD_RETURN_TYPE
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::CoarseCallback( void *arg )
+  {
+    MultiThreader::ThreadInfoStruct *info =
+      static_cast< MultiThreader::ThreadInfoStruct * >( arg );
+    CoarseStruct *str = static_cast< CoarseStruct * >( info->UserData );
+    Self *filter = str->Filter;
+
+    OutputImageRegionType region = filter->m_CoarseFeatures->GetBufferedRegion();
+    const size_t nSlices = region.GetSize(2);
+    const size_t slicesPerThread =
+      ( nSlices + info->NumberOfThreads - 1 ) / info->NumberOfThreads;
+    const size_t sliceBegin = std::min( nSlices, info->ThreadID * slicesPerThread );
+    const size_t sliceEnd = std::min( nSlices, sliceBegin + slicesPerThread );
+    if ( sliceBegin < sliceEnd ) {
+      region.SetIndex( 2, region.GetIndex(2) + sliceBegin );
+      region.SetSize( 2, sliceEnd - sliceBegin );
+      filter->ComputeFeatures( region, str->Smoothed, str->Derivatives,
+			       filter->m_CoarseMaskRuns, str->Layout, 0 );
+    }
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
+			  ThreadIdType itkNotUsed(threadId) )
+  {
+    const size_t scaleOffset = m_CurrentScaleIndex * this->GetNumberOfSelectedFeatures();
+    if ( m_CoarseFeatures ) {
+      this->InterpolateCoarseFeatures( outputRegionForThread, scaleOffset );
+    }
+    else {
+      this->ComputeFeatures( outputRegionForThread, m_SmoothedImage, m_DerivativeImage,
+			     m_MaskRuns, m_OutputLayout, scaleOffset );
+    }
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::InterpolateCoarseFeatures( const OutputImageRegionType& region,
+			       size_t scaleOffset )
+  {
+    typedef typename InputImageType::IndexType IndexType;
+    typedef typename InputImageType::SizeType SizeType;
+    typedef typename InputImageType::OffsetValueType OffsetValueType;
+    typedef typename InputImageType::PointType PointType;
+    typedef ContinuousIndex< double, InputImageType::ImageDimension > ContinuousIndexType;
+    const unsigned int Dimension = InputImageType::ImageDimension;
+
+    const InputMaskType *mask = m_CastFilter->GetInput();
+    const InputMaskType *coarseMask = m_CoarseMaskFilter->GetOutput();
+    const OutputImageType *coarse = m_CoarseFeatures;
+
+    const IndexType bufferStart = mask->GetBufferedRegion().GetIndex();
+    const SizeType bufferSize = mask->GetBufferedRegion().GetSize();
+    const IndexType coarseStart = coarse->GetBufferedRegion().GetIndex();
+    const SizeType coarseSize = coarse->GetBufferedRegion().GetSize();
+    const OffsetValueType *coarseOffsets = coarse->GetOffsetTable();
+    const MaskPixelType *coarseMaskBuffer = coarseMask->GetBufferPointer();
+    const OutputInternalPixelType *coarseBuffer = coarse->GetBufferPointer();
+    const size_t nSelected = this->GetNumberOfSelectedFeatures();
+    OutputInternalPixelType * const *out = &m_OutputLayout.Components[scaleOffset];
+    const OffsetValueType stride = m_OutputLayout.PixelStride;
+
+    const OffsetValueType xBegin = region.GetIndex(0) - bufferStart[0];
+    const OffsetValueType xEnd = xBegin + region.GetSize(0);
+    std::vector< double > value( nSelected );
+
+    IndexType index = region.GetIndex();
+    for ( OffsetValueType z = 0; z < static_cast< OffsetValueType >( region.GetSize(2) ); ++z ) {
+      index[2] = region.GetIndex(2) + z;
+      for ( OffsetValueType y = 0; y < static_cast< OffsetValueType >( region.GetSize(1) ); ++y ) {
+	index[1] = region.GetIndex(1) + y;
+	index[0] = region.GetIndex(0);
+	const OffsetValueType lineOffset = m_OutputLayout.Grid->ComputeOffset( index );
+
+	// The coarse continuous index is affine along the line
+	PointType point;
+	ContinuousIndexType c0, c1;
+	mask->TransformIndexToPhysicalPoint( index, point );
+	coarse->TransformPhysicalPointToContinuousIndex( point, c0 );
+	++index[0];
+	mask->TransformIndexToPhysicalPoint( index, point );
+	coarse->TransformPhysicalPointToContinuousIndex( point, c1 );
+	--index[0];
+
+	const size_t line = ( index[1] - bufferStart[1] ) + ( index[2] - bufferStart[2] ) * bufferSize[1];
+	const MaskRunType *run = m_MaskRuns.begin( line );
+	const MaskRunType *lastRun = m_MaskRuns.end( line );
+	OffsetValueType background = xBegin;
+	for ( ; run != lastRun; ++run ) {
+	  const OffsetValueType runBegin = std::max< OffsetValueType >( run->begin, xBegin );
+	  const OffsetValueType runEnd = std::min< OffsetValueType >( run->end, xEnd );
+	  if ( runBegin >= runEnd ) {
+	    continue;
+	  }
+	  for ( ; background < runBegin; ++background ) {
+	    const OffsetValueType p = ( lineOffset + background - xBegin ) * stride;
+	    for ( size_t k = 0; k < nSelected; ++k ) {
+	      out[k][p] = 0;
+	    }
+	  }
+	  background = runEnd;
+
+	  for ( OffsetValueType x = runBegin; x < runEnd; ++x ) {
+	    // Trilinear interpolation from the coarse voxels with certainty, so
+	    // the features outside the coarse mask do not pull the values
+	    // towards zero at the border of the mask
+	    OffsetValueType lower[Dimension];
+	    double t[Dimension];
+	    for ( unsigned int d = 0; d < Dimension; ++d ) {
+	      const double c = c0[d] + ( x - xBegin ) * ( c1[d] - c0[d] ) - coarseStart[d];
+	      const double clamped = std::min< double >( std::max< double >( c, 0 ), coarseSize[d] - 1 );
+	      lower[d] = std::min< OffsetValueType >( std::floor( clamped ), coarseSize[d] - 2 );
+	      t[d] = clamped - lower[d];
+	    }
+	    std::fill( value.begin(), value.end(), 0 );
+	    double weightSum = 0;
+	    for ( unsigned int corner = 0; corner < 8; ++corner ) {
+	      OffsetValueType offset = 0;
+	      double weight = 1;
+	      for ( unsigned int d = 0; d < Dimension; ++d ) {
+		const unsigned int upper = ( corner >> d ) & 1;
+		offset += ( lower[d] + upper ) * ( d == 0 ? 1 : coarseOffsets[d] );
+		weight *= upper ? t[d] : 1 - t[d];
+	      }
+	      if ( weight == 0 || coarseMaskBuffer[offset] == 0 ) {
+		continue;
+	      }
+	      weightSum += weight;
+	      const OutputInternalPixelType *f = coarseBuffer + offset * nSelected;
+	      for ( size_t k = 0; k < nSelected; ++k ) {
+		value[k] += weight * f[k];
+	      }
+	    }
+	    const OffsetValueType p = ( lineOffset + x - xBegin ) * stride;
+	    for ( size_t k = 0; k < nSelected; ++k ) {
+	      out[k][p] = weightSum > 0 ? value[k] / weightSum : 0;
+	    }
+	  }
+	}
+	for ( ; background < xEnd; ++background ) {
+	  const OffsetValueType p = ( lineOffset + background - xBegin ) * stride;
+	  for ( size_t k = 0; k < nSelected; ++k ) {
+	    out[k][p] = 0;
+	  }
+	}
+      }
+    }
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::ComputeFeatures( const OutputImageRegionType& region,
+		     const RealImageType *smoothedImage,
+		     const DerivativeImageType *derivativeImage,
+		     const MaskRunsType& maskRuns,
+		     const FeatureLayout& output,
+		     size_t scaleOffset )
+  {
+    typedef typename InputImageType::IndexType IndexType;
+    typedef typename InputImageType::SizeType SizeType;
+    typedef typename InputImageType::SpacingType SpacingType;
+    
+    typedef ImageBase< InputImageType::ImageDimension > ImageBaseType;
+
+    // Either the smoothed image, or the value, gradient and Hessian from the
+    // derivative filter. Both have the buffered region of the input.
+    const ImageBaseType *smoothed = derivativeImage
+      ? static_cast< const ImageBaseType * >( derivativeImage )
+      : static_cast< const ImageBaseType * >( smoothedImage );
+
+    const PixelType *in = derivativeImage
+      ? ITK_NULLPTR : smoothedImage->GetBufferPointer();
+    const PixelType *derivatives = derivativeImage
+      ? derivativeImage->GetBufferPointer() : ITK_NULLPTR;
+    const size_t nDerivatives = DerivativeFilterType::NumberOfComponents;
+    const OffsetValueType stride = output.PixelStride;
+
+    // Neighbours are found by clamping the index to the buffered region, which
+    // is the same as the ZeroFluxNeumannBoundaryCondition used by the
+    // derivative filters in the reference pipeline.
+    const IndexType bufferStart = smoothed->GetBufferedRegion().GetIndex();
+    const SizeType bufferSize = smoothed->GetBufferedRegion().GetSize();
+    const OffsetValueType *offsetTable = smoothed->GetOffsetTable();
+    const OffsetValueType xLast = bufferSize[0] - 1;
+    const OffsetValueType yLast = bufferSize[1] - 1;
+    const OffsetValueType zLast = bufferSize[2] - 1;
+
+    // Central difference coefficients scaled by the spacing, as done by
+    // DerivativeImageFilter and GradientMagnitudeImageFilter
+    const SpacingType spacing = smoothed->GetSpacing();
+    const PixelType hx = 0.5 / spacing[0];
+    const PixelType hy = 0.5 / spacing[1];
+    const PixelType hz = 0.5 / spacing[2];
+    const PixelType hxx = 1.0 / ( spacing[0] * spacing[0] );
+    const PixelType hyy = 1.0 / ( spacing[1] * spacing[1] );
+    const PixelType hzz = 1.0 / ( spacing[2] * spacing[2] );
+    const PixelType hxy = hx * hy;
+    const PixelType hxz = hx * hz;
+    const PixelType hyz = hy * hz;
+    
+    // Loop bounds relative to the start of the buffered region
+    const OffsetValueType xBegin = region.GetIndex(0) - bufferStart[0];
+    const OffsetValueType yBegin = region.GetIndex(1) - bufferStart[1];
+    const OffsetValueType zBegin = region.GetIndex(2) - bufferStart[2];
+    const OffsetValueType xEnd = xBegin + region.GetSize(0);
+    const OffsetValueType yEnd = yBegin + region.GetSize(1);
+    const OffsetValueType zEnd = zBegin + region.GetSize(2);
+
+    // Only the stages needed for the selected features are computed
+    const bool computeGaussian = m_Features & GaussianFeature;
+    const bool computeGradientMagnitude = m_Features & GradientMagnitudeFeature;
+    const bool computeHessian = m_Features & ( EigenvalueFeatures | InvariantFeatures );
+    const bool computeEigenvalues = m_Features & EigenvalueFeatures;
+    const bool computeLaplacian = m_Features & LaplacianFeature;
+    const bool computeGaussianCurvature = m_Features & GaussianCurvatureFeature;
+    const bool computeFrobeniusNorm = m_Features & FrobeniusNormFeature;
+
+    // The output component of each selected feature at the current scale,
+    // and the selected components in order
+    const size_t nSelected = this->GetNumberOfSelectedFeatures();
+    OutputInternalPixelType * const *selected = &output.Components[scaleOffset];
+    OutputInternalPixelType *component[numFeatures];
+    for ( size_t i = 0, j = 0; i < numFeatures; ++i ) {
+      component[i] = ITK_NULLPTR;
+      if ( m_Features & ( 1u << i ) ) {
+	component[i] = selected[j++];
+      }
+    }
+
+    // The Hessians of the masked voxels in a line are collected as a
+    // structure of arrays, so the eigenvalues can be found with the batch
+    // solver.
+    const size_t lineLength = region.GetSize(0);
+    std::vector< PixelType > lineBuffer( 9 * lineLength );
+    std::vector< OffsetValueType > linePositions( lineLength );
+    PixelType *hessian[6];
+    PixelType *eigenvalues[3];
+    for ( size_t k = 0; k < 6; ++k ) {
+      hessian[k] = &lineBuffer[k * lineLength];
+    }
+    for ( size_t k = 0; k < 3; ++k ) {
+      eigenvalues[k] = &lineBuffer[(6 + k) * lineLength];
+    }
+    
+    IndexType index = region.GetIndex();
+    for ( OffsetValueType zc = zBegin; zc < zEnd; ++zc ) {
+      const OffsetValueType zm = std::max< OffsetValueType >( zc - 1, 0 ) * offsetTable[2];
+      const OffsetValueType zp = std::min< OffsetValueType >( zc + 1, zLast ) * offsetTable[2];
+      const OffsetValueType z0 = zc * offsetTable[2];
+      index[2] = bufferStart[2] + zc;
+      
+      for ( OffsetValueType yc = yBegin; yc < yEnd; ++yc ) {
+	const OffsetValueType ym = std::max< OffsetValueType >( yc - 1, 0 ) * offsetTable[1];
+	const OffsetValueType yp = std::min< OffsetValueType >( yc + 1, yLast ) * offsetTable[1];
+	const OffsetValueType y0 = yc * offsetTable[1];
+	index[1] = bufferStart[1] + yc;
+
+	// The nine rows of the 3x3 neighbourhood in the y-z plane. The corners
+	// are only needed for the cross derivatives. With Gaussian derivatives
+	// only the derivatives of the line are needed.
+	const PixelType *r00 = ITK_NULLPTR, *rm0 = ITK_NULLPTR, *rp0 = ITK_NULLPTR;
+	const PixelType *r0m = ITK_NULLPTR, *r0p = ITK_NULLPTR, *rmm = ITK_NULLPTR;
+	const PixelType *rpm = ITK_NULLPTR, *rmp = ITK_NULLPTR, *rpp = ITK_NULLPTR;
+	const PixelType *lineDerivatives = ITK_NULLPTR;
+	if ( derivatives ) {
+	  lineDerivatives = derivatives + ( z0 + y0 ) * nDerivatives;
+	}
+	else {
+	  r00 = in + z0 + y0;
+	  rm0 = in + z0 + ym;
+	  rp0 = in + z0 + yp;
+	  r0m = in + zm + y0;
+	  r0p = in + zp + y0;
+	  rmm = in + zm + ym;
+	  rpm = in + zm + yp;
+	  rmp = in + zp + ym;
+	  rpp = in + zp + yp;
+	}
+
+	const OffsetValueType lineOffset = output.Grid->ComputeOffset( index );
+
+	// The features are only calculated on the foreground runs of the line,
+	// and the voxels between the runs are set to zero
+	const MaskRunType *run = maskRuns.begin( yc + zc * bufferSize[1] );
+	const MaskRunType *lastRun = maskRuns.end( yc + zc * bufferSize[1] );
+	OffsetValueType background = xBegin;
+	size_t count = 0;
+	for ( ; run != lastRun; ++run ) {
+	  const OffsetValueType runBegin = std::max< OffsetValueType >( run->begin, xBegin );
+	  const OffsetValueType runEnd = std::min< OffsetValueType >( run->end, xEnd );
+	  if ( runBegin >= runEnd ) {
+	    continue;
+	  }
+	  for ( ; background < runBegin; ++background ) {
+	    const OffsetValueType p = ( lineOffset + background - xBegin ) * stride;
+	    for ( size_t k = 0; k < nSelected; ++k ) {
+	      selected[k][p] = 0;
+	    }
+	  }
+	  background = runEnd;
+
+	  for ( OffsetValueType xc = runBegin; xc < runEnd; ++xc ) {
+	    const OffsetValueType p = ( lineOffset + xc - xBegin ) * stride;
+
+	    const OffsetValueType xm = std::max< OffsetValueType >( xc - 1, 0 );
+	    const OffsetValueType xp = std::min< OffsetValueType >( xc + 1, xLast );
+	    const PixelType *d = lineDerivatives
+	      ? lineDerivatives + xc * nDerivatives : ITK_NULLPTR;
+	  
+	    const PixelType f = d ? d[DerivativeFilterType::Value] : r00[xc];
+	    if ( computeGaussian ) {
+	      component[0][p] = f;
+	    }
+	    if ( computeGradientMagnitude ) {
+	      PixelType dx, dy, dz;
+	      if ( d ) {
+		dx = d[DerivativeFilterType::GradientX];
+		dy = d[DerivativeFilterType::GradientY];
+		dz = d[DerivativeFilterType::GradientZ];
+	      }
+	      else {
+		dx = hx * ( r00[xp] - r00[xm] );
+		dy = hy * ( rp0[xc] - rm0[xc] );
+		dz = hz * ( r0p[xc] - r0m[xc] );
+	      }
+	      component[1][p] = std::sqrt( dx*dx + dy*dy + dz*dz );
+	    }
+	    if ( !computeHessian ) {
+	      continue;
+	    }
+
+	    PixelType H[6];
+	    if ( d ) {
+	      std::copy( d + DerivativeFilterType::HessianXX,
+			 d + DerivativeFilterType::HessianXX + 6,
+			 H );
+	    }
+	    else {
+	      H[0] = hxx * ( r00[xp] - 2 * f + r00[xm] );
+	      H[1] = hxy * ( ( rp0[xp] - rp0[xm] ) - ( rm0[xp] - rm0[xm] ) );
+	      H[2] = hxz * ( ( r0p[xp] - r0p[xm] ) - ( r0m[xp] - r0m[xm] ) );
+	      H[3] = hyy * ( rp0[xc] - 2 * f + rm0[xc] );
+	      H[4] = hyz * ( ( rpp[xc] - rmp[xc] ) - ( rpm[xc] - rmm[xc] ) );
+	      H[5] = hzz * ( r0p[xc] - 2 * f + r0m[xc] );
+	    }
+
+	    // Laplacian, Gaussian curvature and Frobenius norm are invariants of
+	    // the Hessian, so they do not need the eigenvalues
+	    if ( computeLaplacian ) {
+	      component[5][p] = FunctorType::trace( H );
+	    }
+	    if ( computeGaussianCurvature ) {
+	      component[6][p] = FunctorType::determinant( H );
+	    }
+	    if ( computeFrobeniusNorm ) {
+	      component[7][p] = FunctorType::frobeniusNorm( H );
+	    }
+	  
+	    if ( computeEigenvalues ) {
+	      for ( size_t k = 0; k < 6; ++k ) {
+		hessian[k][count] = H[k];
+	      }
+	      linePositions[count] = xc - xBegin;
+	      ++count;
+	    }
+	  }
+	}
+	for ( ; background < xEnd; ++background ) {
+	  const OffsetValueType p = ( lineOffset + background - xBegin ) * stride;
+	  for ( size_t k = 0; k < nSelected; ++k ) {
+	    selected[k][p] = 0;
+	  }
+	}
+
+	if ( count > 0 ) {
+	  BatchSolverType::compute( hessian, eigenvalues, count );
+	  for ( size_t i = 0; i < count; ++i ) {
+	    const OffsetValueType p = ( lineOffset + linePositions[i] ) * stride;
+	    if ( m_Features & Eigenvalue1Feature ) {
+	      component[2][p] = eigenvalues[0][i];
+	    }
+	    if ( m_Features & Eigenvalue2Feature ) {
+	      component[3][p] = eigenvalues[1][i];
+	    }
+	    if ( m_Features & Eigenvalue3Feature ) {
+	      component[4][p] = eigenvalues[2][i];
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+
+  template< typename TInputImage,
+	    typename TInputMask,
+	    typename TOutputImage >
+  void
+  ImageToEmphysemaFeaturesFilter< TInputImage, TInputMask, TOutputImage >
+  ::AfterThreadedGenerateData(void)
+  {
+    // The smoothed image is not needed anymore, so we release it to keep the
+    // memory usage down.
+    m_SmoothedImage = ITK_NULLPTR;
+    m_DerivativeImage = ITK_NULLPTR;
+    m_CoarseFeatures = ITK_NULLPTR;
+    m_FusedSmoothingFilter->GetOutput()->ReleaseData();
+    m_FusedSmoothingFilter->SetInputSmoothedCertainty( ITK_NULLPTR );
+    m_DerivativeFilter->GetOutput()->ReleaseData();
   }
 
   template< typename TInputImage,
@@ -130,6 +1094,25 @@ namespace itk
     Superclass::PrintSelf(os, indent);
     os << indent << "Sigma:" << this->m_Sigma
        << std::endl;
+    os << indent << "Sigmas:";
+    for ( auto sigma : this->m_Sigmas ) {
+      os << " " << sigma;
+    }
+    os << std::endl;
+    os << indent << "UseFusedComputation:" << this->m_UseFusedComputation
+       << std::endl;
+    os << indent << "UseGaussianDerivatives:" << this->m_UseGaussianDerivatives
+       << std::endl;
+    os << indent << "SmoothingMethod:" << this->m_SmoothingMethod
+       << std::endl;
+    os << indent << "PyramidSamplesPerSigma:" << this->m_PyramidSamplesPerSigma
+       << std::endl;
+    os << indent << "SmoothedCertaintyCache:" << this->m_SmoothedCertaintyCache.GetPointer()
+       << std::endl;
+    os << indent << "Features:" << this->m_Features
+       << std::endl;
+    os << indent << "PlanarOutput:" << this->m_PlanarOutput
+       << std::endl;
   }
 
 } // end namespace itk
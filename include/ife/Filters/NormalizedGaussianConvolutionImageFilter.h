@@ -43,36 +43,99 @@
 
    So we can just differentiate the Gaussian a.
 
+   Multi scale:
+   Gaussians compose, a_s2 = a_s1 * a_d with d^2 = s2^2 - s1^2, so
+   {a_s2 * cT} = a_d * {a_s1 * cT} and {a_s2 * c} = a_d * {a_s1 * c}.
+   When a list of scales is given with SetSigmas, the filter has one output
+   for each scale. With UseCascadeOn() the numerator and denominator of a
+   scale are found by smoothing those of the previous scale with a_d. The
+   recursive Gaussian does the same work for any sigma, so this saves the
+   multiplication and reading the inputs for each scale, not work in the
+   smoothing itself.
+   The cascade accumulates the approximation error of the recursive Gaussian.
+   In the interior of the image the difference to independent smoothing is
+   below 1% of the image range for sigmas of 1 to 4 voxels. The cascade is
+   off by default, so each scale is smoothed independently.
+
+   Box smoothing:
+   With SetSmoothingMethod( BoxGaussianSmoothing ) the Gaussian is
+   approximated by iterated box filters instead of the recursive Gaussian,
+   see IteratedBoxFilter.h for the deviation. The smoothing is then done by
+   FusedNormalizedGaussianConvolutionImageFilter, each scale is smoothed
+   independently and UseCascade is not used.
+
+   Shared denominator:
+   The denominator {a * c} only depends on the certainty and sigma. With
+   SetSmoothedCertaintyCache the denominators are looked up in the cache
+   before they are smoothed, and the ones that are smoothed are added, so
+   other filters and later updates with the same certainty and scales only
+   smooth the numerator. Precomputed denominators can be added to the cache
+   with SmoothedCertaintyCache::Add. Only independently smoothed
+   denominators are in the cache. The denominator of a cascaded scale
+   differs from them by the error of the cascade, so it is smoothed from the
+   previous scale like the numerator, and is neither looked up nor added.
+
+   Integer images:
+   The image can have an integer pixel type, such as the short values of a
+   CT scan. The output, the certainty and all intermediate images have the
+   real pixel type of the output, which by default is the float type of the
+   input pixel type. The image is converted when it is first read, by the
+   multiplication with the certainty, by the first recursive Gaussian when
+   the input is weighted, or by the first pass of the box filter, so it is
+   never copied to a real image.
+
+   Streaming:
+   The inputs are requested for the output region padded by 4 times the
+   largest sigma, and the padded region is smoothed as if it was the entire
+   image, see RequestedRegion.h. The streamed result matches the unstreamed
+   result up to the part of the Gaussian beyond the padding.
  */
+#include <vector>
+
 #include "itkDivideImageFilter.h"
+#include "itkImage.h"
 #include "itkImageToImageFilter.h"
 #include "itkMultiplyImageFilter.h"
 #include "itkSmoothingRecursiveGaussianImageFilter.h"
 
+#include "ife/Filters/FusedNormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Util/SmoothedCertaintyCache.h"
+
 namespace itk {
   
-  template < typename TImage >
+  template < typename TInputImage,
+	     typename TOutputImage =
+	     Image< typename NumericTraits< typename TInputImage::PixelType >::FloatType,
+		    TInputImage::ImageDimension > >
   class NormalizedGaussianConvolutionImageFilter :
-    public ImageToImageFilter< TImage, TImage >  {
+    public ImageToImageFilter< TInputImage, TOutputImage >  {
     
   public:
-    typedef NormalizedGaussianConvolutionImageFilter Self;
-    typedef ImageToImageFilter< TImage, TImage >     Superclass;
-    typedef SmartPointer< Self >                     Pointer;
-    typedef SmartPointer< const Self >               ConstPointer;
+    typedef NormalizedGaussianConvolutionImageFilter        Self;
+    typedef ImageToImageFilter< TInputImage, TOutputImage > Superclass;
+    typedef SmartPointer< Self >                            Pointer;
+    typedef SmartPointer< const Self >                      ConstPointer;
+
+    /** The image to convolve */
+    typedef TInputImage                   InputImageType;
 
-    typedef TImage                        ImageType;
+    /** The certainty and the outputs */
+    typedef TOutputImage                  ImageType;
 
     // We wan to hide the composited filters, so they are protected. But we need
     // the ScalarRealType from the Gaussian smoothing filter, so we need to
     // define the typedefs here.
   protected:
-    typedef MultiplyImageFilter< ImageType > MultiplyFilterType;
+    typedef MultiplyImageFilter< InputImageType, ImageType, ImageType > MultiplyFilterType;
     typedef DivideImageFilter< ImageType, ImageType, ImageType > DivideFilterType;
     typedef SmoothingRecursiveGaussianImageFilter< ImageType, ImageType > GaussianFilterType;
+    typedef SmoothingRecursiveGaussianImageFilter< InputImageType, ImageType > InputGaussianFilterType;
+    typedef FusedNormalizedGaussianConvolutionImageFilter< InputImageType, ImageType > BoxFilterType;
 
   public:
     typedef typename GaussianFilterType::ScalarRealType ScalarRealType;
+    typedef std::vector< ScalarRealType > SigmasType;
+    typedef SmoothedCertaintyCache< ImageType > SmoothedCertaintyCacheType;
 
     /** Method for creation through object factory */
     itkNewMacro(Self);
@@ -83,7 +146,7 @@ namespace itk {
 
 
     /** The image to convolve */
-    void SetInputImage(const ImageType* image);
+    void SetInputImage(const InputImageType* image);
 
     /** The certainty of pixels in the input image */
     void SetInputCertainty(const ImageType* image);
@@ -92,6 +155,43 @@ namespace itk {
     itkGetMacro( Sigma, ScalarRealType );
     itkSetMacro( Sigma, ScalarRealType );
 
+    /** Get/Set the scales for multi scale smoothing. When the list is not
+	empty the filter has one output for each scale, GetOutput(i) is the
+	result at scale i, and Sigma is not used. */
+    void SetSigmas( const SigmasType& sigmas );
+    itkGetConstReferenceMacro( Sigmas, SigmasType );
+
+    /** The scales that are calculated, either Sigmas or Sigma */
+    SigmasType GetScales() const;
+
+    /** Get/Set if a scale should be calculated from the previous scale when
+	it is larger. Default is off. */
+    itkGetConstMacro( UseCascade, bool );
+    itkSetMacro( UseCascade, bool );
+    itkBooleanMacro( UseCascade );
+    
+    /** Get/Set if the input image is already multiplied by the certainty, so
+	the input is cT instead of T. This is useful when the same image is
+	smoothed at several scales, because cT is independent of the scale.
+	Default is off. */
+    itkGetConstMacro( InputImageIsWeighted, bool );
+    itkSetMacro( InputImageIsWeighted, bool );
+    itkBooleanMacro( InputImageIsWeighted );
+
+    /** Get/Set how the Gaussian is approximated. Default is
+	RecursiveGaussianSmoothing. */
+    itkGetConstMacro( SmoothingMethod, GaussianSmoothingMethod );
+    itkSetMacro( SmoothingMethod, GaussianSmoothingMethod );
+
+    /** Get/Set the cache of smoothed certainties. Default is null, which
+	smooths the certainty in every update. */
+    itkSetObjectMacro( SmoothedCertaintyCache, SmoothedCertaintyCacheType );
+    itkGetModifiableObjectMacro( SmoothedCertaintyCache, SmoothedCertaintyCacheType );
+
+    /** The inputs are needed in the output region padded by the support of
+	the largest Gaussian */
+    virtual void GenerateInputRequestedRegion(void) ITK_OVERRIDE;
+
   protected:
     NormalizedGaussianConvolutionImageFilter();
   
@@ -106,10 +206,17 @@ namespace itk {
     void operator=(const Self&);          // purposely not implemented
 
     typename MultiplyFilterType::Pointer m_MultiplyFilter;
+    typename InputGaussianFilterType::Pointer m_InputGaussianFilter;
     typename GaussianFilterType::Pointer m_GaussianFilter1;
     typename GaussianFilterType::Pointer m_GaussianFilter2;
     typename DivideFilterType::Pointer   m_DivideFilter;
+    typename BoxFilterType::Pointer      m_BoxFilter;
     ScalarRealType m_Sigma;
+    SigmasType m_Sigmas;
+    bool m_UseCascade;
+    bool m_InputImageIsWeighted;
+    GaussianSmoothingMethod m_SmoothingMethod;
+    typename SmoothedCertaintyCacheType::Pointer m_SmoothedCertaintyCache;
   };
 
 } // end namespace itk
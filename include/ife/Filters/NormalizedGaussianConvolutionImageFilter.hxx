@@ -1,76 +1,277 @@
 #ifndef NormalizedGaussianConvolutionImageFilter_hxx
 #define NormalizedGaussianConvolutionImageFilter_hxx
 
+#include <algorithm>
+#include <cmath>
+
+#include "ife/Util/RequestedRegion.h"
 #include "NormalizedGaussianConvolutionImageFilter.h"
 
 namespace itk {
 
-  template< typename TImage >
-  NormalizedGaussianConvolutionImageFilter< TImage >
+  template< typename TInputImage, typename TOutputImage >
+  NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
   ::NormalizedGaussianConvolutionImageFilter()
   {
     this->SetNumberOfRequiredInputs(2);
     
     m_MultiplyFilter = MultiplyFilterType::New();
+    m_InputGaussianFilter = InputGaussianFilterType::New();
     m_GaussianFilter1 = GaussianFilterType::New();
     m_GaussianFilter2 = GaussianFilterType::New();;
     m_DivideFilter = DivideFilterType::New();
+    m_BoxFilter = BoxFilterType::New();
+    m_BoxFilter->SetSmoothingMethod( BoxGaussianSmoothing );
     m_Sigma = 1.0;
+    m_UseCascade = false;
+    m_InputImageIsWeighted = false;
+    m_SmoothingMethod = RecursiveGaussianSmoothing;
 
     // The filters are connected in GenerateData so it is easier to see what is
     // going 
   }
 
-  template< typename TImage>
-  void NormalizedGaussianConvolutionImageFilter<TImage>
-  ::SetInputImage(const TImage* image) {
-    this->SetNthInput(0, const_cast<TImage*>(image));
+  template< typename TInputImage, typename TOutputImage >
+  void NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputImage(const TInputImage* image) {
+    this->SetNthInput(0, const_cast<TInputImage*>(image));
   }
  
-  template< typename TImage>
-  void NormalizedGaussianConvolutionImageFilter<TImage>
-  ::SetInputCertainty(const TImage* mask)
+  template< typename TInputImage, typename TOutputImage >
+  void NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputCertainty(const TOutputImage* mask)
+  {
+    this->SetNthInput(1, const_cast<TOutputImage*>(mask));
+  }
+  
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetSigmas( const SigmasType& sigmas )
+  {
+    if ( m_Sigmas == sigmas ) {
+      return;
+    }
+    m_Sigmas = sigmas;
+
+    // One output for each scale
+    const unsigned int nOutputs = std::max< size_t >( m_Sigmas.size(), 1 );
+    this->SetNumberOfIndexedOutputs( nOutputs );
+    this->SetNumberOfRequiredOutputs( nOutputs );
+    for ( unsigned int i = 1; i < nOutputs; ++i ) {
+      if ( this->GetOutput( i ) == ITK_NULLPTR ) {
+	this->SetNthOutput( i, this->MakeOutput( i ) );
+      }
+    }
+    this->Modified();
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  typename NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >::SigmasType
+  NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GetScales() const
   {
-    this->SetNthInput(1, const_cast<TImage*>(mask));
+    if ( m_Sigmas.empty() ) {
+      return SigmasType( 1, m_Sigma );
+    }
+    return m_Sigmas;
   }
   
-  template< typename TImage >
+  template< typename TInputImage, typename TOutputImage >
   void
-  NormalizedGaussianConvolutionImageFilter< TImage >
+  NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GenerateInputRequestedRegion()
+  {
+    this->Superclass::GenerateInputRequestedRegion();
+
+    const SigmasType sigmas = this->GetScales();
+    const ScalarRealType sigma = *std::max_element( sigmas.begin(), sigmas.end() );
+    // The superclass only sets the requested region of inputs with the input
+    // image type, so the certainty is set here when the types differ
+    const typename ImageType::RegionType outputRegion =
+      this->GetOutput()->GetRequestedRegion();
+    InputImageType *image =
+      const_cast< InputImageType * >( static_cast< const InputImageType * >( this->ProcessObject::GetInput(0) ) );
+    if ( image ) {
+      image->SetRequestedRegion( outputRegion );
+      padRequestedRegion( image, gaussianSupportRadius( image, sigma ) );
+    }
+    ImageType *certainty =
+      const_cast< ImageType * >( static_cast< const ImageType * >( this->ProcessObject::GetInput(1) ) );
+    if ( certainty ) {
+      certainty->SetRequestedRegion( outputRegion );
+      padRequestedRegion( certainty, gaussianSupportRadius( certainty, sigma ) );
+    }
+  }
+
+  
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
   ::GenerateData()
   {
-    typename ImageType::Pointer inputImage = ImageType::New();
-    inputImage->Graft( static_cast<const ImageType * >( this->ProcessObject::GetInput(0) ));
+    // The requested regions of the inputs are smoothed as if they were the
+    // entire image, so the mini pipeline only sees the padded region.
+    typename InputImageType::Pointer inputImage =
+      graftRequestedRegion( static_cast<const InputImageType * >( this->ProcessObject::GetInput(0) ));
 
-    typename ImageType::Pointer inputCertainty = ImageType::New();
-    inputCertainty->Graft( static_cast<const ImageType * >( this->ProcessObject::GetInput(1) ));
+    typename ImageType::Pointer inputCertainty =
+      graftRequestedRegion( static_cast<const ImageType * >( this->ProcessObject::GetInput(1) ));
 
-    m_MultiplyFilter->SetInput1( inputImage );
-    m_MultiplyFilter->SetInput2( inputCertainty );
+    // Grafting the results back sets the largest possible region of the
+    // outputs to the padded region, so it is restored after each graft.
+    const typename ImageType::RegionType largestRegion =
+      this->GetOutput()->GetLargestPossibleRegion();
 
-    m_GaussianFilter1->SetSigma( m_Sigma );
-    m_GaussianFilter2->SetSigma( m_Sigma );
-    
-    m_GaussianFilter1->SetInput( m_MultiplyFilter->GetOutput() );
-    m_GaussianFilter2->SetInput( inputCertainty );
+    // The certainty is only read for the key when there is a cache. Box
+    // smoothing is done by the fused filter, the recursive Gaussian by ITK.
+    typename SmoothedCertaintyCacheType::KeyType certaintyKey;
+    if ( m_SmoothedCertaintyCache ) {
+      certaintyKey =
+	SmoothedCertaintyCacheType::MakeKey( inputCertainty.GetPointer(),
+					     0,
+					     m_SmoothingMethod,
+					     m_SmoothingMethod == BoxGaussianSmoothing
+					     ? SmoothedCertaintyCacheType::FusedImplementation
+					     : SmoothedCertaintyCacheType::ITKImplementation );
+    }
+
+    const SigmasType sigmas = this->GetScales();
+    if ( m_SmoothingMethod == BoxGaussianSmoothing ) {
+      // The box filter smooths the region of its inputs and does the
+      // multiplication and division itself. The outputs are disconnected so
+      // each scale gets its own buffer.
+      m_BoxFilter->SetInputImage( inputImage );
+      m_BoxFilter->SetInputCertainty( inputCertainty );
+      m_BoxFilter->SetInputImageIsWeighted( m_InputImageIsWeighted );
+      for ( size_t i = 0; i < sigmas.size(); ++i ) {
+	typename ImageType::Pointer smoothedCertainty;
+	if ( m_SmoothedCertaintyCache ) {
+	  certaintyKey.Sigma = sigmas[i];
+	  smoothedCertainty = m_SmoothedCertaintyCache->Find( certaintyKey, inputCertainty );
+	}
+	m_BoxFilter->SetInputSmoothedCertainty( smoothedCertainty );
+	m_BoxFilter->SetGenerateSmoothedCertainty( m_SmoothedCertaintyCache && !smoothedCertainty );
+	m_BoxFilter->SetSigma( sigmas[i] );
+	m_BoxFilter->UpdateLargestPossibleRegion();
+	typename ImageType::Pointer smoothed = m_BoxFilter->GetOutput();
+	smoothed->DisconnectPipeline();
+	this->GraftNthOutput( i, smoothed );
+	this->GetOutput( i )->SetLargestPossibleRegion( largestRegion );
+	if ( m_BoxFilter->GetGenerateSmoothedCertainty() ) {
+	  smoothedCertainty = m_BoxFilter->GetSmoothedCertaintyOutput();
+	  smoothedCertainty->DisconnectPipeline();
+	  m_SmoothedCertaintyCache->Add( certaintyKey, inputCertainty, smoothedCertainty );
+	}
+      }
+      m_BoxFilter->SetInputSmoothedCertainty( ITK_NULLPTR );
+      return;
+    }
+
+    // The numerator cT. A weighted input is smoothed by m_InputGaussianFilter,
+    // which reads the input pixel type.
+    typename ImageType::Pointer weightedImage;
+    if ( !m_InputImageIsWeighted ) {
+      m_MultiplyFilter->SetInput1( inputImage );
+      m_MultiplyFilter->SetInput2( inputCertainty );
+      m_MultiplyFilter->UpdateLargestPossibleRegion();
+      weightedImage = m_MultiplyFilter->GetOutput();
+    }
+
+    typename ImageType::Pointer numerator;
+    typename ImageType::Pointer denominator;
+    for ( size_t i = 0; i < sigmas.size(); ++i ) {
+      ImageType *smoothedNumerator = m_GaussianFilter1->GetOutput();
+
+      // The denominator is not smoothed when it is in the cache. The cache
+      // only has independently smoothed denominators, so a cascaded
+      // denominator is neither looked up nor added, and the cascaded
+      // numerator is always divided by the denominator cascaded with it.
+      const bool cascade = m_UseCascade && i > 0 && sigmas[i] > sigmas[i-1];
+      typename ImageType::Pointer smoothedCertainty;
+      if ( m_SmoothedCertaintyCache && !cascade ) {
+	certaintyKey.Sigma = sigmas[i];
+	smoothedCertainty = m_SmoothedCertaintyCache->Find( certaintyKey, inputCertainty );
+      }
+
+      if ( cascade ) {
+	// Smooth the previous scale with the difference
+	const ScalarRealType sigma =
+	  std::sqrt( sigmas[i] * sigmas[i] - sigmas[i-1] * sigmas[i-1] );
+	m_GaussianFilter1->SetSigma( sigma );
+	m_GaussianFilter2->SetSigma( sigma );
+	m_GaussianFilter1->SetInput( numerator );
+	m_GaussianFilter2->SetInput( denominator );
+      }
+      else {
+	if ( m_InputImageIsWeighted ) {
+	  m_InputGaussianFilter->SetSigma( sigmas[i] );
+	  m_InputGaussianFilter->SetInput( inputImage );
+	  smoothedNumerator = m_InputGaussianFilter->GetOutput();
+	}
+	else {
+	  m_GaussianFilter1->SetSigma( sigmas[i] );
+	  m_GaussianFilter1->SetInput( weightedImage );
+	}
+	m_GaussianFilter2->SetSigma( sigmas[i] );
+	m_GaussianFilter2->SetInput( inputCertainty );
+      }
 
-    m_DivideFilter->SetInput1( m_GaussianFilter1->GetOutput() );
-    m_DivideFilter->SetInput2( m_GaussianFilter2->GetOutput() );   
+      m_DivideFilter->SetInput1( smoothedNumerator );
+      if ( smoothedCertainty ) {
+	m_DivideFilter->SetInput2( smoothedCertainty );
+      }
+      else {
+	m_DivideFilter->SetInput2( m_GaussianFilter2->GetOutput() );
+      }
 
-    m_DivideFilter->GraftOutput( this->GetOutput() );
-    m_DivideFilter->Update();
-    this->GraftOutput( m_DivideFilter->GetOutput() );
+      m_DivideFilter->GraftOutput( this->GetOutput( i ) );
+      m_DivideFilter->Update();
+      this->GraftNthOutput( i, m_DivideFilter->GetOutput() );
+      this->GetOutput( i )->SetLargestPossibleRegion( largestRegion );
+
+      if ( !smoothedCertainty ) {
+	// Disconnected so the Gaussian filter makes a new output
+	smoothedCertainty = m_GaussianFilter2->GetOutput();
+	smoothedCertainty->DisconnectPipeline();
+	if ( m_SmoothedCertaintyCache && !cascade ) {
+	  m_SmoothedCertaintyCache->Add( certaintyKey, inputCertainty, smoothedCertainty );
+	}
+      }
+
+      if ( m_UseCascade && i + 1 < sigmas.size() ) {
+	// Keep the numerator and denominator for the next scale. They are
+	// disconnected so the Gaussian filters make new outputs.
+	numerator = smoothedNumerator;
+	numerator->DisconnectPipeline();
+	denominator = smoothedCertainty;
+      }
+    }
+    m_MultiplyFilter->GetOutput()->ReleaseData();
   }
 
-  template< typename TImage >
+  template< typename TInputImage, typename TOutputImage >
   void
-  NormalizedGaussianConvolutionImageFilter< TImage >
+  NormalizedGaussianConvolutionImageFilter< TInputImage, TOutputImage >
   ::PrintSelf( std::ostream& os, Indent indent ) const
   {
     Superclass::PrintSelf(os,indent);
 
     os << indent << "Sigma:" << this->m_Sigma
        << std::endl;
+    os << indent << "Sigmas:";
+    for ( auto sigma : this->m_Sigmas ) {
+      os << " " << sigma;
+    }
+    os << std::endl;
+    os << indent << "UseCascade:" << this->m_UseCascade
+       << std::endl;
+    os << indent << "InputImageIsWeighted:" << this->m_InputImageIsWeighted
+       << std::endl;
+    os << indent << "SmoothingMethod:" << this->m_SmoothingMethod
+       << std::endl;
+    os << indent << "SmoothedCertaintyCache:" << this->m_SmoothedCertaintyCache.GetPointer()
+       << std::endl;
   }
 
 } // end namespace itk
@@ -0,0 +1,152 @@
+#ifndef NormalizedGaussianDerivativeConvolutionImageFilter_h
+#define NormalizedGaussianDerivativeConvolutionImageFilter_h
+
+/*
+   Normalized convolution with a Gaussian applicability and its derivatives
+   up to second order, see NormalizedGaussianConvolutionImageFilter.h for the
+   details. With
+     N = {a * cT},  D = {a * c},  U = N/D
+   and subscripts denoting partial derivatives, differentiating N = UD gives
+     U_i  = (N_i - U D_i) / D
+     U_ij = (N_ij - U_i D_j - U_j D_i - U D_ij) / D
+   where all derivatives of N and D are convolutions of cT and c with
+   derivatives of the Gaussian.
+
+   The derivatives of N and D are found with the recursive Gaussian and its
+   derivatives, see RecursiveGaussian.h, in one pass along each direction:
+     x: orders 0, 1, 2
+     y: the orders that keep the total order at most 2, 6 combinations
+     z: the same, 10 combinations
+   N and D are filtered as interleaved pairs, and the last pass combines the
+   10 pairs into U, its gradient and its Hessian, which are written to the
+   output components in the order of Components. Voxels where D is not
+   positive are set to 0.
+
+   The input image can have an integer pixel type. It is converted to the
+   real pixel type of the output when the x-lines are read, and the
+   certainty has the same real pixel type as the output.
+
+   Only 3D images are supported.
+ */
+#include <vector>
+
+#include "itkFixedArray.h"
+#include "itkImage.h"
+#include "itkImageToImageFilter.h"
+#include "itkVectorImage.h"
+
+namespace itk {
+
+  template < typename TInputImage,
+	     typename TOutputImage =
+	     VectorImage< typename NumericTraits< typename TInputImage::PixelType >::FloatType,
+			  TInputImage::ImageDimension > >
+  class NormalizedGaussianDerivativeConvolutionImageFilter :
+    public ImageToImageFilter< TInputImage, TOutputImage >  {
+
+  public:
+    typedef NormalizedGaussianDerivativeConvolutionImageFilter Self;
+    typedef ImageToImageFilter< TInputImage, TOutputImage >    Superclass;
+    typedef SmartPointer< Self >                               Pointer;
+    typedef SmartPointer< const Self >                         ConstPointer;
+
+    typedef TInputImage                         InputImageType;
+    typedef typename InputImageType::PixelType  InputPixelType;
+    typedef typename InputImageType::RegionType RegionType;
+    typedef TOutputImage                        OutputImageType;
+    typedef typename OutputImageType::InternalPixelType OutputInternalPixelType;
+    typedef OutputInternalPixelType             PixelType;
+    typedef typename NumericTraits< PixelType >::RealType ScalarRealType;
+
+    itkStaticConstMacro( ImageDimension, unsigned int, InputImageType::ImageDimension );
+
+    /** The certainty has the real pixel type */
+    typedef Image< PixelType, ImageDimension >  CertaintyImageType;
+
+    // The passes are written for 3D
+    static_assert( InputImageType::ImageDimension == 3,
+		   "NormalizedGaussianDerivativeConvolutionImageFilter requires 3D images" );
+
+    /** Method for creation through object factory */
+    itkNewMacro(Self);
+
+    /** Run-time type information */
+    itkTypeMacro(NormalizedGaussianDerivativeConvolutionImageFilter,
+		 ImageToImageFilter);
+
+    /** The output components */
+    enum Components {
+      Value = 0,
+      GradientX, GradientY, GradientZ,
+      HessianXX, HessianXY, HessianXZ, HessianYY, HessianYZ, HessianZZ,
+      NumberOfComponents
+    };
+
+    /** The image to convolve */
+    void SetInputImage(const InputImageType* image);
+
+    /** The certainty of pixels in the input image */
+    void SetInputCertainty(const CertaintyImageType* image);
+
+    typedef FixedArray< ScalarRealType, ImageDimension > SigmaArrayType;
+
+    /** Get/Set the scale of the Gaussian in physical units. SetSigma uses
+	the same scale along every axis, GetSigma is the scale along x. */
+    void SetSigma( ScalarRealType sigma );
+    ScalarRealType GetSigma() const;
+
+    /** Get/Set the scale of the Gaussian along each axis in physical
+	units */
+    itkGetConstMacro( SigmaArray, SigmaArrayType );
+    itkSetMacro( SigmaArray, SigmaArrayType );
+
+    /** Get/Set if the input image is already multiplied by the certainty, so
+	the input is cT instead of T. Default is off. */
+    itkGetConstMacro( InputImageIsWeighted, bool );
+    itkSetMacro( InputImageIsWeighted, bool );
+    itkBooleanMacro( InputImageIsWeighted );
+
+    virtual void GenerateOutputInformation(void) ITK_OVERRIDE;
+
+    /** The smoothing needs the entire input */
+    virtual void GenerateInputRequestedRegion(void) ITK_OVERRIDE;
+    virtual void EnlargeOutputRequestedRegion( DataObject *output ) ITK_OVERRIDE;
+
+  protected:
+    NormalizedGaussianDerivativeConvolutionImageFilter();
+    virtual ~NormalizedGaussianDerivativeConvolutionImageFilter(){};
+
+    virtual void GenerateData() ITK_OVERRIDE;
+
+    /** Display */
+    void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE;
+
+  private:
+    NormalizedGaussianDerivativeConvolutionImageFilter(Self&);   // purposely not implemented
+    void operator=(const Self&);          // purposely not implemented
+
+    /** Filter the pairs along one direction. Lines are split between the
+	threads. */
+    struct PassStruct {
+      Self *Filter;
+      unsigned int Direction;
+    };
+    static ITK_THREAD_RETURN_TYPE PassCallback( void *arg );
+    void ThreadedPass( unsigned int direction,
+		       ThreadIdType threadId,
+		       ThreadIdType numberOfThreads );
+
+    // The pairs (N, D) after the x pass and after the y pass
+    std::vector< PixelType > m_Pairs[2];
+
+    SigmaArrayType m_SigmaArray;
+    bool m_InputImageIsWeighted;
+  };
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "NormalizedGaussianDerivativeConvolutionImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef NormalizedGaussianDerivativeConvolutionImageFilter_hxx
+#define NormalizedGaussianDerivativeConvolutionImageFilter_hxx
+
+#include <algorithm>
+
+#include "itkMultiThreader.h"
+
+#include "ife/Numerics/RecursiveGaussian.h"
+#include "NormalizedGaussianDerivativeConvolutionImageFilter.h"
+
+namespace itk {
+
+  template< typename TInputImage, typename TOutputImage >
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::NormalizedGaussianDerivativeConvolutionImageFilter()
+  {
+    this->SetNumberOfRequiredInputs(2);
+    m_SigmaArray.Fill( 1.0 );
+    m_InputImageIsWeighted = false;
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputImage(const TInputImage* image) {
+    this->SetNthInput(0, const_cast<TInputImage*>(image));
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetInputCertainty(const CertaintyImageType* mask)
+  {
+    this->SetNthInput(1, const_cast<CertaintyImageType*>(mask));
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::SetSigma( ScalarRealType sigma )
+  {
+    SigmaArrayType sigmas;
+    sigmas.Fill( sigma );
+    this->SetSigmaArray( sigmas );
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  typename NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >::ScalarRealType
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GetSigma() const
+  {
+    return m_SigmaArray[0];
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GenerateOutputInformation()
+  {
+    this->Superclass::GenerateOutputInformation();
+    this->GetOutput()->SetNumberOfComponentsPerPixel( NumberOfComponents );
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GenerateInputRequestedRegion()
+  {
+    this->Superclass::GenerateInputRequestedRegion();
+    // The image and the certainty can have different pixel types
+    for ( unsigned int i = 0; i < 2; ++i ) {
+      DataObject *input = this->ProcessObject::GetInput(i);
+      if ( input ) {
+	input->SetRequestedRegionToLargestPossibleRegion();
+      }
+    }
+  }
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::EnlargeOutputRequestedRegion( DataObject *output )
+  {
+    this->Superclass::EnlargeOutputRequestedRegion( output );
+    output->SetRequestedRegionToLargestPossibleRegion();
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::GenerateData()
+  {
+    const InputImageType *image = static_cast< const InputImageType * >( this->ProcessObject::GetInput(0) );
+    const CertaintyImageType *certainty = static_cast< const CertaintyImageType * >( this->ProcessObject::GetInput(1) );
+    const RegionType region = image->GetBufferedRegion();
+    if ( region != certainty->GetBufferedRegion() ) {
+      itkExceptionMacro( << "Image and certainty must have the same buffered region."
+			 << " Image: " << region
+			 << " Certainty: " << certainty->GetBufferedRegion() );
+    }
+    for ( unsigned int d = 0; d < ImageDimension; ++d ) {
+      if ( region.GetSize(d) < 4 ) {
+	itkExceptionMacro( << "The number of pixels along direction " << d
+			   << " is less than 4. This filter requires a minimum"
+			   << " of four pixels along the dimension to be processed." );
+      }
+    }
+
+    OutputImageType *output = this->GetOutput();
+    output->SetBufferedRegion( region );
+    output->Allocate();
+
+    // 3 pairs after the x pass and 6 after the y pass
+    m_Pairs[0].resize( 2 * 3 * region.GetNumberOfPixels() );
+    m_Pairs[1].resize( 2 * 6 * region.GetNumberOfPixels() );
+
+    PassStruct str;
+    str.Filter = this;
+    for ( unsigned int d = 0; d < ImageDimension; ++d ) {
+      str.Direction = d;
+      this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+      this->GetMultiThreader()->SetSingleMethod( PassCallback, &str );
+      this->GetMultiThreader()->SingleMethodExecute();
+      if ( d > 0 ) {
+	std::vector< PixelType >().swap( m_Pairs[d - 1] );
+      }
+    }
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  ITK_THREAD_RETURN_TYPE
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::PassCallback( void *arg )
+  {
+    MultiThreader::ThreadInfoStruct *info =
+      static_cast< MultiThreader::ThreadInfoStruct * >( arg );
+    PassStruct *str = static_cast< PassStruct * >( info->UserData );
+    str->Filter->ThreadedPass( str->Direction, info->ThreadID, info->NumberOfThreads );
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::ThreadedPass( unsigned int direction,
+		  ThreadIdType threadId,
+		  ThreadIdType numberOfThreads )
+  {
+    typedef typename InputImageType::OffsetValueType OffsetValueType;
+    typedef RecursiveGaussian< ScalarRealType > GaussianType;
+
+    // Each output pair of a pass is an input pair filtered with the given
+    // order. The pairs after the z pass are
+    //  0: 1    1: z    2: zz   3: y    4: yz
+    //  5: yy   6: x    7: xz   8: xy   9: xx
+    static const unsigned int nIn[3] = { 1, 3, 6 };
+    static const unsigned int nOut[3] = { 3, 6, 10 };
+    static const unsigned int passes[3][10][2] = {
+      { {0,0}, {0,1}, {0,2} },
+      { {0,0}, {0,1}, {0,2}, {1,0}, {1,1}, {2,0} },
+      { {0,0}, {0,1}, {0,2}, {1,0}, {1,1}, {2,0}, {3,0}, {3,1}, {4,0}, {5,0} }
+    };
+    // The pair of the first derivative along x, y, z, and the pair of each
+    // second derivative in the order of the Hessian components
+    static const unsigned int firstOrder[3] = { 6, 3, 1 };
+    static const unsigned int secondOrder[6][3] = {
+      {0,0,9}, {0,1,8}, {0,2,7}, {1,1,5}, {1,2,4}, {2,2,2}
+    };
+
+    const InputImageType *image = static_cast< const InputImageType * >( this->ProcessObject::GetInput(0) );
+    const CertaintyImageType *certainty = static_cast< const CertaintyImageType * >( this->ProcessObject::GetInput(1) );
+    OutputImageType *output = this->GetOutput();
+    const RegionType region = output->GetBufferedRegion();
+    const OffsetValueType *offsetTable = output->GetOffsetTable();
+
+    // The lines along direction are split evenly between the threads
+    const size_t n = region.GetSize( direction );
+    const OffsetValueType stride = offsetTable[direction];
+    const size_t nLines = region.GetNumberOfPixels() / n;
+    const size_t linesPerThread = ( nLines + numberOfThreads - 1 ) / numberOfThreads;
+    const size_t lineBegin = std::min( nLines, threadId * linesPerThread );
+    const size_t lineEnd = std::min( nLines, lineBegin + linesPerThread );
+
+    // The derivatives are per sample, so they are scaled by the spacing
+    const ScalarRealType sigma = m_SigmaArray[direction] / output->GetSpacing()[direction];
+    const GaussianType gaussians[3] = {
+      GaussianType( sigma, 0 ), GaussianType( sigma, 1 ), GaussianType( sigma, 2 )
+    };
+    const ScalarRealType h = 1.0 / output->GetSpacing()[direction];
+    const ScalarRealType scales[3] = { 1, h, h * h };
+
+    // The pairs of a line are stored one after the other
+    const size_t inPairs = nIn[direction];
+    const size_t outPairs = nOut[direction];
+    std::vector< ScalarRealType > line( 2 * n * inPairs );
+    std::vector< ScalarRealType > filtered( 2 * n * outPairs );
+    std::vector< ScalarRealType > scratch( 2 * n );
+
+    const InputPixelType *T = image->GetBufferPointer();
+    const PixelType *c = certainty->GetBufferPointer();
+    OutputInternalPixelType *out = output->GetBufferPointer();
+    const PixelType *in = direction > 0 ? &m_Pairs[direction - 1][0] : ITK_NULLPTR;
+    PixelType *pairs = direction < 2 ? &m_Pairs[direction][0] : ITK_NULLPTR;
+
+    for ( size_t l = lineBegin; l < lineEnd; ++l ) {
+      // Offset of the first pixel in the line
+      OffsetValueType base = 0;
+      size_t rest = l;
+      for ( unsigned int k = 0; k < ImageDimension; ++k ) {
+	if ( k != direction ) {
+	  base += ( rest % region.GetSize(k) ) * offsetTable[k];
+	  rest /= region.GetSize(k);
+	}
+      }
+
+      if ( direction == 0 ) {
+	// An integer image is converted here
+	for ( size_t i = 0; i < n; ++i ) {
+	  const OffsetValueType j = base + i * stride;
+	  const PixelType t = static_cast< PixelType >( T[j] );
+	  line[2*i] = m_InputImageIsWeighted ? t : c[j] * t;
+	  line[2*i + 1] = c[j];
+	}
+      }
+      else {
+	for ( size_t p = 0; p < inPairs; ++p ) {
+	  ScalarRealType *pair = &line[2 * n * p];
+	  for ( size_t i = 0; i < n; ++i ) {
+	    const OffsetValueType j = base + i * stride;
+	    pair[2*i] = in[2 * ( j * inPairs + p )];
+	    pair[2*i + 1] = in[2 * ( j * inPairs + p ) + 1];
+	  }
+	}
+      }
+
+      for ( size_t p = 0; p < outPairs; ++p ) {
+	const unsigned int source = passes[direction][p][0];
+	const unsigned int order = passes[direction][p][1];
+	ScalarRealType *pair = &filtered[2 * n * p];
+	gaussians[order].template filter< 2 >( &line[2 * n * source], pair, &scratch[0], n );
+	if ( order > 0 ) {
+	  for ( size_t i = 0; i < 2 * n; ++i ) {
+	    pair[i] *= scales[order];
+	  }
+	}
+      }
+
+      if ( direction < 2 ) {
+	for ( size_t p = 0; p < outPairs; ++p ) {
+	  const ScalarRealType *pair = &filtered[2 * n * p];
+	  for ( size_t i = 0; i < n; ++i ) {
+	    const OffsetValueType j = base + i * stride;
+	    pairs[2 * ( j * outPairs + p )] = pair[2*i];
+	    pairs[2 * ( j * outPairs + p ) + 1] = pair[2*i + 1];
+	  }
+	}
+	continue;
+      }
+
+      // Combine the derivatives of N and D into U and its derivatives
+      for ( size_t i = 0; i < n; ++i ) {
+	OutputInternalPixelType *o = out + ( base + i * stride ) * NumberOfComponents;
+	ScalarRealType N[10], D[10];
+	for ( size_t p = 0; p < 10; ++p ) {
+	  N[p] = filtered[2 * ( n * p + i )];
+	  D[p] = filtered[2 * ( n * p + i ) + 1];
+	}
+	if ( D[0] <= 0 ) {
+	  std::fill( o, o + NumberOfComponents, 0 );
+	  continue;
+	}
+	const ScalarRealType U = N[0] / D[0];
+	ScalarRealType gradient[3];
+	for ( size_t k = 0; k < 3; ++k ) {
+	  const unsigned int p = firstOrder[k];
+	  gradient[k] = ( N[p] - U * D[p] ) / D[0];
+	}
+	o[Value] = U;
+	o[GradientX] = gradient[0];
+	o[GradientY] = gradient[1];
+	o[GradientZ] = gradient[2];
+	for ( size_t k = 0; k < 6; ++k ) {
+	  const unsigned int a = secondOrder[k][0];
+	  const unsigned int b = secondOrder[k][1];
+	  const unsigned int p = secondOrder[k][2];
+	  o[HessianXX + k] =
+	    ( N[p] - gradient[a] * D[firstOrder[b]] - gradient[b] * D[firstOrder[a]] - U * D[p] ) / D[0];
+	}
+      }
+    }
+  }
+
+
+  template< typename TInputImage, typename TOutputImage >
+  void
+  NormalizedGaussianDerivativeConvolutionImageFilter< TInputImage, TOutputImage >
+  ::PrintSelf( std::ostream& os, Indent indent ) const
+  {
+    Superclass::PrintSelf(os,indent);
+
+    os << indent << "SigmaArray:" << this->m_SigmaArray
+       << std::endl;
+    os << indent << "InputImageIsWeighted:" << this->m_InputImageIsWeighted
+       << std::endl;
+  }
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __ImageComponentType_h
+#define __ImageComponentType_h
+
+/*
+  The type an image file stores its pixel components as, read from the header
+  without reading the pixels.
+
+  Tools that can process an image with an integer pixel type choose the type
+  they read the image as from it, e.g. short for CT scans, which are stored as
+  short, and float for everything else, so no values are truncated.
+ */
+#include <string>
+
+#include "itkImageIOBase.h"
+#include "itkImageIOFactory.h"
+#include "itkMacro.h"
+
+namespace itk {
+
+  /** The component type of the image file at path. Throws if the file can
+      not be read by any ImageIO. */
+  inline ImageIOBase::IOComponentType
+  readComponentType( const std::string& path ) {
+    ImageIOBase::Pointer imageIO =
+      ImageIOFactory::CreateImageIO( path.c_str(), ImageIOFactory::ReadMode );
+    if ( imageIO.IsNull() ) {
+      itkGenericExceptionMacro( "Could not create an ImageIO for " << path );
+    }
+    imageIO->SetFileName( path );
+    imageIO->ReadImageInformation();
+    return imageIO->GetComponentType();
+  }
+
+  /** True if every value of componentType is a value of short */
+  inline bool
+  fitsInShort( ImageIOBase::IOComponentType componentType ) {
+    return componentType == ImageIOBase::CHAR
+      || componentType == ImageIOBase::UCHAR
+      || componentType == ImageIOBase::SHORT;
+  }
+
+} // end namespace itk
+
+#endif
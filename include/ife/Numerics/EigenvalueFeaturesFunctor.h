@@ -5,30 +5,82 @@
 #include <cmath>
 
 /* Calculate combinations of eigenvalues
+     eig1, eig2, eig3, eig1 + eig2 + eig3, eig1 * eig2 * eig3,
+     sqrt(eig1^2 + eig2^2 + eig3^2)
+   As for the solver the static compute functions do not allocate.
+
+   The last three features are invariants of A, they equal the trace, the
+   determinant and the Frobenius norm of A. These can be calculated directly
+   from A with trace, determinant and frobeniusNorm, without solving for the
+   eigenvalues.
  */
 template< typename TRealType >
 struct EigenvalueFeaturesFunctor :
   public Symmetric3x3EigenvalueSolver<TRealType>
 {
   typedef Symmetric3x3EigenvalueSolver<TRealType> SuperClass;
+  typedef typename SuperClass::RealType RealType;
   typedef typename SuperClass::InputType InputType;
   typedef typename SuperClass::OutputType OutputType;
-  
+  typedef typename SuperClass::FixedInputType FixedInputType;
+  typedef std::array< RealType, 6 > FixedOutputType;
+
+  static const unsigned int numFeatures = 6;
+
   EigenvalueFeaturesFunctor(){};
   ~EigenvalueFeaturesFunctor(){};
-  
+
   inline OutputType operator()(const InputType &A) const {
     assert(A.Size() == 6);
-    auto ev = SuperClass::operator()(A);
-    OutputType features(6);
-    features[0] = ev[0];
-    features[1] = ev[1];
-    features[2] = ev[2];
-    features[3] = ev[0] + ev[1] + ev[2];
-    features[4] = ev[0] * ev[1] * ev[2];
-    features[5] = std::sqrt(ev[0]*ev[0] + ev[1]*ev[1] + ev[2]*ev[2]);
+    OutputType features(numFeatures);
+    compute( A.GetDataPointer(), features.GetDataPointer() );
     return features;
   }
+
+  static inline FixedOutputType compute( const FixedInputType &A ) {
+    FixedOutputType features;
+    compute( A.data(), features.data() );
+    return features;
+  }
+
+  // A must point to 6 values and features to room for 6 values
+  static inline void compute( const RealType *A, RealType *features ) {
+    SuperClass::compute( A, features );
+    features[3] = eigenvalueSum( features );
+    features[4] = eigenvalueProduct( features );
+    features[5] = eigenvalueNorm( features );
+  }
+
+  static inline RealType eigenvalueSum( const RealType *ev ) {
+    return ev[0] + ev[1] + ev[2];
+  }
+
+  static inline RealType eigenvalueProduct( const RealType *ev ) {
+    return ev[0] * ev[1] * ev[2];
+  }
+
+  static inline RealType eigenvalueNorm( const RealType *ev ) {
+    return std::sqrt(ev[0]*ev[0] + ev[1]*ev[1] + ev[2]*ev[2]);
+  }
+
+  // A is the upper triangle {A11, A12, A13, A22, A23, A33}
+  // trace(A) = eig1 + eig2 + eig3
+  static inline RealType trace( const RealType *A ) {
+    return A[0] + A[3] + A[5];
+  }
+
+  // det(A) = eig1 * eig2 * eig3
+  static inline RealType determinant( const RealType *A ) {
+    return A[0] * ( A[3]*A[5] - A[4]*A[4] )
+      - A[1] * ( A[1]*A[5] - A[4]*A[2] )
+      + A[2] * ( A[1]*A[4] - A[3]*A[2] );
+  }
+
+  // ||A||_F = sqrt(eig1^2 + eig2^2 + eig3^2)
+  static inline RealType frobeniusNorm( const RealType *A ) {
+    return std::sqrt( A[0]*A[0] + A[3]*A[3] + A[5]*A[5] +
+		      2 * ( A[1]*A[1] + A[2]*A[2] + A[4]*A[4] ) );
+  }
 };
 
 #endif
@@ -0,0 +1,316 @@
+#ifndef __HalfPrecision_h
+#define __HalfPrecision_h
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+/* Storage of floats in 16 bits.
+
+   float16 is IEEE 754 binary16, with 11 bits of precision and a range of
+   +-65504, beyond which values become infinite. bfloat16 is the upper half
+   of a float, with 8 bits of precision and the range of float.
+   Both round to nearest with ties to even, and keep infinities and NaN.
+
+   When compiled with F16C, e.g. -mf16c, float16 is converted by the F16C
+   instructions, 8 values at a time for arrays. Otherwise, and for bfloat16,
+   the conversion is done with integer operations on the bits.
+
+   Features are only used through histograms, so BinPreservingEncoder
+   rounds a value to a 16 bit value in the same histogram bin, which keeps
+   the histograms unchanged as long as every bin has a 16 bit value. A bin
+   that is narrower than the spacing of the format at its edges, e.g. 1/128
+   of the magnitude for bfloat16, may not have one.
+ */
+
+enum HalfPrecisionFormat {
+  Float16Format,  // IEEE 754 binary16
+  BFloat16Format  // Upper 16 bits of a float
+};
+
+inline uint32_t floatBits( float value ) {
+  uint32_t bits;
+  std::memcpy( &bits, &value, sizeof( bits ) );
+  return bits;
+}
+
+inline float bitsToFloat( uint32_t bits ) {
+  float value;
+  std::memcpy( &value, &bits, sizeof( value ) );
+  return value;
+}
+
+inline uint16_t floatToFloat16( float value ) {
+#if defined(__F16C__)
+  return _cvtss_sh( value, 0 );
+#else
+  const uint32_t f = floatBits( value );
+  const uint16_t sign = ( f >> 16 ) & 0x8000;
+  const uint32_t magnitude = f & 0x7FFFFFFF;
+  if ( magnitude >= 0x7F800000 ) {
+    // Infinity, or NaN which is kept quiet
+    const uint16_t nan = magnitude > 0x7F800000 ? 0x0200 | ( ( magnitude >> 13 ) & 0x03FF ) : 0;
+    return sign | 0x7C00 | nan;
+  }
+  if ( magnitude >= 0x477FF000 ) {
+    // At least 65520, which rounds to infinity
+    return sign | 0x7C00;
+  }
+  if ( magnitude < 0x38800000 ) {
+    // Below 2^-14 the result is subnormal, in units of 2^-24
+    if ( magnitude < 0x33000000 ) {
+      return sign;
+    }
+    const uint32_t exponent = magnitude >> 23;
+    const uint32_t mantissa = ( magnitude & 0x007FFFFF ) | 0x00800000;
+    const uint32_t shift = 126 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ( ( 1u << shift ) - 1 );
+    const uint32_t halfway = 1u << ( shift - 1 );
+    if ( rest > halfway || ( rest == halfway && ( half & 1 ) ) ) {
+      ++half;
+    }
+    return sign | half;
+  }
+  // Rebias the exponent from 127 to 15 and round away 13 bits. A carry out
+  // of the mantissa increments the exponent, which is the right result.
+  const uint32_t rebiased = magnitude - 0x38000000;
+  return sign | ( ( rebiased + 0x0FFF + ( ( rebiased >> 13 ) & 1 ) ) >> 13 );
+#endif
+}
+
+inline float float16ToFloat( uint16_t half ) {
+#if defined(__F16C__)
+  return _cvtsh_ss( half );
+#else
+  const uint32_t sign = uint32_t( half & 0x8000 ) << 16;
+  uint32_t exponent = ( half >> 10 ) & 0x1F;
+  uint32_t mantissa = half & 0x03FF;
+  if ( exponent == 0x1F ) {
+    return bitsToFloat( sign | 0x7F800000 | ( mantissa << 13 ) );
+  }
+  if ( exponent == 0 ) {
+    if ( mantissa == 0 ) {
+      return bitsToFloat( sign );
+    }
+    // Subnormal, normalize the mantissa
+    exponent = 113;
+    while ( !( mantissa & 0x0400 ) ) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    return bitsToFloat( sign | ( exponent << 23 ) | ( ( mantissa & 0x03FF ) << 13 ) );
+  }
+  return bitsToFloat( sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 ) );
+#endif
+}
+
+inline uint16_t floatToBFloat16( float value ) {
+  const uint32_t f = floatBits( value );
+  if ( ( f & 0x7FFFFFFF ) > 0x7F800000 ) {
+    // NaN, which is kept quiet
+    return ( f >> 16 ) | 0x0040;
+  }
+  return ( f + 0x7FFF + ( ( f >> 16 ) & 1 ) ) >> 16;
+}
+
+inline float bfloat16ToFloat( uint16_t value ) {
+  return bitsToFloat( uint32_t( value ) << 16 );
+}
+
+/* Convert n values */
+inline void floatToFloat16( const float *in, uint16_t *out, std::size_t n ) {
+  std::size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+  for ( ; i + 8 <= n; i += 8 ) {
+    const __m128i half = _mm256_cvtps_ph( _mm256_loadu_ps( in + i ), _MM_FROUND_TO_NEAREST_INT );
+    _mm_storeu_si128( reinterpret_cast< __m128i * >( out + i ), half );
+  }
+#endif
+  for ( ; i < n; ++i ) {
+    out[i] = floatToFloat16( in[i] );
+  }
+}
+
+inline void float16ToFloat( const uint16_t *in, float *out, std::size_t n ) {
+  std::size_t i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+  for ( ; i + 8 <= n; i += 8 ) {
+    const __m128i half = _mm_loadu_si128( reinterpret_cast< const __m128i * >( in + i ) );
+    _mm256_storeu_ps( out + i, _mm256_cvtph_ps( half ) );
+  }
+#endif
+  for ( ; i < n; ++i ) {
+    out[i] = float16ToFloat( in[i] );
+  }
+}
+
+
+/* Conversion to and from the format chosen at run time */
+class HalfPrecisionCodec {
+public:
+  explicit HalfPrecisionCodec( HalfPrecisionFormat format = Float16Format )
+    : m_Format( format )
+  {}
+
+  HalfPrecisionFormat getFormat() const {
+    return m_Format;
+  }
+
+  uint16_t encode( float value ) const {
+    return m_Format == Float16Format ? floatToFloat16( value ) : floatToBFloat16( value );
+  }
+
+  float decode( uint16_t value ) const {
+    return m_Format == Float16Format ? float16ToFloat( value ) : bfloat16ToFloat( value );
+  }
+
+  void encode( const float *in, uint16_t *out, std::size_t n ) const {
+    if ( m_Format == Float16Format ) {
+      floatToFloat16( in, out, n );
+    }
+    else {
+      for ( std::size_t i = 0; i < n; ++i ) {
+	out[i] = floatToBFloat16( in[i] );
+      }
+    }
+  }
+
+  void decode( const uint16_t *in, float *out, std::size_t n ) const {
+    if ( m_Format == Float16Format ) {
+      float16ToFloat( in, out, n );
+    }
+    else {
+      for ( std::size_t i = 0; i < n; ++i ) {
+	out[i] = bfloat16ToFloat( in[i] );
+      }
+    }
+  }
+
+  /* The next larger and smaller value. Both formats are sign and magnitude,
+     so the magnitude steps by one. Infinities are kept. */
+  uint16_t nextUp( uint16_t value ) const {
+    if ( value == 0x8000 ) {
+      return 0x0001;
+    }
+    if ( value & 0x8000 ) {
+      return value - 1;
+    }
+    return value == getInfinity() ? value : value + 1;
+  }
+
+  uint16_t nextDown( uint16_t value ) const {
+    if ( value == 0x0000 ) {
+      return 0x8001;
+    }
+    if ( value & 0x8000 ) {
+      return value == ( 0x8000 | getInfinity() ) ? value : value + 1;
+    }
+    return value - 1;
+  }
+
+  /* The bits of positive infinity */
+  uint16_t getInfinity() const {
+    return m_Format == Float16Format ? 0x7C00 : 0x7F80;
+  }
+
+  /* Name of the format, as used on the command line and in file headers */
+  static const char* getFormatName( HalfPrecisionFormat format ) {
+    return format == Float16Format ? "float16" : "bfloat16";
+  }
+
+private:
+  HalfPrecisionFormat m_Format;
+};
+
+
+/* Encode values such that the decoded value is in the same bin of a
+   histogram with the given edges as the value, see DenseHistogram.h for the
+   bins. The nearest 16 bit value is used when it is in the bin, otherwise
+   the nearest value on the other side of the value. When the bin is so
+   narrow that neither is in it the nearest value is used, and the value is
+   counted as not preserved. This happens only for bins without a 16 bit
+   value, so the bins of all values are kept when preservesAllBins().
+ */
+template< typename TRealType >
+class BinPreservingEncoder {
+public:
+  typedef TRealType RealType;
+
+  template< typename InputIt >
+  BinPreservingEncoder( const HalfPrecisionCodec& codec, InputIt begin, InputIt end )
+    : m_Codec( codec ), m_Edges( begin, end ), m_NumberOfNotPreserved( 0 )
+  {
+    assert( std::is_sorted( m_Edges.begin(), m_Edges.end() ) );
+  }
+
+  uint16_t encode( RealType value ) {
+    const uint16_t nearest = m_Codec.encode( value );
+    const std::size_t bin = getBin( value );
+    const RealType decoded = m_Codec.decode( nearest );
+    if ( getBin( decoded ) == bin || decoded != decoded ) {
+      return nearest;
+    }
+    const uint16_t other = decoded > value
+      ? m_Codec.nextDown( nearest )
+      : m_Codec.nextUp( nearest );
+    if ( getBin( m_Codec.decode( other ) ) == bin ) {
+      return other;
+    }
+    ++m_NumberOfNotPreserved;
+    return nearest;
+  }
+
+  float decode( uint16_t value ) const {
+    return m_Codec.decode( value );
+  }
+
+  /* The bin that value is counted in */
+  std::size_t getBin( RealType value ) const {
+    return std::lower_bound( m_Edges.begin(), m_Edges.end(), value ) - m_Edges.begin();
+  }
+
+  /* True if there is a 16 bit value in bin. The first and the last bin
+     have the infinities, and an empty bin has nothing to preserve. */
+  bool hasValueInBin( std::size_t bin ) const {
+    assert( bin <= m_Edges.size() );
+    if ( bin == 0 || bin == m_Edges.size() || !( m_Edges[bin - 1] < m_Edges[bin] ) ) {
+      return true;
+    }
+    // The largest 16 bit value that is not above the upper edge
+    uint16_t value = m_Codec.encode( m_Edges[bin] );
+    if ( m_Codec.decode( value ) > m_Edges[bin] ) {
+      value = m_Codec.nextDown( value );
+    }
+    return m_Codec.decode( value ) > m_Edges[bin - 1];
+  }
+
+  /* True if every value is encoded in its bin */
+  bool preservesAllBins() const {
+    for ( std::size_t bin = 0; bin <= m_Edges.size(); ++bin ) {
+      if ( !hasValueInBin( bin ) ) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  /* Number of values that were encoded in another bin */
+  std::size_t getNumberOfNotPreserved() const {
+    return m_NumberOfNotPreserved;
+  }
+
+private:
+  HalfPrecisionCodec m_Codec;
+  std::vector< RealType > m_Edges;
+  std::size_t m_NumberOfNotPreserved;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef __IteratedBoxFilter_h
+#define __IteratedBoxFilter_h
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+/* Approximation of convolution with a Gaussian along a line by iterated box
+   filters. Each box is a running sum, so the cost per sample does not depend
+   on sigma.
+
+   The boxes are the extended boxes of
+     Gwosdek et al. Theoretical Foundations of Gaussian Convolution by
+     Extended Box Filtering. SSVM 2011.
+   An extended box of radius r has weight 1 for |j| <= r and a fractional
+   weight alpha for |j| = r+1, which lets the variance of the boxes match
+   sigma^2 exactly instead of only for the discrete widths of plain boxes.
+
+   The boxes only approximate the shape of the Gaussian. The maximum
+   deviation of a filtered unit step from the exact Gaussian, relative to the
+   step height, for sigma between 2 and 16 samples is
+     3 boxes: 1.0%,  4 boxes: 0.74%,  5 boxes: 0.57%
+   and from the recursive Gaussian, see RecursiveGaussian.h,
+     3 boxes: 1.1%,  4 boxes: 0.86%,  5 boxes: 0.67%
+   Below 2 samples the boxes are only a few samples wide and the deviation
+   grows, to 2% at sigma 1 with 4 boxes. The filter is meant for large sigma.
+
+   The interface is the same as RecursiveGaussian. The line is given as
+   NChannels interleaved channels, such that
+     data[i*NChannels + c]
+   is sample i of channel c, and all channels are filtered together. The line
+   is extended with the edge values, like the recursive Gaussian.
+
+   Sigma is given in samples.
+ */
+template< typename TRealType >
+class IteratedBoxFilter {
+public:
+  typedef TRealType RealType;
+
+  explicit IteratedBoxFilter( RealType sigma, unsigned int iterations = 3 )
+    : m_Iterations( iterations ) {
+    assert( sigma > 0 );
+    assert( iterations > 0 );
+    // Each box has variance sigma^2 / iterations. The largest plain box with
+    // at most that variance has radius r, and alpha makes up the rest.
+    const RealType variance = sigma * sigma / iterations;
+    m_Radius = std::floor( 0.5 * std::sqrt( 12 * variance + 1 ) - 0.5 );
+    const RealType r = m_Radius;
+    m_Alpha = ( 2*r + 1 ) * ( r * ( r + 1 ) - 3 * variance )
+      / ( 6 * ( variance - ( r + 1 ) * ( r + 1 ) ) );
+    m_Scale = 1 / ( 2*r + 1 + 2*m_Alpha );
+  }
+
+  /* The sigma of the iterated boxes */
+  RealType getSigma() const {
+    const RealType r = m_Radius;
+    const RealType variance =
+      ( ( 2*r + 1 ) * r * ( r + 1 ) / 3 + 2 * m_Alpha * ( r + 1 ) * ( r + 1 ) ) * m_Scale;
+    return std::sqrt( m_Iterations * variance );
+  }
+
+  /* Filter the n samples in data and store the result in out.
+     scratch must have room for n*NChannels values. out can not be data. */
+  template< unsigned int NChannels >
+  void filter( const RealType *data, RealType *out,
+	       RealType *scratch, std::size_t n ) const {
+    // Alternate between out and scratch so the last box writes to out
+    const std::size_t k = m_Iterations;
+    const RealType *source = data;
+    for ( std::size_t i = 0; i < k; ++i ) {
+      RealType *destination = ( k - 1 - i ) % 2 == 0 ? out : scratch;
+      box< NChannels >( source, destination, n );
+      source = destination;
+    }
+  }
+
+private:
+  /* One extended box */
+  template< unsigned int NChannels >
+  void box( const RealType *source, RealType *destination,
+	    std::size_t n ) const {
+    const std::ptrdiff_t C = NChannels;
+    const std::ptrdiff_t last = n - 1;
+    const std::ptrdiff_t r = m_Radius;
+
+    // The sum of the window at sample 0, where the first sample is repeated
+    RealType sum[NChannels];
+    for ( std::ptrdiff_t c = 0; c < C; ++c ) {
+      sum[c] = 0;
+    }
+    for ( std::ptrdiff_t j = -r; j <= r; ++j ) {
+      const RealType *s = source + std::min( std::max< std::ptrdiff_t >( j, 0 ), last ) * C;
+      for ( std::ptrdiff_t c = 0; c < C; ++c ) {
+	sum[c] += s[c];
+      }
+    }
+
+    // Move the window one sample at a time. The samples just outside the
+    // window have weight alpha, and the one after the window enters it.
+    for ( std::ptrdiff_t i = 0; i <= last; ++i ) {
+      const RealType *before = source + std::max< std::ptrdiff_t >( i - r - 1, 0 ) * C;
+      const RealType *after = source + std::min( i + r + 1, last ) * C;
+      const RealType *leave = source + std::max< std::ptrdiff_t >( i - r, 0 ) * C;
+      RealType *d = destination + i * C;
+      for ( std::ptrdiff_t c = 0; c < C; ++c ) {
+	d[c] = ( sum[c] + m_Alpha * ( before[c] + after[c] ) ) * m_Scale;
+	sum[c] += after[c] - leave[c];
+      }
+    }
+  }
+
+  unsigned int m_Iterations;
+  std::ptrdiff_t m_Radius;
+  RealType m_Alpha;
+  RealType m_Scale;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef __RecursiveGaussian_h
+#define __RecursiveGaussian_h
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+/* Recursive approximation of convolution with a Gaussian along a line.
+   This is the 4th order Deriche filter with the same coefficients and the
+   same boundary handling as itk::RecursiveGaussianImageFilter, so the result
+   of filtering along each direction matches
+   itk::SmoothingRecursiveGaussianImageFilter up to floating point rounding.
+
+   The line is given as NChannels interleaved channels, such that
+     data[i*NChannels + c]
+   is sample i of channel c. All channels are filtered in the same recursion,
+   which is how several images can be smoothed with one pass over memory.
+
+   The order selects convolution with the Gaussian (0), its first derivative
+   (1) or its second derivative (2). The derivatives are per sample, so they
+   must be divided by spacing^order to get physical units.
+
+   Sigma is given in samples. Lines must have at least 4 samples.
+ */
+template< typename TRealType >
+class RecursiveGaussian {
+public:
+  typedef TRealType RealType;
+
+  explicit RecursiveGaussian( RealType sigma, unsigned int order = 0 ) {
+    assert( sigma > 0 );
+    assert( order <= 2 );
+    // Parameters of the exponential series
+    const RealType W1 = 0.6681;
+    const RealType L1 = -1.3932;
+    const RealType W2 = 2.0787;
+    const RealType L2 = -1.3732;
+
+    // Weights of the series for the Gaussian and its derivatives
+    const RealType A1[3] = {  1.3530, -0.6724, -1.3563 };
+    const RealType B1[3] = {  1.8151, -3.4327,  5.2318 };
+    const RealType A2[3] = { -0.3531,  0.6724,  0.3446 };
+    const RealType B2[3] = {  0.0902,  0.6100, -2.2355 };
+
+    const RealType cos1 = std::cos( W1 / sigma );
+    const RealType cos2 = std::cos( W2 / sigma );
+    const RealType exp1 = std::exp( L1 / sigma );
+    const RealType exp2 = std::exp( L2 / sigma );
+
+    m_D4 = exp1 * exp1 * exp2 * exp2;
+    m_D3 = -2 * cos1 * exp1 * exp2 * exp2 - 2 * cos2 * exp2 * exp1 * exp1;
+    m_D2 = 4 * cos2 * cos1 * exp1 * exp2 + exp1 * exp1 + exp2 * exp2;
+    m_D1 = -2 * ( exp2 * cos2 + exp1 * cos1 );
+    const RealType SD = 1 + m_D1 + m_D2 + m_D3 + m_D4;
+    const RealType DD = m_D1 + 2 * m_D2 + 3 * m_D3 + 4 * m_D4;
+    const RealType ED = m_D1 + 4 * m_D2 + 9 * m_D3 + 16 * m_D4;
+
+    RealType N[4], SN, DN, EN;
+    RealType alpha;
+    bool symmetric = true;
+    switch ( order ) {
+    case 0:
+      // Normalize so the filter has unit gain
+      numerator( sigma, A1[0], B1[0], A2[0], B2[0], N, SN, DN, EN );
+      alpha = 2 * SN / SD - N[0];
+      break;
+    case 1:
+      // Normalize so the response to a unit ramp is 1
+      numerator( sigma, A1[1], B1[1], A2[1], B2[1], N, SN, DN, EN );
+      alpha = 2 * ( SN * DD - DN * SD ) / ( SD * SD );
+      symmetric = false;
+      break;
+    default: {
+      // Combine with the Gaussian so the response to a constant is 0, and
+      // normalize so the response to a unit parabola is 1
+      RealType N0[4], SN0, DN0, EN0;
+      numerator( sigma, A1[0], B1[0], A2[0], B2[0], N0, SN0, DN0, EN0 );
+      numerator( sigma, A1[2], B1[2], A2[2], B2[2], N, SN, DN, EN );
+      const RealType beta = -( 2 * SN - SD * N[0] ) / ( 2 * SN0 - SD * N0[0] );
+      for ( unsigned int i = 0; i < 4; ++i ) {
+	N[i] += beta * N0[i];
+      }
+      SN += beta * SN0;
+      DN += beta * DN0;
+      EN += beta * EN0;
+      alpha = ( EN * SD * SD - ED * SN * SD - 2 * DN * DD * SD + 2 * DD * DD * SN )
+	/ ( SD * SD * SD );
+    }
+    }
+    m_N0 = N[0] / alpha;
+    m_N1 = N[1] / alpha;
+    m_N2 = N[2] / alpha;
+    m_N3 = N[3] / alpha;
+
+    // The anti causal coefficients of a symmetric or anti symmetric filter
+    const RealType sign = symmetric ? 1 : -1;
+    m_M1 = sign * ( m_N1 - m_D1 * m_N0 );
+    m_M2 = sign * ( m_N2 - m_D2 * m_N0 );
+    m_M3 = sign * ( m_N3 - m_D3 * m_N0 );
+    m_M4 = -sign * m_D4 * m_N0;
+
+    // Boundary coefficients, that extend the line with the edge values
+    SN = m_N0 + m_N1 + m_N2 + m_N3;
+    const RealType SM = m_M1 + m_M2 + m_M3 + m_M4;
+    m_BN1 = m_D1 * SN / SD;
+    m_BN2 = m_D2 * SN / SD;
+    m_BN3 = m_D3 * SN / SD;
+    m_BN4 = m_D4 * SN / SD;
+    m_BM1 = m_D1 * SM / SD;
+    m_BM2 = m_D2 * SM / SD;
+    m_BM3 = m_D3 * SM / SD;
+    m_BM4 = m_D4 * SM / SD;
+  }
+
+  /* Filter the n samples in data and store the result in out.
+     scratch must have room for n*NChannels values. out can not be data. */
+  template< unsigned int NChannels >
+  void filter( const RealType *data, RealType *out,
+	       RealType *scratch, std::size_t n ) const {
+    assert( n >= 4 );
+    const std::ptrdiff_t C = NChannels;
+
+    // Causal direction. The first sample is assumed to extend to infinity.
+    for ( std::ptrdiff_t c = 0; c < C; ++c ) {
+      const RealType v = data[c];
+      const RealType *x = data + c;
+      RealType *y = scratch + c;
+      y[0]   = v*m_N0 + v*m_N1 + v*m_N2 + v*m_N3;
+      y[C]   = x[C]*m_N0 + v*m_N1 + v*m_N2 + v*m_N3;
+      y[2*C] = x[2*C]*m_N0 + x[C]*m_N1 + v*m_N2 + v*m_N3;
+      y[3*C] = x[3*C]*m_N0 + x[2*C]*m_N1 + x[C]*m_N2 + v*m_N3;
+
+      y[0]   -= v*m_BN1 + v*m_BN2 + v*m_BN3 + v*m_BN4;
+      y[C]   -= y[0]*m_D1 + v*m_BN2 + v*m_BN3 + v*m_BN4;
+      y[2*C] -= y[C]*m_D1 + y[0]*m_D2 + v*m_BN3 + v*m_BN4;
+      y[3*C] -= y[2*C]*m_D1 + y[C]*m_D2 + y[0]*m_D3 + v*m_BN4;
+    }
+    for ( std::size_t i = 4*NChannels; i < n*NChannels; ++i ) {
+      scratch[i] =
+	data[i]*m_N0 + data[i-C]*m_N1 + data[i-2*C]*m_N2 + data[i-3*C]*m_N3
+	- ( scratch[i-C]*m_D1 + scratch[i-2*C]*m_D2 + scratch[i-3*C]*m_D3 + scratch[i-4*C]*m_D4 );
+    }
+    for ( std::size_t i = 0; i < n*NChannels; ++i ) {
+      out[i] = scratch[i];
+    }
+
+    // Anti causal direction. The last sample is assumed to extend to infinity.
+    const std::size_t last = (n - 1) * NChannels;
+    for ( std::ptrdiff_t c = 0; c < C; ++c ) {
+      const RealType v = data[last + c];
+      const RealType *x = data + last + c;
+      RealType *y = scratch + last + c;
+      y[0]      = v*m_M1 + v*m_M2 + v*m_M3 + v*m_M4;
+      y[-C]     = x[0]*m_M1 + v*m_M2 + v*m_M3 + v*m_M4;
+      y[-2*C]   = x[-C]*m_M1 + x[0]*m_M2 + v*m_M3 + v*m_M4;
+      y[-3*C]   = x[-2*C]*m_M1 + x[-C]*m_M2 + x[0]*m_M3 + v*m_M4;
+
+      y[0]    -= v*m_BM1 + v*m_BM2 + v*m_BM3 + v*m_BM4;
+      y[-C]   -= y[0]*m_D1 + v*m_BM2 + v*m_BM3 + v*m_BM4;
+      y[-2*C] -= y[-C]*m_D1 + y[0]*m_D2 + v*m_BM3 + v*m_BM4;
+      y[-3*C] -= y[-2*C]*m_D1 + y[-C]*m_D2 + y[0]*m_D3 + v*m_BM4;
+    }
+    for ( std::size_t i = (n - 4) * NChannels; i > 0; --i ) {
+      const std::size_t j = i - 1;
+      scratch[j] =
+	data[j+C]*m_M1 + data[j+2*C]*m_M2 + data[j+3*C]*m_M3 + data[j+4*C]*m_M4
+	- ( scratch[j+C]*m_D1 + scratch[j+2*C]*m_D2 + scratch[j+3*C]*m_D3 + scratch[j+4*C]*m_D4 );
+    }
+    for ( std::size_t i = 0; i < n*NChannels; ++i ) {
+      out[i] += scratch[i];
+    }
+  }
+
+private:
+  /* Causal coefficients for the series with weights A1, B1, A2, B2, and
+     their sum, first and second moment */
+  static void numerator( RealType sigma,
+			 RealType A1, RealType B1, RealType A2, RealType B2,
+			 RealType N[4], RealType& SN, RealType& DN, RealType& EN ) {
+    const RealType W1 = 0.6681;
+    const RealType L1 = -1.3932;
+    const RealType W2 = 2.0787;
+    const RealType L2 = -1.3732;
+    const RealType sin1 = std::sin( W1 / sigma );
+    const RealType sin2 = std::sin( W2 / sigma );
+    const RealType cos1 = std::cos( W1 / sigma );
+    const RealType cos2 = std::cos( W2 / sigma );
+    const RealType exp1 = std::exp( L1 / sigma );
+    const RealType exp2 = std::exp( L2 / sigma );
+
+    N[0] = A1 + A2;
+    N[1] = exp2 * ( B2 * sin2 - ( A2 + 2 * A1 ) * cos2 )
+      + exp1 * ( B1 * sin1 - ( A1 + 2 * A2 ) * cos1 );
+    N[2] = 2 * exp1 * exp2 * ( ( A1 + A2 ) * cos2 * cos1
+			       - B1 * cos2 * sin1 - B2 * cos1 * sin2 )
+      + A2 * exp1 * exp1 + A1 * exp2 * exp2;
+    N[3] = exp2 * exp1 * exp1 * ( B2 * sin2 - A2 * cos2 )
+      + exp1 * exp2 * exp2 * ( B1 * sin1 - A1 * cos1 );
+    SN = N[0] + N[1] + N[2] + N[3];
+    DN = N[1] + 2 * N[2] + 3 * N[3];
+    EN = N[1] + 4 * N[2] + 9 * N[3];
+  }
+
+  RealType m_N0, m_N1, m_N2, m_N3;
+  RealType m_D1, m_D2, m_D3, m_D4;
+  RealType m_M1, m_M2, m_M3, m_M4;
+  RealType m_BN1, m_BN2, m_BN3, m_BN4;
+  RealType m_BM1, m_BM2, m_BM3, m_BM4;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __Symmetric3x3EigenvalueBatchSolver_h
+#define __Symmetric3x3EigenvalueBatchSolver_h
+
+#include <cstddef>
+
+#include "Symmetric3x3EigenvalueSolver.h"
+
+/* Calculates eigenvalues of many 3x3 symmetric matrices at once.
+   The matrices are given as a structure of arrays, A[0] points to n values of
+   A11, A[1] to n values of A12 and so on in the order
+     {A11, A12, A13, A22, A23, A33}
+   The eigenvalues are written to eigenvalues[0..2], each with room for n
+   values, such that |eig3| <= |eig2| <= |eig1|.
+
+   The generic version calls Symmetric3x3EigenvalueSolver for each matrix.
+   For float there is a branch free version that is compiled for SSE2, AVX2
+   and AVX-512, so 4, 8 or 16 matrices are solved per instruction. The
+   instruction set is selected at runtime from what the CPU supports.
+
+   The float version uses polynomial approximations of acos and cos. Each
+   eigenvalue is within 5e-4 * ||A||_F of the eigenvalue calculated by
+   Symmetric3x3EigenvalueSolver<float>. Both are within 5e-4 * ||A||_F of the
+   exact eigenvalues, the error comes from the float precision of the
+   trigonometric formulation, not the approximations. The error is largest
+   when two eigenvalues are close, e.g. for nearly diagonal matrices with two
+   equal diagonal entries. Then det(B)/2 is near +-1 and acos amplifies its
+   rounding to about sqrt(float epsilon) = 3.5e-4; we have measured up to
+   2.5e-4 * ||A||_F. When the eigenvalues are well separated the error is
+   below 1e-5 * ||A||_F. Eigenvalues that are equal in magnitude, but not in
+   sign, can be returned in a different order. The result does not depend on
+   the selected instruction set.
+ */
+template< typename TRealType >
+struct Symmetric3x3EigenvalueBatchSolver {
+  typedef TRealType RealType;
+  typedef Symmetric3x3EigenvalueSolver< RealType > SolverType;
+
+  static void compute( const RealType * const A[6],
+		       RealType * const eigenvalues[3],
+		       std::size_t n ) {
+    for ( std::size_t i = 0; i < n; ++i ) {
+      RealType a[6] = { A[0][i], A[1][i], A[2][i], A[3][i], A[4][i], A[5][i] };
+      RealType e[3];
+      SolverType::compute( a, e );
+      eigenvalues[0][i] = e[0];
+      eigenvalues[1][i] = e[1];
+      eigenvalues[2][i] = e[2];
+    }
+  }
+
+  // The instruction set used by compute
+  static const char* instructionSet() {
+    return "scalar";
+  }
+};
+
+template<>
+void
+Symmetric3x3EigenvalueBatchSolver< float >
+::compute( const float * const A[6], float * const eigenvalues[3], std::size_t n );
+
+template<>
+const char*
+Symmetric3x3EigenvalueBatchSolver< float >
+::instructionSet();
+
+#endif
@@ -2,11 +2,20 @@
 #define __Symmetric3x3EigenvalueSolver_h
 
 #include "itkVariableLengthVector.h"
+#include <array>
 #include <cmath>
+#include <utility>
 
-/* Calculates eigenvalues of 3x3 symmetric matrix. 
+/* Calculates eigenvalues of 3x3 symmetric matrix.
    source: https://en.wikipedia.org/wiki/Eigenvalue_algorithm#3.C3.973_matrices
    Returns them in order such that |eig3| <= |eig2| <= |eig1|
+
+   The matrix is given by the upper triangle in row major order
+     {A11, A12, A13, A22, A23, A33}
+
+   The work is done by the static compute functions, that work on fixed size
+   arrays and do not allocate. operator() is a convenience for use as a functor
+   with itk::VariableLengthVector, which allocates the returned vector.
  */
 template< typename TRealType >
 struct Symmetric3x3EigenvalueSolver {
@@ -14,6 +23,9 @@ struct Symmetric3x3EigenvalueSolver {
   typedef itk::VariableLengthVector<RealType> InputType;
   typedef itk::VariableLengthVector<RealType> OutputType;
 
+  typedef std::array< RealType, 6 > FixedInputType;
+  typedef std::array< RealType, 3 > FixedOutputType;
+
   Symmetric3x3EigenvalueSolver(){}
   ~Symmetric3x3EigenvalueSolver(){};
 
@@ -29,19 +41,30 @@ struct Symmetric3x3EigenvalueSolver {
   bool operator==( const Symmetric3x3EigenvalueSolver& other ) const {
     return !(*this != other);
   }
-  
+
   inline OutputType operator()(const InputType &A) const {
     assert(A.Size() == 6);
     OutputType eigenvalues(3);
-  
+    compute( A.GetDataPointer(), eigenvalues.GetDataPointer() );
+    return eigenvalues;
+  }
+
+  static inline FixedOutputType compute( const FixedInputType &A ) {
+    FixedOutputType eigenvalues;
+    compute( A.data(), eigenvalues.data() );
+    return eigenvalues;
+  }
+
+  // A must point to 6 values and eigenvalues to room for 3 values
+  static inline void compute( const RealType *A, RealType *eigenvalues ) {
     RealType A11 = A[0];
     RealType A12 = A[1]; // = A21
     RealType A13 = A[2]; // = A31
-    RealType A22 = A[3]; 
+    RealType A22 = A[3];
     RealType A23 = A[4]; // = A32
     RealType A33 = A[5];
 
-    RealType p = A12*A12 + A13*A13 + A23*A23; 
+    RealType p = A12*A12 + A13*A13 + A23*A23;
     if (p == 0) {
       // A is diagonal.
       if ( std::abs(A11) > std::abs(A22) ) {
@@ -114,7 +137,7 @@ struct Symmetric3x3EigenvalueSolver {
       else {
 	phi = acos(r) / 3;
       }
-    
+
       // The eigenvalues satisfy eig3 <= eig2 <= eig1
       eigenvalues[0] = q + 2 * p * cos(phi);
       eigenvalues[2] = q + 2 * p * cos(phi + M_PI * (2.0/3.0));
@@ -128,7 +151,6 @@ struct Symmetric3x3EigenvalueSolver {
 	std::swap( eigenvalues[1], eigenvalues[2] );
       }
     }
-    return eigenvalues;
   }
 };
 
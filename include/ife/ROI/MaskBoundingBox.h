@@ -0,0 +1,119 @@
+#ifndef __MaskBoundingBox_h
+#define __MaskBoundingBox_h
+
+/*
+  Restrict the feature computation to the part of the image that is needed.
+
+  The features of a voxel only depend on the voxels within a few sigma, so
+  when the lungs only fill part of the field of view the image and mask can be
+  cropped to the bounding box of the mask padded by a Gaussian halo before the
+  features are calculated.
+
+  The regions are in the index space of the mask, so cropping with
+  ExtractImageFilter, which keeps the index of the extracted region, lets ROIs
+  and output coordinates be used unchanged.
+ */
+#include <algorithm>
+#include <cmath>
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+namespace itk {
+
+  /** The smallest region containing all non-zero voxels in the buffered region
+      of mask. The size is zero if the mask is empty. */
+  template< typename TMask >
+  typename TMask::RegionType
+  maskBoundingBox( const TMask* mask ) {
+    typedef typename TMask::RegionType RegionType;
+    typedef typename TMask::IndexType IndexType;
+    typedef typename TMask::SizeType SizeType;
+    const unsigned int Dimension = TMask::ImageDimension;
+
+    IndexType lower, upper;
+    bool empty = true;
+    ImageRegionConstIteratorWithIndex< TMask >
+      iter( mask, mask->GetBufferedRegion() );
+    for ( iter.GoToBegin(); !iter.IsAtEnd(); ++iter ) {
+      if ( iter.Get() ) {
+	const IndexType index = iter.GetIndex();
+	if ( empty ) {
+	  lower = upper = index;
+	  empty = false;
+	}
+	for ( unsigned int d = 0; d < Dimension; ++d ) {
+	  lower[d] = std::min( lower[d], index[d] );
+	  upper[d] = std::max( upper[d], index[d] );
+	}
+      }
+    }
+
+    RegionType region;
+    if ( empty ) {
+      region.SetIndex( mask->GetBufferedRegion().GetIndex() );
+      SizeType size;
+      size.Fill( 0 );
+      region.SetSize( size );
+      return region;
+    }
+    SizeType size;
+    for ( unsigned int d = 0; d < Dimension; ++d ) {
+      size[d] = upper[d] - lower[d] + 1;
+    }
+    region.SetIndex( lower );
+    region.SetSize( size );
+    return region;
+  }
+
+  /** The bounding box of the mask padded by the support of a Gaussian with
+      scale sigma in physical units, that is 4*sigma plus one voxel for the
+      derivative stencil, and cropped to the largest possible region. */
+  template< typename TMask >
+  typename TMask::RegionType
+  maskSupportRegion( const TMask* mask, double sigma ) {
+    typedef typename TMask::RegionType RegionType;
+    typedef typename TMask::SizeType SizeType;
+    const unsigned int Dimension = TMask::ImageDimension;
+
+    RegionType region = maskBoundingBox( mask );
+    if ( region.GetNumberOfPixels() == 0 ) {
+      return region;
+    }
+    SizeType radius;
+    for ( unsigned int d = 0; d < Dimension; ++d ) {
+      radius[d] = std::ceil( 4 * sigma / mask->GetSpacing()[d] ) + 1;
+    }
+    region.PadByRadius( radius );
+    region.Crop( mask->GetLargestPossibleRegion() );
+    return region;
+  }
+
+  /** The smallest region containing both a and b */
+  template< typename TRegion >
+  TRegion
+  regionUnion( const TRegion& a, const TRegion& b ) {
+    typedef typename TRegion::IndexType IndexType;
+    typedef typename TRegion::SizeType SizeType;
+    const unsigned int Dimension = TRegion::ImageDimension;
+
+    if ( a.GetNumberOfPixels() == 0 ) {
+      return b;
+    }
+    if ( b.GetNumberOfPixels() == 0 ) {
+      return a;
+    }
+    IndexType index;
+    SizeType size;
+    for ( unsigned int d = 0; d < Dimension; ++d ) {
+      index[d] = std::min( a.GetIndex(d), b.GetIndex(d) );
+      const typename IndexType::IndexValueType end =
+	std::max( a.GetIndex(d) + static_cast< typename IndexType::IndexValueType >( a.GetSize(d) ),
+		  b.GetIndex(d) + static_cast< typename IndexType::IndexValueType >( b.GetSize(d) ) );
+      size[d] = end - index[d];
+    }
+    return TRegion( index, size );
+  }
+
+} // end namespace itk
+
+#endif
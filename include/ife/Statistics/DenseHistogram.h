@@ -2,12 +2,14 @@
 #define __DenseHistogram_h
 
 #include <algorithm>
+#include <cassert>
 #include <numeric>
 #include <iterator>
 #include <vector>
 #include <limits>
 
 #include "ife/IO/IO.h"
+#include "ife/Statistics/EdgeIndex.h"
 
 template< typename NumType >
 class DenseHistogram {
@@ -27,7 +29,8 @@ public:
   */
   template< typename InputIt >
   DenseHistogram( InputIt begin, InputIt end )
-    : m_Edges( begin, end ), m_Counts( m_Edges.size() + 1 )
+    : m_Edges( begin, end ), m_Index( m_Edges.begin(), m_Edges.end() ),
+      m_Counts( m_Edges.size() + 1 )
   {
     assert( m_Edges.size() > 0 );
     assert( m_Counts.size() > 1 );
@@ -36,22 +39,36 @@ public:
   
   // edges should be sorted
   DenseHistogram( std::initializer_list< value_type > edges )
-    : m_Edges( edges ), m_Counts( edges.size() + 1 )
+    : m_Edges( edges ), m_Index( m_Edges.begin(), m_Edges.end() ),
+      m_Counts( edges.size() + 1 )
   {
     assert( m_Edges.size() > 0 );
     assert( m_Counts.size() > 1 );
   }
 
   // Insert value in bin such that value is greater than the left edge and
-  // less than or equal to the right edge.
+  // less than or equal to the right edge. The bin is found by EdgeIndex,
+  // which gives the same bin as std::lower_bound over the edges.
   void insert( value_type value ) {
-    auto edge = std::lower_bound(m_Edges.begin(), m_Edges.end(), value );
-    auto bin = std::distance( m_Edges.begin(), edge );
-    assert( bin >= 0 );
+    const std::size_t bin = m_Index.getBin( value );
     assert( bin < m_Counts.size() );
     ++m_Counts[bin];
   }
 
+  // Insert the n values in values, with the same bins as insert( value ).
+  // The bins are found for a block of values at a time by
+  // EdgeIndex::getBins, which is vectorized for few edges.
+  void insert( const value_type* values, std::size_t n ) {
+    unsigned int bins[BlockSize];
+    for ( std::size_t begin = 0; begin < n; begin += BlockSize ) {
+      const std::size_t m = n - begin < BlockSize ? n - begin : BlockSize;
+      m_Index.getBins( values + begin, m, bins );
+      for ( std::size_t i = 0; i < m; ++i ) {
+	++m_Counts[bins[i]];
+      }
+    }
+  }
+
   std::vector< value_type> getFrequencies() {
     std::vector< value_type > frequencies( m_Counts.size() );
     value_type sum = std::accumulate(m_Counts.begin(), m_Counts.end(), 0);
@@ -72,7 +89,11 @@ public:
   }
   
 private:
+  // Values inserted together are binned in blocks of BlockSize
+  static const std::size_t BlockSize = 256;
+
   std::vector< value_type > m_Edges;
+  EdgeIndex< value_type > m_Index;
   std::vector< unsigned int > m_Counts;
   size_type m_Center, m_High;  
 };
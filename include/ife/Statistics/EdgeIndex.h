@@ -0,0 +1,162 @@
+#ifndef __EdgeIndex_h
+#define __EdgeIndex_h
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/*
+  Find the bin of a value among sorted histogram edges without the
+  unpredictable branches of std::lower_bound.
+
+  The bins are the same as for DenseHistogram
+    (-inf, edges[0]], (edges[0], edges[1]], ..., (edges[n-1], inf)
+  so the bin of a value is the number of edges below it, which is also the
+  position std::lower_bound returns.
+
+  When the edges are uniformly spaced the bin is calculated from the value,
+  and corrected by at most one bin by comparing with the neighbouring edges,
+  so rounding and edges that are written with a few digits still give
+  exactly the bin of lower_bound. The edges count as uniform when each
+  differs by at most a quarter of the spacing from the uniform edges.
+
+  Otherwise the edges are searched in Eytzinger order, where the children
+  of element k are 2k and 2k+1, so the first levels share a few cache lines.
+  The tree is padded with infinity to a perfect tree, so every search takes
+  the same number of steps, each step is a comparison added to the index,
+  and the leaf reached is the number of edges below the value.
+
+  Many values are binned together by getBins, which with few edges counts
+  the edges below each value without branches, so the loops are vectorized.
+ */
+template< typename TReal >
+class EdgeIndex {
+public:
+  typedef TReal value_type;
+
+  template< typename InputIt >
+  EdgeIndex( InputIt begin, InputIt end )
+    : m_Edges( begin, end ),
+      m_Uniform( false ), m_First( 0 ), m_Width( 0 ), m_InverseWidth( 0 ),
+      m_Height( 0 )
+  {
+    assert( std::is_sorted( m_Edges.begin(), m_Edges.end() ) );
+    const std::size_t n = m_Edges.size();
+
+    // Uniform edges need at least two edges, a positive spacing and NaN for
+    // the ends of m_Bounded
+    if ( std::numeric_limits< value_type >::has_quiet_NaN &&
+	 n >= 2 && m_Edges.back() > m_Edges.front() ) {
+      m_First = m_Edges.front();
+      m_Width = ( double( m_Edges.back() ) - m_First ) / ( n - 1 );
+      m_Uniform = true;
+      for ( std::size_t i = 0; i < n && m_Uniform; ++i ) {
+	m_Uniform = std::fabs( m_Edges[i] - ( m_First + i * m_Width ) ) <= 0.25 * m_Width;
+      }
+      m_InverseWidth = 1 / m_Width;
+      const value_type nan = std::numeric_limits< value_type >::quiet_NaN();
+      m_Bounded.assign( 1, nan );
+      m_Bounded.insert( m_Bounded.end(), m_Edges.begin(), m_Edges.end() );
+      m_Bounded.push_back( nan );
+    }
+
+    // The smallest perfect tree that holds the edges
+    while ( ( std::size_t( 1 ) << m_Height ) - 1 < n ) {
+      ++m_Height;
+    }
+    const std::size_t size = ( std::size_t( 1 ) << m_Height ) - 1;
+    const value_type padding = std::numeric_limits< value_type >::has_infinity
+      ? std::numeric_limits< value_type >::infinity()
+      : std::numeric_limits< value_type >::max();
+    std::vector< value_type > padded( m_Edges );
+    padded.resize( size, padding );
+    m_Tree.resize( size + 1 );
+    std::size_t i = 0;
+    buildTree( padded, i, 1 );
+  }
+
+  /* The bin of value, which is the number of edges below value */
+  std::size_t getBin( value_type value ) const {
+    return m_Uniform ? getUniformBin( value ) : getSearchedBin( value );
+  }
+
+  /* The bin found by arithmetic, only valid for uniform edges */
+  std::size_t getUniformBin( value_type value ) const {
+    const std::size_t n = m_Edges.size();
+    // The value is above edge floor(t) and at most edge floor(t) + 1, up to
+    // the deviation from the uniform edges. NaN compares false and ends up
+    // in the first bin, like lower_bound.
+    const double t = ( value - m_First ) * m_InverseWidth;
+    const double c = t < n ? t : n;
+    std::size_t bin = t > 0 ? static_cast< std::size_t >( c ) + 1 : 0;
+    bin = bin < n ? bin : n;
+    // Edge i is m_Bounded[i + 1], and comparisons with the NaN at the ends
+    // are false, so the first and last bin need no checks
+    bin -= m_Bounded[bin] >= value;
+    bin += m_Bounded[bin + 1] < value;
+    return bin;
+  }
+
+  /* The bin found by searching the Eytzinger tree */
+  std::size_t getSearchedBin( value_type value ) const {
+    std::size_t k = 1;
+    for ( unsigned int level = 0; level < m_Height; ++level ) {
+      k = 2 * k + ( m_Tree[k] < value );
+    }
+    return k - ( std::size_t( 1 ) << m_Height );
+  }
+
+  /* The bins of the n values. TBin must hold the number of edges. */
+  template< typename TBin >
+  void getBins( const value_type* values, std::size_t n, TBin* bins ) const {
+    if ( m_Edges.size() > MaxEdgesForCounting ) {
+      for ( std::size_t i = 0; i < n; ++i ) {
+	bins[i] = static_cast< TBin >( getBin( values[i] ) );
+      }
+      return;
+    }
+    std::fill( bins, bins + n, 0 );
+    for ( const value_type edge : m_Edges ) {
+      for ( std::size_t i = 0; i < n; ++i ) {
+	bins[i] += edge < values[i];
+      }
+    }
+  }
+
+  bool isUniform() const {
+    return m_Uniform;
+  }
+
+  std::size_t getNumberOfEdges() const {
+    return m_Edges.size();
+  }
+
+  /* Above this number of edges getBins searches each value */
+  static const std::size_t MaxEdgesForCounting = 64;
+
+private:
+  // Fill the subtree at k with the sorted values from i, in order
+  void buildTree( const std::vector< value_type >& sorted, std::size_t& i, std::size_t k ) {
+    if ( k < m_Tree.size() ) {
+      buildTree( sorted, i, 2 * k );
+      m_Tree[k] = sorted[i++];
+      buildTree( sorted, i, 2 * k + 1 );
+    }
+  }
+
+  std::vector< value_type > m_Edges;
+
+  // Uniform edges, and the edges between two NaN
+  bool m_Uniform;
+  double m_First, m_Width, m_InverseWidth;
+  std::vector< value_type > m_Bounded;
+
+  // The padded edges in Eytzinger order from index 1
+  std::vector< value_type > m_Tree;
+  unsigned int m_Height;
+};
+
+#endif
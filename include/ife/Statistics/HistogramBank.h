@@ -0,0 +1,277 @@
+#ifndef __HistogramBank_h
+#define __HistogramBank_h
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ife/Statistics/EdgeIndex.h"
+
+/*
+  A set of histograms with the same number of bins, such as one histogram for
+  each feature of a feature vector. The bins of each histogram are the same
+  as for DenseHistogram
+    (-inf, edges[0]], (edges[0], edges[1]], ..., (edges[n-1], inf)
+
+  The counts are one matrix with a row of bins for each histogram, stored in
+  count_type, which the caller chooses such that it can hold the largest
+  count. The edges are stored both by histogram and by edge, so a feature
+  vector is binned by comparing it with one row of edges at a time, which is
+  vectorized over the histograms.
+
+  Values can also be removed, so the histograms of a window can be updated
+  as it moves, see SlidingWindowHistograms.h. count_type is unsigned, and a
+  removal adds count_type(-1), which wraps around to a decrement.
+
+  The frequencies of all histograms are written to one output row, e.g. a row
+  of a row major Eigen matrix, without allocating.
+ */
+template< typename TReal, typename TCount = uint32_t >
+class HistogramBank {
+public:
+  typedef TReal value_type;
+  typedef TCount count_type;
+
+  /* One histogram of the bank, which can be used where a DenseHistogram is
+     inserted into, e.g. by insertMaskedRegion */
+  class Histogram {
+  public:
+    typedef TReal value_type;
+
+    Histogram( HistogramBank& bank, std::size_t histogram )
+      : m_Bank( bank ), m_Histogram( histogram )
+    {}
+
+    void insert( value_type value ) {
+      m_Bank.insert( m_Histogram, value );
+    }
+
+    void insert( const value_type* values, std::size_t n ) {
+      m_Bank.insert( m_Histogram, values, n );
+    }
+
+    void remove( const value_type* values, std::size_t n ) {
+      m_Bank.remove( m_Histogram, values, n );
+    }
+
+    void insertBins( const uint8_t* bins, std::size_t n ) {
+      m_Bank.insertBins( m_Histogram, bins, n );
+    }
+
+    void removeBins( const uint8_t* bins, std::size_t n ) {
+      m_Bank.removeBins( m_Histogram, bins, n );
+    }
+
+  private:
+    HistogramBank& m_Bank;
+    std::size_t m_Histogram;
+  };
+
+  HistogramBank()
+    : m_NumberOfEdges( 0 )
+  {}
+
+  /* Add a histogram with the sorted edges in [begin, end). All histograms
+     must have the same number of edges. */
+  template< typename InputIt >
+  void addHistogram( InputIt begin, InputIt end ) {
+    const std::vector< value_type > edges( begin, end );
+    assert( edges.size() > 0 );
+    assert( m_Indexes.empty() || edges.size() == m_NumberOfEdges );
+    m_NumberOfEdges = edges.size();
+    m_Indexes.emplace_back( edges.begin(), edges.end() );
+    m_Edges.insert( m_Edges.end(), edges.begin(), edges.end() );
+    m_Counts.resize( m_Counts.size() + getNumberOfBins(), 0 );
+
+    // Edge e of histogram k is m_EdgesByEdge[e*nHistograms + k]
+    const std::size_t nHistograms = getNumberOfHistograms();
+    m_EdgesByEdge.resize( m_Edges.size() );
+    for ( std::size_t k = 0; k < nHistograms; ++k ) {
+      for ( std::size_t e = 0; e < m_NumberOfEdges; ++e ) {
+	m_EdgesByEdge[e * nHistograms + k] = m_Edges[k * m_NumberOfEdges + e];
+      }
+    }
+    m_Bins.resize( nHistograms );
+  }
+
+  std::size_t getNumberOfHistograms() const {
+    return m_Indexes.size();
+  }
+
+  /* The number of bins of each histogram */
+  std::size_t getNumberOfBins() const {
+    return m_NumberOfEdges + 1;
+  }
+
+  /* Insert values[k] in histogram k, for all histograms */
+  void insert( const value_type* values ) {
+    add( values, 1 );
+  }
+
+  /* Remove values[k] from histogram k, for all histograms */
+  void remove( const value_type* values ) {
+    add( values, count_type( -1 ) );
+  }
+
+  /* Insert value in histogram */
+  void insert( std::size_t histogram, value_type value ) {
+    assert( histogram < getNumberOfHistograms() );
+    ++m_Counts[histogram * getNumberOfBins() + m_Indexes[histogram].getBin( value )];
+  }
+
+  /* Insert the n values in histogram, see DenseHistogram::insert */
+  void insert( std::size_t histogram, const value_type* values, std::size_t n ) {
+    add( histogram, values, n, 1 );
+  }
+
+  /* Remove the n values, which must have been inserted, from histogram */
+  void remove( std::size_t histogram, const value_type* values, std::size_t n ) {
+    add( histogram, values, n, count_type( -1 ) );
+  }
+
+  /* Count the n bins of values that are already binned, e.g. by
+     quantizeFeature in BinIndexFeatures.h. Bins that are not bins of the
+     histogram, such as OutsideMaskBin, are not counted. */
+  void insertBins( std::size_t histogram, const uint8_t* bins, std::size_t n ) {
+    addBins( histogram, bins, n, 1 );
+  }
+
+  void removeBins( std::size_t histogram, const uint8_t* bins, std::size_t n ) {
+    addBins( histogram, bins, n, count_type( -1 ) );
+  }
+
+  const EdgeIndex< value_type >& getEdgeIndex( std::size_t histogram ) const {
+    assert( histogram < getNumberOfHistograms() );
+    return m_Indexes[histogram];
+  }
+
+  /* The bin of value in histogram */
+  std::size_t getBin( std::size_t histogram, value_type value ) const {
+    assert( histogram < getNumberOfHistograms() );
+    return m_Indexes[histogram].getBin( value );
+  }
+
+  Histogram getHistogram( std::size_t histogram ) {
+    assert( histogram < getNumberOfHistograms() );
+    return Histogram( *this, histogram );
+  }
+
+  /* The counts of histogram, getNumberOfBins() values */
+  const count_type* getCounts( std::size_t histogram ) const {
+    return m_Counts.data() + histogram * getNumberOfBins();
+  }
+
+  count_type getCount( std::size_t histogram, std::size_t bin ) const {
+    assert( bin < getNumberOfBins() );
+    return getCounts( histogram )[bin];
+  }
+
+  /* Write the frequencies of all histograms, histogram after histogram, to
+     out. The frequencies of a histogram without values are NaN, as for
+     DenseHistogram::getFrequencies. */
+  template< typename OutputIt >
+  OutputIt writeFrequencies( OutputIt out ) const {
+    const std::size_t nBins = getNumberOfBins();
+    for ( std::size_t k = 0; k < getNumberOfHistograms(); ++k ) {
+      out = writeFrequencies( getCounts( k ), nBins, out );
+    }
+    return out;
+  }
+
+  /* Write the frequencies of the nBins counts to out */
+  template< typename OutputIt >
+  static OutputIt writeFrequencies( const count_type* counts, std::size_t nBins, OutputIt out ) {
+    uint64_t sum = 0;
+    for ( std::size_t l = 0; l < nBins; ++l ) {
+      sum += counts[l];
+    }
+    const value_type total = static_cast< value_type >( sum );
+    for ( std::size_t l = 0; l < nBins; ++l, ++out ) {
+      *out = static_cast< value_type >( counts[l] ) / total;
+    }
+    return out;
+  }
+
+  /* Write the frequencies as writeFrequencies and reset the counts */
+  template< typename OutputIt >
+  OutputIt emitFrequencies( OutputIt out ) {
+    out = writeFrequencies( out );
+    resetCounts();
+    return out;
+  }
+
+  void resetCounts() {
+    std::fill( m_Counts.begin(), m_Counts.end(), 0 );
+  }
+
+private:
+  // Add delta to the bin of values[k] in histogram k
+  void add( const value_type* values, count_type delta ) {
+    const std::size_t nHistograms = getNumberOfHistograms();
+    const std::size_t nBins = getNumberOfBins();
+    if ( m_NumberOfEdges > EdgeIndex< value_type >::MaxEdgesForCounting ) {
+      for ( std::size_t k = 0; k < nHistograms; ++k ) {
+	m_Counts[k * nBins + m_Indexes[k].getBin( values[k] )] += delta;
+      }
+      return;
+    }
+    // The bin of values[k] is the number of edges of histogram k below it
+    unsigned int *bins = m_Bins.data();
+    std::fill( bins, bins + nHistograms, 0 );
+    const value_type *edges = m_EdgesByEdge.data();
+    for ( std::size_t e = 0; e < m_NumberOfEdges; ++e, edges += nHistograms ) {
+      for ( std::size_t k = 0; k < nHistograms; ++k ) {
+	bins[k] += edges[k] < values[k];
+      }
+    }
+    for ( std::size_t k = 0; k < nHistograms; ++k ) {
+      m_Counts[k * nBins + bins[k]] += delta;
+    }
+  }
+
+  // Add delta to the bins of the n values in histogram
+  void add( std::size_t histogram, const value_type* values, std::size_t n, count_type delta ) {
+    assert( histogram < getNumberOfHistograms() );
+    count_type *counts = m_Counts.data() + histogram * getNumberOfBins();
+    unsigned int bins[BlockSize];
+    for ( std::size_t offset = 0; offset < n; offset += BlockSize ) {
+      const std::size_t m = n - offset < BlockSize ? n - offset : BlockSize;
+      m_Indexes[histogram].getBins( values + offset, m, bins );
+      for ( std::size_t i = 0; i < m; ++i ) {
+	counts[bins[i]] += delta;
+      }
+    }
+  }
+
+  // Add delta to the count of the n bins in histogram
+  void addBins( std::size_t histogram, const uint8_t* bins, std::size_t n, count_type delta ) {
+    assert( histogram < getNumberOfHistograms() );
+    const std::size_t nBins = getNumberOfBins();
+    count_type *counts = m_Counts.data() + histogram * nBins;
+    for ( std::size_t i = 0; i < n; ++i ) {
+      if ( bins[i] < nBins ) {
+	counts[bins[i]] += delta;
+      }
+    }
+  }
+
+  // Values inserted together are binned in blocks of BlockSize
+  static const std::size_t BlockSize = 256;
+
+  std::size_t m_NumberOfEdges;
+  std::vector< EdgeIndex< value_type > > m_Indexes;
+
+  // The edges by histogram and by edge
+  std::vector< value_type > m_Edges;
+  std::vector< value_type > m_EdgesByEdge;
+
+  // The counts by histogram
+  std::vector< count_type > m_Counts;
+
+  // The bins of the values of one feature vector
+  std::vector< unsigned int > m_Bins;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef __IntegralHistogram_h
+#define __IntegralHistogram_h
+
+/*
+  Integral histogram of the masked voxels of a region of a scalar image, such
+  as one feature of the planar output of ImageToEmphysemaFeaturesFilter.
+
+  For every bin there is a summed volume table, whose entry (x, y, z) is the
+  number of voxels in the bin in the box from the start of the region to
+  (x, y, z), not included. The histogram of any box inside the region is
+  then 8 lookups per bin, independent of the size of the box, which pays off
+  when many, possibly overlapping, ROIs are taken from the same region.
+
+  The table has (X+1)(Y+1)(Z+1) entries for each bin, with the bins of an
+  entry adjacent so a lookup reads one run of counts. It is built in one pass
+  over the region, where each voxel adds the counts of its row, its plane and
+  the previous plane.
+
+  A region that is too large for the memory of the tables is split into slabs
+  along z by planTiles, each with the ROIs that fit in it.
+ */
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "itkMacro.h"
+
+namespace itk {
+
+  template< typename TRegion, typename TCount = uint32_t >
+  class IntegralHistogram {
+  public:
+    typedef TRegion RegionType;
+    typedef TCount count_type;
+    typedef typename RegionType::IndexType IndexType;
+
+    /* A region and the ROIs, by their position in the list given to
+       planTiles, that are inside it */
+    struct Tile {
+      RegionType Region;
+      std::vector< size_t > ROIs;
+    };
+
+    explicit IntegralHistogram( size_t numberOfBins )
+      : m_NumberOfBins( numberOfBins )
+    {
+      static_assert( RegionType::ImageDimension == 3, "IntegralHistogram is for 3D regions" );
+    }
+
+    size_t getNumberOfBins() const {
+      return m_NumberOfBins;
+    }
+
+    const RegionType& getRegion() const {
+      return m_Region;
+    }
+
+    /* The number of table entries for region */
+    static size_t getNumberOfEntries( const RegionType& region, size_t numberOfBins ) {
+      return ( region.GetSize(0) + 1 ) * ( region.GetSize(1) + 1 ) * ( region.GetSize(2) + 1 )
+	* numberOfBins;
+    }
+
+    /* Build the tables of the voxels of region where mask is non-zero. The
+       bin of a value is getBin( value ), which must be less than the number
+       of bins. The region must be inside the buffered regions of the image
+       and the mask. */
+    template< typename TImage, typename TMask, typename TBinFunction >
+    void build( const TImage* image,
+		const TMask* mask,
+		const RegionType& region,
+		TBinFunction getBin ) {
+      if ( !image->GetBufferedRegion().IsInside( region ) ||
+	   !mask->GetBufferedRegion().IsInside( region ) ) {
+	itkGenericExceptionMacro( "Region " << region
+				  << " is not inside the image " << image->GetBufferedRegion()
+				  << " and the mask " << mask->GetBufferedRegion() );
+      }
+      m_Region = region;
+      const size_t nBins = m_NumberOfBins;
+      const size_t sizeX = region.GetSize(0), sizeY = region.GetSize(1), sizeZ = region.GetSize(2);
+      m_Table.assign( getNumberOfEntries( region, nBins ), 0 );
+
+      // The counts of the row up to x, and of the plane up to (x, y)
+      std::vector< count_type > row( nBins );
+      std::vector< count_type > plane( ( sizeX + 1 ) * nBins );
+      for ( size_t z = 0; z < sizeZ; ++z ) {
+	std::fill( plane.begin(), plane.end(), 0 );
+	for ( size_t y = 0; y < sizeY; ++y ) {
+	  IndexType index = region.GetIndex();
+	  index[1] += y;
+	  index[2] += z;
+	  const typename TImage::PixelType *in =
+	    image->GetBufferPointer() + image->ComputeOffset( index );
+	  const typename TMask::PixelType *m =
+	    mask->GetBufferPointer() + mask->ComputeOffset( index );
+	  const count_type *previous = getEntry( 1, y + 1, z );
+	  count_type *current = getEntry( 1, y + 1, z + 1 );
+	  count_type *p = plane.data() + nBins;
+	  std::fill( row.begin(), row.end(), 0 );
+	  for ( size_t x = 0; x < sizeX; ++x ) {
+	    if ( m[x] ) {
+	      ++row[getBin( in[x] )];
+	    }
+	    for ( size_t b = 0; b < nBins; ++b ) {
+	      p[b] += row[b];
+	      current[b] = previous[b] + p[b];
+	    }
+	    previous += nBins;
+	    current += nBins;
+	    p += nBins;
+	  }
+	}
+      }
+    }
+
+    /* Write the counts of the masked voxels of roi to counts, which has
+       getNumberOfBins() elements. roi must be inside the region of the
+       tables. */
+    void getCounts( const RegionType& roi, count_type* counts ) const {
+      assert( m_Region.IsInside( roi ) );
+      const size_t x0 = roi.GetIndex(0) - m_Region.GetIndex(0), x1 = x0 + roi.GetSize(0);
+      const size_t y0 = roi.GetIndex(1) - m_Region.GetIndex(1), y1 = y0 + roi.GetSize(1);
+      const size_t z0 = roi.GetIndex(2) - m_Region.GetIndex(2), z1 = z0 + roi.GetSize(2);
+      const count_type
+	*c000 = getEntry( x0, y0, z0 ), *c100 = getEntry( x1, y0, z0 ),
+	*c010 = getEntry( x0, y1, z0 ), *c110 = getEntry( x1, y1, z0 ),
+	*c001 = getEntry( x0, y0, z1 ), *c101 = getEntry( x1, y0, z1 ),
+	*c011 = getEntry( x0, y1, z1 ), *c111 = getEntry( x1, y1, z1 );
+      // The counts are unsigned, so the intermediate sums can wrap around
+      for ( size_t b = 0; b < m_NumberOfBins; ++b ) {
+	counts[b] = static_cast< count_type >( c111[b] - c011[b] - c101[b] - c110[b]
+					       + c001[b] + c010[b] + c100[b] - c000[b] );
+      }
+    }
+
+    /* Split the bounding box of rois into slabs along z, such that the
+       tables of a slab have at most maxEntries entries, and every ROI is in
+       one of the slabs. Returns no slabs when a ROI is too tall for a slab. */
+    static std::vector< Tile > planTiles( const std::vector< RegionType >& rois,
+					  size_t numberOfBins,
+					  size_t maxEntries ) {
+      std::vector< Tile > tiles;
+      if ( rois.empty() ) {
+	return tiles;
+      }
+      IndexType begin = rois[0].GetIndex(), end = rois[0].GetUpperIndex();
+      for ( const auto& roi : rois ) {
+	for ( unsigned int d = 0; d < 3; ++d ) {
+	  begin[d] = std::min( begin[d], roi.GetIndex()[d] );
+	  end[d] = std::max( end[d], roi.GetUpperIndex()[d] );
+	}
+      }
+      RegionType bounds = rois[0];
+      bounds.SetIndex( begin );
+      for ( unsigned int d = 0; d < 3; ++d ) {
+	bounds.SetSize( d, end[d] - begin[d] + 1 );
+      }
+      const size_t planeEntries =
+	( bounds.GetSize(0) + 1 ) * ( bounds.GetSize(1) + 1 ) * numberOfBins;
+      if ( maxEntries / planeEntries < 2 ) {
+	return tiles;
+      }
+      const size_t maxSizeZ = maxEntries / planeEntries - 1;
+      for ( const auto& roi : rois ) {
+	if ( roi.GetSize(2) > maxSizeZ ) {
+	  return tiles;
+	}
+      }
+
+      // Each slab starts at the first ROI that is not in a slab and has the
+      // ROIs that end in it
+      std::vector< size_t > order( rois.size() );
+      std::iota( order.begin(), order.end(), 0 );
+      std::stable_sort( order.begin(), order.end(), [&rois]( size_t a, size_t b ) {
+	  return rois[a].GetIndex(2) < rois[b].GetIndex(2);
+	} );
+      std::vector< bool > assigned( rois.size(), false );
+      for ( size_t i = 0; i < order.size(); ++i ) {
+	if ( assigned[order[i]] ) {
+	  continue;
+	}
+	const auto tileBegin = rois[order[i]].GetIndex(2);
+	const auto tileEnd = std::min( tileBegin + static_cast< decltype( tileBegin ) >( maxSizeZ ),
+				       end[2] + 1 );
+	Tile tile;
+	auto usedEnd = tileBegin;
+	for ( size_t j = i; j < order.size() && rois[order[j]].GetIndex(2) < tileEnd; ++j ) {
+	  const RegionType& roi = rois[order[j]];
+	  const auto roiEnd = roi.GetIndex(2) + static_cast< decltype( tileBegin ) >( roi.GetSize(2) );
+	  if ( !assigned[order[j]] && roiEnd <= tileEnd ) {
+	    assigned[order[j]] = true;
+	    tile.ROIs.push_back( order[j] );
+	    usedEnd = std::max( usedEnd, roiEnd );
+	  }
+	}
+	tile.Region = bounds;
+	tile.Region.SetIndex( 2, tileBegin );
+	tile.Region.SetSize( 2, usedEnd - tileBegin );
+	tiles.push_back( tile );
+      }
+      return tiles;
+    }
+
+  private:
+    count_type* getEntry( size_t x, size_t y, size_t z ) {
+      return m_Table.data() + getEntryOffset( x, y, z );
+    }
+
+    const count_type* getEntry( size_t x, size_t y, size_t z ) const {
+      return m_Table.data() + getEntryOffset( x, y, z );
+    }
+
+    size_t getEntryOffset( size_t x, size_t y, size_t z ) const {
+      return ( ( z * ( m_Region.GetSize(1) + 1 ) + y ) * ( m_Region.GetSize(0) + 1 ) + x )
+	* m_NumberOfBins;
+    }
+
+    size_t m_NumberOfBins;
+    RegionType m_Region;
+    std::vector< count_type > m_Table;
+  };
+
+} // end namespace itk
+
+#endif
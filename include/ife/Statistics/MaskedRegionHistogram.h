@@ -0,0 +1,108 @@
+#ifndef __MaskedRegionHistogram_h
+#define __MaskedRegionHistogram_h
+
+/*
+  Histograms of the masked voxels of a region of a scalar image, such as one
+  feature of the planar output of ImageToEmphysemaFeaturesFilter.
+
+  The lines of the region along x are contiguous in both the image and the
+  mask, so each line is streamed once: the values of the masked voxels are
+  compacted into a buffer without branches and inserted into the histogram
+  together, see DenseHistogram::insert. No voxel is read through an index or
+  gathered from a vector pixel.
+
+  The values of a region can also be removed again from a histogram that
+  supports it, such as a histogram of a HistogramBank.
+ */
+#include <vector>
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMacro.h"
+
+namespace itk {
+
+  /** The operations on the histogram for the values of each line */
+  struct InsertMaskedValues {
+    template< typename THistogram >
+    static void apply( THistogram& histogram,
+		       const typename THistogram::value_type* values,
+		       size_t n ) {
+      histogram.insert( values, n );
+    }
+  };
+
+  struct RemoveMaskedValues {
+    template< typename THistogram >
+    static void apply( THistogram& histogram,
+		       const typename THistogram::value_type* values,
+		       size_t n ) {
+      histogram.remove( values, n );
+    }
+  };
+
+  /** Apply TOperation to histogram and the values of image in the voxels of
+      region where mask is non-zero. The region must be inside the buffered
+      regions of the image and the mask, which can be different. */
+  template< typename TOperation, typename TImage, typename TMask, typename THistogram >
+  void updateMaskedRegion( const TImage* image,
+			   const TMask* mask,
+			   const typename TImage::RegionType& region,
+			   THistogram& histogram ) {
+    typedef typename TImage::RegionType RegionType;
+    typedef typename TImage::IndexType IndexType;
+    typedef typename THistogram::value_type ValueType;
+
+    if ( !image->GetBufferedRegion().IsInside( region ) ||
+	 !mask->GetBufferedRegion().IsInside( region ) ) {
+      itkGenericExceptionMacro( "Region " << region
+				<< " is not inside the image " << image->GetBufferedRegion()
+				<< " and the mask " << mask->GetBufferedRegion() );
+    }
+    if ( region.GetNumberOfPixels() == 0 ) {
+      return;
+    }
+
+    const size_t lineLength = region.GetSize(0);
+    std::vector< ValueType > values( lineLength );
+
+    // One iteration for each line of the region
+    RegionType lines = region;
+    lines.SetSize( 0, 1 );
+    ImageRegionConstIteratorWithIndex< TMask > lineIter( mask, lines );
+    for ( ; !lineIter.IsAtEnd(); ++lineIter ) {
+      const IndexType index = lineIter.GetIndex();
+      const typename TImage::PixelType *in =
+	image->GetBufferPointer() + image->ComputeOffset( index );
+      const typename TMask::PixelType *m =
+	mask->GetBufferPointer() + mask->ComputeOffset( index );
+      size_t n = 0;
+      for ( size_t x = 0; x < lineLength; ++x ) {
+	values[n] = in[x];
+	n += m[x] != 0;
+      }
+      TOperation::apply( histogram, values.data(), n );
+    }
+  }
+
+  /** Insert the values of image in the voxels of region where mask is
+      non-zero into histogram, see updateMaskedRegion. */
+  template< typename TImage, typename TMask, typename THistogram >
+  void insertMaskedRegion( const TImage* image,
+			   const TMask* mask,
+			   const typename TImage::RegionType& region,
+			   THistogram& histogram ) {
+    updateMaskedRegion< InsertMaskedValues >( image, mask, region, histogram );
+  }
+
+  /** Remove the values that insertMaskedRegion inserts from histogram */
+  template< typename TImage, typename TMask, typename THistogram >
+  void removeMaskedRegion( const TImage* image,
+			   const TMask* mask,
+			   const typename TImage::RegionType& region,
+			   THistogram& histogram ) {
+    updateMaskedRegion< RemoveMaskedValues >( image, mask, region, histogram );
+  }
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef __SlidingWindowHistograms_h
+#define __SlidingWindowHistograms_h
+
+/*
+  Histograms of a sequence of ROIs of the same size, such as the dense ROIs of
+  DenseROIGenerator, that are updated as the window moves instead of being
+  made from scratch for each ROI.
+
+  When the window moves by d voxels along an axis, the slab of d faces that
+  leaves the window is removed from the histograms and the slab that enters
+  is inserted, which for a move of one voxel is O(s^2) voxels instead of
+  the O(s^3) voxels of the ROI. The counts are integers, so the histograms
+  are exactly those made from the ROI.
+
+  The ROIs are typically in raster order, where the first ROI of a row is far
+  from the last ROI of the previous row. The histograms of the first ROI of
+  the current row and plane are therefore kept, and the next ROI starts from
+  whichever of the window, the row start and the plane start needs the
+  fewest voxels, or from scratch when that is cheaper.
+
+  The voxels are inserted and removed by an update function
+    update( region, histograms, remove )
+  so the features can be planar images, see MaskedRegionHistogram.h, or
+  packed vectors.
+ */
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+
+namespace itk {
+
+  template< typename TRegion, typename THistogramBank >
+  class SlidingWindowHistograms {
+  public:
+    typedef TRegion RegionType;
+    typedef THistogramBank HistogramBankType;
+    typedef std::function< void( const RegionType&, HistogramBankType&, bool ) >
+    UpdateFunctionType;
+
+    static const unsigned int ImageDimension = RegionType::ImageDimension;
+
+    /** histograms gives the edges, its counts are not used */
+    SlidingWindowHistograms( const HistogramBankType& histograms,
+			     UpdateFunctionType update )
+      : m_Update( update ),
+	m_Window( histograms ),
+	m_RowStart( histograms ),
+	m_PlaneStart( histograms ),
+	m_NumberOfUpdatedVoxels( 0 )
+    {}
+
+    /** The histograms of roi */
+    const HistogramBankType& compute( const RegionType& roi ) {
+      // The cheapest state to start from, if any is cheaper than scratch
+      size_t cost = roi.GetNumberOfPixels();
+      const Window *start = 0;
+      for ( const Window *window : { &m_Window, &m_RowStart, &m_PlaneStart } ) {
+	const size_t moveCost = getMoveCost( *window, roi );
+	if ( moveCost < cost ) {
+	  cost = moveCost;
+	  start = window;
+	}
+      }
+
+      const bool hasPrevious = m_Window.Valid;
+      const RegionType previous = m_Window.Region;
+      if ( start == 0 ) {
+	m_Window.Histograms.resetCounts();
+	update( roi, false );
+	m_Window.Region = roi;
+	m_Window.Valid = true;
+      }
+      else {
+	if ( start != &m_Window ) {
+	  m_Window = *start;
+	}
+	move( roi );
+      }
+
+      // A new row starts when the ROI moved in any direction but x, and a new
+      // plane when it moved in any direction but x and y
+      if ( !hasPrevious || !sameIndex( previous, roi, 2 ) ) {
+	m_PlaneStart = m_Window;
+      }
+      if ( !hasPrevious || !sameIndex( previous, roi, 1 ) ) {
+	m_RowStart = m_Window;
+      }
+      return m_Window.Histograms;
+    }
+
+    /** The number of voxels that have been inserted or removed */
+    size_t getNumberOfUpdatedVoxels() const {
+      return m_NumberOfUpdatedVoxels;
+    }
+
+  private:
+    struct Window {
+      Window( const HistogramBankType& histograms )
+	: Valid( false ), Histograms( histograms )
+      {
+	Histograms.resetCounts();
+      }
+
+      bool Valid;
+      RegionType Region;
+      HistogramBankType Histograms;
+    };
+
+    // The number of voxels to remove and insert to move window to roi. When
+    // they differ in size or do not overlap it is the cost of starting from
+    // scratch.
+    size_t getMoveCost( const Window& window, const RegionType& roi ) const {
+      if ( !window.Valid || window.Region.GetSize() != roi.GetSize() ) {
+	return roi.GetNumberOfPixels();
+      }
+      size_t cost = 0;
+      for ( unsigned int d = 0; d < ImageDimension; ++d ) {
+	const size_t delta =
+	  std::abs( roi.GetIndex( d ) - window.Region.GetIndex( d ) );
+	if ( delta >= roi.GetSize( d ) ) {
+	  return roi.GetNumberOfPixels();
+	}
+	cost += 2 * delta * ( roi.GetNumberOfPixels() / roi.GetSize( d ) );
+      }
+      return cost;
+    }
+
+    // Move m_Window to roi one axis at a time. The ROIs overlap in every
+    // axis, see getMoveCost.
+    void move( const RegionType& roi ) {
+      RegionType& region = m_Window.Region;
+      for ( unsigned int d = 0; d < ImageDimension; ++d ) {
+	const auto begin = region.GetIndex( d );
+	const auto end = begin + static_cast< decltype( begin ) >( region.GetSize( d ) );
+	const auto delta = roi.GetIndex( d ) - begin;
+	if ( delta == 0 ) {
+	  continue;
+	}
+	RegionType leaving = region;
+	RegionType entering = region;
+	const size_t width = std::abs( delta );
+	leaving.SetSize( d, width );
+	entering.SetSize( d, width );
+	if ( delta > 0 ) {
+	  leaving.SetIndex( d, begin );
+	  entering.SetIndex( d, end );
+	}
+	else {
+	  leaving.SetIndex( d, end + delta );
+	  entering.SetIndex( d, begin + delta );
+	}
+	update( leaving, true );
+	update( entering, false );
+	region.SetIndex( d, roi.GetIndex( d ) );
+      }
+    }
+
+    void update( const RegionType& region, bool remove ) {
+      m_Update( region, m_Window.Histograms, remove );
+      m_NumberOfUpdatedVoxels += region.GetNumberOfPixels();
+    }
+
+    // True if a and b have the same index along the axes from first
+    static bool sameIndex( const RegionType& a, const RegionType& b, unsigned int first ) {
+      for ( unsigned int d = first; d < ImageDimension; ++d ) {
+	if ( a.GetIndex( d ) != b.GetIndex( d ) ) {
+	  return false;
+	}
+      }
+      return true;
+    }
+
+    UpdateFunctionType m_Update;
+    Window m_Window, m_RowStart, m_PlaneStart;
+    size_t m_NumberOfUpdatedVoxels;
+  };
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef __BinIndexFeatures_h
+#define __BinIndexFeatures_h
+
+/*
+  Feature volumes kept as the histogram bin of each voxel.
+
+  The features are only used through histograms with edges that are fixed
+  before the features are calculated, so a feature can be replaced by the
+  index of its bin. The indices are stored in 8 bits, which is a quarter of
+  the memory of float features, and voxels outside the mask get
+  OutsideMaskBin, so the mask is not needed to make histograms.
+
+  The bins of a line of a feature are found together by EdgeIndex::getBins,
+  which is vectorized for the usual number of edges. Histograms of a region
+  then count small integers, see insertBinRegion.
+ */
+#include <cstdint>
+#include <vector>
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMacro.h"
+
+#include "ife/Statistics/EdgeIndex.h"
+
+namespace itk {
+
+  typedef uint8_t BinIndexType;
+
+  /** The bin of voxels outside the mask, which is not a bin of any histogram */
+  const BinIndexType OutsideMaskBin = 255;
+
+  /** Store the bins of the voxels of feature in bins, which must have the
+      buffered region of feature. Voxels where mask is zero get
+      OutsideMaskBin. The histogram of edgeIndex must have fewer than
+      OutsideMaskBin bins. */
+  template< typename TFeatureImage, typename TMask, typename TBinImage, typename TReal >
+  void quantizeFeature( const TFeatureImage* feature,
+			const TMask* mask,
+			const EdgeIndex< TReal >& edgeIndex,
+			TBinImage* bins ) {
+    typedef typename TFeatureImage::RegionType RegionType;
+    typedef typename TFeatureImage::IndexType IndexType;
+
+    const RegionType region = feature->GetBufferedRegion();
+    if ( bins->GetBufferedRegion() != region ||
+	 !mask->GetBufferedRegion().IsInside( region ) ) {
+      itkGenericExceptionMacro( "The bins " << bins->GetBufferedRegion()
+				<< " must have the region of the feature " << region
+				<< " and the mask " << mask->GetBufferedRegion()
+				<< " must contain it" );
+    }
+    if ( edgeIndex.getNumberOfEdges() >= OutsideMaskBin ) {
+      itkGenericExceptionMacro( "Histograms with " << edgeIndex.getNumberOfEdges() + 1
+				<< " bins do not fit in bin indices" );
+    }
+    if ( region.GetNumberOfPixels() == 0 ) {
+      return;
+    }
+
+    // One iteration for each line of the region
+    const size_t lineLength = region.GetSize(0);
+    RegionType lines = region;
+    lines.SetSize( 0, 1 );
+    ImageRegionConstIteratorWithIndex< TMask > lineIter( mask, lines );
+    for ( ; !lineIter.IsAtEnd(); ++lineIter ) {
+      const IndexType index = lineIter.GetIndex();
+      const typename TFeatureImage::PixelType *in =
+	feature->GetBufferPointer() + feature->ComputeOffset( index );
+      const typename TMask::PixelType *m =
+	mask->GetBufferPointer() + mask->ComputeOffset( index );
+      typename TBinImage::PixelType *out =
+	bins->GetBufferPointer() + bins->ComputeOffset( index );
+      edgeIndex.getBins( in, lineLength, out );
+      for ( size_t x = 0; x < lineLength; ++x ) {
+	out[x] = m[x] ? out[x] : OutsideMaskBin;
+      }
+    }
+  }
+
+  /** The operations on the histogram for the bins of each line */
+  struct InsertBins {
+    template< typename THistogram >
+    static void apply( THistogram& histogram, const BinIndexType* bins, size_t n ) {
+      histogram.insertBins( bins, n );
+    }
+  };
+
+  struct RemoveBins {
+    template< typename THistogram >
+    static void apply( THistogram& histogram, const BinIndexType* bins, size_t n ) {
+      histogram.removeBins( bins, n );
+    }
+  };
+
+  /** Apply TOperation to histogram and the bins of the voxels of region.
+      The region must be inside the buffered region of bins. */
+  template< typename TOperation, typename TBinImage, typename THistogram >
+  void updateBinRegion( const TBinImage* bins,
+			const typename TBinImage::RegionType& region,
+			THistogram& histogram ) {
+    typedef typename TBinImage::RegionType RegionType;
+
+    if ( !bins->GetBufferedRegion().IsInside( region ) ) {
+      itkGenericExceptionMacro( "Region " << region
+				<< " is not inside the bins " << bins->GetBufferedRegion() );
+    }
+    if ( region.GetNumberOfPixels() == 0 ) {
+      return;
+    }
+
+    const size_t lineLength = region.GetSize(0);
+    RegionType lines = region;
+    lines.SetSize( 0, 1 );
+    ImageRegionConstIteratorWithIndex< TBinImage > lineIter( bins, lines );
+    for ( ; !lineIter.IsAtEnd(); ++lineIter ) {
+      TOperation::apply( histogram,
+			 bins->GetBufferPointer() + bins->ComputeOffset( lineIter.GetIndex() ),
+			 lineLength );
+    }
+  }
+
+  /** Insert the bins of the voxels of region in the mask into histogram */
+  template< typename TBinImage, typename THistogram >
+  void insertBinRegion( const TBinImage* bins,
+			const typename TBinImage::RegionType& region,
+			THistogram& histogram ) {
+    updateBinRegion< InsertBins >( bins, region, histogram );
+  }
+
+  /** Remove the bins that insertBinRegion inserts from histogram */
+  template< typename TBinImage, typename THistogram >
+  void removeBinRegion( const TBinImage* bins,
+			const typename TBinImage::RegionType& region,
+			THistogram& histogram ) {
+    updateBinRegion< RemoveBins >( bins, region, histogram );
+  }
+
+} // end namespace itk
+
+#endif
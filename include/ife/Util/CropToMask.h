@@ -0,0 +1,80 @@
+#ifndef __CropToMask_h
+#define __CropToMask_h
+
+/*
+  Crop the inputs of a feature filter to the part of the image that is
+  needed for the mask, see ROI/MaskBoundingBox.h.
+
+  The image and mask are cropped with ExtractImageFilter, which keeps the
+  index of the extracted region, so ROIs and indices of the full image can be
+  used with the features as they are.
+ */
+#include <vector>
+
+#include "itkExtractImageFilter.h"
+
+#include "ife/ROI/MaskBoundingBox.h"
+
+namespace itk {
+
+  /** The region the inputs of a feature filter are cropped to by cropToMask,
+      and the filters that crop them. The filters must be kept until the
+      feature filter has been updated. */
+  template< typename TImage, typename TMask >
+  struct MaskCrop {
+    typedef ExtractImageFilter< TImage, TImage > ImageCropFilterType;
+    typedef ExtractImageFilter< TMask, TMask > MaskCropFilterType;
+    typedef typename TMask::RegionType RegionType;
+
+    RegionType Region;
+    typename ImageCropFilterType::Pointer ImageCropFilter;
+    typename MaskCropFilterType::Pointer MaskCropFilter;
+  };
+
+  /** Crop the image and mask inputs of featureFilter to the bounding box of
+      the mask padded by the support of a Gaussian with scale sigma, see
+      maskSupportRegion, extended to contain rois and cropped to the largest
+      possible region of the mask. The mask must be up to date.
+
+      When the region is empty, which is when the mask is empty and there are
+      no ROIs in the image, the inputs are not changed and the returned
+      Region has no pixels. */
+  template< typename TFeatureFilter, typename TImage, typename TMask >
+  MaskCrop< TImage, TMask >
+  cropToMask( TFeatureFilter* featureFilter,
+	      const TImage* image,
+	      const TMask* mask,
+	      double sigma,
+	      const std::vector< typename TMask::RegionType >& rois =
+	      std::vector< typename TMask::RegionType >() ) {
+    typedef MaskCrop< TImage, TMask > MaskCropType;
+
+    MaskCropType crop;
+    crop.Region = maskSupportRegion( mask, sigma );
+    for ( const auto& roi : rois ) {
+      crop.Region = regionUnion( crop.Region, roi );
+    }
+    if ( crop.Region.GetNumberOfPixels() == 0 ||
+	 !crop.Region.Crop( mask->GetLargestPossibleRegion() ) ) {
+      typename TMask::SizeType size;
+      size.Fill( 0 );
+      crop.Region.SetSize( size );
+      return crop;
+    }
+
+    crop.ImageCropFilter = MaskCropType::ImageCropFilterType::New();
+    crop.ImageCropFilter->SetInput( image );
+    crop.ImageCropFilter->SetExtractionRegion( crop.Region );
+    crop.ImageCropFilter->SetDirectionCollapseToSubmatrix();
+    crop.MaskCropFilter = MaskCropType::MaskCropFilterType::New();
+    crop.MaskCropFilter->SetInput( mask );
+    crop.MaskCropFilter->SetExtractionRegion( crop.Region );
+    crop.MaskCropFilter->SetDirectionCollapseToSubmatrix();
+    featureFilter->SetInputImage( crop.ImageCropFilter->GetOutput() );
+    featureFilter->SetInputMask( crop.MaskCropFilter->GetOutput() );
+    return crop;
+  }
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef __FeatureArguments_h
+#define __FeatureArguments_h
+
+/*
+  Command line arguments shared by the tools that calculate features with
+  ImageToEmphysemaFeaturesFilter.
+
+  Each argument adds itself to the command line when it is constructed, as
+  the TCLAP arguments it derives from, and converts its value to what the
+  feature filter takes, e.g.
+
+    TCLAP::CmdLine cmd( ... );
+    FeaturesArg featuresArg( cmd );
+    SmoothingArg smoothingArg( cmd );
+    cmd.parse( argc, argv );
+    featureFilter->SetFeatures( featuresArg.getFeatures< FeatureFilterType >() );
+    featureFilter->SetSmoothingMethod( smoothingArg.getSmoothingMethod() );
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tclap/CmdLine.h"
+
+#include "ife/Filters/FusedNormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Numerics/HalfPrecision.h"
+
+/* -F/--features, the features to calculate */
+class FeaturesArg : public TCLAP::MultiArg< std::string > {
+public:
+  explicit FeaturesArg( TCLAP::CmdLineInterface& cmd )
+    : TCLAP::MultiArg< std::string >(
+	"F",
+	"features",
+	"Features to calculate. One of GaussianBlur, GradientMagnitude, "
+	"Eigenvalue1, Eigenvalue2, Eigenvalue3, LaplacianOfGaussian, "
+	"GaussianCurvature, FrobeniusNorm. Can be given multiple times. "
+	"Default is all features. The features are always calculated in "
+	"the listed order.",
+	false,
+	"string",
+	cmd )
+  {}
+
+  /* The flags of TFeatureFilter for the given features, or AllFeatures when
+     none are given. A name that is not a feature is reported on std::cerr
+     and gives 0. */
+  template< typename TFeatureFilter >
+  unsigned int getFeatures() {
+    return getFeatures< TFeatureFilter >( getValue() );
+  }
+
+  /* The flags of TFeatureFilter for the features in names, as getFeatures(),
+     for tools that choose the filter type after parsing */
+  template< typename TFeatureFilter >
+  static unsigned int getFeatures( const std::vector< std::string >& names ) {
+    unsigned int features = 0;
+    for ( const auto& name : names ) {
+      const unsigned int flag = TFeatureFilter::GetFeatureFlag( name );
+      if ( flag == 0 ) {
+	std::cerr << "Unknown feature '" << name << "'" << std::endl;
+	return 0;
+      }
+      features |= flag;
+    }
+    return features == 0 ? TFeatureFilter::AllFeatures : features;
+  }
+
+  /* The names of the selected features in the order of the output
+     components of TFeatureFilter */
+  template< typename TFeatureFilter >
+  std::vector< std::string > getFeatureNames() {
+    const unsigned int features = getFeatures< TFeatureFilter >();
+    std::vector< std::string > names;
+    for ( size_t i = 0; i < TFeatureFilter::numFeatures; ++i ) {
+      if ( features & ( 1u << i ) ) {
+	names.push_back( TFeatureFilter::GetFeatureNames()[i] );
+      }
+    }
+    return names;
+  }
+};
+
+/* -C/--crop-to-mask. The description says what the crop contains and what
+   the tool does outside it. */
+class CropToMaskArg : public TCLAP::ValueArg< bool > {
+public:
+  CropToMaskArg( TCLAP::CmdLineInterface& cmd, const std::string& description )
+    : TCLAP::ValueArg< bool >( "C", "crop-to-mask", description, false, false, "boolean", cmd )
+  {}
+};
+
+/* -g/--smoothing, the approximation of the Gaussian */
+class SmoothingArg : public TCLAP::ValueArg< std::string > {
+public:
+  explicit SmoothingArg( TCLAP::CmdLineInterface& cmd )
+    : TCLAP::ValueArg< std::string >(
+	"g",
+	"smoothing",
+	"Approximation of the Gaussian. box is faster for large scales "
+	"and deviates about 1% from the Gaussian.",
+	false,
+	"recursive",
+	getConstraint(),
+	cmd )
+  {}
+
+  itk::GaussianSmoothingMethod getSmoothingMethod() {
+    return getValue() == "box" ? itk::BoxGaussianSmoothing : itk::RecursiveGaussianSmoothing;
+  }
+
+private:
+  static TCLAP::ValuesConstraint< std::string >* getConstraint() {
+    static std::vector< std::string > methods{ "recursive", "box" };
+    static TCLAP::ValuesConstraint< std::string > constraint( methods );
+    return &constraint;
+  }
+};
+
+/* -P/--pyramid, see ImageToEmphysemaFeaturesFilter::SetPyramidSamplesPerSigma */
+class PyramidArg : public TCLAP::ValueArg< float > {
+public:
+  explicit PyramidArg( TCLAP::CmdLineInterface& cmd )
+    : TCLAP::ValueArg< float >(
+	"P",
+	"pyramid",
+	"Calculate large scales on a grid that is 2^k times coarser, "
+	"where k is the largest level at which the scale still covers "
+	"this number of voxels along every axis, and interpolate the "
+	"features. 0 uses the image grid for all scales.",
+	false,
+	0,
+	"float",
+	cmd )
+  {}
+};
+
+/* -S/--storage, how the features are kept while the histograms are made,
+   see HalfPrecisionFeatures.h and BinIndexFeatures.h */
+class StorageArg : public TCLAP::ValueArg< std::string > {
+public:
+  explicit StorageArg( TCLAP::CmdLineInterface& cmd )
+    : TCLAP::ValueArg< std::string >(
+	"S",
+	"storage",
+	"Precision of the features while the histograms are made. "
+	"float16 and bfloat16 halve the memory for the features. The "
+	"features are rounded to a value in the same histogram bin, so "
+	"the bag is the same as for float32. A format is refused when a "
+	"bin is narrower than its spacing, which for bfloat16 is 1/128 "
+	"of the magnitude at the bin edges. bins stores the histogram "
+	"bin of each feature value in 8 bits, a quarter of the memory, "
+	"and gives the same bag.",
+	false,
+	"float32",
+	getConstraint(),
+	cmd )
+  {}
+
+  bool isHalfPrecision() {
+    return getValue() == "float16" || getValue() == "bfloat16";
+  }
+
+  bool isBinIndices() {
+    return getValue() == "bins";
+  }
+
+  HalfPrecisionFormat getHalfPrecisionFormat() {
+    return getValue() == "bfloat16" ? BFloat16Format : Float16Format;
+  }
+
+private:
+  static TCLAP::ValuesConstraint< std::string >* getConstraint() {
+    static std::vector< std::string > formats{ "float32", "float16", "bfloat16", "bins" };
+    static TCLAP::ValuesConstraint< std::string > constraint( formats );
+    return &constraint;
+  }
+};
+
+#endif
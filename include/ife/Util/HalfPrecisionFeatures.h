@@ -0,0 +1,62 @@
+#ifndef __HalfPrecisionFeatures_h
+#define __HalfPrecisionFeatures_h
+
+/*
+  Feature volumes kept with 16 bits per component, see
+  Numerics/HalfPrecision.h.
+
+  The features of all scales are calculated one scale at a time and packed
+  into a VectorImage of the 16 bit values, so the float features of only one
+  scale are in memory. Each component is encoded by the BinPreservingEncoder
+  of its histogram, so the histograms made from the decoded components are
+  the same as those made from the float features, as long as every bin has a
+  16 bit value, see BinPreservingEncoder::preservesAllBins.
+ */
+#include <cstdint>
+#include <vector>
+
+#include "itkMacro.h"
+#include "itkVectorImage.h"
+
+#include "ife/Numerics/HalfPrecision.h"
+
+namespace itk {
+
+  /** Encode the components of features into the components
+      componentOffset, componentOffset+1, ... of packed. Component k is
+      encoded by encoders[componentOffset + k]. Features and packed must
+      have the same buffered region. */
+  template< typename TFeatureImage, typename TPackedImage, typename TEncoder >
+  void packFeatures( const TFeatureImage* features,
+		     TPackedImage* packed,
+		     size_t componentOffset,
+		     std::vector< TEncoder >& encoders ) {
+    if ( features->GetBufferedRegion() != packed->GetBufferedRegion() ) {
+      itkGenericExceptionMacro( "Features and packed features must have the same buffered region."
+				<< " Features: " << features->GetBufferedRegion()
+				<< " Packed: " << packed->GetBufferedRegion() );
+    }
+    const size_t nFeatures = features->GetNumberOfComponentsPerPixel();
+    const size_t nPacked = packed->GetNumberOfComponentsPerPixel();
+    if ( componentOffset + nFeatures > nPacked ||
+	 componentOffset + nFeatures > encoders.size() ) {
+      itkGenericExceptionMacro( "Components " << componentOffset << " to "
+				<< componentOffset + nFeatures
+				<< " do not fit in " << nPacked
+				<< " packed components and " << encoders.size()
+				<< " encoders" );
+    }
+
+    const size_t nPixels = features->GetBufferedRegion().GetNumberOfPixels();
+    const typename TFeatureImage::InternalPixelType *in = features->GetBufferPointer();
+    typename TPackedImage::InternalPixelType *out = packed->GetBufferPointer() + componentOffset;
+    for ( size_t i = 0; i < nPixels; ++i, in += nFeatures, out += nPacked ) {
+      for ( size_t k = 0; k < nFeatures; ++k ) {
+	out[k] = encoders[componentOffset + k].encode( in[k] );
+      }
+    }
+  }
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef __MaskRuns_h
+#define __MaskRuns_h
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/*
+  The foreground of a mask as runs of consecutive non-zero voxels along the
+  lines of the buffer. For an image with size (nx, ny, nz) the lines are the
+  ny*nz rows along x, and line y + z*ny starts at offset (y + z*ny)*nx.
+
+  Each run is [begin, end) in x relative to the start of the line. The runs
+  of a line are sorted and do not touch.
+
+  Used to restrict computations to the mask, so voxels outside the mask are
+  only visited to be set to zero, and lines without foreground are skipped
+  entirely.
+ */
+template< typename TMaskPixel >
+class MaskRuns {
+public:
+  typedef TMaskPixel MaskPixelType;
+  typedef std::ptrdiff_t OffsetType;
+
+  struct Run {
+    OffsetType begin;
+    OffsetType end;
+  };
+
+  MaskRuns()
+    : m_LineStarts( 1, 0 ), m_NumberOfForegroundVoxels( 0 )
+  {}
+
+  // Find the runs in the nLines lines of lineLength voxels in mask
+  MaskRuns( const MaskPixelType* mask, std::size_t lineLength, std::size_t nLines )
+  {
+    initialize( mask, lineLength, nLines );
+  }
+
+  void initialize( const MaskPixelType* mask, std::size_t lineLength, std::size_t nLines ) {
+    m_Runs.clear();
+    m_LineStarts.assign( 1, 0 );
+    m_LineStarts.reserve( nLines + 1 );
+    m_NumberOfForegroundVoxels = 0;
+    const OffsetType n = lineLength;
+    for ( std::size_t line = 0; line < nLines; ++line, mask += lineLength ) {
+      OffsetType x = 0;
+      while ( x < n ) {
+	while ( x < n && mask[x] == 0 ) {
+	  ++x;
+	}
+	if ( x == n ) {
+	  break;
+	}
+	Run run;
+	run.begin = x;
+	while ( x < n && mask[x] != 0 ) {
+	  ++x;
+	}
+	run.end = x;
+	m_Runs.push_back( run );
+	m_NumberOfForegroundVoxels += run.end - run.begin;
+      }
+      m_LineStarts.push_back( m_Runs.size() );
+    }
+  }
+
+  // The runs of line
+  const Run* begin( std::size_t line ) const {
+    assert( line + 1 < m_LineStarts.size() );
+    return m_Runs.data() + m_LineStarts[line];
+  }
+
+  const Run* end( std::size_t line ) const {
+    assert( line + 1 < m_LineStarts.size() );
+    return m_Runs.data() + m_LineStarts[line + 1];
+  }
+
+  std::size_t getNumberOfLines() const {
+    return m_LineStarts.size() - 1;
+  }
+
+  std::size_t getNumberOfRuns() const {
+    return m_Runs.size();
+  }
+
+  std::size_t getNumberOfForegroundVoxels() const {
+    return m_NumberOfForegroundVoxels;
+  }
+
+private:
+  std::vector< Run > m_Runs;
+  std::vector< std::size_t > m_LineStarts;
+  std::size_t m_NumberOfForegroundVoxels;
+};
+
+#endif
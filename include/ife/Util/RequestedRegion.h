@@ -0,0 +1,83 @@
+#ifndef __RequestedRegion_h
+#define __RequestedRegion_h
+
+/*
+  Helpers for filters that smooth with a Gaussian and still support
+  streaming.
+
+  Such a filter requests its output region padded by the support of the
+  Gaussian, and then processes the padded region as if it was the entire
+  image. That lets the filters in a mini pipeline, which smooth along the
+  whole largest possible region, work on a slab of the image. The recursive
+  Gaussian extends the data at the border of the slab, so the result differs
+  from the unstreamed result by the part of the Gaussian beyond the padding.
+  For 4 sigma that is 6e-5 of the mass of the Gaussian, so smoothed values
+  differ by about 1e-4 of the image range, which is far above floating point
+  rounding. Features made from derivatives differ more, so streamed output
+  should be compared with a tolerance, e.g. 5e-2 for the smoothed test image
+  and 2e-2 + 1e-3 |e| for its features in the streaming tests.
+ */
+#include <cmath>
+
+#include "itkImageAlgorithm.h"
+#include "itkImageRegion.h"
+#include "itkInvalidRequestedRegionError.h"
+
+namespace itk {
+
+  /** Radius in voxels that covers 4 sigma of a Gaussian with scale sigma in
+      physical units, plus extra voxels for a stencil */
+  template< typename TImage >
+  typename TImage::SizeType
+  gaussianSupportRadius( const TImage* image, double sigma, unsigned int extra = 0 ) {
+    typename TImage::SizeType radius;
+    for ( unsigned int d = 0; d < TImage::ImageDimension; ++d ) {
+      radius[d] = std::ceil( 4 * sigma / image->GetSpacing()[d] ) + extra;
+    }
+    return radius;
+  }
+
+  /** Pad the requested region of image by radius and crop it to the largest
+      possible region. Throws InvalidRequestedRegionError if the requested
+      region is outside the largest possible region. */
+  template< typename TImage >
+  void
+  padRequestedRegion( TImage* image, const typename TImage::SizeType& radius ) {
+    typename TImage::RegionType requestedRegion = image->GetRequestedRegion();
+    requestedRegion.PadByRadius( radius );
+    if ( !requestedRegion.Crop( image->GetLargestPossibleRegion() ) ) {
+      image->SetRequestedRegion( requestedRegion );
+      InvalidRequestedRegionError e(__FILE__, __LINE__);
+      e.SetLocation(ITK_LOCATION);
+      e.SetDescription("Requested region is (at least partially) outside the largest possible region.");
+      e.SetDataObject(image);
+      throw e;
+    }
+    image->SetRequestedRegion( requestedRegion );
+  }
+
+  /** A graft of the requested region of image, that has the requested region
+      as both buffered and largest possible region. The pixels are only
+      copied when the buffered region is larger than the requested region. */
+  template< typename TImage >
+  typename TImage::Pointer
+  graftRequestedRegion( const TImage* image ) {
+    typedef typename TImage::RegionType RegionType;
+    const RegionType region = image->GetRequestedRegion();
+    typename TImage::Pointer result = TImage::New();
+    if ( image->GetBufferedRegion() == region ) {
+      result->Graft( image );
+    }
+    else {
+      result->CopyInformation( image );
+      result->SetRegions( region );
+      result->Allocate();
+      ImageAlgorithm::Copy( image, result.GetPointer(), region, region );
+    }
+    result->SetLargestPossibleRegion( region );
+    return result;
+  }
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef __ScaleByScaleFeatures_h
+#define __ScaleByScaleFeatures_h
+
+/*
+  Calculate the features of ImageToEmphysemaFeaturesFilter one scale at a
+  time and keep each scale in less memory before the next is calculated, so
+  the float features of only one scale are in memory.
+
+  Feature k at scale i is kept as component i*numFeatures + k, which is the
+  order of the components when all scales are calculated in one update. The
+  component can be packed with 16 bits, see HalfPrecisionFeatures.h, or
+  replaced by its histogram bin, see BinIndexFeatures.h.
+ */
+#include <cstddef>
+#include <vector>
+
+#include "itkSmartPointer.h"
+
+#include "ife/Numerics/HalfPrecision.h"
+#include "ife/Statistics/HistogramBank.h"
+#include "ife/Util/BinIndexFeatures.h"
+#include "ife/Util/HalfPrecisionFeatures.h"
+
+namespace itk {
+
+  /** Update featureFilter for each scale in turn and call storeScale( i )
+      after scale i is calculated */
+  template< typename TFeatureFilter, typename TStoreScale >
+  void computeScaleByScale( TFeatureFilter* featureFilter,
+			    const std::vector< float >& scales,
+			    TStoreScale storeScale ) {
+    for ( size_t i = 0; i < scales.size(); ++i ) {
+      featureFilter->SetSigmas( typename TFeatureFilter::SigmasType{ scales[i] } );
+      featureFilter->UpdateLargestPossibleRegion();
+      storeScale( i );
+    }
+  }
+
+  /** Calculate the features of all scales and pack them into packed, which
+      is allocated with the region of the features. Component c is encoded
+      by encoders[c]. */
+  template< typename TFeatureFilter, typename TPackedImage, typename TReal >
+  void computePackedFeatures( TFeatureFilter* featureFilter,
+			      const std::vector< float >& scales,
+			      std::vector< BinPreservingEncoder< TReal > >& encoders,
+			      TPackedImage* packed ) {
+    const size_t numFeatures = featureFilter->GetNumberOfSelectedFeatures();
+    featureFilter->SetPlanarOutput( false );
+    computeScaleByScale( featureFilter, scales, [&]( size_t i ) {
+	auto *scaleFeatures = featureFilter->GetOutput();
+	if ( i == 0 ) {
+	  packed->CopyInformation( scaleFeatures );
+	  packed->SetRegions( scaleFeatures->GetBufferedRegion() );
+	  packed->SetNumberOfComponentsPerPixel( numFeatures * scales.size() );
+	  packed->Allocate();
+	}
+	packFeatures( scaleFeatures, packed, i * numFeatures, encoders );
+	scaleFeatures->ReleaseData();
+      } );
+  }
+
+  /** Calculate the features of all scales and replace component c by its
+      bin of histogram c of histograms, which is stored in bins[c]. Voxels
+      where mask is zero get OutsideMaskBin. */
+  template< typename TFeatureFilter, typename TMask, typename TReal, typename TCount, typename TBinImage >
+  void computeBinFeatures( TFeatureFilter* featureFilter,
+			   const std::vector< float >& scales,
+			   const TMask* mask,
+			   const HistogramBank< TReal, TCount >& histograms,
+			   std::vector< SmartPointer< TBinImage > >& bins ) {
+    const size_t numFeatures = featureFilter->GetNumberOfSelectedFeatures();
+    featureFilter->SetPlanarOutput( true );
+    bins.clear();
+    computeScaleByScale( featureFilter, scales, [&]( size_t i ) {
+	for ( size_t k = 0; k < numFeatures; ++k ) {
+	  auto *feature = featureFilter->GetFeatureOutput( k );
+	  typename TBinImage::Pointer featureBins = TBinImage::New();
+	  featureBins->CopyInformation( feature );
+	  featureBins->SetRegions( feature->GetBufferedRegion() );
+	  featureBins->Allocate();
+	  quantizeFeature( feature, mask, histograms.getEdgeIndex( i * numFeatures + k ),
+			   featureBins.GetPointer() );
+	  bins.push_back( featureBins );
+	  feature->ReleaseData();
+	}
+      } );
+  }
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef __SmoothedCertaintyCache_h
+#define __SmoothedCertaintyCache_h
+
+/*
+  Smoothed certainties {a * c} kept in memory for reuse.
+
+  The denominator of normalized convolution only depends on the certainty
+  and the Gaussian, so when several images are processed with the same mask,
+  or the same image is processed again with the same mask and scales, the
+  smoothed certainty can be reused instead of smoothed again.
+
+  The certainty is identified by a digest of the values in its buffered
+  region together with its geometry, the region, spacing, origin and
+  direction, so two masks read from the same file, or two casts of the same
+  mask, have the same key. The key also holds the scale, the smoothing
+  method and the implementation that smoothed it, since the recursive
+  Gaussian of FusedNormalizedGaussianConvolutionImageFilter and ITK's
+  SmoothingRecursiveGaussianImageFilter differ by rounding. Only certainties
+  smoothed directly with the scale belong in the cache, not ones that are
+  smoothed from a smaller scale, whose error depends on the scales before
+  them.
+
+  The digest can collide, so the cache keeps a copy of each certainty and
+  Find compares it with the given certainty before it returns a smoothed
+  certainty.
+
+  The cache keeps at most MaximumNumberOfImages images and forgets the
+  oldest first. Each image is the size of the certainty, and the copies of
+  the certainties are shared by the images smoothed from the same
+  certainty, so the limit should be chosen with the memory in mind.
+
+  The images in the cache are shared and must not be modified. The cache can
+  be used by filters running in different threads.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+
+#include "itkMutexLockHolder.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include "ife/Filters/FusedNormalizedGaussianConvolutionImageFilter.h"
+
+namespace itk {
+
+  template < typename TImage >
+  class SmoothedCertaintyCache : public Object {
+  public:
+    typedef SmoothedCertaintyCache     Self;
+    typedef Object                     Superclass;
+    typedef SmartPointer< Self >       Pointer;
+    typedef SmartPointer< const Self > ConstPointer;
+
+    typedef TImage ImageType;
+    typedef typename ImageType::Pointer ImagePointer;
+    typedef typename ImageType::RegionType RegionType;
+    typedef typename ImageType::SpacingType SpacingType;
+    typedef typename ImageType::PointType PointType;
+    typedef typename ImageType::DirectionType DirectionType;
+    typedef double ScalarRealType;
+    typedef uint64_t DigestType;
+
+    /** The code that smoothed a certainty. Box smoothing is always done by
+	FusedNormalizedGaussianConvolutionImageFilter. */
+    enum ImplementationType {
+      ITKImplementation,   // SmoothingRecursiveGaussianImageFilter
+      FusedImplementation  // FusedNormalizedGaussianConvolutionImageFilter
+    };
+
+    /** Identifies a smoothed certainty */
+    struct KeyType {
+      DigestType Digest;
+      RegionType Region;
+      SpacingType Spacing;
+      PointType Origin;
+      DirectionType Direction;
+      ScalarRealType Sigma;
+      GaussianSmoothingMethod Method;
+      ImplementationType Implementation;
+
+      bool operator==( const KeyType& other ) const {
+	return Digest == other.Digest
+	  && Region == other.Region
+	  && Spacing == other.Spacing
+	  && Origin == other.Origin
+	  && Direction == other.Direction
+	  && Sigma == other.Sigma
+	  && Method == other.Method
+	  && Implementation == other.Implementation;
+      }
+    };
+
+    /** Method for creation through object factory */
+    itkNewMacro(Self);
+
+    /** Run-time type information */
+    itkTypeMacro(SmoothedCertaintyCache, Object);
+
+    /** The key of certainty smoothed with sigma by method and
+	implementation. The digest is calculated from the buffered region,
+	which is read once. */
+    static KeyType MakeKey( const ImageType* certainty,
+			    ScalarRealType sigma,
+			    GaussianSmoothingMethod method,
+			    ImplementationType implementation ) {
+      KeyType key;
+      key.Digest = ComputeDigest( certainty );
+      key.Region = certainty->GetBufferedRegion();
+      key.Spacing = certainty->GetSpacing();
+      key.Origin = certainty->GetOrigin();
+      key.Direction = certainty->GetDirection();
+      key.Sigma = sigma;
+      key.Method = method;
+      key.Implementation = implementation;
+      return key;
+    }
+
+    /** FNV-1a hash of the bytes of the buffered region */
+    static DigestType ComputeDigest( const ImageType* certainty ) {
+      const unsigned char *p =
+	reinterpret_cast< const unsigned char * >( certainty->GetBufferPointer() );
+      const unsigned char *end =
+	p + certainty->GetBufferedRegion().GetNumberOfPixels() * sizeof( typename ImageType::PixelType );
+      DigestType digest = 14695981039346656037ull;
+      for ( ; p != end; ++p ) {
+	digest = ( digest ^ *p ) * 1099511628211ull;
+      }
+      return digest;
+    }
+
+    /** The smoothed certainty with the given key, or null if it is not in
+	the cache. A certainty with the key, but other values than
+	certainty, is not returned. */
+    ImagePointer Find( const KeyType& key, const ImageType* certainty ) const {
+      MutexLockHolder< SimpleFastMutexLock > holder( m_Mutex );
+      for ( const Entry& entry : m_Entries ) {
+	if ( entry.Key == key && SameValues( entry.Certainty, certainty ) ) {
+	  return entry.Image;
+	}
+      }
+      return ITK_NULLPTR;
+    }
+
+    /** Add image, certainty smoothed as given by key, which can also be
+	precomputed elsewhere. The certainty is copied unless the cache has
+	a copy already. An image with the same key and certainty is
+	replaced. */
+    void Add( const KeyType& key, const ImageType* certainty, ImageType* image ) {
+      MutexLockHolder< SimpleFastMutexLock > holder( m_Mutex );
+      for ( Entry& entry : m_Entries ) {
+	if ( entry.Key == key && SameValues( entry.Certainty, certainty ) ) {
+	  entry.Image = image;
+	  return;
+	}
+      }
+      if ( m_MaximumNumberOfImages == 0 ) {
+	return;
+      }
+      while ( m_Entries.size() >= m_MaximumNumberOfImages ) {
+	m_Entries.pop_front();
+      }
+      Entry entry;
+      entry.Key = key;
+      entry.Image = image;
+
+      // The other scales of the certainty share its copy
+      for ( const Entry& other : m_Entries ) {
+	if ( other.Key.Digest == key.Digest && other.Key.Region == key.Region
+	     && SameValues( other.Certainty, certainty ) ) {
+	  entry.Certainty = other.Certainty;
+	  break;
+	}
+      }
+      if ( !entry.Certainty ) {
+	ImagePointer copy = ImageType::New();
+	copy->CopyInformation( certainty );
+	copy->SetRegions( certainty->GetBufferedRegion() );
+	copy->Allocate();
+	std::copy( certainty->GetBufferPointer(),
+		   certainty->GetBufferPointer() + certainty->GetBufferedRegion().GetNumberOfPixels(),
+		   copy->GetBufferPointer() );
+	entry.Certainty = copy;
+      }
+      m_Entries.push_back( entry );
+    }
+
+    /** Forget all images */
+    void Clear() {
+      MutexLockHolder< SimpleFastMutexLock > holder( m_Mutex );
+      m_Entries.clear();
+    }
+
+    size_t GetNumberOfImages() const {
+      MutexLockHolder< SimpleFastMutexLock > holder( m_Mutex );
+      return m_Entries.size();
+    }
+
+    /** Get/Set the largest number of images kept. Default is 8. */
+    itkGetConstMacro( MaximumNumberOfImages, size_t );
+    itkSetMacro( MaximumNumberOfImages, size_t );
+
+  protected:
+    SmoothedCertaintyCache() : m_MaximumNumberOfImages( 8 ) {}
+    virtual ~SmoothedCertaintyCache() {}
+
+    void PrintSelf( std::ostream& os, Indent indent ) const ITK_OVERRIDE {
+      Superclass::PrintSelf( os, indent );
+      os << indent << "MaximumNumberOfImages:" << m_MaximumNumberOfImages
+	 << std::endl;
+      os << indent << "NumberOfImages:" << this->GetNumberOfImages()
+	 << std::endl;
+    }
+
+  private:
+    SmoothedCertaintyCache(Self&);   // purposely not implemented
+    void operator=(const Self&);     // purposely not implemented
+
+    struct Entry {
+      KeyType Key;
+      ImagePointer Certainty;
+      ImagePointer Image;
+    };
+
+    /** If a and b, which have the same buffered region, have the same
+	values */
+    static bool SameValues( const ImageType* a, const ImageType* b ) {
+      const size_t n = a->GetBufferedRegion().GetNumberOfPixels();
+      return a->GetBufferedRegion() == b->GetBufferedRegion()
+	&& std::equal( a->GetBufferPointer(), a->GetBufferPointer() + n, b->GetBufferPointer() );
+    }
+
+    std::deque< Entry > m_Entries;
+    size_t m_MaximumNumberOfImages;
+    mutable SimpleFastMutexLock m_Mutex;
+  };
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+
+#include "ife/Numerics/Symmetric3x3EigenvalueBatchSolver.h"
+
+/*
+  Everything in solve is branch free so the loop in kernel can be vectorized
+  by the compiler. The file must be compiled with
+    -O3 -fno-math-errno -fno-trapping-math
+  otherwise the selects are not turned into blends, see
+  src/Numerics/CMakeLists.txt. We also compile with -ffp-contract=off, so the
+  AVX2 and AVX-512 versions do not use fused multiply-add and give the same
+  result as the SSE2 version.
+ */
+
+namespace {
+  const float PI = 3.14159265358979f;
+
+  inline float select( bool condition, float a, float b ) {
+    return condition ? a : b;
+  }
+
+  // asin(x) for |x| <= 0.5. Coefficients from Cephes asinf.
+  inline float asinSmall( float x ) {
+    const float z = x * x;
+    return ((((4.2163199048e-2f * z
+	       + 2.4181311049e-2f) * z
+	      + 4.5470025998e-2f) * z
+	     + 7.4953002686e-2f) * z
+	    + 1.6666752422e-1f) * z * x + x;
+  }
+
+  // acos(x) for |x| <= 1
+  inline float acosApprox( float x ) {
+    const float a = std::fabs( x );
+    // For |x| > 0.5 we use acos(a) = 2*asin(sqrt((1-a)/2)) which is well
+    // conditioned close to 1
+    const bool large = a > 0.5f;
+    const float s = select( large, std::sqrt( ( 1 - a ) * 0.5f ), a );
+    const float t = asinSmall( s );
+    const float acosA = select( large, 2 * t, PI/2 - t );
+    return select( x < 0, PI - acosA, acosA );
+  }
+
+  // cos(x) for 0 <= x <= pi, using cos(x) = -sin(x - pi/2) and the Taylor
+  // series of sin to the 11th order, which has error below 6e-8 on
+  // [-pi/2, pi/2].
+  inline float cosApprox( float x ) {
+    const float y = x - PI/2;
+    const float z = y * y;
+    const float s = (((((-2.5052108385e-8f * z
+			 + 2.7557319224e-6f) * z
+			- 1.9841269841e-4f) * z
+		       + 8.3333333333e-3f) * z
+		      - 1.6666666667e-1f) * z * y) + y;
+    return -s;
+  }
+
+  // Swap so that |a| >= |b|
+  inline void sortPair( float& a, float& b ) {
+    const bool swap = std::fabs( a ) < std::fabs( b );
+    const float t = a;
+    a = select( swap, b, a );
+    b = select( swap, t, b );
+  }
+
+  // The same algorithm as Symmetric3x3EigenvalueSolver, but we calculate both
+  // the diagonal and the general case and blend the results.
+  inline void solve( float A11, float A12, float A13,
+		     float A22, float A23, float A33,
+		     float& e1, float& e2, float& e3 ) {
+    const float p1 = A12*A12 + A13*A13 + A23*A23;
+    const bool diagonal = p1 == 0;
+
+    const float q = ( A11 + A22 + A33 ) / 3;
+    const float p2 = (A11 - q) * (A11 - q) + (A22 - q) * (A22 - q) +
+      (A33 - q) * (A33 - q) + 2 * p1;
+    // p is zero when the matrix is a multiple of the identity. Then we use the
+    // diagonal, so we just need to avoid division by zero.
+    const float p = select( diagonal, 1, std::sqrt( p2 / 6 ) );
+    const float pInv = 1 / p;
+    const float B11 = (A11 - q) * pInv;
+    const float B12 = A12 * pInv;
+    const float B13 = A13 * pInv;
+    const float B22 = (A22 - q) * pInv;
+    const float B23 = A23 * pInv;
+    const float B33 = (A33 - q) * pInv;
+    float r = (B11 * B22 * B33
+	       + 2 * B12 * B13 * B23
+	       - B23*B23 * B11
+	       - B13*B13 * B22
+	       - B12*B12 * B33
+	       ) / 2;
+    r = select( r < -1, -1, select( r > 1, 1, r ) );
+
+    const float phi = acosApprox( r ) / 3;
+    const float g1 = q + 2 * p * cosApprox( phi );
+    const float g3 = q + 2 * p * cosApprox( phi + PI * (2.0f/3.0f) );
+    const float g2 = 3 * q - g1 - g3;
+
+    e1 = select( diagonal, A11, g1 );
+    e2 = select( diagonal, A22, g2 );
+    e3 = select( diagonal, A33, g3 );
+
+    // Sorting network for |e1| >= |e2| >= |e3|
+    sortPair( e1, e3 );
+    sortPair( e1, e2 );
+    sortPair( e2, e3 );
+  }
+
+  typedef void (*KernelType)( const float * const A[6],
+			      float * const eigenvalues[3],
+			      std::size_t n );
+
+  // Matrices are copied to blocks on the stack, so the compiler knows that
+  // nothing aliases and the inner loop is vectorized with the full block as
+  // one, two or four vectors.
+  const std::size_t BlockSize = 16;
+
+  // Forced inline so it is compiled with the instruction set of the caller
+  inline __attribute__((always_inline))
+  void kernel( const float * const A[6],
+	       float * const eigenvalues[3],
+	       std::size_t n ) {
+    float a[6][BlockSize];
+    float e[3][BlockSize];
+    for ( std::size_t start = 0; start < n; start += BlockSize ) {
+      const std::size_t m = std::min( BlockSize, n - start );
+      for ( std::size_t k = 0; k < 6; ++k ) {
+	std::copy( A[k] + start, A[k] + start + m, a[k] );
+	// The remainder of a partial block is solved as a zero matrix
+	std::fill( a[k] + m, a[k] + BlockSize, 0.0f );
+      }
+      for ( std::size_t i = 0; i < BlockSize; ++i ) {
+	solve( a[0][i], a[1][i], a[2][i], a[3][i], a[4][i], a[5][i],
+	       e[0][i], e[1][i], e[2][i] );
+      }
+      for ( std::size_t k = 0; k < 3; ++k ) {
+	std::copy( e[k], e[k] + m, eigenvalues[k] + start );
+      }
+    }
+  }
+
+  void kernelDefault( const float * const A[6],
+		      float * const eigenvalues[3],
+		      std::size_t n ) {
+    kernel( A, eigenvalues, n );
+  }
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+  __attribute__((target("avx2")))
+  void kernelAVX2( const float * const A[6],
+		   float * const eigenvalues[3],
+		   std::size_t n ) {
+    kernel( A, eigenvalues, n );
+  }
+
+  __attribute__((target("avx512f")))
+  void kernelAVX512( const float * const A[6],
+		     float * const eigenvalues[3],
+		     std::size_t n ) {
+    kernel( A, eigenvalues, n );
+  }
+#endif
+
+  struct Dispatch {
+    KernelType kernel;
+    const char *name;
+  };
+
+  Dispatch selectKernel() {
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx512f" ) ) {
+      return Dispatch{ kernelAVX512, "AVX-512" };
+    }
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+      return Dispatch{ kernelAVX2, "AVX2" };
+    }
+    return Dispatch{ kernelDefault, "SSE2" };
+#else
+    return Dispatch{ kernelDefault, "default" };
+#endif
+  }
+
+  const Dispatch& dispatch() {
+    static const Dispatch selected = selectKernel();
+    return selected;
+  }
+}
+
+
+template<>
+void
+Symmetric3x3EigenvalueBatchSolver< float >
+::compute( const float * const A[6], float * const eigenvalues[3], std::size_t n ) {
+  dispatch().kernel( A, eigenvalues, n );
+}
+
+template<>
+const char*
+Symmetric3x3EigenvalueBatchSolver< float >
+::instructionSet() {
+  return dispatch().name;
+}
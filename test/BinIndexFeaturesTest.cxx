@@ -0,0 +1,169 @@
+/*
+  Test that the histograms of a region made from the bin indices of a
+  feature are the histograms made from the feature and the mask, and that
+  the bins can be removed again. The bins must be the bins of EdgeIndex for
+  values on the edges, for lines that are not a multiple of the vector
+  width, for features that do not start where the mask starts and for more
+  edges than getBins counts.
+ */
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ife/Statistics/MaskedRegionHistogram.h"
+#include "ife/Util/BinIndexFeatures.h"
+
+#include "HistogramTestData.h"
+
+typedef itk::Image< itk::BinIndexType, 3 > BinImageType;
+typedef EdgeIndex< PixelType > EdgeIndexType;
+
+const unsigned int ImageSize = 20;
+
+// Bins with the buffered region of feature
+BinImageType::Pointer
+makeBins( const ImageType* feature ) {
+  BinImageType::Pointer bins = BinImageType::New();
+  bins->CopyInformation( feature );
+  bins->SetRegions( feature->GetBufferedRegion() );
+  bins->Allocate();
+  return bins;
+}
+
+// Quantize feature and compare each bin to the bin of edgeIndex
+BinImageType::Pointer
+__TestQuantization( const ImageType* feature, const MaskType* mask, const EdgeIndexType& edgeIndex ) {
+  BinImageType::Pointer bins = makeBins( feature );
+  itk::quantizeFeature( feature, mask, edgeIndex, bins.GetPointer() );
+
+  itk::ImageRegionIterator< BinImageType > iter( bins, bins->GetBufferedRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const PixelType value = feature->GetPixel( iter.GetIndex() );
+    if ( mask->GetPixel( iter.GetIndex() ) ) {
+      EXPECT_EQ( edgeIndex.getBin( value ), iter.Get() ) << "Value " << value;
+    }
+    else {
+      EXPECT_EQ( itk::OutsideMaskBin, iter.Get() );
+    }
+  }
+  return bins;
+}
+
+TEST( BinIndexFeatures, MatchesFeatureHistograms ) {
+  std::mt19937 gen(42);
+  const RegionType imageRegion( SizeType{ {ImageSize, ImageSize, ImageSize} } );
+  ImageType::Pointer feature = makeRandomFeature( gen, imageRegion );
+  MaskType::Pointer mask = makeRandomMask( gen, imageRegion );
+  const HistogramBankType histograms = makeHistogramBank();
+  BinImageType::Pointer bins =
+    __TestQuantization( feature.GetPointer(), mask.GetPointer(), histograms.getEdgeIndex( 0 ) );
+
+  // A region inside the image and the whole image
+  for ( const RegionType& region : { RegionType( IndexType{ {2, 3, 4} }, SizeType{ {13, 7, 9} } ),
+				      imageRegion } ) {
+    HistogramBankType expected( histograms );
+    auto expectedHistogram = expected.getHistogram( 0 );
+    itk::insertMaskedRegion( feature.GetPointer(), mask.GetPointer(), region, expectedHistogram );
+    HistogramBankType actual( histograms );
+    auto actualHistogram = actual.getHistogram( 0 );
+    itk::insertBinRegion( bins.GetPointer(), region, actualHistogram );
+    for ( size_t l = 0; l < histograms.getNumberOfBins(); ++l ) {
+      EXPECT_EQ( expected.getCount( 0, l ), actual.getCount( 0, l ) ) << "Region " << region << " bin " << l;
+    }
+
+    itk::removeBinRegion( bins.GetPointer(), region, actualHistogram );
+    for ( size_t l = 0; l < histograms.getNumberOfBins(); ++l ) {
+      EXPECT_EQ( 0u, actual.getCount( 0, l ) ) << "Region " << region << " bin " << l;
+    }
+  }
+}
+
+TEST( BinIndexFeatures, ValuesOnTheEdges ) {
+  // Lines of 13 voxels, and a feature inside a larger mask
+  std::mt19937 gen(42);
+  const RegionType featureRegion( IndexType{ {-2, 1, 3} }, SizeType{ {13, 3, 2} } );
+  const RegionType maskRegion( IndexType{ {-5, 0, 0} }, SizeType{ {ImageSize, 6, 7} } );
+  MaskType::Pointer mask = makeRandomMask( gen, maskRegion );
+  const HistogramBankType histograms = makeHistogramBank();
+
+  // Each edge, the values next to it, and values outside the edges
+  std::vector< PixelType > values{ -10, 10 };
+  for ( PixelType edge : histogramEdges() ) {
+    values.push_back( edge );
+    values.push_back( std::nextafter( edge, -std::numeric_limits< PixelType >::infinity() ) );
+    values.push_back( std::nextafter( edge, std::numeric_limits< PixelType >::infinity() ) );
+  }
+  std::uniform_int_distribution< size_t > valueDis( 0, values.size() - 1 );
+  ImageType::Pointer feature = makeRandomImage< ImageType >( gen, [&]( std::mt19937& g ) {
+      return values[valueDis( g )];
+    }, featureRegion );
+
+  BinImageType::Pointer bins =
+    __TestQuantization( feature.GetPointer(), mask.GetPointer(), histograms.getEdgeIndex( 0 ) );
+  HistogramBankType expected( histograms );
+  auto expectedHistogram = expected.getHistogram( 0 );
+  itk::insertMaskedRegion( feature.GetPointer(), mask.GetPointer(), featureRegion, expectedHistogram );
+  HistogramBankType actual( histograms );
+  auto actualHistogram = actual.getHistogram( 0 );
+  itk::insertBinRegion( bins.GetPointer(), featureRegion, actualHistogram );
+  for ( size_t l = 0; l < histograms.getNumberOfBins(); ++l ) {
+    EXPECT_EQ( expected.getCount( 0, l ), actual.getCount( 0, l ) ) << "Bin " << l;
+  }
+}
+
+TEST( BinIndexFeatures, ManyEdges ) {
+  std::mt19937 gen(42);
+  const RegionType region( SizeType{ {ImageSize, ImageSize, 3} } );
+  ImageType::Pointer feature = makeRandomFeature( gen, region );
+  MaskType::Pointer mask = makeRandomMask( gen, region );
+
+  // More edges than getBins counts, and not uniform, so each value is
+  // searched
+  std::vector< PixelType > edges;
+  for ( int i = 0; i <= 100; ++i ) {
+    edges.push_back( -5 + 10 * ( i / 100.0f ) * ( i / 100.0f ) );
+  }
+  const EdgeIndexType edgeIndex( edges.begin(), edges.end() );
+  const size_t maxEdgesForCounting = EdgeIndexType::MaxEdgesForCounting;
+  ASSERT_LT( maxEdgesForCounting, edges.size() );
+  ASSERT_FALSE( edgeIndex.isUniform() );
+  __TestQuantization( feature.GetPointer(), mask.GetPointer(), edgeIndex );
+
+  // The bins of more edges do not fit in bin indices
+  edges.resize( itk::OutsideMaskBin );
+  for ( size_t i = 0; i < edges.size(); ++i ) {
+    edges[i] = -5 + 0.01f * i;
+  }
+  BinImageType::Pointer bins = makeBins( feature.GetPointer() );
+  EXPECT_ANY_THROW( itk::quantizeFeature( feature.GetPointer(), mask.GetPointer(),
+					  EdgeIndexType( edges.begin(), edges.end() ),
+					  bins.GetPointer() ) );
+}
+
+TEST( BinIndexFeatures, RegionsMustBeInside ) {
+  std::mt19937 gen(42);
+  const RegionType region( SizeType{ {ImageSize, ImageSize, ImageSize} } );
+  ImageType::Pointer feature = makeRandomFeature( gen, region );
+  const HistogramBankType histograms = makeHistogramBank();
+
+  // A mask that does not contain the feature
+  MaskType::Pointer mask =
+    makeRandomMask( gen, RegionType( IndexType{ {1, 0, 0} }, SizeType{ {ImageSize, ImageSize, ImageSize} } ) );
+  BinImageType::Pointer bins = makeBins( feature.GetPointer() );
+  EXPECT_ANY_THROW( itk::quantizeFeature( feature.GetPointer(), mask.GetPointer(),
+					  histograms.getEdgeIndex( 0 ), bins.GetPointer() ) );
+
+  // A region that is not inside the bins
+  HistogramBankType bank( histograms );
+  auto histogram = bank.getHistogram( 0 );
+  const RegionType outside( IndexType{ {0, 0, 1} }, SizeType{ {ImageSize, ImageSize, ImageSize} } );
+  EXPECT_ANY_THROW( itk::insertBinRegion( bins.GetPointer(), outside, histogram ) );
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,9 +1,16 @@
 /*
   Test the dense histogram class
  */
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "ife/Statistics/DenseHistogram.h"
+#include "ife/Statistics/EdgeIndex.h"
+#include "ife/Statistics/HistogramBank.h"
 
 typedef float RealType;
 
@@ -54,6 +61,188 @@ TEST( DenseHistogram, Frequencies ) {
   }
 }
 
+TEST( DenseHistogram, InsertMany ) {
+  // Values on and around the edges, and more than one block of values
+  const std::vector< RealType > edges{ 1, 2.5, 3.0, 4.7, 6.2, 8.3 };
+  std::vector< RealType > values;
+  for ( size_t i = 0; i < 1000; ++i ) {
+    values.push_back( edges[i % edges.size()] + ( int( i % 5 ) - 2 ) * 0.25f );
+  }
+  values.push_back( std::numeric_limits< RealType >::infinity() );
+  values.push_back( -std::numeric_limits< RealType >::infinity() );
+  values.push_back( std::numeric_limits< RealType >::quiet_NaN() );
+
+  // Few edges are counted, many edges are searched
+  std::vector< RealType > manyEdges;
+  for ( size_t i = 0; i < 100; ++i ) {
+    manyEdges.push_back( i * 0.1f );
+  }
+
+  for ( const auto& e : { edges, manyEdges } ) {
+    DenseHistogram<RealType> expected( e.begin(), e.end() );
+    for ( auto value : values ) {
+      expected.insert( value );
+    }
+    DenseHistogram<RealType> actual( e.begin(), e.end() );
+    actual.insert( values.data(), values.size() );
+    EXPECT_EQ( expected.getCounts(), actual.getCounts() ) << e.size() << " edges";
+  }
+}
+
+// The bin of the current implementation
+size_t lowerBoundBin( const std::vector< RealType >& edges, RealType value ) {
+  return std::lower_bound( edges.begin(), edges.end(), value ) - edges.begin();
+}
+
+// The edges, the values just around them and random values in and beyond
+// the range of the edges
+std::vector< RealType > valuesAroundEdges( const std::vector< RealType >& edges ) {
+  std::vector< RealType > values{
+    std::numeric_limits< RealType >::infinity(),
+    -std::numeric_limits< RealType >::infinity(),
+    std::numeric_limits< RealType >::quiet_NaN(),
+    std::numeric_limits< RealType >::max(),
+    std::numeric_limits< RealType >::lowest() };
+  for ( auto edge : edges ) {
+    values.push_back( edge );
+    values.push_back( std::nextafter( edge, -std::numeric_limits< RealType >::infinity() ) );
+    values.push_back( std::nextafter( edge, std::numeric_limits< RealType >::infinity() ) );
+  }
+  const RealType range = edges.back() - edges.front() + 1;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution< RealType > dis( edges.front() - range, edges.back() + range );
+  for ( size_t i = 0; i < 10000; ++i ) {
+    values.push_back( dis( gen ) );
+  }
+  return values;
+}
+
+TEST( EdgeIndex, MatchesLowerBound ) {
+  std::vector< std::vector< RealType > > edgeSets{
+    { 1, 2.5, 3.0, 4.7, 6.2, 8.3 },
+    { 0.5 },
+    { -3, -3, 0, 0, 0, 7 },
+    { -1000.3f, -2.001f, -0.0101f, 0.0f, 0.01f, 1.0001f, 1.0161f, 3.3f, 70000 } };
+  // 2^k - 1 edges fill the tree, 2^k edges need another level
+  for ( size_t n : { 7, 8, 31, 33 } ) {
+    std::vector< RealType > edges;
+    for ( size_t i = 0; i < n; ++i ) {
+      edges.push_back( i * i * 0.1f - 3 );
+    }
+    edgeSets.push_back( edges );
+  }
+
+  // Many edges are searched by getBins
+  std::vector< RealType > manyEdges;
+  for ( size_t i = 0; i < 100; ++i ) {
+    manyEdges.push_back( i * 0.37f - 10 );
+  }
+  manyEdges.back() += 1;
+  edgeSets.push_back( manyEdges );
+
+  for ( const auto& edges : edgeSets ) {
+    EdgeIndex< RealType > index( edges.begin(), edges.end() );
+    EXPECT_FALSE( index.isUniform() ) << edges.size() << " edges";
+    const auto values = valuesAroundEdges( edges );
+    std::vector< uint8_t > bins( values.size() );
+    index.getBins( values.data(), values.size(), bins.data() );
+    for ( size_t i = 0; i < values.size(); ++i ) {
+      ASSERT_EQ( lowerBoundBin( edges, values[i] ), index.getBin( values[i] ) )
+	<< "Value " << values[i] << " with " << edges.size() << " edges";
+      ASSERT_EQ( lowerBoundBin( edges, values[i] ), bins[i] )
+	<< "Value " << values[i] << " with " << edges.size() << " edges";
+    }
+  }
+}
+
+TEST( EdgeIndex, UniformMatchesLowerBound ) {
+  std::vector< std::vector< RealType > > edgeSets;
+  // Uniform edges as they are written in a histogram specification, so
+  // they are rounded
+  for ( RealType first : { -1000.0f, -1.5f, 0.0f, 0.3f } ) {
+    for ( RealType width : { 0.001f, 0.1f, 1.0f / 3, 25.0f } ) {
+      std::vector< RealType > edges;
+      for ( size_t i = 0; i < 40; ++i ) {
+	edges.push_back( std::round( ( first + i * width ) * 1000 ) / 1000 );
+      }
+      edgeSets.push_back( edges );
+    }
+  }
+
+  for ( const auto& edges : edgeSets ) {
+    EdgeIndex< RealType > index( edges.begin(), edges.end() );
+    ASSERT_TRUE( index.isUniform() ) << edges.front() << " " << edges.back();
+    for ( auto value : valuesAroundEdges( edges ) ) {
+      ASSERT_EQ( lowerBoundBin( edges, value ), index.getUniformBin( value ) )
+	<< "Value " << value << " with edges " << edges.front() << " to " << edges.back();
+      ASSERT_EQ( lowerBoundBin( edges, value ), index.getSearchedBin( value ) )
+	<< "Value " << value << " with edges " << edges.front() << " to " << edges.back();
+    }
+  }
+}
+
+TEST( HistogramBank, MatchesDenseHistograms ) {
+  // Few edges are counted, many are searched
+  for ( size_t nEdges : { 6, 70 } ) {
+    const size_t nHistograms = 5;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution< RealType > dis( -10, 10 );
+    std::vector< DenseHistogram< RealType > > histograms;
+    HistogramBank< RealType, uint16_t > bank;
+    for ( size_t k = 0; k < nHistograms; ++k ) {
+      std::vector< RealType > edges( nEdges );
+      for ( auto& edge : edges ) {
+	edge = dis( gen );
+      }
+      std::sort( edges.begin(), edges.end() );
+      histograms.emplace_back( edges.begin(), edges.end() );
+      bank.addHistogram( edges.begin(), edges.end() );
+    }
+    ASSERT_EQ( nHistograms, bank.getNumberOfHistograms() );
+    ASSERT_EQ( nEdges + 1, bank.getNumberOfBins() );
+
+    // Feature vectors, and runs of values of one histogram
+    std::vector< RealType > values( nHistograms );
+    for ( size_t i = 0; i < 1000; ++i ) {
+      for ( size_t k = 0; k < nHistograms; ++k ) {
+	values[k] = dis( gen );
+	histograms[k].insert( values[k] );
+      }
+      bank.insert( values.data() );
+    }
+    values.resize( 600 );
+    for ( size_t k = 0; k < nHistograms; ++k ) {
+      for ( auto& value : values ) {
+	value = dis( gen );
+	histograms[k].insert( value );
+      }
+      auto histogram = bank.getHistogram( k );
+      histogram.insert( values.data(), values.size() );
+    }
+
+    for ( size_t k = 0; k < nHistograms; ++k ) {
+      const auto expected = histograms[k].getCounts();
+      for ( size_t l = 0; l < bank.getNumberOfBins(); ++l ) {
+	ASSERT_EQ( expected[l], bank.getCount( k, l ) ) << k << " " << l;
+      }
+    }
+
+    // One row with the frequencies of all histograms, after which the counts
+    // are reset
+    std::vector< RealType > row( nHistograms * bank.getNumberOfBins() + 1, -1 );
+    auto end = bank.emitFrequencies( row.begin() );
+    EXPECT_EQ( row.end() - 1, end );
+    EXPECT_EQ( -1, row.back() );
+    for ( size_t k = 0; k < nHistograms; ++k ) {
+      const auto expected = histograms[k].getFrequencies();
+      for ( size_t l = 0; l < bank.getNumberOfBins(); ++l ) {
+	EXPECT_EQ( expected[l], row[k * bank.getNumberOfBins() + l] );
+	EXPECT_EQ( 0, bank.getCount( k, l ) );
+      }
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
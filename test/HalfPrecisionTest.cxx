@@ -0,0 +1,145 @@
+/*
+  Test the conversion of floats to float16 and bfloat16 and the encoding that
+  keeps the histogram bin of a value.
+ */
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ife/Numerics/HalfPrecision.h"
+#include "ife/Statistics/DenseHistogram.h"
+
+TEST( HalfPrecision, Float16ExactValues ) {
+  const std::vector< float > values{ 0, 1, -1, 0.5, 2, 1024, -2048, 65504, -65504,
+      std::ldexp( 1.0f, -14 ),   // Smallest normal
+      std::ldexp( 1.0f, -24 ),   // Smallest subnormal
+      std::ldexp( 3.0f, -24 ) };
+  for ( float value : values ) {
+    EXPECT_EQ( value, float16ToFloat( floatToFloat16( value ) ) ) << value;
+  }
+  EXPECT_EQ( 0x3C00, floatToFloat16( 1 ) );
+  EXPECT_EQ( 0x7BFF, floatToFloat16( 65504 ) );
+  EXPECT_EQ( 0x0001, floatToFloat16( std::ldexp( 1.0f, -24 ) ) );
+}
+
+TEST( HalfPrecision, Float16RoundsToNearestEven ) {
+  // The spacing at 1 is 2^-10
+  const float ulp = std::ldexp( 1.0f, -10 );
+  EXPECT_EQ( 1.0f, float16ToFloat( floatToFloat16( 1 + 0.5f * ulp ) ) );
+  EXPECT_EQ( 1 + 2 * ulp, float16ToFloat( floatToFloat16( 1 + 1.5f * ulp ) ) );
+  EXPECT_EQ( 1 + ulp, float16ToFloat( floatToFloat16( 1 + 0.75f * ulp ) ) );
+  // Ties between subnormals
+  EXPECT_EQ( 0x0000, floatToFloat16( std::ldexp( 1.0f, -25 ) ) );
+  EXPECT_EQ( 0x0002, floatToFloat16( std::ldexp( 3.0f, -25 ) ) );
+  // Overflow
+  EXPECT_EQ( 0x7BFF, floatToFloat16( 65519 ) );
+  EXPECT_EQ( 0x7C00, floatToFloat16( 65520 ) );
+  EXPECT_EQ( 0xFC00, floatToFloat16( -1e6f ) );
+  EXPECT_TRUE( std::isnan( float16ToFloat( floatToFloat16( std::numeric_limits< float >::quiet_NaN() ) ) ) );
+}
+
+TEST( HalfPrecision, Float16RoundTripsAllValues ) {
+  for ( uint32_t bits = 0; bits <= 0xFFFF; ++bits ) {
+    const float value = float16ToFloat( bits );
+    if ( std::isnan( value ) ) {
+      EXPECT_TRUE( std::isnan( float16ToFloat( floatToFloat16( value ) ) ) );
+    }
+    else {
+      EXPECT_EQ( bits, floatToFloat16( value ) ) << bits;
+    }
+  }
+}
+
+TEST( HalfPrecision, Float16ArraysMatchScalars ) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution< float > dis( -70000, 70000 );
+  std::vector< float > values( 1003 );
+  for ( auto& value : values ) {
+    value = dis( gen ) * std::ldexp( 1.0f, int( dis( gen ) ) % 20 - 20 );
+  }
+  std::vector< uint16_t > half( values.size() );
+  floatToFloat16( &values[0], &half[0], values.size() );
+  std::vector< float > decoded( values.size() );
+  float16ToFloat( &half[0], &decoded[0], values.size() );
+  for ( size_t i = 0; i < values.size(); ++i ) {
+    ASSERT_EQ( floatToFloat16( values[i] ), half[i] ) << values[i];
+    ASSERT_EQ( float16ToFloat( half[i] ), decoded[i] ) << values[i];
+  }
+}
+
+TEST( HalfPrecision, BFloat16 ) {
+  EXPECT_EQ( 0x3F80, floatToBFloat16( 1 ) );
+  EXPECT_NEAR( 1e30f, bfloat16ToFloat( floatToBFloat16( 1e30f ) ), 1e30f / 256 );
+  // The spacing at 1 is 2^-7
+  const float ulp = std::ldexp( 1.0f, -7 );
+  EXPECT_EQ( 1.0f, bfloat16ToFloat( floatToBFloat16( 1 + 0.5f * ulp ) ) );
+  EXPECT_EQ( 1 + 2 * ulp, bfloat16ToFloat( floatToBFloat16( 1 + 1.5f * ulp ) ) );
+  EXPECT_TRUE( std::isnan( bfloat16ToFloat( floatToBFloat16( std::numeric_limits< float >::quiet_NaN() ) ) ) );
+  for ( uint32_t bits = 0; bits <= 0xFFFF; ++bits ) {
+    const float value = bfloat16ToFloat( bits );
+    if ( !std::isnan( value ) ) {
+      EXPECT_EQ( bits, floatToBFloat16( value ) ) << bits;
+    }
+  }
+}
+
+TEST( HalfPrecision, BinPreservingEncoderKeepsHistograms ) {
+  // Narrow bins and values close to the edges, where rounding to the nearest
+  // value would often change the bin
+  const std::vector< float > edges{ -1000.3f, -2.001f, -0.0101f, 0.0f, 0.01f, 1.0001f, 1.0161f, 3.3f, 70000 };
+  std::mt19937 gen(42);
+  std::uniform_int_distribution< size_t > edgeDis( 0, edges.size() - 1 );
+  std::uniform_real_distribution< float > offsetDis( -1e-3f, 1e-3f );
+
+  for ( HalfPrecisionFormat format : { Float16Format, BFloat16Format } ) {
+    HalfPrecisionCodec codec( format );
+    BinPreservingEncoder< float > encoder( codec, edges.begin(), edges.end() );
+    DenseHistogram< float > expected( edges.begin(), edges.end() );
+    DenseHistogram< float > actual( edges.begin(), edges.end() );
+    DenseHistogram< float > nearest( edges.begin(), edges.end() );
+    for ( size_t i = 0; i < 10000; ++i ) {
+      const float edge = edges[edgeDis( gen )];
+      const float value = edge + offsetDis( gen ) * std::max( 1.0f, std::fabs( edge ) );
+      expected.insert( value );
+      actual.insert( encoder.decode( encoder.encode( value ) ) );
+      nearest.insert( codec.decode( codec.encode( value ) ) );
+    }
+    EXPECT_EQ( 0u, encoder.getNumberOfNotPreserved() );
+    EXPECT_EQ( expected.getCounts(), actual.getCounts() ) << HalfPrecisionCodec::getFormatName( format );
+    // Otherwise the test does not test anything
+    EXPECT_NE( expected.getCounts(), nearest.getCounts() ) << HalfPrecisionCodec::getFormatName( format );
+  }
+}
+
+TEST( HalfPrecision, BinPreservingEncoderDetectsNarrowBins ) {
+  // Lung intensities around -860 HU, where the spacing is 0.5 for float16
+  // and 4 for bfloat16
+  const std::vector< float > narrowEdges{ -870.0f, -868.0f, -866.0f, -865.7f, -865.0f };
+  const std::vector< float > wideEdges{ -870.0f, -866.0f, -862.0f };
+  std::mt19937 gen(42);
+  std::uniform_real_distribution< float > dis( -872.0f, -860.0f );
+  for ( HalfPrecisionFormat format : { Float16Format, BFloat16Format } ) {
+    HalfPrecisionCodec codec( format );
+    BinPreservingEncoder< float > narrow( codec, narrowEdges.begin(), narrowEdges.end() );
+    const std::vector< bool > expected = format == Float16Format
+      ? std::vector< bool >{ true, true, true, false, true, true }
+      : std::vector< bool >{ true, true, false, false, false, true };
+    for ( size_t bin = 0; bin < expected.size(); ++bin ) {
+      EXPECT_EQ( expected[bin], narrow.hasValueInBin( bin ) )
+	<< HalfPrecisionCodec::getFormatName( format ) << " bin " << bin;
+    }
+    EXPECT_FALSE( narrow.preservesAllBins() );
+
+    // When every bin has a value, every value keeps its bin
+    BinPreservingEncoder< float > wide( codec, wideEdges.begin(), wideEdges.end() );
+    ASSERT_TRUE( wide.preservesAllBins() ) << HalfPrecisionCodec::getFormatName( format );
+    for ( size_t i = 0; i < 10000; ++i ) {
+      const float value = dis( gen );
+      ASSERT_EQ( wide.getBin( value ), wide.getBin( wide.decode( wide.encode( value ) ) ) ) << value;
+    }
+    EXPECT_EQ( 0u, wide.getNumberOfNotPreserved() );
+  }
+}
@@ -0,0 +1,132 @@
+/*
+  Test the single stencil Hessian filter against the composition of
+  DerivativeImageFilter it replaces.
+ */
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkComposeImageFilter.h"
+#include "itkDerivativeImageFilter.h"
+#include "itkGradientMagnitudeImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+
+#include "ife/Filters/Hessian3DImageFilter.h"
+
+typedef float PixelType;
+typedef itk::Image< PixelType, 3 > ImageType;
+typedef itk::VectorImage< PixelType, 3 > VectorImageType;
+typedef itk::Hessian3DImageFilter< ImageType, VectorImageType > HessianFilterType;
+typedef itk::DerivativeImageFilter< ImageType, ImageType > DerivativeFilterType;
+
+// Random values in [0,100] with anisotropic spacing
+ImageType::Pointer
+makeImage() {
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size{ {23, 17, 11} };
+  image->SetRegions( size );
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.7;
+  spacing[1] = 0.9;
+  spacing[2] = 1.3;
+  image->SetSpacing( spacing );
+  image->Allocate();
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<PixelType> dis(0, 100);
+  itk::ImageRegionIterator< ImageType > iter( image, image->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    iter.Set( dis(gen) );
+  }
+  return image;
+}
+
+DerivativeFilterType::Pointer
+makeDerivative( const ImageType* input, unsigned int order, unsigned int direction ) {
+  DerivativeFilterType::Pointer filter = DerivativeFilterType::New();
+  filter->SetInput( input );
+  filter->SetOrder( order );
+  filter->SetDirection( direction );
+  return filter;
+}
+
+TEST( Hessian3DImageFilter, MatchesDerivativeComposition ) {
+  ImageType::Pointer image = makeImage();
+
+  DerivativeFilterType::Pointer dx = makeDerivative( image, 1, 0 );
+  DerivativeFilterType::Pointer dy = makeDerivative( image, 1, 1 );
+  typedef itk::ComposeImageFilter< ImageType, VectorImageType > ComposeFilterType;
+  ComposeFilterType::Pointer reference = ComposeFilterType::New();
+  reference->SetInput( 0, makeDerivative( image, 2, 0 )->GetOutput() );
+  reference->SetInput( 1, makeDerivative( dx->GetOutput(), 1, 1 )->GetOutput() );
+  reference->SetInput( 2, makeDerivative( dx->GetOutput(), 1, 2 )->GetOutput() );
+  reference->SetInput( 3, makeDerivative( image, 2, 1 )->GetOutput() );
+  reference->SetInput( 4, makeDerivative( dy->GetOutput(), 1, 2 )->GetOutput() );
+  reference->SetInput( 5, makeDerivative( image, 2, 2 )->GetOutput() );
+  reference->Update();
+
+  typedef itk::GradientMagnitudeImageFilter< ImageType, ImageType > GradientMagnitudeFilterType;
+  GradientMagnitudeFilterType::Pointer gradientMagnitude = GradientMagnitudeFilterType::New();
+  gradientMagnitude->SetInput( image );
+  gradientMagnitude->Update();
+
+  HessianFilterType::Pointer hessian = HessianFilterType::New();
+  hessian->SetInput( image );
+  hessian->ComputeGradientMagnitudeOn();
+  hessian->Update();
+  ASSERT_EQ( 7, hessian->GetOutput()->GetNumberOfComponentsPerPixel() );
+
+  itk::ImageRegionConstIteratorWithIndex< ImageType >
+    iter( image, image->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const VectorImageType::PixelType expected = reference->GetOutput()->GetPixel( iter.GetIndex() );
+    const VectorImageType::PixelType actual = hessian->GetOutput()->GetPixel( iter.GetIndex() );
+    for ( unsigned int k = 0; k < 6; ++k ) {
+      EXPECT_NEAR( expected[k], actual[k], 1e-3 )
+	<< "Component " << k << " index " << iter.GetIndex();
+    }
+    EXPECT_NEAR( gradientMagnitude->GetOutput()->GetPixel( iter.GetIndex() ), actual[6], 1e-3 )
+      << "Index " << iter.GetIndex();
+  }
+}
+
+TEST( Hessian3DImageFilter, RequestedRegionMatchesLargestPossibleRegion ) {
+  ImageType::Pointer image = makeImage();
+
+  HessianFilterType::Pointer full = HessianFilterType::New();
+  full->SetInput( image );
+  full->Update();
+
+  // A region touching the border in x and inside the image in y and z
+  ImageType::RegionType region;
+  region.SetIndex( 0, 0 );
+  region.SetIndex( 1, 3 );
+  region.SetIndex( 2, 4 );
+  region.SetSize( 0, 10 );
+  region.SetSize( 1, 5 );
+  region.SetSize( 2, 3 );
+
+  HessianFilterType::Pointer part = HessianFilterType::New();
+  part->SetInput( image );
+  part->GetOutput()->SetRequestedRegion( region );
+  part->Update();
+
+  itk::ImageRegionConstIteratorWithIndex< ImageType > iter( image, region );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const VectorImageType::PixelType expected = full->GetOutput()->GetPixel( iter.GetIndex() );
+    const VectorImageType::PixelType actual = part->GetOutput()->GetPixel( iter.GetIndex() );
+    for ( unsigned int k = 0; k < 6; ++k ) {
+      EXPECT_FLOAT_EQ( expected[k], actual[k] )
+	<< "Component " << k << " index " << iter.GetIndex();
+    }
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,74 @@
+#ifndef __HistogramTestData_h
+#define __HistogramTestData_h
+
+/*
+  Random features, masks and histogram edges for the tests of the histograms
+  of ROIs, see SlidingWindowHistogramsTest, IntegralHistogramTest and
+  BinIndexFeaturesTest. The tests make them from one generator seeded with
+  42, so the counts they compare are the same on every run.
+ */
+#include <random>
+#include <vector>
+
+#include "itkImage.h"
+#include "itkImageRegionIterator.h"
+
+#include "ife/Statistics/HistogramBank.h"
+
+typedef float PixelType;
+typedef unsigned char MaskPixelType;
+typedef itk::Image< PixelType, 3 > ImageType;
+typedef itk::Image< MaskPixelType, 3 > MaskType;
+typedef ImageType::RegionType RegionType;
+typedef ImageType::IndexType IndexType;
+typedef ImageType::SizeType SizeType;
+typedef HistogramBank< PixelType > HistogramBankType;
+
+// An image with the buffered region region and values drawn from dis
+template< typename TImage, typename TDistribution >
+typename TImage::Pointer
+makeRandomImage( std::mt19937& gen, TDistribution dis, const RegionType& region ) {
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions( region );
+  image->Allocate();
+  itk::ImageRegionIterator< TImage > iter( image, region );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    iter.Set( dis( gen ) );
+  }
+  return image;
+}
+
+// A feature with values in [-5, 5], on both sides of the histogram edges
+inline ImageType::Pointer
+makeRandomFeature( std::mt19937& gen, const RegionType& region ) {
+  return makeRandomImage< ImageType >( gen, std::uniform_real_distribution< PixelType >( -5, 5 ), region );
+}
+
+// A mask where three of four voxels are in the mask, with labels 1 to 3
+inline MaskType::Pointer
+makeRandomMask( std::mt19937& gen, const RegionType& region ) {
+  return makeRandomImage< MaskType >( gen, std::uniform_int_distribution< int >( 0, 3 ), region );
+}
+
+// The edges of the histograms, with bins of different widths
+inline std::vector< PixelType >
+histogramEdges() {
+  return { -3, -1, 0, 0.5, 2, 4 };
+}
+
+// A bank with one histogram for each edge offset, where histogram k has the
+// edges of histogramEdges() shifted by offsets[k]
+inline HistogramBankType
+makeHistogramBank( const std::vector< PixelType >& offsets = { 0 } ) {
+  HistogramBankType histograms;
+  for ( PixelType offset : offsets ) {
+    std::vector< PixelType > edges = histogramEdges();
+    for ( auto& edge : edges ) {
+      edge += offset;
+    }
+    histograms.addHistogram( edges.begin(), edges.end() );
+  }
+  return histograms;
+}
+
+#endif
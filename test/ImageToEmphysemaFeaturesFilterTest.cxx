@@ -0,0 +1,692 @@
+/*
+  Test that the feature filter can be streamed. The features calculated in
+  slabs should match the features calculated on the entire image, for both
+  the fused computation and the reference composition.
+  Calculating a large scale on a coarser level of the pyramid should be close
+  to calculating it on the image grid, also when the voxels are much longer
+  along z, and give finite features for any number of samples per sigma.
+  A short image should give the same features as a float image with the same
+  values.
+  The planar output should have the components of the vector output, and the
+  histograms of a region made from the planes should match the histograms
+  made voxel by voxel.
+  A subset of the features should give exactly the components of those
+  features in the output with all features.
+  Calculating several scales in one update should give exactly the features
+  of each scale calculated alone, with selected feature k of scale i in
+  component i * nSelected + k.
+  The fused computation should match the reference composition up to the
+  accuracy of the batch eigenvalue solver.
+  Calculating the features only on the foreground runs of the mask should
+  give exactly the features of calculating every voxel, also for runs at the
+  ends of the lines and regions that cut the runs.
+ */
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkRoundImageFilter.h"
+#include "itkStreamingImageFilter.h"
+
+#include "ife/Filters/ImageToEmphysemaFeaturesFilter.h"
+#include "ife/Statistics/DenseHistogram.h"
+#include "ife/Statistics/MaskedRegionHistogram.h"
+
+typedef float PixelType;
+typedef unsigned char MaskPixelType;
+typedef itk::Image< PixelType, 3 > ImageType;
+typedef itk::Image< MaskPixelType, 3 > MaskType;
+typedef itk::VectorImage< PixelType, 3 > VectorImageType;
+typedef itk::ImageToEmphysemaFeaturesFilter< ImageType, MaskType, VectorImageType > FilterType;
+
+const unsigned int ImageSize = 48;
+
+// A smooth pattern with a little noise, so the Hessian features are not
+// dominated by the noise
+ImageType::Pointer
+makeImage() {
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size{ {ImageSize, ImageSize, ImageSize} };
+  image->SetRegions( size );
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.8;
+  spacing[1] = 0.8;
+  spacing[2] = 1.2;
+  image->SetSpacing( spacing );
+  image->Allocate();
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<PixelType> dis(-1, 1);
+  itk::ImageRegionIterator< ImageType > iter( image, image->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const double x = iter.GetIndex()[0];
+    const double y = iter.GetIndex()[1];
+    const double z = iter.GetIndex()[2];
+    iter.Set( 50 + 20 * std::sin( x / 5 ) * std::cos( y / 7 ) + 10 * std::sin( z / 4 ) + dis(gen) );
+  }
+  return image;
+}
+
+// A ball of ones in the center
+MaskType::Pointer
+makeMask( const ImageType* image ) {
+  MaskType::Pointer mask = MaskType::New();
+  mask->CopyInformation( image );
+  mask->SetRegions( image->GetLargestPossibleRegion() );
+  mask->Allocate();
+
+  const double center = ImageSize / 2.0;
+  const double radius = 18;
+  itk::ImageRegionIterator< MaskType > iter( mask, mask->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    double d = 0;
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      d += ( iter.GetIndex()[i] - center ) * ( iter.GetIndex()[i] - center );
+    }
+    iter.Set( d <= radius * radius ? 1 : 0 );
+  }
+  return mask;
+}
+
+
+TEST( ImageToEmphysemaFeaturesFilter, StreamingMatchesUnstreamed ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  const FilterType::SigmasType sigmas{ 1, 2 };
+
+  for ( const bool fused : { true, false } ) {
+    FilterType::Pointer unstreamed = FilterType::New();
+    unstreamed->SetInputImage( image );
+    unstreamed->SetInputMask( mask );
+    unstreamed->SetSigmas( sigmas );
+    unstreamed->SetUseFusedComputation( fused );
+    unstreamed->Update();
+
+    FilterType::Pointer filter = FilterType::New();
+    filter->SetInputImage( image );
+    filter->SetInputMask( mask );
+    filter->SetSigmas( sigmas );
+    filter->SetUseFusedComputation( fused );
+
+    typedef itk::StreamingImageFilter< VectorImageType, VectorImageType > StreamerType;
+    StreamerType::Pointer streamer = StreamerType::New();
+    streamer->SetInput( filter->GetOutput() );
+    streamer->SetNumberOfStreamDivisions( 4 );
+    streamer->Update();
+
+    const VectorImageType *expected = unstreamed->GetOutput();
+    const VectorImageType *actual = streamer->GetOutput();
+    ASSERT_EQ( expected->GetLargestPossibleRegion(), actual->GetLargestPossibleRegion() );
+    ASSERT_EQ( expected->GetNumberOfComponentsPerPixel(), actual->GetNumberOfComponentsPerPixel() );
+
+    itk::ImageRegionConstIteratorWithIndex< MaskType >
+      iter( mask, mask->GetLargestPossibleRegion() );
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      const VectorImageType::PixelType e = expected->GetPixel( iter.GetIndex() );
+      const VectorImageType::PixelType a = actual->GetPixel( iter.GetIndex() );
+      for ( unsigned int k = 0; k < e.GetSize(); ++k ) {
+	// The Gaussian beyond the padding gives small differences, the
+	// Gaussian curvature is a product of three second derivatives so the
+	// tolerance is relative to the size of the feature.
+	EXPECT_NEAR( e[k], a[k], 2e-2 + 1e-3 * std::fabs( e[k] ) )
+	  << "Fused " << fused << " component " << k << " index " << iter.GetIndex();
+      }
+    }
+  }
+}
+
+// The features of sigmas calculated on the pyramid with the given number of
+// samples per sigma must be within 10% of the range of the features on the
+// image grid, away from the border of the mask. The first scale must be on
+// the image grid.
+void
+__TestPyramid( const ImageType* image,
+	       const MaskType* mask,
+	       const FilterType::SigmasType& sigmas,
+	       FilterType::ScalarRealType samplesPerSigma ) {
+  FilterType::Pointer fine = FilterType::New();
+  fine->SetInputImage( image );
+  fine->SetInputMask( mask );
+  fine->SetSigmas( sigmas );
+  fine->Update();
+
+  FilterType::Pointer pyramid = FilterType::New();
+  pyramid->SetInputImage( image );
+  pyramid->SetInputMask( mask );
+  pyramid->SetSigmas( sigmas );
+  pyramid->SetPyramidSamplesPerSigma( samplesPerSigma );
+  pyramid->Update();
+
+  const VectorImageType *expected = fine->GetOutput();
+  const VectorImageType *actual = pyramid->GetOutput();
+  ASSERT_EQ( expected->GetNumberOfComponentsPerPixel(), actual->GetNumberOfComponentsPerPixel() );
+  const unsigned int nComponents = expected->GetNumberOfComponentsPerPixel();
+  const unsigned int nFeatures = FilterType::numFeatures;
+
+  // Away from the border of the mask, where the block averages of the
+  // certainty change the normalized convolution
+  const double center = ImageSize / 2.0;
+  const double radius = 12;
+  std::vector< double > range( nComponents, 0 );
+  std::vector< double > error( nComponents, 0 );
+  itk::ImageRegionConstIteratorWithIndex< MaskType >
+    iter( mask, mask->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const VectorImageType::PixelType e = expected->GetPixel( iter.GetIndex() );
+    const VectorImageType::PixelType a = actual->GetPixel( iter.GetIndex() );
+    double d = 0;
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      d += ( iter.GetIndex()[i] - center ) * ( iter.GetIndex()[i] - center );
+    }
+    for ( unsigned int k = 0; k < nComponents; ++k ) {
+      if ( iter.Get() == 0 || k < nFeatures ) {
+	// The fine scale and the background are calculated as before
+	EXPECT_EQ( e[k], a[k] ) << "Component " << k << " index " << iter.GetIndex();
+      }
+      else if ( d <= radius * radius ) {
+	range[k] = std::max< double >( range[k], std::fabs( e[k] ) );
+	error[k] = std::max< double >( error[k], std::fabs( e[k] - a[k] ) );
+      }
+    }
+  }
+  for ( unsigned int k = nFeatures; k < nComponents; ++k ) {
+    EXPECT_LE( error[k], 0.1 * range[k] ) << "Component " << k;
+  }
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, PyramidIsCloseToImageGrid ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  // With 1.5 voxels per sigma, sigma 4 is calculated on level 1, where the
+  // voxels are 1.6 x 1.6 x 2.4
+  __TestPyramid( image, mask, FilterType::SigmasType{ 1, 4 }, 1.5 );
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, AnisotropicPyramidIsCloseToImageGrid ) {
+  // Slices much thicker than the voxels are wide. The block average of
+  // level 1 smooths with variance 0.09 mm^2 along x and y and 1.56 mm^2
+  // along z, which must be removed from the Gaussian along each axis.
+  ImageType::Pointer image = makeImage();
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.6;
+  spacing[1] = 0.6;
+  spacing[2] = 2.5;
+  image->SetSpacing( spacing );
+  MaskType::Pointer mask = makeMask( image );
+  // With 0.5 voxels per sigma, sigma 4 is calculated on level 1, where the
+  // voxels are 1.2 x 1.2 x 5, and sigma 1 on the image grid
+  __TestPyramid( image, mask, FilterType::SigmasType{ 1, 4 }, 0.5 );
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, PyramidWithFewSamplesPerSigmaIsFinite ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  // With 0.1 voxels per sigma, level 3 would be chosen for sigma 1, but the
+  // block average of level 2 already smooths more than sigma along z, so
+  // level 1 is used
+  const FilterType::SigmasType sigmas{ 1, 4 };
+
+  FilterType::Pointer pyramid = FilterType::New();
+  pyramid->SetInputImage( image );
+  pyramid->SetInputMask( mask );
+  pyramid->SetSigmas( sigmas );
+  pyramid->SetPyramidSamplesPerSigma( 0.1 );
+  pyramid->Update();
+
+  const VectorImageType *features = pyramid->GetOutput();
+  itk::ImageRegionConstIteratorWithIndex< MaskType >
+    iter( mask, mask->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const VectorImageType::PixelType f = features->GetPixel( iter.GetIndex() );
+    for ( unsigned int k = 0; k < f.GetSize(); ++k ) {
+      EXPECT_TRUE( std::isfinite( f[k] ) ) << "Component " << k << " index " << iter.GetIndex();
+    }
+  }
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, ShortInputMatchesFloatInput ) {
+  typedef itk::Image< short, 3 > ShortImageType;
+  typedef itk::ImageToEmphysemaFeaturesFilter< ShortImageType, MaskType, VectorImageType > ShortFilterType;
+  typedef itk::RoundImageFilter< ImageType, ShortImageType > RoundFilterType;
+
+  // The float image has the values of the short image
+  RoundFilterType::Pointer round = RoundFilterType::New();
+  round->SetInput( makeImage() );
+  round->Update();
+  ShortImageType::Pointer shortImage = round->GetOutput();
+  ImageType::Pointer image = ImageType::New();
+  image->CopyInformation( shortImage );
+  image->SetRegions( shortImage->GetLargestPossibleRegion() );
+  image->Allocate();
+  std::copy( shortImage->GetBufferPointer(),
+	     shortImage->GetBufferPointer() + shortImage->GetLargestPossibleRegion().GetNumberOfPixels(),
+	     image->GetBufferPointer() );
+  MaskType::Pointer mask = makeMask( image );
+  const FilterType::SigmasType sigmas{ 1, 4 };
+
+  for ( const bool fused : { true, false } ) {
+    for ( const bool derivatives : { false, true } ) {
+      FilterType::Pointer floatFilter = FilterType::New();
+      floatFilter->SetInputImage( image );
+      floatFilter->SetInputMask( mask );
+      floatFilter->SetSigmas( sigmas );
+      floatFilter->SetUseFusedComputation( fused );
+      floatFilter->SetUseGaussianDerivatives( derivatives );
+      floatFilter->SetPyramidSamplesPerSigma( 1.5 );
+      floatFilter->Update();
+
+      ShortFilterType::Pointer shortFilter = ShortFilterType::New();
+      shortFilter->SetInputImage( shortImage );
+      shortFilter->SetInputMask( mask );
+      shortFilter->SetSigmas( sigmas );
+      shortFilter->SetUseFusedComputation( fused );
+      shortFilter->SetUseGaussianDerivatives( derivatives );
+      shortFilter->SetPyramidSamplesPerSigma( 1.5 );
+      shortFilter->Update();
+
+      const VectorImageType *expected = floatFilter->GetOutput();
+      const VectorImageType *actual = shortFilter->GetOutput();
+      ASSERT_EQ( expected->GetNumberOfComponentsPerPixel(), actual->GetNumberOfComponentsPerPixel() );
+      const size_t n =
+	expected->GetLargestPossibleRegion().GetNumberOfPixels() * expected->GetNumberOfComponentsPerPixel();
+      // The image is converted to float before it is multiplied by the mask,
+      // so the features are the same
+      for ( size_t i = 0; i < n; ++i ) {
+	ASSERT_EQ( expected->GetBufferPointer()[i], actual->GetBufferPointer()[i] )
+	  << "Fused " << fused << " derivatives " << derivatives << " value " << i;
+      }
+    }
+  }
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, PlanarOutputMatchesVectorOutput ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  const FilterType::SigmasType sigmas{ 1, 4 };
+  // A subset of the features, so the components are not the flags
+  const unsigned int features = FilterType::GaussianFeature
+    | FilterType::Eigenvalue2Feature
+    | FilterType::FrobeniusNormFeature;
+
+  for ( const bool fused : { true, false } ) {
+    FilterType::Pointer vectorFilter = FilterType::New();
+    vectorFilter->SetInputImage( image );
+    vectorFilter->SetInputMask( mask );
+    vectorFilter->SetSigmas( sigmas );
+    vectorFilter->SetFeatures( features );
+    vectorFilter->SetUseFusedComputation( fused );
+    vectorFilter->SetPyramidSamplesPerSigma( 1.5 );
+    vectorFilter->Update();
+
+    FilterType::Pointer planarFilter = FilterType::New();
+    planarFilter->SetInputImage( image );
+    planarFilter->SetInputMask( mask );
+    planarFilter->SetSigmas( sigmas );
+    planarFilter->SetFeatures( features );
+    planarFilter->SetUseFusedComputation( fused );
+    planarFilter->SetPyramidSamplesPerSigma( 1.5 );
+    planarFilter->PlanarOutputOn();
+    planarFilter->Update();
+
+    const VectorImageType *expected = vectorFilter->GetOutput();
+    const size_t nComponents = expected->GetNumberOfComponentsPerPixel();
+    ASSERT_EQ( 6u, nComponents );
+    EXPECT_EQ( 0u, planarFilter->GetOutput()->GetBufferedRegion().GetNumberOfPixels() );
+    EXPECT_EQ( nullptr, planarFilter->GetFeatureOutput( nComponents ) );
+    for ( size_t c = 0; c < nComponents; ++c ) {
+      const FilterType::FeatureImageType *actual = planarFilter->GetFeatureOutput( c );
+      ASSERT_NE( nullptr, actual );
+      ASSERT_EQ( expected->GetBufferedRegion(), actual->GetBufferedRegion() );
+      const size_t n = expected->GetBufferedRegion().GetNumberOfPixels();
+      for ( size_t i = 0; i < n; ++i ) {
+	ASSERT_EQ( expected->GetBufferPointer()[i * nComponents + c], actual->GetBufferPointer()[i] )
+	  << "Fused " << fused << " component " << c << " voxel " << i;
+      }
+    }
+
+    // The histograms of a region that crosses the border of the mask
+    MaskType::RegionType roi;
+    roi.SetIndex( MaskType::IndexType{ {3, 10, 12} } );
+    roi.SetSize( MaskType::SizeType{ {21, 17, 9} } );
+    const std::vector< PixelType > edges{ -10, -1, -0.1f, 0, 0.1f, 1, 10, 50 };
+    for ( size_t c = 0; c < nComponents; ++c ) {
+      DenseHistogram< PixelType > voxelHistogram( edges.begin(), edges.end() );
+      itk::ImageRegionConstIteratorWithIndex< MaskType > iter( mask, roi );
+      for ( ; !iter.IsAtEnd(); ++iter ) {
+	if ( iter.Get() ) {
+	  voxelHistogram.insert( expected->GetPixel( iter.GetIndex() )[c] );
+	}
+      }
+      DenseHistogram< PixelType > planeHistogram( edges.begin(), edges.end() );
+      itk::insertMaskedRegion( planarFilter->GetFeatureOutput( c ), mask.GetPointer(), roi, planeHistogram );
+      EXPECT_EQ( voxelHistogram.getCounts(), planeHistogram.getCounts() )
+	<< "Fused " << fused << " component " << c;
+    }
+  }
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, FeatureSubsetMatchesAllFeatures ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  const FilterType::ScalarRealType sigma = 1.5;
+  const size_t nFeatures = FilterType::numFeatures;
+
+  // Every feature alone, features that share the eigenvalues and features
+  // that only need the invariants of the Hessian
+  std::vector< unsigned int > subsets;
+  for ( unsigned int i = 0; i < nFeatures; ++i ) {
+    subsets.push_back( 1u << i );
+  }
+  subsets.push_back( FilterType::GradientMagnitudeFeature
+		     | FilterType::Eigenvalue1Feature
+		     | FilterType::Eigenvalue3Feature
+		     | FilterType::GaussianCurvatureFeature );
+  subsets.push_back( FilterType::GaussianFeature | FilterType::InvariantFeatures );
+
+  for ( const bool fused : { true, false } ) {
+    FilterType::Pointer all = FilterType::New();
+    all->SetInputImage( image );
+    all->SetInputMask( mask );
+    all->SetSigma( sigma );
+    all->SetUseFusedComputation( fused );
+    all->Update();
+    const VectorImageType *expected = all->GetOutput();
+    ASSERT_EQ( nFeatures, expected->GetNumberOfComponentsPerPixel() );
+
+    for ( const unsigned int features : subsets ) {
+      FilterType::Pointer subset = FilterType::New();
+      subset->SetInputImage( image );
+      subset->SetInputMask( mask );
+      subset->SetSigma( sigma );
+      subset->SetFeatures( features );
+      subset->SetUseFusedComputation( fused );
+      subset->Update();
+      const VectorImageType *actual = subset->GetOutput();
+      ASSERT_EQ( subset->GetNumberOfSelectedFeatures(), actual->GetNumberOfComponentsPerPixel() );
+      ASSERT_EQ( expected->GetBufferedRegion(), actual->GetBufferedRegion() );
+
+      // The components of the selected features in the order of the flags
+      std::vector< size_t > components;
+      for ( size_t k = 0; k < nFeatures; ++k ) {
+	if ( features & ( 1u << k ) ) {
+	  components.push_back( k );
+	}
+      }
+      ASSERT_EQ( components.size(), actual->GetNumberOfComponentsPerPixel() );
+
+      // The stages that are skipped do not change the selected features
+      const size_t n = expected->GetBufferedRegion().GetNumberOfPixels();
+      for ( size_t i = 0; i < n; ++i ) {
+	for ( size_t c = 0; c < components.size(); ++c ) {
+	  ASSERT_EQ( expected->GetBufferPointer()[i * nFeatures + components[c]],
+		     actual->GetBufferPointer()[i * components.size() + c] )
+	    << "Fused " << fused << " features " << features << " component " << c << " voxel " << i;
+	}
+      }
+    }
+  }
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, MultiScaleMatchesSingleScales ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  const FilterType::SigmasType sigmas{ 1, 2.5, 4 };
+  // A subset of the features, so nSelected is not the number of features
+  const unsigned int features = FilterType::GradientMagnitudeFeature
+    | FilterType::Eigenvalue2Feature
+    | FilterType::LaplacianFeature;
+  const size_t nSelected = 3;
+
+  for ( const bool fused : { true, false } ) {
+    FilterType::Pointer multi = FilterType::New();
+    multi->SetInputImage( image );
+    multi->SetInputMask( mask );
+    multi->SetSigmas( sigmas );
+    multi->SetFeatures( features );
+    multi->SetUseFusedComputation( fused );
+    multi->Update();
+    const VectorImageType *actual = multi->GetOutput();
+    ASSERT_EQ( nSelected * sigmas.size(), actual->GetNumberOfComponentsPerPixel() );
+
+    for ( size_t i = 0; i < sigmas.size(); ++i ) {
+      FilterType::Pointer single = FilterType::New();
+      single->SetInputImage( image );
+      single->SetInputMask( mask );
+      single->SetSigma( sigmas[i] );
+      single->SetFeatures( features );
+      single->SetUseFusedComputation( fused );
+      single->Update();
+      const VectorImageType *expected = single->GetOutput();
+      ASSERT_EQ( nSelected, expected->GetNumberOfComponentsPerPixel() );
+      ASSERT_EQ( expected->GetBufferedRegion(), actual->GetBufferedRegion() );
+
+      // The shared mask cast and product of image and mask do not change
+      // the features of a scale
+      const size_t n = expected->GetBufferedRegion().GetNumberOfPixels();
+      for ( size_t v = 0; v < n; ++v ) {
+	for ( size_t k = 0; k < nSelected; ++k ) {
+	  ASSERT_EQ( expected->GetBufferPointer()[v * nSelected + k],
+		     actual->GetBufferPointer()[v * nSelected * sigmas.size() + i * nSelected + k] )
+	    << "Fused " << fused << " scale " << i << " feature " << k << " voxel " << v;
+	}
+      }
+    }
+  }
+}
+
+TEST( ImageToEmphysemaFeaturesFilter, FusedMatchesReference ) {
+  // The spacing of makeImage is anisotropic, so the Gaussians and the
+  // central differences are scaled differently along z
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+
+  // A tube along z is removed from the ball, so the lines through it have
+  // two runs
+  itk::ImageRegionIterator< MaskType > maskIter( mask, mask->GetLargestPossibleRegion() );
+  for ( ; !maskIter.IsAtEnd(); ++maskIter ) {
+    const double dx = maskIter.GetIndex()[0] - 20.0;
+    const double dy = maskIter.GetIndex()[1] - 26.0;
+    if ( dx * dx + dy * dy <= 25 ) {
+      maskIter.Set( 0 );
+    }
+  }
+  const FilterType::SigmasType sigmas{ 1, 2.5 };
+  const size_t nFeatures = FilterType::numFeatures;
+
+  FilterType::Pointer reference = FilterType::New();
+  reference->SetInputImage( image );
+  reference->SetInputMask( mask );
+  reference->SetSigmas( sigmas );
+  reference->UseFusedComputationOff();
+  reference->Update();
+
+  FilterType::Pointer fused = FilterType::New();
+  fused->SetInputImage( image );
+  fused->SetInputMask( mask );
+  fused->SetSigmas( sigmas );
+  fused->Update();
+
+  const VectorImageType *expected = reference->GetOutput();
+  const VectorImageType *actual = fused->GetOutput();
+  ASSERT_EQ( nFeatures * sigmas.size(), expected->GetNumberOfComponentsPerPixel() );
+  ASSERT_EQ( expected->GetNumberOfComponentsPerPixel(), actual->GetNumberOfComponentsPerPixel() );
+
+  // The largest value of the Gaussian, the gradient magnitude and the
+  // Frobenius norm of the Hessian in the mask, for each scale
+  std::vector< double > maxValue( sigmas.size(), 0 );
+  std::vector< double > maxGradient( sigmas.size(), 0 );
+  std::vector< double > maxNorm( sigmas.size(), 0 );
+  itk::ImageRegionConstIteratorWithIndex< MaskType >
+    iter( mask, mask->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    if ( iter.Get() ) {
+      const VectorImageType::PixelType e = expected->GetPixel( iter.GetIndex() );
+      for ( size_t i = 0; i < sigmas.size(); ++i ) {
+	maxValue[i] = std::max< double >( maxValue[i], std::fabs( e[i * nFeatures] ) );
+	maxGradient[i] = std::max< double >( maxGradient[i], e[i * nFeatures + 1] );
+	maxNorm[i] = std::max< double >( maxNorm[i], e[i * nFeatures + 7] );
+      }
+    }
+  }
+
+  // The two Gaussians differ by rounding, 1e-4 of the largest value. The
+  // batch solver finds the eigenvalues within 5e-4 * ||H||_F of the solver
+  // used by the reference, which also gives the Laplacian and the Frobenius
+  // norm as sums of the eigenvalues. So the Hessian features may differ by
+  // 2e-3 * ||H||_F and the Gaussian curvature, a product of three
+  // eigenvalues, by 5e-3 * ||H||_F^3. The gradient magnitude is the same
+  // central differences, so it differs by the rounding of the Gaussian.
+  for ( iter.GoToBegin(); !iter.IsAtEnd(); ++iter ) {
+    const VectorImageType::PixelType e = expected->GetPixel( iter.GetIndex() );
+    const VectorImageType::PixelType a = actual->GetPixel( iter.GetIndex() );
+    for ( size_t i = 0; i < sigmas.size(); ++i ) {
+      const double norm = maxNorm[i];
+      const double tolerance[] = {
+	1e-4 * maxValue[i],
+	1e-3 * maxGradient[i],
+	2e-3 * norm, 2e-3 * norm, 2e-3 * norm, 2e-3 * norm,
+	5e-3 * norm * norm * norm,
+	2e-3 * norm
+      };
+      for ( size_t k = 0; k < nFeatures; ++k ) {
+	const size_t c = i * nFeatures + k;
+	if ( iter.Get() ) {
+	  EXPECT_NEAR( e[c], a[c], tolerance[k] )
+	    << "Sigma " << sigmas[i] << " feature " << k << " index " << iter.GetIndex();
+	}
+	else {
+	  // Both mask the features
+	  EXPECT_EQ( 0, e[c] ) << "Sigma " << sigmas[i] << " feature " << k << " index " << iter.GetIndex();
+	  EXPECT_EQ( 0, a[c] ) << "Sigma " << sigmas[i] << " feature " << k << " index " << iter.GetIndex();
+	}
+      }
+    }
+  }
+}
+
+// Exposes the kernel of the fused computation, so it can be given the runs
+// of another mask than the one the features are calculated for
+class RunsFilterType : public FilterType {
+public:
+  typedef RunsFilterType Self;
+  typedef itk::SmartPointer< Self > Pointer;
+  itkNewMacro( Self );
+
+  using FilterType::MaskRunsType;
+  using FilterType::DerivativeFilterType;
+  using FilterType::DerivativeImageType;
+  using FilterType::FeatureLayout;
+  using FilterType::GetFeatureLayout;
+  using FilterType::ComputeFeatures;
+};
+
+TEST( ImageToEmphysemaFeaturesFilter, RunsMatchEveryVoxel ) {
+  ImageType::Pointer image = makeImage();
+  MaskType::Pointer mask = makeMask( image );
+  const MaskType::SizeType size = mask->GetLargestPossibleRegion().GetSize();
+
+  // Runs that start at the first voxel of a line, end at the last voxel, or
+  // are a single voxel at either end, next to lines that are full
+  typedef MaskType::IndexValueType IndexValueType;
+  const IndexValueType xLast = size[0] - 1;
+  for ( IndexValueType z = 10; z < 20; ++z ) {
+    for ( IndexValueType y = 0; y + 2 < IndexValueType( size[1] ); y += 3 ) {
+      for ( IndexValueType x = 0; x < 4; ++x ) {
+	mask->SetPixel( MaskType::IndexType{ {x, y, z} }, 1 );
+	mask->SetPixel( MaskType::IndexType{ {xLast - x, y + 1, z} }, 1 );
+      }
+      mask->SetPixel( MaskType::IndexType{ {0, y + 2, z} }, 1 );
+      mask->SetPixel( MaskType::IndexType{ {xLast, y + 2, z} }, 1 );
+    }
+  }
+  for ( IndexValueType x = 0; x <= xLast; ++x ) {
+    mask->SetPixel( MaskType::IndexType{ {x, 5, 30} }, 1 );
+  }
+
+  // The runs of the mask and runs that cover every voxel
+  const size_t nLines = size[1] * size[2];
+  RunsFilterType::MaskRunsType maskRuns( mask->GetBufferPointer(), size[0], nLines );
+  const std::vector< MaskPixelType > full( size[0] * nLines, 1 );
+  RunsFilterType::MaskRunsType fullRuns( full.data(), size[0], nLines );
+
+  // The smoothed image is only read by the kernel, any image will do. The
+  // derivatives are calculated with the mask as certainty.
+  ImageType::Pointer certainty = ImageType::New();
+  certainty->CopyInformation( mask );
+  certainty->SetRegions( mask->GetLargestPossibleRegion() );
+  certainty->Allocate();
+  std::copy( mask->GetBufferPointer(),
+	     mask->GetBufferPointer() + mask->GetLargestPossibleRegion().GetNumberOfPixels(),
+	     certainty->GetBufferPointer() );
+  RunsFilterType::DerivativeFilterType::Pointer derivativeFilter =
+    RunsFilterType::DerivativeFilterType::New();
+  derivativeFilter->SetInputImage( image );
+  derivativeFilter->SetInputCertainty( certainty );
+  derivativeFilter->SetSigma( 1.5 );
+  derivativeFilter->Update();
+  const RunsFilterType::DerivativeImageType *derivatives = derivativeFilter->GetOutput();
+
+  // The whole image, and a region that cuts the runs along x and starts in
+  // the middle of the image along y and z, as a thread or stream does
+  const MaskType::RegionType whole = mask->GetLargestPossibleRegion();
+  const MaskType::RegionType part( MaskType::IndexType{ {2, 7, 11} },
+				   MaskType::SizeType{ {size[0] - 5, 30, 25} } );
+
+  RunsFilterType::Pointer filter = RunsFilterType::New();
+  for ( const bool useDerivatives : { false, true } ) {
+    for ( const MaskType::RegionType& region : { whole, part } ) {
+      VectorImageType::Pointer dense = VectorImageType::New();
+      dense->CopyInformation( image );
+      dense->SetRegions( whole );
+      dense->SetNumberOfComponentsPerPixel( FilterType::numFeatures );
+      dense->Allocate();
+      VectorImageType::Pointer restricted = VectorImageType::New();
+      restricted->CopyInformation( image );
+      restricted->SetRegions( whole );
+      restricted->SetNumberOfComponentsPerPixel( FilterType::numFeatures );
+      restricted->Allocate();
+      // Voxels that are not written keep a value no feature has
+      VectorImageType::PixelType unwritten( FilterType::numFeatures );
+      unwritten.Fill( -12345 );
+      dense->FillBuffer( unwritten );
+      restricted->FillBuffer( unwritten );
+
+      const ImageType *smoothed = useDerivatives ? ITK_NULLPTR : image.GetPointer();
+      const RunsFilterType::DerivativeImageType *d = useDerivatives ? derivatives : ITK_NULLPTR;
+      filter->ComputeFeatures( region, smoothed, d, fullRuns,
+			       RunsFilterType::GetFeatureLayout( dense ), 0 );
+      filter->ComputeFeatures( region, smoothed, d, maskRuns,
+			       RunsFilterType::GetFeatureLayout( restricted ), 0 );
+
+      itk::ImageRegionConstIteratorWithIndex< MaskType > iter( mask, whole );
+      for ( ; !iter.IsAtEnd(); ++iter ) {
+	const VectorImageType::PixelType e = dense->GetPixel( iter.GetIndex() );
+	const VectorImageType::PixelType a = restricted->GetPixel( iter.GetIndex() );
+	for ( unsigned int k = 0; k < e.GetSize(); ++k ) {
+	  if ( !region.IsInside( iter.GetIndex() ) ) {
+	    EXPECT_EQ( -12345, a[k] ) << "Index " << iter.GetIndex();
+	  }
+	  else if ( iter.Get() ) {
+	    // The eigenvalues of a voxel do not depend on where in the batch
+	    // it is solved
+	    ASSERT_EQ( e[k], a[k] )
+	      << "Derivatives " << useDerivatives << " region " << region
+	      << " component " << k << " index " << iter.GetIndex();
+	  }
+	  else {
+	    ASSERT_EQ( 0, a[k] )
+	      << "Derivatives " << useDerivatives << " region " << region
+	      << " component " << k << " index " << iter.GetIndex();
+	  }
+	}
+      }
+    }
+  }
+}
@@ -0,0 +1,186 @@
+/*
+  Test that the histograms of ROIs looked up in integral histograms are the
+  histograms made by counting the voxels of the ROIs, also when the ROIs are
+  on the border of the tables and when the integral histograms are split
+  into slabs that end where a ROI ends.
+ */
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ife/Statistics/IntegralHistogram.h"
+#include "ife/Statistics/MaskedRegionHistogram.h"
+
+#include "HistogramTestData.h"
+
+typedef itk::IntegralHistogram< RegionType > IntegralHistogramType;
+
+const unsigned int ImageSize = 30;
+
+// The number of table entries of one plane of the bounding box of rois
+size_t
+planeEntries( const std::vector< RegionType >& rois, size_t nBins ) {
+  const auto tiles = IntegralHistogramType::planTiles( rois, nBins, size_t( -1 ) );
+  return ( tiles.at( 0 ).Region.GetSize(0) + 1 ) * ( tiles.at( 0 ).Region.GetSize(1) + 1 ) * nBins;
+}
+
+// Plan the tiles of rois with maxEntries and compare the histograms looked
+// up in each tile to the counted histograms. Every ROI must be in one tile,
+// and each slab must start where its first ROI starts and end where its
+// last ROI ends. Returns the tiles.
+std::vector< IntegralHistogramType::Tile >
+__TestTiles( const ImageType* image,
+	     const MaskType* mask,
+	     const HistogramBankType& histograms,
+	     const std::vector< RegionType >& rois,
+	     size_t maxEntries ) {
+  const size_t nBins = histograms.getNumberOfBins();
+  const auto tiles = IntegralHistogramType::planTiles( rois, nBins, maxEntries );
+  EXPECT_FALSE( tiles.empty() );
+  std::vector< size_t > timesInTile( rois.size(), 0 );
+  IntegralHistogramType integralHistogram( nBins );
+  std::vector< IntegralHistogramType::count_type > counts( nBins );
+  for ( const auto& tile : tiles ) {
+    EXPECT_GE( maxEntries, IntegralHistogramType::getNumberOfEntries( tile.Region, nBins ) );
+    integralHistogram.build( image, mask, tile.Region,
+			     [&histograms]( PixelType value ) { return histograms.getBin( 0, value ); } );
+    EXPECT_FALSE( tile.ROIs.empty() );
+    const itk::IndexValueType tileBegin = tile.Region.GetIndex(2);
+    const itk::IndexValueType tileEnd = tileBegin + static_cast< itk::IndexValueType >( tile.Region.GetSize(2) );
+    itk::IndexValueType zBegin = tileEnd, zEnd = tileBegin;
+    for ( size_t j : tile.ROIs ) {
+      ++timesInTile[j];
+      EXPECT_TRUE( tile.Region.IsInside( rois[j] ) ) << "ROI " << rois[j] << " tile " << tile.Region;
+      zBegin = std::min( zBegin, rois[j].GetIndex(2) );
+      zEnd = std::max( zEnd, rois[j].GetIndex(2) + static_cast< itk::IndexValueType >( rois[j].GetSize(2) ) );
+      integralHistogram.getCounts( rois[j], counts.data() );
+      HistogramBankType expected( histograms );
+      auto histogram = expected.getHistogram( 0 );
+      itk::insertMaskedRegion( image, mask, rois[j], histogram );
+      for ( size_t l = 0; l < nBins; ++l ) {
+	EXPECT_EQ( expected.getCount( 0, l ), counts[l] ) << "ROI " << rois[j] << " bin " << l;
+      }
+    }
+    EXPECT_EQ( tileBegin, zBegin ) << "Tile " << tile.Region;
+    EXPECT_EQ( tileEnd, zEnd ) << "Tile " << tile.Region;
+  }
+  for ( size_t j = 0; j < rois.size(); ++j ) {
+    EXPECT_EQ( 1u, timesInTile[j] ) << "ROI " << rois[j];
+  }
+  return tiles;
+}
+
+TEST( IntegralHistogram, MatchesCountedHistograms ) {
+  std::mt19937 gen(42);
+  const RegionType region( SizeType{ {ImageSize, ImageSize, ImageSize} } );
+  ImageType::Pointer image = makeRandomFeature( gen, region );
+  MaskType::Pointer mask = makeRandomMask( gen, region );
+  const HistogramBankType histograms = makeHistogramBank();
+  const size_t nBins = histograms.getNumberOfBins();
+
+  // Random ROIs of different sizes, with an offset from the image border
+  std::vector< RegionType > rois;
+  std::uniform_int_distribution< int > indexDis( 2, ImageSize - 10 );
+  std::uniform_int_distribution< int > sizeDis( 1, 8 );
+  for ( size_t i = 0; i < 300; ++i ) {
+    RegionType roi;
+    for ( unsigned int d = 0; d < 3; ++d ) {
+      roi.SetIndex( d, indexDis( gen ) );
+      roi.SetSize( d, sizeDis( gen ) );
+    }
+    rois.push_back( roi );
+  }
+
+  // All ROIs in one slab, and a budget that needs several slabs
+  const size_t plane = planeEntries( rois, nBins );
+  EXPECT_EQ( 1u, __TestTiles( image, mask, histograms, rois, plane * ( ImageSize + 1 ) ).size() );
+  EXPECT_LT( 1u, __TestTiles( image, mask, histograms, rois, plane * 10 ).size() );
+
+  // A ROI that is taller than a slab
+  EXPECT_TRUE( IntegralHistogramType::planTiles( rois, nBins, plane * 5 ).empty() );
+}
+
+TEST( IntegralHistogram, ROIsOnTheTableBorder ) {
+  // The region does not start at the origin and has a different size along
+  // each axis
+  std::mt19937 gen(42);
+  const IndexType begin{ {3, -2, 1} };
+  const SizeType size{ {11, 9, 13} };
+  const RegionType region( begin, size );
+  ImageType::Pointer image = makeRandomFeature( gen, region );
+  MaskType::Pointer mask = makeRandomMask( gen, region );
+  const HistogramBankType histograms = makeHistogramBank();
+
+  // The whole region, a voxel at each corner, and a slab of two voxels at
+  // each face, so the table is the region and every ROI touches its border
+  std::vector< RegionType > rois{ region };
+  for ( unsigned int corner = 0; corner < 8; ++corner ) {
+    IndexType index = begin;
+    for ( unsigned int d = 0; d < 3; ++d ) {
+      if ( corner & ( 1u << d ) ) {
+	index[d] += static_cast< itk::IndexValueType >( size[d] ) - 1;
+      }
+    }
+    rois.push_back( RegionType( index, SizeType{ {1, 1, 1} } ) );
+  }
+  for ( unsigned int d = 0; d < 3; ++d ) {
+    RegionType low = region;
+    low.SetSize( d, 2 );
+    RegionType high = low;
+    high.SetIndex( d, begin[d] + static_cast< itk::IndexValueType >( size[d] ) - 2 );
+    rois.push_back( low );
+    rois.push_back( high );
+  }
+
+  const auto tiles = __TestTiles( image, mask, histograms, rois, size_t( -1 ) );
+  ASSERT_EQ( 1u, tiles.size() );
+  EXPECT_EQ( region, tiles[0].Region );
+}
+
+TEST( IntegralHistogram, SlabsEndWhereROIsEnd ) {
+  std::mt19937 gen(42);
+  const RegionType region( SizeType{ {ImageSize, ImageSize, ImageSize} } );
+  ImageType::Pointer image = makeRandomFeature( gen, region );
+  MaskType::Pointer mask = makeRandomMask( gen, region );
+  const HistogramBankType histograms = makeHistogramBank();
+  const size_t nBins = histograms.getNumberOfBins();
+
+  // Slabs of at most 6 planes. ROIs of 6 planes that fill a slab each, ROIs
+  // of one plane on either side of the end of the first slab, and a ROI
+  // across the first two slabs.
+  const SizeType full{ {ImageSize, ImageSize, 6} };
+  std::vector< RegionType > rois;
+  for ( itk::IndexValueType z = 0; z < ImageSize; z += 6 ) {
+    rois.push_back( RegionType( IndexType{ {0, 0, z} }, full ) );
+  }
+  rois.push_back( RegionType( IndexType{ {4, 5, 5} }, SizeType{ {3, 2, 1} } ) );
+  rois.push_back( RegionType( IndexType{ {4, 5, 6} }, SizeType{ {3, 2, 1} } ) );
+  rois.push_back( RegionType( IndexType{ {1, 2, 3} }, SizeType{ {7, 5, 6} } ) );
+
+  const size_t maxEntries = planeEntries( rois, nBins ) * 7;
+  const auto tiles = __TestTiles( image, mask, histograms, rois, maxEntries );
+  // One slab for each ROI of 6 planes, and one for the ROI across them
+  EXPECT_EQ( ImageSize / 6 + 1, tiles.size() );
+  for ( const auto& tile : tiles ) {
+    EXPECT_EQ( maxEntries, IntegralHistogramType::getNumberOfEntries( tile.Region, nBins ) )
+      << "Tile " << tile.Region;
+  }
+}
+
+TEST( IntegralHistogram, RegionOutsideTheImage ) {
+  std::mt19937 gen(42);
+  const RegionType region( SizeType{ {10, 10, 10} } );
+  ImageType::Pointer image = makeRandomFeature( gen, region );
+  MaskType::Pointer mask = makeRandomMask( gen, region );
+  IntegralHistogramType integralHistogram( 7 );
+  auto getBin = []( PixelType ) { return 0; };
+  const RegionType outside( IndexType{ {5, 0, 0} }, SizeType{ {6, 10, 10} } );
+  EXPECT_ANY_THROW( integralHistogram.build( image.GetPointer(), mask.GetPointer(), outside, getBin ) );
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,88 @@
+/*
+  Test the bounding box of a mask, its padding by the support of a Gaussian,
+  which is clipped at the border of the image, and the union of regions.
+ */
+#include "gtest/gtest.h"
+
+#include "itkImage.h"
+
+#include "ife/ROI/MaskBoundingBox.h"
+
+typedef unsigned char MaskPixelType;
+typedef itk::Image< MaskPixelType, 3 > MaskType;
+typedef MaskType::RegionType RegionType;
+typedef MaskType::IndexType IndexType;
+typedef MaskType::SizeType SizeType;
+
+const unsigned int ImageSize = 20;
+
+// An empty mask of ImageSize^3 voxels
+MaskType::Pointer
+makeMask() {
+  MaskType::Pointer mask = MaskType::New();
+  SizeType size{ {ImageSize, ImageSize, ImageSize} };
+  mask->SetRegions( size );
+  mask->Allocate();
+  mask->FillBuffer( 0 );
+  return mask;
+}
+
+TEST( MaskBoundingBox, EmptyMask ) {
+  MaskType::Pointer mask = makeMask();
+  EXPECT_EQ( 0, itk::maskBoundingBox( mask.GetPointer() ).GetNumberOfPixels() );
+  EXPECT_EQ( 0, itk::maskSupportRegion( mask.GetPointer(), 2.0 ).GetNumberOfPixels() );
+}
+
+TEST( MaskBoundingBox, FullMask ) {
+  MaskType::Pointer mask = makeMask();
+  mask->FillBuffer( 1 );
+  EXPECT_EQ( mask->GetLargestPossibleRegion(), itk::maskBoundingBox( mask.GetPointer() ) );
+  EXPECT_EQ( mask->GetLargestPossibleRegion(), itk::maskSupportRegion( mask.GetPointer(), 2.0 ) );
+}
+
+TEST( MaskBoundingBox, BoundingBox ) {
+  MaskType::Pointer mask = makeMask();
+  mask->SetPixel( IndexType{ {3, 12, 7} }, 1 );
+  mask->SetPixel( IndexType{ {9, 4, 7} }, 2 );
+  mask->SetPixel( IndexType{ {5, 5, 15} }, 1 );
+  EXPECT_EQ( RegionType( IndexType{ {3, 4, 7} }, SizeType{ {7, 9, 9} } ),
+	     itk::maskBoundingBox( mask.GetPointer() ) );
+}
+
+TEST( MaskBoundingBox, PaddingIsClippedAtTheBorder ) {
+  MaskType::Pointer mask = makeMask();
+  MaskType::SpacingType spacing;
+  spacing[0] = 1;
+  spacing[1] = 1;
+  spacing[2] = 2;
+  mask->SetSpacing( spacing );
+  mask->SetPixel( IndexType{ {1, 10, 18} }, 1 );
+
+  // 4 sigma plus one voxel is 5 voxels along x and y and 3 along z. Along x
+  // and z the padding is clipped at the border.
+  EXPECT_EQ( RegionType( IndexType{ {0, 5, 15} }, SizeType{ {7, 11, 5} } ),
+	     itk::maskSupportRegion( mask.GetPointer(), 1.0 ) );
+
+  // A sigma larger than the image gives the whole image
+  EXPECT_EQ( mask->GetLargestPossibleRegion(),
+	     itk::maskSupportRegion( mask.GetPointer(), 10.0 ) );
+}
+
+TEST( MaskBoundingBox, RegionUnion ) {
+  const RegionType a( IndexType{ {0, 0, 0} }, SizeType{ {2, 2, 2} } );
+  const RegionType b( IndexType{ {5, 6, 7} }, SizeType{ {1, 2, 3} } );
+  const RegionType expected( IndexType{ {0, 0, 0} }, SizeType{ {6, 8, 10} } );
+  EXPECT_EQ( expected, itk::regionUnion( a, b ) );
+  EXPECT_EQ( expected, itk::regionUnion( b, a ) );
+
+  // Negative indices, and a region inside the other
+  const RegionType c( IndexType{ {-3, 2, -1} }, SizeType{ {4, 1, 2} } );
+  EXPECT_EQ( RegionType( IndexType{ {-3, 0, -1} }, SizeType{ {9, 8, 11} } ),
+	     itk::regionUnion( expected, c ) );
+  EXPECT_EQ( expected, itk::regionUnion( expected, b ) );
+
+  // An empty region is ignored, wherever it is
+  const RegionType empty( IndexType{ {50, 50, 50} }, SizeType{ {0, 0, 0} } );
+  EXPECT_EQ( a, itk::regionUnion( a, empty ) );
+  EXPECT_EQ( a, itk::regionUnion( empty, a ) );
+}
@@ -0,0 +1,142 @@
+/*
+  Test that the runs of a mask cover exactly its non-zero voxels, for empty
+  and full masks, runs that touch the ends of the lines and random masks.
+ */
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ife/Util/MaskRuns.h"
+
+typedef unsigned char MaskPixelType;
+typedef MaskRuns< MaskPixelType > MaskRunsType;
+
+// The mask rebuilt from the runs
+std::vector< MaskPixelType >
+fillRuns( const MaskRunsType& runs, size_t lineLength ) {
+  std::vector< MaskPixelType > mask( lineLength * runs.getNumberOfLines(), 0 );
+  for ( size_t line = 0; line < runs.getNumberOfLines(); ++line ) {
+    for ( const MaskRunsType::Run *run = runs.begin( line ); run != runs.end( line ); ++run ) {
+      for ( MaskRunsType::OffsetType x = run->begin; x < run->end; ++x ) {
+	mask[line * lineLength + x] = 1;
+      }
+    }
+  }
+  return mask;
+}
+
+// The runs of each line must be sorted, not touch and cover the non-zero
+// voxels
+void
+__TestRuns( const std::vector< MaskPixelType >& mask, size_t lineLength ) {
+  const size_t nLines = mask.size() / lineLength;
+  MaskRunsType runs( mask.data(), lineLength, nLines );
+  ASSERT_EQ( nLines, runs.getNumberOfLines() );
+
+  size_t foreground = 0;
+  for ( size_t line = 0; line < nLines; ++line ) {
+    for ( const MaskRunsType::Run *run = runs.begin( line ); run != runs.end( line ); ++run ) {
+      EXPECT_LE( 0, run->begin );
+      EXPECT_LT( run->begin, run->end );
+      EXPECT_LE( run->end, static_cast< MaskRunsType::OffsetType >( lineLength ) );
+      if ( run != runs.begin( line ) ) {
+	EXPECT_LT( ( run - 1 )->end, run->begin ) << "Line " << line;
+      }
+    }
+  }
+  std::vector< MaskPixelType > filled = fillRuns( runs, lineLength );
+  for ( size_t i = 0; i < mask.size(); ++i ) {
+    EXPECT_EQ( mask[i] != 0, filled[i] != 0 ) << "Voxel " << i;
+    foreground += mask[i] != 0;
+  }
+  EXPECT_EQ( foreground, runs.getNumberOfForegroundVoxels() );
+}
+
+TEST( MaskRuns, Default ) {
+  MaskRunsType runs;
+  EXPECT_EQ( 0, runs.getNumberOfLines() );
+  EXPECT_EQ( 0, runs.getNumberOfRuns() );
+  EXPECT_EQ( 0, runs.getNumberOfForegroundVoxels() );
+}
+
+TEST( MaskRuns, EmptyMask ) {
+  const size_t lineLength = 7, nLines = 5;
+  std::vector< MaskPixelType > mask( lineLength * nLines, 0 );
+  MaskRunsType runs( mask.data(), lineLength, nLines );
+  EXPECT_EQ( nLines, runs.getNumberOfLines() );
+  EXPECT_EQ( 0, runs.getNumberOfRuns() );
+  EXPECT_EQ( 0, runs.getNumberOfForegroundVoxels() );
+  for ( size_t line = 0; line < nLines; ++line ) {
+    EXPECT_EQ( runs.begin( line ), runs.end( line ) );
+  }
+}
+
+TEST( MaskRuns, FullMask ) {
+  const size_t lineLength = 7, nLines = 5;
+  std::vector< MaskPixelType > mask( lineLength * nLines, 3 );
+  MaskRunsType runs( mask.data(), lineLength, nLines );
+  EXPECT_EQ( nLines, runs.getNumberOfRuns() );
+  EXPECT_EQ( mask.size(), runs.getNumberOfForegroundVoxels() );
+  for ( size_t line = 0; line < nLines; ++line ) {
+    ASSERT_EQ( 1, runs.end( line ) - runs.begin( line ) );
+    EXPECT_EQ( 0, runs.begin( line )->begin );
+    EXPECT_EQ( static_cast< MaskRunsType::OffsetType >( lineLength ), runs.begin( line )->end );
+  }
+}
+
+TEST( MaskRuns, RunsTouchingLineEnds ) {
+  // Runs at the start and end of each line must not continue into the
+  // neighbouring lines
+  const size_t lineLength = 6;
+  std::vector< MaskPixelType > mask{
+    1, 1, 0, 0, 0, 1,
+    1, 0, 0, 0, 1, 1,
+    0, 0, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 1,
+    1, 0, 1, 0, 1, 0,
+  };
+  __TestRuns( mask, lineLength );
+
+  MaskRunsType runs( mask.data(), lineLength, mask.size() / lineLength );
+  EXPECT_EQ( 9, runs.getNumberOfRuns() );
+  ASSERT_EQ( 2, runs.end( 0 ) - runs.begin( 0 ) );
+  EXPECT_EQ( 0, runs.begin( 0 )[0].begin );
+  EXPECT_EQ( 2, runs.begin( 0 )[0].end );
+  EXPECT_EQ( 5, runs.begin( 0 )[1].begin );
+  EXPECT_EQ( 6, runs.begin( 0 )[1].end );
+  ASSERT_EQ( 1, runs.end( 3 ) - runs.begin( 3 ) );
+  EXPECT_EQ( 5, runs.begin( 3 )->begin );
+  EXPECT_EQ( 6, runs.begin( 3 )->end );
+}
+
+TEST( MaskRuns, LinesOfOneVoxel ) {
+  std::vector< MaskPixelType > mask{ 1, 0, 1, 1, 0 };
+  __TestRuns( mask, 1 );
+}
+
+TEST( MaskRuns, RandomMasks ) {
+  std::mt19937 gen(42);
+  const size_t lineLength = 17;
+  for ( int p : { 1, 5, 9 } ) {
+    // Foreground with probability p/10
+    std::uniform_int_distribution< int > dis( 0, 9 );
+    std::vector< MaskPixelType > mask( lineLength * 50 );
+    for ( auto& m : mask ) {
+      m = dis( gen ) < p;
+    }
+    __TestRuns( mask, lineLength );
+  }
+}
+
+TEST( MaskRuns, Reinitialize ) {
+  const size_t lineLength = 4;
+  std::vector< MaskPixelType > full( lineLength * 3, 1 );
+  std::vector< MaskPixelType > sparse{ 0, 1, 0, 0,  0, 0, 0, 0 };
+  MaskRunsType runs( full.data(), lineLength, 3 );
+  runs.initialize( sparse.data(), lineLength, 2 );
+  EXPECT_EQ( 2, runs.getNumberOfLines() );
+  EXPECT_EQ( 1, runs.getNumberOfRuns() );
+  EXPECT_EQ( 1, runs.getNumberOfForegroundVoxels() );
+  EXPECT_EQ( runs.begin( 1 ), runs.end( 1 ) );
+}
@@ -0,0 +1,543 @@
+/*
+  Test the normalized convolution.
+  The cascaded multi scale smoothing should match smoothing each scale
+  independently, except close to the image border where the recursive
+  Gaussian handles the boundary differently.
+  Streaming the smoothing in slabs should match smoothing the entire image.
+  The fused filter should match the composition of ITK filters up to
+  floating point rounding.
+  Smoothing with iterated box filters should be close to the Gaussian.
+  Reusing the smoothed certainty of another image with the same certainty
+  should give the same result as smoothing it. Certainties with the same
+  values but another geometry, or another smoothing implementation, must
+  not share smoothed certainties, and a key whose digest collides must not
+  return the smoothed certainty of other values.
+  The derivative filter should have the value of the normalized convolution,
+  and the exact gradient and Hessian of a quadratic polynomial away from the
+  border.
+ */
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "itkImage.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkStreamingImageFilter.h"
+
+#include "ife/Filters/NormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Filters/FusedNormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Filters/NormalizedGaussianDerivativeConvolutionImageFilter.h"
+
+typedef float PixelType;
+typedef itk::Image< PixelType, 3 > ImageType;
+typedef itk::NormalizedGaussianConvolutionImageFilter< ImageType > FilterType;
+typedef itk::FusedNormalizedGaussianConvolutionImageFilter< ImageType > FusedFilterType;
+typedef itk::NormalizedGaussianDerivativeConvolutionImageFilter< ImageType > DerivativeFilterType;
+
+const unsigned int ImageSize = 64;
+
+// Random values in [0,100]
+ImageType::Pointer
+makeImage() {
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size{ {ImageSize, ImageSize, ImageSize} };
+  image->SetRegions( size );
+  image->Allocate();
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<PixelType> dis(0, 100);
+  itk::ImageRegionIterator< ImageType > iter( image, image->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    iter.Set( dis(gen) );
+  }
+  return image;
+}
+
+// A ball of ones in the center
+ImageType::Pointer
+makeCertainty() {
+  ImageType::Pointer certainty = ImageType::New();
+  ImageType::SizeType size{ {ImageSize, ImageSize, ImageSize} };
+  certainty->SetRegions( size );
+  certainty->Allocate();
+
+  const double center = ImageSize / 2.0;
+  const double radius = 20;
+  itk::ImageRegionIterator< ImageType > iter( certainty, certainty->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    double d = 0;
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      d += ( iter.GetIndex()[i] - center ) * ( iter.GetIndex()[i] - center );
+    }
+    iter.Set( d <= radius * radius ? 1 : 0 );
+  }
+  return certainty;
+}
+
+
+TEST( NormalizedGaussianConvolutionImageFilter, CascadeMatchesIndependentSmoothing ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 1, 2, 4 };
+
+  FilterType::Pointer cascade = FilterType::New();
+  cascade->SetInputImage( image );
+  cascade->SetInputCertainty( certainty );
+  cascade->SetSigmas( sigmas );
+  cascade->UseCascadeOn();
+  cascade->Update();
+
+  for ( size_t i = 0; i < sigmas.size(); ++i ) {
+    FilterType::Pointer independent = FilterType::New();
+    independent->SetInputImage( image );
+    independent->SetInputCertainty( certainty );
+    independent->SetSigma( sigmas[i] );
+    independent->Update();
+
+    // Compare inside the certainty where we are at least 3*sigma from the
+    // border.
+    const unsigned int margin = 12;
+    ImageType::RegionType region = image->GetLargestPossibleRegion();
+    region.ShrinkByRadius( margin );
+    itk::ImageRegionConstIteratorWithIndex< ImageType >
+      iter( certainty, region );
+    size_t count = 0;
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      if ( iter.Get() == 0 ) {
+	continue;
+      }
+      const PixelType expected = independent->GetOutput()->GetPixel( iter.GetIndex() );
+      const PixelType actual = cascade->GetOutput( i )->GetPixel( iter.GetIndex() );
+      // 1% of the image range
+      EXPECT_NEAR( expected, actual, 1.0 )
+	<< "Sigma " << sigmas[i] << " index " << iter.GetIndex();
+      ++count;
+    }
+    EXPECT_GT( count, 0 );
+  }
+}
+
+TEST( NormalizedGaussianConvolutionImageFilter, NoCascadeIsIndependentSmoothing ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 1, 2 };
+
+  FilterType::Pointer multiScale = FilterType::New();
+  multiScale->SetInputImage( image );
+  multiScale->SetInputCertainty( certainty );
+  multiScale->SetSigmas( sigmas );
+  multiScale->UseCascadeOff();
+  multiScale->Update();
+
+  for ( size_t i = 0; i < sigmas.size(); ++i ) {
+    FilterType::Pointer independent = FilterType::New();
+    independent->SetInputImage( image );
+    independent->SetInputCertainty( certainty );
+    independent->SetSigma( sigmas[i] );
+    independent->Update();
+
+    itk::ImageRegionConstIteratorWithIndex< ImageType >
+      iter( certainty, certainty->GetLargestPossibleRegion() );
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      if ( iter.Get() != 0 ) {
+	EXPECT_EQ( independent->GetOutput()->GetPixel( iter.GetIndex() ),
+		   multiScale->GetOutput( i )->GetPixel( iter.GetIndex() ) );
+      }
+    }
+  }
+}
+
+TEST( NormalizedGaussianConvolutionImageFilter, StreamingMatchesUnstreamed ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 1, 2 };
+
+  FilterType::Pointer unstreamed = FilterType::New();
+  unstreamed->SetInputImage( image );
+  unstreamed->SetInputCertainty( certainty );
+  unstreamed->SetSigmas( sigmas );
+  unstreamed->Update();
+
+  for ( size_t i = 0; i < sigmas.size(); ++i ) {
+    FilterType::Pointer filter = FilterType::New();
+    filter->SetInputImage( image );
+    filter->SetInputCertainty( certainty );
+    filter->SetSigmas( sigmas );
+
+    typedef itk::StreamingImageFilter< ImageType, ImageType > StreamerType;
+    StreamerType::Pointer streamer = StreamerType::New();
+    streamer->SetInput( filter->GetOutput( i ) );
+    streamer->SetNumberOfStreamDivisions( 4 );
+    streamer->Update();
+
+    itk::ImageRegionConstIteratorWithIndex< ImageType >
+      iter( certainty, certainty->GetLargestPossibleRegion() );
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      if ( iter.Get() != 0 ) {
+	// The Gaussian beyond the padding gives differences of about 0.01% of
+	// the image range
+	EXPECT_NEAR( unstreamed->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		     streamer->GetOutput()->GetPixel( iter.GetIndex() ),
+		     5e-2 )
+	  << "Sigma " << sigmas[i] << " index " << iter.GetIndex();
+      }
+    }
+  }
+}
+
+TEST( FusedNormalizedGaussianConvolutionImageFilter, MatchesComposition ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  // Anisotropic spacing to check that sigma is in physical units
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.7;
+  spacing[1] = 0.7;
+  spacing[2] = 1.25;
+  image->SetSpacing( spacing );
+  certainty->SetSpacing( spacing );
+
+  for ( const double sigma : { 1.0, 2.5 } ) {
+    FilterType::Pointer reference = FilterType::New();
+    reference->SetInputImage( image );
+    reference->SetInputCertainty( certainty );
+    reference->SetSigma( sigma );
+    reference->Update();
+
+    FusedFilterType::Pointer fused = FusedFilterType::New();
+    fused->SetInputImage( image );
+    fused->SetInputCertainty( certainty );
+    fused->SetSigma( sigma );
+    fused->Update();
+
+    itk::ImageRegionConstIteratorWithIndex< ImageType >
+      iter( certainty, certainty->GetLargestPossibleRegion() );
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      if ( iter.Get() != 0 ) {
+	// 0.01% of the image range
+	EXPECT_NEAR( reference->GetOutput()->GetPixel( iter.GetIndex() ),
+		     fused->GetOutput()->GetPixel( iter.GetIndex() ),
+		     1e-2 )
+	  << "Sigma " << sigma << " index " << iter.GetIndex();
+      }
+    }
+  }
+}
+
+TEST( NormalizedGaussianConvolutionImageFilter, BoxSmoothingIsCloseToGaussian ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 2, 4, 8 };
+
+  FilterType::Pointer gaussian = FilterType::New();
+  gaussian->SetInputImage( image );
+  gaussian->SetInputCertainty( certainty );
+  gaussian->SetSigmas( sigmas );
+  gaussian->UseCascadeOff();
+  gaussian->Update();
+
+  FilterType::Pointer box = FilterType::New();
+  box->SetInputImage( image );
+  box->SetInputCertainty( certainty );
+  box->SetSigmas( sigmas );
+  box->SetSmoothingMethod( itk::BoxGaussianSmoothing );
+  box->Update();
+
+  for ( size_t i = 0; i < sigmas.size(); ++i ) {
+    itk::ImageRegionConstIteratorWithIndex< ImageType >
+      iter( certainty, certainty->GetLargestPossibleRegion() );
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      if ( iter.Get() != 0 ) {
+	// The boxes deviate about 1% of the step height from the Gaussian, so
+	// 2% of the image range
+	EXPECT_NEAR( gaussian->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		     box->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		     2 )
+	  << "Sigma " << sigmas[i] << " index " << iter.GetIndex();
+      }
+    }
+  }
+}
+
+TEST( NormalizedGaussianConvolutionImageFilter, SmoothedCertaintyCacheIsReused ) {
+  ImageType::Pointer first = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 1, 2 };
+
+  // A second image with the same certainty
+  ImageType::Pointer second = ImageType::New();
+  second->SetRegions( first->GetLargestPossibleRegion() );
+  second->Allocate();
+  itk::ImageRegionConstIterator< ImageType > firstIter( first, first->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator< ImageType > secondIter( second, second->GetLargestPossibleRegion() );
+  for ( ; !secondIter.IsAtEnd(); ++firstIter, ++secondIter ) {
+    secondIter.Set( 100 - firstIter.Get() );
+  }
+
+  FilterType::SmoothedCertaintyCacheType::Pointer cache =
+    FilterType::SmoothedCertaintyCacheType::New();
+  FilterType::Pointer cached = FilterType::New();
+  cached->SetInputImage( first );
+  cached->SetInputCertainty( certainty );
+  cached->SetSigmas( sigmas );
+  cached->UseCascadeOff();
+  cached->SetSmoothedCertaintyCache( cache );
+  cached->Update();
+  ASSERT_EQ( sigmas.size(), cache->GetNumberOfImages() );
+
+  cached->SetInputImage( second );
+  cached->Update();
+  ASSERT_EQ( sigmas.size(), cache->GetNumberOfImages() );
+
+  FilterType::Pointer uncached = FilterType::New();
+  uncached->SetInputImage( second );
+  uncached->SetInputCertainty( certainty );
+  uncached->SetSigmas( sigmas );
+  uncached->UseCascadeOff();
+  uncached->Update();
+
+  // The fused filter with the cached smoothed certainty
+  FusedFilterType::Pointer fused = FusedFilterType::New();
+  fused->SetInputImage( second );
+  fused->SetInputCertainty( certainty );
+  fused->SetSigma( sigmas[1] );
+  fused->GenerateSmoothedCertaintyOn();
+  fused->Update();
+  FusedFilterType::Pointer fusedCached = FusedFilterType::New();
+  fusedCached->SetInputImage( second );
+  fusedCached->SetInputCertainty( certainty );
+  fusedCached->SetInputSmoothedCertainty( fused->GetSmoothedCertaintyOutput() );
+  fusedCached->SetSigma( sigmas[1] );
+  fusedCached->Update();
+
+  itk::ImageRegionConstIteratorWithIndex< ImageType >
+    iter( certainty, certainty->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    for ( size_t i = 0; i < sigmas.size(); ++i ) {
+      EXPECT_NEAR( uncached->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		   cached->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		   1e-4 )
+	<< "Sigma " << sigmas[i] << " index " << iter.GetIndex();
+    }
+    // The given smoothed certainty is rounded to the pixel type
+    EXPECT_NEAR( fused->GetOutput()->GetPixel( iter.GetIndex() ),
+		 fusedCached->GetOutput()->GetPixel( iter.GetIndex() ),
+		 1e-4 )
+      << "Index " << iter.GetIndex();
+  }
+}
+
+TEST( NormalizedGaussianConvolutionImageFilter, SmoothedCertaintyCacheKeepsCascadeApart ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 1, 2 };
+
+  // A cascaded and an independent filter share the cache, in both orders
+  for ( bool cascadeFirst : { true, false } ) {
+    FilterType::SmoothedCertaintyCacheType::Pointer cache =
+      FilterType::SmoothedCertaintyCacheType::New();
+    std::vector< FilterType::Pointer > cached, uncached;
+    for ( bool useCascade : { cascadeFirst, !cascadeFirst } ) {
+      for ( bool useCache : { true, false } ) {
+	FilterType::Pointer filter = FilterType::New();
+	filter->SetInputImage( image );
+	filter->SetInputCertainty( certainty );
+	filter->SetSigmas( sigmas );
+	filter->SetUseCascade( useCascade );
+	if ( useCache ) {
+	  filter->SetSmoothedCertaintyCache( cache );
+	}
+	filter->Update();
+	( useCache ? cached : uncached ).push_back( filter );
+      }
+    }
+    // Only the independently smoothed denominators are cached
+    ASSERT_EQ( sigmas.size(), cache->GetNumberOfImages() );
+
+    itk::ImageRegionConstIteratorWithIndex< ImageType >
+      iter( certainty, certainty->GetLargestPossibleRegion() );
+    for ( ; !iter.IsAtEnd(); ++iter ) {
+      for ( size_t k = 0; k < cached.size(); ++k ) {
+	for ( size_t i = 0; i < sigmas.size(); ++i ) {
+	  ASSERT_NEAR( uncached[k]->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		       cached[k]->GetOutput( i )->GetPixel( iter.GetIndex() ),
+		       1e-4 )
+	    << "Cascade " << cached[k]->GetUseCascade() << " sigma " << sigmas[i]
+	    << " index " << iter.GetIndex();
+	}
+      }
+    }
+  }
+}
+
+TEST( NormalizedGaussianConvolutionImageFilter, SmoothedCertaintyCacheChecksGeometryAndValues ) {
+  typedef FilterType::SmoothedCertaintyCacheType CacheType;
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const FilterType::SigmasType sigmas{ 1, 2 };
+
+  // The same values, so the same digest, with another origin and direction
+  ImageType::Pointer moved = ImageType::New();
+  moved->SetRegions( certainty->GetLargestPossibleRegion() );
+  ImageType::PointType origin;
+  origin.Fill( -12.5 );
+  moved->SetOrigin( origin );
+  ImageType::DirectionType direction;
+  direction.Fill( 0 );
+  direction[0][1] = 1;
+  direction[1][0] = 1;
+  direction[2][2] = -1;
+  moved->SetDirection( direction );
+  moved->Allocate();
+  std::copy( certainty->GetBufferPointer(),
+	     certainty->GetBufferPointer() + certainty->GetLargestPossibleRegion().GetNumberOfPixels(),
+	     moved->GetBufferPointer() );
+  ImageType::Pointer movedImage = ImageType::New();
+  movedImage->Graft( image );
+  movedImage->SetOrigin( origin );
+  movedImage->SetDirection( direction );
+
+  const CacheType::KeyType key =
+    CacheType::MakeKey( certainty, 1, itk::RecursiveGaussianSmoothing, CacheType::ITKImplementation );
+  const CacheType::KeyType movedKey =
+    CacheType::MakeKey( moved, 1, itk::RecursiveGaussianSmoothing, CacheType::ITKImplementation );
+  ASSERT_EQ( key.Digest, movedKey.Digest );
+  EXPECT_FALSE( key == movedKey );
+  EXPECT_FALSE( key == CacheType::MakeKey( certainty, 1, itk::RecursiveGaussianSmoothing,
+					   CacheType::FusedImplementation ) );
+
+  CacheType::Pointer cache = CacheType::New();
+  FilterType::Pointer cached = FilterType::New();
+  cached->SetInputImage( image );
+  cached->SetInputCertainty( certainty );
+  cached->SetSigmas( sigmas );
+  cached->SetSmoothedCertaintyCache( cache );
+  cached->Update();
+  ASSERT_EQ( sigmas.size(), cache->GetNumberOfImages() );
+
+  FilterType::Pointer movedCached = FilterType::New();
+  movedCached->SetInputImage( movedImage );
+  movedCached->SetInputCertainty( moved );
+  movedCached->SetSigmas( sigmas );
+  movedCached->SetSmoothedCertaintyCache( cache );
+  movedCached->Update();
+  ASSERT_EQ( 2 * sigmas.size(), cache->GetNumberOfImages() );
+  for ( size_t i = 0; i < sigmas.size(); ++i ) {
+    EXPECT_EQ( origin, movedCached->GetOutput( i )->GetOrigin() ) << "Sigma " << sigmas[i];
+    EXPECT_EQ( direction, movedCached->GetOutput( i )->GetDirection() ) << "Sigma " << sigmas[i];
+  }
+
+  // A key with the digest of certainty, but other values, as if the digests
+  // collided
+  ImageType::Pointer other = makeCertainty();
+  other->SetPixel( ImageType::IndexType{ {32, 32, 32} }, 0 );
+  CacheType::KeyType collidingKey =
+    CacheType::MakeKey( other, 1, itk::RecursiveGaussianSmoothing, CacheType::ITKImplementation );
+  ASSERT_NE( key.Digest, collidingKey.Digest );
+  collidingKey.Digest = key.Digest;
+  ASSERT_TRUE( collidingKey == key );
+  EXPECT_NE( nullptr, cache->Find( key, certainty ).GetPointer() );
+  EXPECT_EQ( nullptr, cache->Find( collidingKey, other ).GetPointer() );
+
+  // Adding it keeps the smoothed certainty of both
+  ImageType::Pointer smoothedOther = ImageType::New();
+  cache->Add( collidingKey, other, smoothedOther );
+  EXPECT_EQ( smoothedOther.GetPointer(), cache->Find( collidingKey, other ).GetPointer() );
+  EXPECT_NE( smoothedOther.GetPointer(), cache->Find( key, certainty ).GetPointer() );
+  EXPECT_NE( nullptr, cache->Find( key, certainty ).GetPointer() );
+}
+
+TEST( NormalizedGaussianDerivativeConvolutionImageFilter, ValueMatchesNormalizedConvolution ) {
+  ImageType::Pointer image = makeImage();
+  ImageType::Pointer certainty = makeCertainty();
+  const double sigma = 2;
+
+  FilterType::Pointer reference = FilterType::New();
+  reference->SetInputImage( image );
+  reference->SetInputCertainty( certainty );
+  reference->SetSigma( sigma );
+  reference->Update();
+
+  DerivativeFilterType::Pointer derivatives = DerivativeFilterType::New();
+  derivatives->SetInputImage( image );
+  derivatives->SetInputCertainty( certainty );
+  derivatives->SetSigma( sigma );
+  derivatives->Update();
+  ASSERT_EQ( DerivativeFilterType::NumberOfComponents,
+	     derivatives->GetOutput()->GetNumberOfComponentsPerPixel() );
+
+  itk::ImageRegionConstIteratorWithIndex< ImageType >
+    iter( certainty, certainty->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    if ( iter.Get() != 0 ) {
+      EXPECT_NEAR( reference->GetOutput()->GetPixel( iter.GetIndex() ),
+		   derivatives->GetOutput()->GetPixel( iter.GetIndex() )[DerivativeFilterType::Value],
+		   1e-2 )
+	<< "Index " << iter.GetIndex();
+    }
+  }
+}
+
+TEST( NormalizedGaussianDerivativeConvolutionImageFilter, QuadraticDerivatives ) {
+  // f = 0.5x^2 + 2xy - z^2 + 3x + 0.1yz in physical coordinates, with full
+  // certainty
+  ImageType::Pointer image = ImageType::New();
+  ImageType::SizeType size{ {ImageSize, ImageSize, ImageSize} };
+  image->SetRegions( size );
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.7;
+  spacing[1] = 0.9;
+  spacing[2] = 1.3;
+  image->SetSpacing( spacing );
+  image->Allocate();
+  ImageType::Pointer certainty = ImageType::New();
+  certainty->CopyInformation( image );
+  certainty->SetRegions( size );
+  certainty->Allocate();
+  certainty->FillBuffer( 1 );
+
+  itk::ImageRegionIterator< ImageType > iter( image, image->GetLargestPossibleRegion() );
+  for ( ; !iter.IsAtEnd(); ++iter ) {
+    const double x = iter.GetIndex()[0] * spacing[0];
+    const double y = iter.GetIndex()[1] * spacing[1];
+    const double z = iter.GetIndex()[2] * spacing[2];
+    iter.Set( 0.5*x*x + 2*x*y - z*z + 3*x + 0.1*y*z );
+  }
+
+  DerivativeFilterType::Pointer derivatives = DerivativeFilterType::New();
+  derivatives->SetInputImage( image );
+  derivatives->SetInputCertainty( certainty );
+  derivatives->SetSigma( 2 );
+  derivatives->Update();
+
+  ImageType::RegionType region = image->GetLargestPossibleRegion();
+  region.ShrinkByRadius( 16 );
+  itk::ImageRegionConstIteratorWithIndex< ImageType > inner( image, region );
+  for ( ; !inner.IsAtEnd(); ++inner ) {
+    const double x = inner.GetIndex()[0] * spacing[0];
+    const double y = inner.GetIndex()[1] * spacing[1];
+    const double z = inner.GetIndex()[2] * spacing[2];
+    const DerivativeFilterType::OutputImageType::PixelType d =
+      derivatives->GetOutput()->GetPixel( inner.GetIndex() );
+    // The recursive Gaussian and the edge extension at the border give errors
+    // of a few percent
+    EXPECT_NEAR( x + 2*y + 3, d[DerivativeFilterType::GradientX], 0.1 );
+    EXPECT_NEAR( 2*x + 0.1*z, d[DerivativeFilterType::GradientY], 0.1 );
+    EXPECT_NEAR( -2*z + 0.1*y, d[DerivativeFilterType::GradientZ], 0.1 );
+    EXPECT_NEAR( 1, d[DerivativeFilterType::HessianXX], 5e-2 );
+    EXPECT_NEAR( 2, d[DerivativeFilterType::HessianXY], 5e-2 );
+    EXPECT_NEAR( 0, d[DerivativeFilterType::HessianXZ], 5e-2 );
+    EXPECT_NEAR( 0, d[DerivativeFilterType::HessianYY], 5e-2 );
+    EXPECT_NEAR( 0.1, d[DerivativeFilterType::HessianYZ], 5e-2 );
+    EXPECT_NEAR( -2, d[DerivativeFilterType::HessianZZ], 5e-2 );
+  }
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
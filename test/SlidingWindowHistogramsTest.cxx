@@ -0,0 +1,121 @@
+/*
+  Test that the histograms of dense ROIs that are updated as the window moves
+  are the histograms made from each ROI, also when the window moves back,
+  along several axes at once, to the image border and too far to overlap.
+ */
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ife/ROI/DenseROIGenerator.h"
+#include "ife/Statistics/MaskedRegionHistogram.h"
+#include "ife/Statistics/SlidingWindowHistograms.h"
+
+#include "HistogramTestData.h"
+
+typedef itk::SlidingWindowHistograms< RegionType, HistogramBankType > SlidingWindowHistogramsType;
+
+const unsigned int ImageSize = 24;
+
+// Histogram k of the bank is the histogram of features[k]
+struct Features {
+  Features( std::mt19937& gen, const std::vector< PixelType >& offsets ) {
+    const RegionType region( SizeType{ {ImageSize, ImageSize, ImageSize} } );
+    for ( size_t k = 0; k < offsets.size(); ++k ) {
+      Images.push_back( makeRandomFeature( gen, region ) );
+    }
+    Mask = makeRandomMask( gen, region );
+    Histograms = makeHistogramBank( offsets );
+  }
+
+  void update( const RegionType& region, HistogramBankType& bank, bool remove ) const {
+    for ( size_t k = 0; k < Images.size(); ++k ) {
+      auto histogram = bank.getHistogram( k );
+      if ( remove ) {
+	itk::removeMaskedRegion( Images[k].GetPointer(), Mask.GetPointer(), region, histogram );
+      }
+      else {
+	itk::insertMaskedRegion( Images[k].GetPointer(), Mask.GetPointer(), region, histogram );
+      }
+    }
+  }
+
+  std::vector< ImageType::Pointer > Images;
+  MaskType::Pointer Mask;
+  HistogramBankType Histograms;
+};
+
+// Compute the histograms of rois in order and compare them to the histograms
+// made from each ROI. Returns the number of updated voxels.
+size_t
+__TestSlidingWindow( const Features& features, const std::vector< RegionType >& rois ) {
+  SlidingWindowHistogramsType window( features.Histograms,
+				      [&features]( const RegionType& region, HistogramBankType& bank, bool remove ) {
+					features.update( region, bank, remove );
+				      } );
+  for ( const auto& roi : rois ) {
+    const HistogramBankType& actual = window.compute( roi );
+    HistogramBankType expected( features.Histograms );
+    features.update( roi, expected, false );
+    for ( size_t k = 0; k < expected.getNumberOfHistograms(); ++k ) {
+      for ( size_t l = 0; l < expected.getNumberOfBins(); ++l ) {
+	EXPECT_EQ( expected.getCount( k, l ), actual.getCount( k, l ) )
+	  << "ROI " << roi << " histogram " << k << " bin " << l;
+      }
+    }
+  }
+  return window.getNumberOfUpdatedVoxels();
+}
+
+TEST( SlidingWindowHistograms, MatchesHistogramsOfEachROI ) {
+  std::mt19937 gen(42);
+  const Features features( gen, { 0.0f, 0.25f, -0.5f } );
+
+  // The ROIs of the voxels in the mask, in raster order with gaps
+  itk::DenseROIGenerator< MaskType > roiGenerator( features.Mask );
+  SizeType roiSize{ {7, 5, 6} };
+  const std::vector< RegionType > rois = roiGenerator.generate( roiSize );
+  ASSERT_LT( 1000u, rois.size() );
+
+  size_t numberOfVoxels = 0;
+  for ( const auto& roi : rois ) {
+    numberOfVoxels += roi.GetNumberOfPixels();
+  }
+  // Otherwise the histograms are made from scratch
+  EXPECT_LT( 2 * __TestSlidingWindow( features, rois ), numberOfVoxels );
+}
+
+TEST( SlidingWindowHistograms, MovesInEveryDirection ) {
+  std::mt19937 gen(42);
+  const Features features( gen, { 0.0f, 0.25f } );
+  const SizeType roiSize{ {5, 4, 3} };
+  const itk::IndexValueType last[3] = {
+    ImageSize - 5, ImageSize - 4, ImageSize - 3
+  };
+  auto roi = [&roiSize]( itk::IndexValueType x, itk::IndexValueType y, itk::IndexValueType z ) {
+    return RegionType( IndexType{ {x, y, z} }, roiSize );
+  };
+  const std::vector< RegionType > rois{
+    roi( 0, 0, 0 ),              // At the image corner
+    roi( 1, 0, 0 ),              // One voxel along x
+    roi( 4, 0, 0 ),              // Several voxels along x
+    roi( 2, 0, 0 ),              // Back along x
+    roi( 2, 3, 0 ),              // Along y, which starts a row
+    roi( 0, 3, 0 ),              // Back along x in the new row
+    roi( 3, 1, 2 ),              // Along every axis at once
+    roi( 2, 2, 1 ),              // Back along every axis at once
+    roi( last[0], 2, 1 ),        // Too far to overlap
+    roi( last[0], last[1], last[2] ), // At the other image corner
+    roi( last[0] - 1, last[1], last[2] - 2 ),
+    roi( 0, 3, 0 ),              // Back to an earlier row
+    RegionType( IndexType{ {1, 3, 0} }, SizeType{ {6, 4, 3} } ), // Another size
+    roi( 1, 3, 0 ),
+  };
+  __TestSlidingWindow( features, rois );
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -5,10 +5,35 @@
   numpy.linalg.eig
   using python 3.4.2 and numpy 1.8.2
  */
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <new>
+#include <random>
+
 #include "gtest/gtest.h"
 
 #include "itkFixedArray.h"
 #include "ife/Numerics/Symmetric3x3EigenvalueSolver.h"
+#include "ife/Numerics/EigenvalueFeaturesFunctor.h"
+#include "ife/Numerics/Symmetric3x3EigenvalueBatchSolver.h"
+
+// Count heap allocations so we can test that the fixed size interface does
+// not allocate.
+static size_t allocationCount = 0;
+
+void* operator new( std::size_t size ) {
+  ++allocationCount;
+  void *p = std::malloc( size );
+  if ( p == 0 ) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete( void *p ) noexcept {
+  std::free( p );
+}
 
 typedef Symmetric3x3EigenvalueSolver<double> SolverType;
 typedef SolverType::RealType RealType;
@@ -89,9 +114,239 @@ TEST ( EigenvaluesTest, RandomsBigNums ) {
   __TestEigenvalues( mBuf, vBuf );
 }
 
+TEST ( EigenvaluesTest, FixedSizeMatchesVariableLength ) {
+  std::vector< RealType > mBuf{599,860,-835,-941,817,-207};
+  MatrixType matrix(&mBuf[0], 6);
+  SolverType solver;
+  VectorType expected = solver(matrix);
+  SolverType::FixedInputType fixedMatrix{ {599,860,-835,-941,817,-207} };
+  SolverType::FixedOutputType actual = SolverType::compute( fixedMatrix );
+  EXPECT_EQ(expected[0], actual[0]);
+  EXPECT_EQ(expected[1], actual[1]);
+  EXPECT_EQ(expected[2], actual[2]);
+}
+
+
+// Solve the matrices with the batch solver and check that it agrees with the
+// scalar solver within the documented tolerance of 5e-4 * ||A||_F.
+// Eigenvalues with equal magnitude can come in different order, so we compare
+// the eigenvalues sorted by value and check the ordering by magnitude
+// separately.
+double
+__FrobeniusNorm( const float *matrix ) {
+  double norm = 0;
+  for ( size_t k = 0; k < 6; ++k ) {
+    norm += ( k == 0 || k == 3 || k == 5 ? 1 : 2 ) * matrix[k] * matrix[k];
+  }
+  return std::sqrt( norm );
+}
+
+void
+__TestBatchAgainstScalar( const std::vector< float >& matrices ) {
+  typedef Symmetric3x3EigenvalueSolver< float > ScalarSolverType;
+  typedef Symmetric3x3EigenvalueBatchSolver< float > BatchSolverType;
+  const size_t n = matrices.size() / 6;
+
+  // Structure of arrays
+  std::vector< float > components( 6*n );
+  for ( size_t i = 0; i < n; ++i ) {
+    for ( size_t k = 0; k < 6; ++k ) {
+      components[k*n + i] = matrices[6*i + k];
+    }
+  }
+  const float *A[6];
+  for ( size_t k = 0; k < 6; ++k ) {
+    A[k] = &components[k*n];
+  }
+  std::vector< float > eigenvalues( 3*n );
+  float *E[3] = { &eigenvalues[0], &eigenvalues[n], &eigenvalues[2*n] };
+  BatchSolverType::compute( A, E, n );
+
+  for ( size_t i = 0; i < n; ++i ) {
+    const float *matrix = &matrices[6*i];
+    std::array< float, 3 > expected;
+    ScalarSolverType::compute( matrix, expected.data() );
+    std::array< float, 3 > actual{ { E[0][i], E[1][i], E[2][i] } };
+
+    const double tolerance = 5e-4 * __FrobeniusNorm( matrix );
+
+    EXPECT_GE( std::abs( actual[0] ), std::abs( actual[1] ) );
+    EXPECT_GE( std::abs( actual[1] ), std::abs( actual[2] ) );
+    std::sort( expected.begin(), expected.end() );
+    std::sort( actual.begin(), actual.end() );
+    for ( size_t k = 0; k < 3; ++k ) {
+      EXPECT_NEAR( expected[k], actual[k], tolerance ) << "Matrix " << i;
+    }
+  }
+}
+
+// Solve the matrices with the float scalar solver and check that it agrees
+// with the double solver within the documented tolerance of 5e-4 * ||A||_F.
+void
+__TestFloatAgainstDouble( const std::vector< float >& matrices ) {
+  const size_t n = matrices.size() / 6;
+  for ( size_t i = 0; i < n; ++i ) {
+    const float *matrix = &matrices[6*i];
+    std::array< double, 6 > matrixDouble;
+    std::copy( matrix, matrix + 6, matrixDouble.begin() );
+    std::array< double, 3 > expected;
+    Symmetric3x3EigenvalueSolver< double >::compute( matrixDouble.data(), expected.data() );
+    std::array< float, 3 > actual;
+    Symmetric3x3EigenvalueSolver< float >::compute( matrix, actual.data() );
+
+    const double tolerance = 5e-4 * __FrobeniusNorm( matrix );
+    std::sort( expected.begin(), expected.end() );
+    std::sort( actual.begin(), actual.end() );
+    for ( size_t k = 0; k < 3; ++k ) {
+      EXPECT_NEAR( expected[k], actual[k], tolerance ) << "Matrix " << i;
+    }
+  }
+}
+
+// Matrices with two close eigenvalues, where the trigonometric formulation
+// loses the most precision in float. Half are diagonal matrices with two
+// equal or almost equal entries and off-diagonal entries from 1e-9 to 1 of
+// the diagonal, half are rotations of diag(l, l + d, m) with d from 0 to l.
+std::vector< float >
+__NearDegenerateMatrices( size_t n ) {
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dis(-1, 1);
+  std::uniform_real_distribution<double> exponent(-9, 0);
+  std::vector< float > matrices;
+  for ( size_t i = 0; i < n; ++i ) {
+    const double l = 100 * dis(gen);
+    const double d = i % 4 < 2 ? 0 : l * std::pow( 10, exponent(gen) );
+    const double m = 100 * dis(gen);
+    double A[3][3] = { { 0 } };
+    if ( i % 2 == 0 ) {
+      const double s = l * std::pow( 10, exponent(gen) );
+      A[0][0] = l;
+      A[1][1] = l + d;
+      A[2][2] = m;
+      A[0][1] = A[1][0] = s * dis(gen);
+      A[0][2] = A[2][0] = i % 8 == 0 ? 0 : s * dis(gen);
+      A[1][2] = A[2][1] = i % 8 == 0 ? 0 : s * dis(gen);
+    }
+    else {
+      // Rotation from a random unit quaternion
+      double q[4] = { dis(gen), dis(gen), dis(gen), dis(gen) };
+      const double qNorm = std::sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+      for ( auto& v : q ) {
+	v /= qNorm;
+      }
+      const double R[3][3] = {
+	{ 1 - 2*(q[2]*q[2] + q[3]*q[3]), 2*(q[1]*q[2] - q[0]*q[3]), 2*(q[1]*q[3] + q[0]*q[2]) },
+	{ 2*(q[1]*q[2] + q[0]*q[3]), 1 - 2*(q[1]*q[1] + q[3]*q[3]), 2*(q[2]*q[3] - q[0]*q[1]) },
+	{ 2*(q[1]*q[3] - q[0]*q[2]), 2*(q[2]*q[3] + q[0]*q[1]), 1 - 2*(q[1]*q[1] + q[2]*q[2]) } };
+      const double lambda[3] = { l, l + d, m };
+      for ( size_t r = 0; r < 3; ++r ) {
+	for ( size_t c = 0; c < 3; ++c ) {
+	  for ( size_t k = 0; k < 3; ++k ) {
+	    A[r][c] += R[r][k] * lambda[k] * R[c][k];
+	  }
+	}
+      }
+    }
+    const double upper[6] = { A[0][0], A[0][1], A[0][2], A[1][1], A[1][2], A[2][2] };
+    matrices.insert( matrices.end(), upper, upper + 6 );
+  }
+  return matrices;
+}
+
+TEST ( EigenvaluesBatchTest, SpecialMatrices ) {
+  std::vector< float > matrices{
+    1,0,0,1,0,1,       // Identity
+    1,0,0,2,0,3,       // Diagonal
+    -1,0,0,-2,0,-3,
+    1,0,0,-2,0,3,
+    0,0,0,0,0,0,       // Zero
+    1,1,1,1,1,1,       // Rank one
+    0.27, 0.92, 0.58, 0.24, 0.75, 0.04,
+    599,860,-835,-941,817,-207,
+    2,1e-4,0,2,0,2,    // Almost a multiple of the identity
+    2,1e-4,1e-4,2,1e-4,5,  // Almost diagonal with two equal entries
+    2,1e-3,0,2.001f,0,5,   // Almost diagonal with two close entries
+    -3,1e-5,2e-5,-3,-1e-5,-3, // Almost a multiple of the identity, negative
+  };
+  __TestBatchAgainstScalar( matrices );
+}
+
+TEST ( EigenvaluesBatchTest, RandomMatrices ) {
+  // An odd number of matrices so we also test partial blocks
+  const size_t n = 100003;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> dis(-100, 100);
+  std::vector< float > matrices( 6*n );
+  for ( auto& v : matrices ) {
+    v = dis(gen);
+  }
+  __TestBatchAgainstScalar( matrices );
+}
+
+TEST ( EigenvaluesBatchTest, NearDegenerateMatrices ) {
+  __TestBatchAgainstScalar( __NearDegenerateMatrices( 100003 ) );
+}
+
+TEST ( EigenvaluesTest, FloatNearDegenerateMatrices ) {
+  __TestFloatAgainstDouble( __NearDegenerateMatrices( 100003 ) );
+}
+
+
+// The invariants computed directly from the matrix should agree with the
+// combinations of the eigenvalues
+TEST ( EigenvalueFeaturesTest, InvariantsMatchEigenvalueFeatures ) {
+  typedef EigenvalueFeaturesFunctor< double > FunctorType;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dis(-100, 100);
+  for ( size_t i = 0; i < 1000; ++i ) {
+    double A[6];
+    for ( auto& v : A ) {
+      v = dis(gen);
+    }
+    double features[6];
+    FunctorType::compute( A, features );
+    const double norm = FunctorType::frobeniusNorm( A );
+    EXPECT_NEAR( features[3], FunctorType::trace( A ), 1e-9 * norm );
+    EXPECT_NEAR( features[4], FunctorType::determinant( A ), 1e-9 * norm*norm*norm );
+    EXPECT_NEAR( features[5], norm, 1e-9 * norm );
+  }
+}
+
+
+// Compare the variable length and fixed size interfaces of the feature functor
+// on random matrices. The variable length interface allocates the input and
+// the output for each matrix, the fixed size interface must not allocate.
+// The time of each is measured by tools/BenchmarkFeatures.
+TEST ( EigenvalueFeaturesTest, FixedSizeFeaturesDoNotAllocate ) {
+  typedef EigenvalueFeaturesFunctor< float > FunctorType;
+  const size_t n = 1000;
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<float> dis(-100, 100);
+  std::vector< float > matrices( 6*n );
+  for ( auto& v : matrices ) {
+    v = dis(gen);
+  }
+
+  FunctorType functor;
+  float sum = 0;
+  size_t before = allocationCount;
+  for ( size_t i = 0; i < n; ++i ) {
+    FunctorType::InputType A( &matrices[6*i], 6 );
+    FunctorType::OutputType features = functor( A );
+    sum += features[5];
+  }
+  const size_t variableLengthAllocations = allocationCount - before;
 
+  float fixedSum = 0;
+  before = allocationCount;
+  for ( size_t i = 0; i < n; ++i ) {
+    float features[6];
+    FunctorType::compute( &matrices[6*i], features );
+    fixedSum += features[5];
+  }
+  const size_t fixedAllocations = allocationCount - before;
 
-int main(int argc, char **argv) {
-  ::testing::InitGoogleTest(&argc, argv);
-  return RUN_ALL_TESTS();
+  EXPECT_EQ( sum, fixedSum );
+  EXPECT_GE( variableLengthAllocations, n );
+  EXPECT_EQ( 0, fixedAllocations );
 }
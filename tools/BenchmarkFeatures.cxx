@@ -0,0 +1,268 @@
+/*
+  Measure the throughput of ImageToEmphysemaFeaturesFilter on a synthetic
+  volume, for the reference composition of ITK filters, the fused
+  computation and the fused computation with Gaussian derivatives.
+
+  The image is random values in [-1000, 0] and the mask is a ball that fills
+  about half of the volume, which is roughly what a lung mask does in a CT
+  scan. Each configuration is updated a number of times and the mean time
+  and throughput in voxels per second are written to stdout.
+
+  The eigenvalue features of 2^22 random matrices are then timed on their
+  own, through the variable length and the fixed size interface of
+  EigenvalueFeaturesFunctor, and with Symmetric3x3EigenvalueBatchSolver,
+  whose instruction set is written with the time.
+ */
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tclap/CmdLine.h"
+
+#include "itkImage.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTimeProbe.h"
+#include "itkVectorImage.h"
+
+#include "ife/Filters/ImageToEmphysemaFeaturesFilter.h"
+#include "ife/Numerics/EigenvalueFeaturesFunctor.h"
+#include "ife/Numerics/Symmetric3x3EigenvalueBatchSolver.h"
+
+const std::string VERSION("0.1");
+
+int main(int argc, char *argv[]) {
+  // Commandline parsing
+  TCLAP::CmdLine cmd("Measure the throughput of the feature filter.", ' ', VERSION);
+
+  TCLAP::ValueArg<unsigned int>
+    sizeArg("n",
+	    "size",
+	    "Number of voxels along each side of the volume",
+	    false,
+	    512,
+	    "N>=4",
+	    cmd);
+
+  TCLAP::MultiArg<float>
+    scalesArg("s",
+	      "scale",
+	      "Scales for the Gauss applicability function. Default is 1.",
+	      false,
+	      "double",
+	      cmd);
+
+  TCLAP::ValueArg<unsigned int>
+    repetitionsArg("r",
+		   "repetitions",
+		   "Number of updates of each configuration",
+		   false,
+		   3,
+		   "N>=1",
+		   cmd);
+
+  TCLAP::ValueArg<unsigned int>
+    threadsArg("t",
+	       "threads",
+	       "Number of threads. Default is the ITK default.",
+	       false,
+	       0,
+	       "N",
+	       cmd);
+
+  TCLAP::ValueArg<bool>
+    referenceArg("R",
+		 "reference",
+		 "Include the reference composition, which needs several "
+		 "volumes of intermediate images",
+		 false,
+		 true,
+		 "boolean",
+		 cmd);
+
+  try {
+    cmd.parse(argc, argv);
+  } catch(TCLAP::ArgException &e) {
+    std::cerr << "Error : " << e.error()
+	      << " for arg " << e.argId()
+	      << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int size( sizeArg.getValue() );
+  std::vector< float > scales( scalesArg.getValue() );
+  const unsigned int repetitions( repetitionsArg.getValue() );
+  const unsigned int threads( threadsArg.getValue() );
+  const bool includeReference( referenceArg.getValue() );
+  if ( scales.empty() ) {
+    scales.push_back( 1 );
+  }
+  //// Commandline parsing is done ////
+
+  typedef float PixelType;
+  typedef unsigned char MaskPixelType;
+  const unsigned int Dimension = 3;
+  typedef itk::Image< PixelType, Dimension > ImageType;
+  typedef itk::Image< MaskPixelType, Dimension > MaskType;
+  typedef itk::VectorImage< PixelType, Dimension > VectorImageType;
+  typedef itk::ImageToEmphysemaFeaturesFilter<
+    ImageType,
+    MaskType,
+    VectorImageType > FeatureFilterType;
+
+  // Setup the synthetic image and mask
+  ImageType::SizeType imageSize;
+  imageSize.Fill( size );
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( imageSize );
+  image->Allocate();
+  std::mt19937 gen(42);
+  std::uniform_real_distribution< PixelType > dis( -1000, 0 );
+  itk::ImageRegionIterator< ImageType > imageIter( image, image->GetLargestPossibleRegion() );
+  for ( ; !imageIter.IsAtEnd(); ++imageIter ) {
+    imageIter.Set( dis(gen) );
+  }
+
+  MaskType::Pointer mask = MaskType::New();
+  mask->SetRegions( imageSize );
+  mask->Allocate();
+  const double center = size / 2.0;
+  const double radius = 0.49 * size;
+  itk::ImageRegionIteratorWithIndex< MaskType > maskIter( mask, mask->GetLargestPossibleRegion() );
+  for ( ; !maskIter.IsAtEnd(); ++maskIter ) {
+    double d = 0;
+    for ( unsigned int i = 0; i < Dimension; ++i ) {
+      d += ( maskIter.GetIndex()[i] - center ) * ( maskIter.GetIndex()[i] - center );
+    }
+    maskIter.Set( d <= radius * radius ? 1 : 0 );
+  }
+
+  struct Configuration {
+    std::string name;
+    bool fused;
+    bool derivatives;
+  };
+  std::vector< Configuration > configurations;
+  if ( includeReference ) {
+    configurations.push_back( Configuration{ "Reference", false, false } );
+  }
+  configurations.push_back( Configuration{ "Fused", true, false } );
+  configurations.push_back( Configuration{ "FusedGaussianDerivatives", true, true } );
+
+  const double voxels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  std::cout << "Size: " << size << "^3" << std::endl
+	    << "Scales:";
+  for ( auto scale : scales ) {
+    std::cout << ' ' << scale;
+  }
+  std::cout << std::endl;
+
+  for ( const auto& configuration : configurations ) {
+    FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
+    featureFilter->SetInputImage( image );
+    featureFilter->SetInputMask( mask );
+    featureFilter->SetSigmas( scales );
+    featureFilter->SetUseFusedComputation( configuration.fused );
+    featureFilter->SetUseGaussianDerivatives( configuration.derivatives );
+    if ( threads > 0 ) {
+      featureFilter->SetNumberOfThreads( threads );
+    }
+
+    itk::TimeProbe probe;
+    for ( unsigned int i = 0; i < repetitions; ++i ) {
+      featureFilter->Modified();
+      probe.Start();
+      try {
+	featureFilter->UpdateLargestPossibleRegion();
+      }
+      catch ( itk::ExceptionObject &e ) {
+	std::cerr << "Failed to update feature filter." << std::endl
+		  << "Configuration: " << configuration.name << std::endl
+		  << "ExceptionObject: " << e << std::endl;
+	return EXIT_FAILURE;
+      }
+      probe.Stop();
+    }
+    const double seconds = probe.GetMean();
+    std::cout << configuration.name << ": "
+	      << seconds << " s, "
+	      << voxels / seconds / 1e6 << " Mvoxel/s"
+	      << std::endl;
+  }
+
+  // Eigenvalue features of random symmetric matrices. The sums are written so
+  // the loops are not optimized away.
+  typedef EigenvalueFeaturesFunctor< PixelType > FunctorType;
+  typedef Symmetric3x3EigenvalueBatchSolver< PixelType > BatchSolverType;
+  const size_t nMatrices = size_t(1) << 22;
+  std::uniform_real_distribution< PixelType > matrixDis( -100, 100 );
+  std::vector< PixelType > matrices( 6*nMatrices );
+  for ( auto& v : matrices ) {
+    v = matrixDis(gen);
+  }
+
+  FunctorType functor;
+  itk::TimeProbe variableLengthProbe;
+  PixelType variableLengthSum = 0;
+  for ( unsigned int r = 0; r < repetitions; ++r ) {
+    variableLengthProbe.Start();
+    for ( size_t i = 0; i < nMatrices; ++i ) {
+      FunctorType::InputType A( &matrices[6*i], 6 );
+      FunctorType::OutputType features = functor( A );
+      variableLengthSum += features[5];
+    }
+    variableLengthProbe.Stop();
+  }
+
+  itk::TimeProbe fixedProbe;
+  PixelType fixedSum = 0;
+  for ( unsigned int r = 0; r < repetitions; ++r ) {
+    fixedProbe.Start();
+    for ( size_t i = 0; i < nMatrices; ++i ) {
+      PixelType features[6];
+      FunctorType::compute( &matrices[6*i], features );
+      fixedSum += features[5];
+    }
+    fixedProbe.Stop();
+  }
+
+  // The batch solver takes the matrices as a structure of arrays
+  std::vector< PixelType > components( 6*nMatrices );
+  for ( size_t i = 0; i < nMatrices; ++i ) {
+    for ( unsigned int j = 0; j < 6; ++j ) {
+      components[j*nMatrices + i] = matrices[6*i + j];
+    }
+  }
+  const PixelType *A[6];
+  for ( unsigned int j = 0; j < 6; ++j ) {
+    A[j] = &components[j*nMatrices];
+  }
+  std::vector< PixelType > eigenvalues( 3*nMatrices );
+  PixelType * const e[3] = {
+    &eigenvalues[0], &eigenvalues[nMatrices], &eigenvalues[2*nMatrices]
+  };
+  itk::TimeProbe batchProbe;
+  PixelType batchSum = 0;
+  for ( unsigned int r = 0; r < repetitions; ++r ) {
+    batchProbe.Start();
+    BatchSolverType::compute( A, e, nMatrices );
+    batchProbe.Stop();
+    batchSum += eigenvalues[0];
+  }
+
+  std::cout << "EigenvalueFeatures VariableLength: "
+	    << variableLengthProbe.GetMean() << " s, "
+	    << nMatrices / variableLengthProbe.GetMean() / 1e6 << " Mmatrix/s"
+	    << " (sum " << variableLengthSum << ")" << std::endl
+	    << "EigenvalueFeatures Fixed: "
+	    << fixedProbe.GetMean() << " s, "
+	    << nMatrices / fixedProbe.GetMean() / 1e6 << " Mmatrix/s"
+	    << " (sum " << fixedSum << ")" << std::endl
+	    << "Eigenvalues Batch " << BatchSolverType::instructionSet() << ": "
+	    << batchProbe.GetMean() << " s, "
+	    << nMatrices / batchProbe.GetMean() / 1e6 << " Mmatrix/s"
+	    << " (sum " << batchSum << ")" << std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@
    The population can be estimated by sampling or the entire population can be 
    used.
 */
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <vector>
@@ -22,6 +23,8 @@
 #include "ife/Statistics/DetermineEdgesForEqualizedHistogram.h"
 #include "ife/Filters/ImageToEmphysemaFeaturesFilter.h"
 #include "ife/IO/IO.h"
+#include "ife/Util/CropToMask.h"
+#include "ife/Util/FeatureArguments.h"
 #include "ife/Util/Path.h"
 
 
@@ -92,6 +95,29 @@ int main(int argc, char *argv[]) {
 		       cmd);
  
   
+  // We can select a subset of the features
+  FeaturesArg featuresArg( cmd );
+
+  // We can skip the part of the image that is far from the mask
+  CropToMaskArg cropArg( cmd,
+			 "Calculate the features on the bounding box of the mask, padded by "
+			 "4 times the largest scale, instead of the entire image." );
+  
+  // Large scales can be calculated on a coarser grid
+  PyramidArg pyramidArg( cmd );
+
+  // Images that share a mask can share the smoothed mask
+  TCLAP::ValueArg<bool>
+    reuseArg("R",
+	     "reuse-smoothed-mask",
+	     "Keep the smoothed mask of each scale in memory, so the next image "
+	     "with the same mask only needs to smooth the image. Uses one "
+	     "image of memory for each scale.",
+	     false,
+	     false,
+	     "boolean",
+	     cmd);
+
   try {
     cmd.parse(argc, argv);
   } catch(TCLAP::ArgException &e) {
@@ -108,6 +134,9 @@ int main(int argc, char *argv[]) {
   unsigned int nSamples( nSamplesArg.getValue() );
   const std::vector< float > scales( scalesArg.getValue() );
   const std::vector<unsigned int> foregroundValues( foregroundValueArg.getValue() );
+  const bool cropToMask( cropArg.getValue() );
+  const float pyramidSamplesPerSigma( pyramidArg.getValue() );
+  const bool reuseSmoothedMask( reuseArg.getValue() );
   //// Commandline parsing is done ////
 
   // Some common values/types that are always used.
@@ -122,6 +151,7 @@ int main(int argc, char *argv[]) {
   typedef unsigned char MaskPixelType;
   typedef itk::Image< MaskPixelType, Dimension >  MaskType;
   typedef itk::ImageFileReader< MaskType > MaskReaderType;
+  typedef MaskType::RegionType RegionType;
 
   // Setup the random distribution we will need to seed the random iterator with
   std::random_device rd;
@@ -156,7 +186,19 @@ int main(int argc, char *argv[]) {
     ImageType,
     MaskType,
     VectorImageType > FeatureFilterType;
-  const size_t numFeatures = FeatureFilterType::numFeatures;
+
+  // Select the features
+  const unsigned int features = featuresArg.getFeatures< FeatureFilterType >();
+  if ( features == 0 ) {
+    return EXIT_FAILURE;
+  }
+
+  // The output has a component for each selected feature
+  const std::vector< std::string > selectedNames( featuresArg.getFeatureNames< FeatureFilterType >() );
+  const size_t numFeatures = selectedNames.size();
+
+  // Filters for cropping to the mask
+  typedef itk::MaskCrop< ImageType, MaskType > MaskCropType;
 
   // Typedefs for the iterators
   typedef itk::ImageRegionConstIteratorWithIndex< MaskType >
@@ -168,6 +210,13 @@ int main(int argc, char *argv[]) {
   std::vector< std::vector<PixelType> >
     samples( scales.size() * numFeatures ); 
   
+  // The smoothed masks of the last mask
+  FeatureFilterType::SmoothedCertaintyCacheType::Pointer smoothedMaskCache;
+  if ( reuseSmoothedMask ) {
+    smoothedMaskCache = FeatureFilterType::SmoothedCertaintyCacheType::New();
+    smoothedMaskCache->SetMaximumNumberOfImages( scales.size() );
+  }
+
   for ( auto imageMaskPair : imageMaskPairList ) {
     std::cout << "Processing " << std::endl
 	      << "Image: '" << imageMaskPair.first << "'" << std::endl
@@ -187,76 +236,102 @@ int main(int argc, char *argv[]) {
       return EXIT_FAILURE;
     }
 
-    RandomIteratorType
-      randomIter( maskReader->GetOutput(),
-		  maskReader->GetOutput()->GetLargestPossibleRegion() );
-    randomIter.SetNumberOfSamples( nSamples );
-    randomIter.ReinitializeSeed( dist(rd) );
-    
-    IteratorType
-      iter( maskReader->GetOutput(),
-	    maskReader->GetOutput()->GetRequestedRegion() );
-
     FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
     featureFilter->SetInputImage( imageReader->GetOutput() );
     featureFilter->SetInputMask( clampFilter->GetOutput() );
-    
-    for ( size_t i = 0; i < scales.size(); ++i ) {
-      auto scale = scales[i];
-      featureFilter->SetSigma(scale);
-      VectorImageType::Pointer features = featureFilter->GetOutput();
+    featureFilter->SetFeatures( features );
+
+    // When cropping, the features are only calculated in the bounding box of
+    // the mask. The extracted images keep their index and all foreground
+    // voxels are inside the box, so we sample the box in the original index
+    // space.
+    RegionType sampleRegion = maskReader->GetOutput()->GetLargestPossibleRegion();
+    MaskCropType crop;
+    if ( cropToMask ) {
       try {
-	featureFilter->Update();
+	clampFilter->Update();
       }
       catch ( itk::ExceptionObject &e ) {
-	std::cerr << "Failed to Update feature filter." << std::endl
-		  << "Image: '" << imageMaskPair.first << "'" << std::endl
+	std::cerr << "Failed to Update clamp filter." << std::endl
 		  << "Mask: '" << imageMaskPair.second << "'" << std::endl
 		  << "ExceptionObject: " << e << std::endl;
 	return EXIT_FAILURE;
       }
+      const float maxScale = *std::max_element( scales.begin(), scales.end() );
+      crop = itk::cropToMask( featureFilter.GetPointer(),
+			      imageReader->GetOutput(),
+			      clampFilter->GetOutput(),
+			      maxScale );
+      if ( crop.Region.GetNumberOfPixels() == 0 ) {
+	std::cout << "Empty mask. Skipping" << std::endl;
+	continue;
+      }
+      sampleRegion = crop.Region;
+    }
+
+    RandomIteratorType
+      randomIter( maskReader->GetOutput(), sampleRegion );
+    randomIter.SetNumberOfSamples( nSamples );
+    randomIter.ReinitializeSeed( dist(rd) );
+    
+    IteratorType
+      iter( maskReader->GetOutput(), sampleRegion );
+    
+    // All scales are calculated in one update. Feature k at scale i is
+    // component i*numFeatures + k, which is also the index in samples.
+    featureFilter->SetSigmas( scales );
+    featureFilter->SetPyramidSamplesPerSigma( pyramidSamplesPerSigma );
+    featureFilter->SetSmoothedCertaintyCache( smoothedMaskCache );
+    VectorImageType::Pointer features = featureFilter->GetOutput();
+    try {
+      featureFilter->Update();
+    }
+    catch ( itk::ExceptionObject &e ) {
+      std::cerr << "Failed to Update feature filter." << std::endl
+		<< "Image: '" << imageMaskPair.first << "'" << std::endl
+		<< "Mask: '" << imageMaskPair.second << "'" << std::endl
+		<< "ExceptionObject: " << e << std::endl;
+      return EXIT_FAILURE;
+    }
     
-      if ( nSamples == 0 ) {
-	for ( iter.GoToBegin(); !iter.IsAtEnd(); ++iter ) {
-	  auto iterV = iter.Get();
+    if ( nSamples == 0 ) {
+      for ( iter.GoToBegin(); !iter.IsAtEnd(); ++iter ) {
+	auto iterV = iter.Get();
+	for ( const auto acceptV : foregroundValues ) {
+	  if ( iterV == acceptV ) {
+	    auto sample = features->GetPixel( iter.GetIndex() );
+	    for ( size_t idx = 0; idx < sample.GetSize(); ++idx ) {
+	      samples[idx].push_back( sample[idx] );
+	    }
+	    // We accept this iterator location because it is in the foreground.
+	    // So no need to check other foreground values.
+	    break;
+	  }
+	}
+      }
+    }
+    else {
+      unsigned int nSampled = 0;
+      while ( nSampled < nSamples ) {
+	for ( randomIter.GoToBegin(); !randomIter.IsAtEnd(); ++randomIter ) {
+	  auto iterV = randomIter.Get();
 	  for ( const auto acceptV : foregroundValues ) {
 	    if ( iterV == acceptV ) {
-	      auto sample = features->GetPixel( iter.GetIndex() );
-	      for ( size_t j = 0; j < sample.GetSize(); ++j ) {
-		auto idx = j + i * numFeatures;
-		samples[idx].push_back( sample[j] );
+	      auto sample = features->GetPixel( randomIter.GetIndex() );
+	      for ( size_t idx = 0; idx < sample.GetSize(); ++idx ) {
+		samples[idx].push_back( sample[idx] );
 	      }
+	      ++nSampled;
 	      // We accept this iterator location because it is in the foreground.
 	      // So no need to check other foreground values.
 	      break;
 	    }
 	  }
-	}
-      }
-      else {
-	unsigned int nSampled = 0;
-	while ( nSampled < nSamples ) {
-	  for ( randomIter.GoToBegin(); !randomIter.IsAtEnd(); ++randomIter ) {
-	    auto iterV = randomIter.Get();
-	    for ( const auto acceptV : foregroundValues ) {
-	      if ( iterV == acceptV ) {
-		auto sample = features->GetPixel( randomIter.GetIndex() );
-		for ( size_t j = 0; j < sample.GetSize(); ++j ) {
-		  auto idx = j + i * numFeatures;
-		  samples[idx].push_back( sample[j] );
-		}
-		++nSampled;
-		// We accept this iterator location because it is in the foreground.
-		// So no need to check other foreground values.
-		break;
-	      }
-	    }
-	    // We have a double loop. We might not get enough samples from one pass of the random iterator,
-	    // in that case we reinitialize it. If we have reinitialized, we need to ensure that we dont
-	    //  get too many samples.
-	    if ( nSampled == nSamples ) {
-	      break;
-	    }
+	  // We have a double loop. We might not get enough samples from one pass of the random iterator,
+	  // in that case we reinitialize it. If we have reinitialized, we need to ensure that we dont
+	  //  get too many samples.
+	  if ( nSampled == nSamples ) {
+	    break;
 	  }
 	}
       }
@@ -267,7 +342,11 @@ int main(int argc, char *argv[]) {
   std::ofstream out( outfilePath );
 
   // Write a header
-  out << "# Features: GaussianBlur GradientMagnitude Eigenvalue1 Eigenvalue2 Eigenvalue3 LaplacianOfGaussian GaussianCurvature FrobeniusNorm\n"
+  out << "# Features:";
+  for ( const auto& name : selectedNames ) {
+    out << ' ' << name;
+  }
+  out << "\n"
       << "# Scales: ";
   for ( size_t i = 0; i < scales.size(); ++i ) {
     out << scales[i] << (i+1 < scales.size() ? ' ' : '\n');
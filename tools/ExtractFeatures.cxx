@@ -1,5 +1,8 @@
 
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "tclap/CmdLine.h"
 
@@ -7,8 +10,11 @@
 #include "itkImageFileWriter.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
 #include "itkClampImageFilter.h"
+#include "itkConstantPadImageFilter.h"
 
 #include "ife/Filters/ImageToEmphysemaFeaturesFilter.h"
+#include "ife/Util/CropToMask.h"
+#include "ife/Util/FeatureArguments.h"
 #include "ife/Util/Path.h"
 
 const std::string VERSION("0.1");
@@ -61,6 +67,22 @@ int main( int argc, char* argv[] ) {
 	      true, 
 	      "double", 
 	      cmd);
+
+  // We can select a subset of the features
+  FeaturesArg featuresArg( cmd );
+
+  // We can skip the part of the image that is far from the mask
+  CropToMaskArg cropArg( cmd,
+			 "Calculate the features on the bounding box of the mask, padded by "
+			 "4 times the largest scale, instead of the entire image. The "
+			 "features are zero outside the cropped region." );
+
+  // How the Gaussian is approximated
+  SmoothingArg smoothingArg( cmd );
+
+  // Large scales can be calculated on a coarser grid
+  PyramidArg pyramidArg( cmd );
+
   try {
     cmd.parse(argc, argv);
   } catch(TCLAP::ArgException &e) {
@@ -75,6 +97,9 @@ int main( int argc, char* argv[] ) {
   const std::string maskPath( maskArg.getValue() );
   const std::string outBasePath( outArg.getValue() );
   const std::vector< float > scales( scalesArg.getValue() );
+  const bool cropToMask( cropArg.getValue() );
+  const itk::GaussianSmoothingMethod smoothingMethod( smoothingArg.getSmoothingMethod() );
+  const float pyramidSamplesPerSigma( pyramidArg.getValue() );
   //// Commandline parsing is done ////
   
   
@@ -84,6 +109,7 @@ int main( int argc, char* argv[] ) {
   typedef itk::Image< PixelType, Dimension > ImageType;
   typedef itk::Image< MaskPixelType, Dimension > MaskType;
   typedef itk::VectorImage< PixelType, Dimension >  VectorImageType;
+  typedef ImageType::RegionType RegionType;
   
 
   // Setup the reader
@@ -109,9 +135,17 @@ int main( int argc, char* argv[] ) {
     ImageType,
     MaskType,
     VectorImageType > FeatureFilterType;
+
+  // Select the features
+  const unsigned int features = featuresArg.getFeatures< FeatureFilterType >();
+  if ( features == 0 ) {
+    return EXIT_FAILURE;
+  }
+
   FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
   featureFilter->SetInputImage( reader->GetOutput() );
   featureFilter->SetInputMask( clampFilter->GetOutput() );
+  featureFilter->SetFeatures( features );
   
   typedef itk::VectorIndexSelectionCastImageFilter<VectorImageType, ImageType>
     IndexSelectionType;
@@ -123,23 +157,73 @@ int main( int argc, char* argv[] ) {
   WriterType::Pointer writer =  WriterType::New();
   writer->SetInput( indexSelectionFilter->GetOutput() );
 
-  std::vector< std::string > featureNames{
-    "GaussianBlur", "GradientMagnitude",
-      "Eigenvalue1", "Eigenvalue2", "Eigenvalue3",
-      "LaplacianOfGaussian", "GaussianCurvature", "FrobeniusNorm"
-      };
-  
-  for ( auto scale : scales ) {
-    featureFilter->SetSigma( scale );
+  // Crop the image and mask to the part needed for the mask. The extracted
+  // images keep their index, so the features are padded with zeros back to
+  // the original region before they are written.
+  typedef itk::MaskCrop< ImageType, MaskType > MaskCropType;
+  MaskCropType crop;
+  typedef itk::ConstantPadImageFilter< ImageType, ImageType > PadFilterType;
+  PadFilterType::Pointer padFilter = PadFilterType::New();
+  if ( cropToMask ) {
+    try {
+      clampFilter->Update();
+    }
+    catch ( itk::ExceptionObject &e ) {
+      std::cerr << "Failed to read mask." << std::endl
+		<< "Mask: " << maskPath << std::endl
+		<< "ExceptionObject: " << e << std::endl;
+      return EXIT_FAILURE;
+    }
+    const float maxScale = *std::max_element( scales.begin(), scales.end() );
+    crop = itk::cropToMask( featureFilter.GetPointer(),
+			    reader->GetOutput(),
+			    clampFilter->GetOutput(),
+			    maxScale );
+    const RegionType fullRegion = clampFilter->GetOutput()->GetLargestPossibleRegion();
+    const RegionType cropRegion = crop.Region;
+    if ( cropRegion.GetNumberOfPixels() > 0 ) {
+      std::cout << "Cropping to " << cropRegion.GetIndex() << cropRegion.GetSize()
+		<< std::endl;
+      ImageType::SizeType lowerBound, upperBound;
+      for ( unsigned int d = 0; d < Dimension; ++d ) {
+	lowerBound[d] = cropRegion.GetIndex(d) - fullRegion.GetIndex(d);
+	upperBound[d] = fullRegion.GetUpperIndex()[d] - cropRegion.GetUpperIndex()[d];
+      }
+      padFilter->SetInput( indexSelectionFilter->GetOutput() );
+      padFilter->SetPadLowerBound( lowerBound );
+      padFilter->SetPadUpperBound( upperBound );
+      padFilter->SetConstant( 0 );
+      writer->SetInput( padFilter->GetOutput() );
+    }
+  }
 
-    for (unsigned int i = 0; i < featureNames.size(); ++i ) {
-      indexSelectionFilter->SetIndex( i );
+  // The names of the selected features in the order of the output components
+  const std::vector< std::string > featureNames( featuresArg.getFeatureNames< FeatureFilterType >() );
+  
+  // All scales are calculated in one update, feature k at scale i is
+  // component i*featureNames.size() + k
+  featureFilter->SetSigmas( scales );
+  featureFilter->SetSmoothingMethod( smoothingMethod );
+  featureFilter->SetPyramidSamplesPerSigma( pyramidSamplesPerSigma );
+  try {
+    featureFilter->UpdateLargestPossibleRegion();
+  }
+  catch ( itk::ExceptionObject &e ) {
+    std::cerr << "Failed to process." << std::endl
+	      << "Image: " << imagePath << std::endl
+	      << "Mask: " << maskPath << std::endl
+	      << "ExceptionObject: " << e << std::endl;
+    return EXIT_FAILURE;
+  }
+  
+  for ( size_t i = 0; i < scales.size(); ++i ) {
+    for ( size_t k = 0; k < featureNames.size(); ++k ) {
+      indexSelectionFilter->SetIndex( i * featureNames.size() + k );
       std::string outPath = outBasePath
-	+ "_scale_" + std::to_string(scale)
-	+ featureNames[i] + OUT_FILE_TYPE;
+	+ "_scale_" + std::to_string(scales[i])
+	+ featureNames[k] + OUT_FILE_TYPE;
       writer->SetFileName( outPath );
       try {
-	featureFilter->UpdateLargestPossibleRegion();
 	writer->Update();
       }
       catch ( itk::ExceptionObject &e ) {
@@ -17,6 +17,7 @@
 
 
 */
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -24,15 +25,13 @@
 
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkImageRegionConstIteratorWithIndex.h"
-#include "itkDerivativeImageFilter.h"
-#include "itkComposeImageFilter.h"
-#include "itkFixedArray.h"
-#include "itkVectorImageToImageAdaptor.h"
+#include "itkImageRegionIterator.h"
+#include "itkVectorImage.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
 
+#include "ife/Filters/Hessian3DImageFilter.h"
+#include "ife/Numerics/EigenvalueFeaturesFunctor.h"
 #include "ife/Util/Path.h"
-#include "Eigenvalues.h"
 
 const std::string VERSION("0.1");
 const std::string OUT_FILE_TYPE(".nii.gz");
@@ -123,66 +122,14 @@ int main(int argc, char *argv[]) {
   maskReader->SetFileName( maskPath );
 
   
-  // Setup the derivative filters. We need six to get all needed derivatives
-  typedef itk::DerivativeImageFilter< ImageType, ImageType >
-    DerivativeFilterType;
+  // Setup the Hessian filter, that calculates all six second order derivatives
+  // in one pass
+  typedef itk::Hessian3DImageFilter< ImageType, VectorImageType >
+    HessianFilterType;
+  HessianFilterType::Pointer hessianFilter = HessianFilterType::New();
+  hessianFilter->SetInput( imageReader->GetOutput() );
 
-  // The second order derivatives
-  DerivativeFilterType::Pointer dxxFilter = DerivativeFilterType::New();
-  dxxFilter->SetOrder( 2 );
-  dxxFilter->SetDirection( 0 );
-  dxxFilter->SetInput( imageReader->GetOutput() );
-
-  DerivativeFilterType::Pointer dyyFilter = DerivativeFilterType::New();
-  dyyFilter->SetOrder( 2 );
-  dyyFilter->SetDirection( 1 );
-  dyyFilter->SetInput( imageReader->GetOutput() );
-
-  DerivativeFilterType::Pointer dzzFilter = DerivativeFilterType::New();
-  dzzFilter->SetOrder( 2 );
-  dzzFilter->SetDirection( 2 );
-  dzzFilter->SetInput( imageReader->GetOutput() );
-
-  // The cross derivatives
-  // First we need first order derivatives in x and y direction
-  DerivativeFilterType::Pointer dxFilter = DerivativeFilterType::New();
-  dxFilter->SetOrder( 1 );
-  dxFilter->SetDirection( 0 );
-  dxFilter->SetInput( imageReader->GetOutput() );
-
-  DerivativeFilterType::Pointer dyFilter = DerivativeFilterType::New();
-  dyFilter->SetOrder( 1 );
-  dyFilter->SetDirection( 0 );
-  dyFilter->SetInput( imageReader->GetOutput() );
-
-  // Now we can do the cross derivatives
-  DerivativeFilterType::Pointer dxyFilter = DerivativeFilterType::New();
-  dxyFilter->SetOrder( 1 );
-  dxyFilter->SetDirection( 1 );
-  dxyFilter->SetInput( dxFilter->GetOutput() );
-
-  DerivativeFilterType::Pointer dxzFilter = DerivativeFilterType::New();
-  dxzFilter->SetOrder( 1 );
-  dxzFilter->SetDirection( 2 );
-  dxzFilter->SetInput( dxFilter->GetOutput() );
-
-  DerivativeFilterType::Pointer dyzFilter = DerivativeFilterType::New();
-  dyzFilter->SetOrder( 1 );
-  dyzFilter->SetDirection( 2 );
-  dyzFilter->SetInput( dyFilter->GetOutput() );
-
-  // Now we combine the derivatives into a vector image
-  typedef itk::ComposeImageFilter< ImageType > ImageToVectorFilterType;
-  ImageToVectorFilterType::Pointer imageToVectorFilter =
-    ImageToVectorFilterType::New();
-  imageToVectorFilter->SetInput( 0, dxxFilter->GetOutput() );
-  imageToVectorFilter->SetInput( 1, dxyFilter->GetOutput() );
-  imageToVectorFilter->SetInput( 2, dxzFilter->GetOutput() );
-  imageToVectorFilter->SetInput( 3, dyyFilter->GetOutput() );
-  imageToVectorFilter->SetInput( 4, dyzFilter->GetOutput() );
-  imageToVectorFilter->SetInput( 5, dzzFilter->GetOutput() );
-
-  VectorImageType::Pointer hessianImage = imageToVectorFilter->GetOutput();
+  VectorImageType::Pointer hessianImage = hessianFilter->GetOutput();
 
   // We need an explicit update before we start iterating over the images and
   // mask 
@@ -199,6 +146,7 @@ int main(int argc, char *argv[]) {
   // This could be moved into a separate filter, but that is TODO.
   // We just store the eigenvalues in the three first components of hessianImage
   // the LoG, Gausian curvature and Frobenius norm in the last three.
+  typedef EigenvalueFeaturesFunctor< PixelType > FunctorType;
   typedef itk::ImageRegionConstIterator< MaskType> MaskIteratorType;
   MaskIteratorType maskIterator( maskReader->GetOutput(), 
   				 maskReader->GetOutput()->GetRequestedRegion() );
@@ -216,15 +164,12 @@ int main(int argc, char *argv[]) {
       hessianIterator.Set( pixel );
     }
     else {
+      // The features replace the Hessian, so it is copied first
       auto pixel = hessianIterator.Get();
-      itk::FixedArray<PixelType,6> hessian{ pixel.GetDataPointer() };
-      itk::FixedArray<PixelType,3> eig = eigenvalues_symmetric3x3( hessian );
-      pixel[0] = eig[0];
-      pixel[1] = eig[1];
-      pixel[2] = eig[2];
-      pixel[3] = eig[0] + eig[1] + eig[2];
-      pixel[4] = eig[0] * eig[1] * eig[2];
-      pixel[5] = std::sqrt(eig[0]*eig[0] + eig[1]*eig[1] + eig[2]*eig[2]);
+      PixelType hessian[6];
+      std::copy( pixel.GetDataPointer(), pixel.GetDataPointer() + 6, hessian );
+      FunctorType::compute( hessian, pixel.GetDataPointer() );
+      hessianIterator.Set( pixel );
     }
   }
   
@@ -1,6 +1,7 @@
 
 // We need an image, a mask, a histogram specification and optionally a set of ROIs
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <string>
@@ -14,23 +15,58 @@
 #include "itkClampImageFilter.h"
 #include "itkImageFileReader.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
-#include "itkRegionOfInterestImageFilter.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkVectorImage.h"
 
 #include "ife/Filters/ImageToEmphysemaFeaturesFilter.h"
 #include "ife/IO/IO.h"
+#include "ife/IO/ImageComponentType.h"
 #include "ife/IO/ROIReader.h"
 #include "ife/ROI/DenseROIGenerator.h"
-#include "ife/Statistics/DenseHistogram.h"
+#include "ife/Numerics/HalfPrecision.h"
+#include "ife/Statistics/HistogramBank.h"
+#include "ife/Statistics/MaskedRegionHistogram.h"
+#include "ife/Statistics/SlidingWindowHistograms.h"
+#include "ife/Util/BinIndexFeatures.h"
+#include "ife/Util/CropToMask.h"
+#include "ife/Util/FeatureArguments.h"
 #include "ife/Util/Path.h"
+#include "ife/Util/ScaleByScaleFeatures.h"
 
 const std::string VERSION("0.1");
 
+typedef float PixelType;
+typedef unsigned short MaskPixelType;
+
+// The parsed command line
+struct Arguments {
+  std::string imagePath;
+  std::string maskPath;
+  std::string histPath;
+  std::string outDirPath;
+  std::vector< float > scales;
+
+  // Optional
+  std::string roiMaskPath;
+  MaskPixelType roiMaskValue;
+  size_t roiSizeX;
+  size_t roiSizeY;
+  size_t roiSizeZ;
+  std::string prefix;
+  std::vector< std::string > featureNames;
+  bool cropToMask;
+  float pyramidSamplesPerSigma;
+  std::string storage;
+  bool halfPrecision;
+  bool binIndices;
+  HalfPrecisionCodec codec;
+};
+
+// Make the bag with the image read as ImagePixelType
+template< typename ImagePixelType >
+int makeBag( const Arguments& args );
+
 int main(int argc, char *argv[]) {
-  typedef float PixelType;
-  typedef unsigned short MaskPixelType;
-  
   // Commandline parsing
   TCLAP::CmdLine cmd("Create a bag of instances samples from an image.", ' ', VERSION);
 
@@ -150,6 +186,21 @@ int main(int argc, char *argv[]) {
 	      "string", 
 	      cmd);
   
+  // We can select a subset of the features
+  FeaturesArg featuresArg( cmd );
+
+  // We can skip the part of the image that is far from the mask
+  CropToMaskArg cropArg( cmd,
+			 "Calculate the features on the bounding box of the mask and the "
+			 "ROIs, padded by 4 times the largest scale, instead of the entire "
+			 "image." );
+
+  // Large scales can be calculated on a coarser grid
+  PyramidArg pyramidArg( cmd );
+
+  // The features can be kept with 16 bits per component, or as bin indices
+  StorageArg storageArg( cmd );
+
   try {
     cmd.parse(argc, argv);
   } catch(TCLAP::ArgException &e) {
@@ -160,28 +211,56 @@ int main(int argc, char *argv[]) {
   }
 
   // Store the arguments
-  const std::string imagePath( imageArg.getValue() );
-  const std::string maskPath( maskArg.getValue() );
-  const std::string histPath( histArg.getValue() );
-  const std::string outDirPath( outDirArg.getValue() );
-  const std::vector< float > scales( scalesArg.getValue() );
+  Arguments args;
+  args.imagePath = imageArg.getValue();
+  args.maskPath = maskArg.getValue();
+  args.histPath = histArg.getValue();
+  args.outDirPath = outDirArg.getValue();
+  args.scales = scalesArg.getValue();
 
   // Optional
-  const std::string roiMaskPath( roiMaskArg.getValue() );
-  const MaskPixelType roiMaskValue( roiMaskValueArg.getValue() );
-  const size_t roiSizeX = roiSizeXArg.getValue();
-  const size_t roiSizeY = roiSizeYArg.getValue();
-  const size_t roiSizeZ = roiSizeZArg.getValue();
-  const std::string prefix( prefixArg.getValue() );
+  args.roiMaskPath = roiMaskArg.getValue();
+  args.roiMaskValue = roiMaskValueArg.getValue();
+  args.roiSizeX = roiSizeXArg.getValue();
+  args.roiSizeY = roiSizeYArg.getValue();
+  args.roiSizeZ = roiSizeZArg.getValue();
+  args.prefix = prefixArg.getValue();
+  args.featureNames = featuresArg.getValue();
+  args.cropToMask = cropArg.getValue();
+  args.pyramidSamplesPerSigma = pyramidArg.getValue();
+  args.storage = storageArg.getValue();
+  args.halfPrecision = storageArg.isHalfPrecision();
+  args.binIndices = storageArg.isBinIndices();
+  args.codec = HalfPrecisionCodec( storageArg.getHalfPrecisionFormat() );
   //// Commandline parsing is done ////
 
-  const size_t numFeatures = 8;
+  // CT scans are stored as short and are read as short, which saves the
+  // memory of a float copy. Other images are read as float, so their values
+  // are not truncated.
+  itk::ImageIOBase::IOComponentType componentType;
+  try {
+    componentType = itk::readComponentType( args.imagePath );
+  }
+  catch ( itk::ExceptionObject &e ) {
+    std::cerr << "Failed to read image information." << std::endl
+	      << "Image: " << args.imagePath << std::endl
+	      << "ExceptionObject: " << e << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( itk::fitsInShort( componentType ) ) {
+    return makeBag< short >( args );
+  }
+  return makeBag< float >( args );
+}
 
+template< typename ImagePixelType >
+int makeBag( const Arguments& args ) {
   // Some common values/types that are always used.
   const unsigned int Dimension = 3;
 
-  // TODO: Need to consider which pixeltype to use
-  typedef itk::Image< PixelType, Dimension >  ImageType;
+  // The image is read as ImagePixelType, see main. The features are
+  // calculated as PixelType.
+  typedef itk::Image< ImagePixelType, Dimension >  ImageType;
   typedef itk::Image< MaskPixelType, Dimension >  MaskImageType;
   typedef itk::VectorImage< PixelType, Dimension >  VectorImageType;
 
@@ -191,15 +270,15 @@ int main(int argc, char *argv[]) {
 
   // Setup the readers
   typedef itk::ImageFileReader< ImageType > ImageReaderType;
-  ImageReaderType::Pointer imageReader = ImageReaderType::New();
-  imageReader->SetFileName( imagePath );
+  typename ImageReaderType::Pointer imageReader = ImageReaderType::New();
+  imageReader->SetFileName( args.imagePath );
 
   typedef itk::ImageFileReader< MaskImageType > MaskReaderType;
   MaskReaderType::Pointer maskReader = MaskReaderType::New();
-  maskReader->SetFileName( maskPath );
+  maskReader->SetFileName( args.maskPath );
 
   MaskReaderType::Pointer roiMaskReader = MaskReaderType::New();
-  roiMaskReader->SetFileName( roiMaskPath );
+  roiMaskReader->SetFileName( args.roiMaskPath );
 
   // Setup a filter that ensures the mask is binary.
   // This is necesary for the feature filter, because the lung segmentation is
@@ -217,8 +296,8 @@ int main(int argc, char *argv[]) {
     MaskImageType,
     MaskImageType > RoiThresholdFilterType;
   RoiThresholdFilterType::Pointer roiThresholdFilter = RoiThresholdFilterType::New();
-  roiThresholdFilter->SetLowerThreshold( roiMaskValue );
-  roiThresholdFilter->SetUpperThreshold( roiMaskValue );
+  roiThresholdFilter->SetLowerThreshold( args.roiMaskValue );
+  roiThresholdFilter->SetUpperThreshold( args.roiMaskValue );
   roiThresholdFilter->SetInsideValue( 1 );
   roiThresholdFilter->SetOutsideValue( 0 );
   roiThresholdFilter->SetInput( roiMaskReader->GetOutput() );  
@@ -229,9 +308,18 @@ int main(int argc, char *argv[]) {
     ImageType,
     MaskImageType,
     VectorImageType > FeatureFilterType;
-  FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
+
+  // Select the features
+  const unsigned int features = FeaturesArg::getFeatures< FeatureFilterType >( args.featureNames );
+  if ( features == 0 ) {
+    return EXIT_FAILURE;
+  }
+
+  typename FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
   featureFilter->SetInputImage( imageReader->GetOutput() );
   featureFilter->SetInputMask( clampFilter->GetOutput() );
+  featureFilter->SetFeatures( features );
+  const size_t numFeatures = featureFilter->GetNumberOfSelectedFeatures();
 
  
   // If we have a ROI specification file we use that, otherwise we
@@ -239,18 +327,18 @@ int main(int argc, char *argv[]) {
   typedef itk::DenseROIGenerator< MaskImageType > ROIGeneratorType;    
   ROIGeneratorType roiGenerator( clampFilter->GetOutput() );
 
-  if ( !roiMaskPath.empty() ) {
+  if ( !args.roiMaskPath.empty() ) {
     std::cout << "Using ROI mask." << std::endl;
     roiGenerator.setMask( roiThresholdFilter->GetOutput() );
   }
 
   std::vector< RegionType > rois;
-  SizeType roiSize{ {roiSizeX, roiSizeY, roiSizeZ} };
+  SizeType roiSize{ {args.roiSizeX, args.roiSizeY, args.roiSizeZ} };
   try {
     rois = roiGenerator.generate( roiSize );
     // We should store the generated ROIs
-    std::string roiFileName = prefix + ".ROIInfo";
-    std::string roiOutPath( Path::join( outDirPath, roiFileName ) );
+    std::string roiFileName = args.prefix + ".ROIInfo";
+    std::string roiOutPath( Path::join( args.outDirPath, roiFileName ) );
     std::ofstream out( roiOutPath );
     for ( auto roi : rois ) {
       out << roi.GetIndex() << roi.GetSize() << '\n';
@@ -266,17 +354,23 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
   
-  // Setup the histogram containers
-  typedef DenseHistogram< PixelType > HistogramType;
-  std::vector< HistogramType > histograms;
+  // Setup the histograms, one for each feature at each scale
+  typedef HistogramBank< PixelType > HistogramBankType;
+  HistogramBankType histograms;
 
   // We want to known how many bins there are in total
   size_t histSize = 0;
+
+  // When the features are kept with 16 bits, feature component histIdx is
+  // encoded such that it stays in its bin of histogram histIdx. When they are
+  // kept as bin indices, it is replaced by its bin of histogram histIdx.
+  typedef BinPreservingEncoder< PixelType > EncoderType;
+  std::vector< EncoderType > encoders;
   
   // Read the histogram edge spec
-  std::ifstream isHist( histPath );
+  std::ifstream isHist( args.histPath );
   if ( !isHist.good() ) {
-    std::cerr << "Could not read histogram file '" << histPath << "'" << std::endl;
+    std::cerr << "Could not read histogram file '" << args.histPath << "'" << std::endl;
     return EXIT_FAILURE;
   }
   
@@ -295,7 +389,6 @@ int main(int argc, char *argv[]) {
     std::stringstream ss( line );
     std::vector< PixelType > edges;
     readTextSequence< PixelType, char >( ss, std::back_inserter(edges) );
-    histograms.emplace_back( HistogramType( edges.begin(), edges.end() ));
     if ( histSize == 0 ) {
       histSize = edges.size() + 1;
     }
@@ -304,38 +397,38 @@ int main(int argc, char *argv[]) {
 		<< std::endl
 		<< "Expected " << histSize << " Got " << edges.size()
 		<< std::endl
-		<< "Number of histograms " << histograms.size()
+		<< "Number of histograms " << histograms.getNumberOfHistograms()
 		<< std::endl;
       return EXIT_FAILURE;
     }
+    histograms.addHistogram( edges.begin(), edges.end() );
+    encoders.emplace_back( args.codec, edges.begin(), edges.end() );
+  }
+
+  // A bin without a 16 bit value would lose its values to a neighbouring
+  // bin, so the bag would not be the same as for float32
+  if ( args.halfPrecision ) {
+    for ( size_t histIdx = 0; histIdx < encoders.size(); ++histIdx ) {
+      if ( !encoders[histIdx].preservesAllBins() ) {
+	std::cerr << "Histogram " << histIdx << " has bins that are narrower than the spacing of "
+		  << args.storage << ". Use a wider storage format." << std::endl;
+	return EXIT_FAILURE;
+      }
+    }
   }
 
-  if ( histograms.size() != numFeatures * scales.size() ) {
+  if ( histograms.getNumberOfHistograms() != numFeatures * args.scales.size() ) {
     std::cerr << "Number of histograms must match number of features times number of scales"
 	      << std::endl
-	      << "Number of histograms = " << histograms.size() << std::endl
-	      << "Number of features*scales = " << numFeatures*scales.size()
+	      << "Number of histograms = " << histograms.getNumberOfHistograms() << std::endl
+	      << "Number of features*scales = " << numFeatures*args.scales.size()
 	      << std::endl;
     return EXIT_FAILURE;
   }
 
-  const size_t totalBins = histSize * histograms.size();
+  const size_t totalBins = histSize * histograms.getNumberOfHistograms();
 
-  // Setup the ROI extraction filter
-  // We need one for the features and one for the mask
-  typedef itk::RegionOfInterestImageFilter<
-		 VectorImageType,
-		 VectorImageType > ROIFilterType;
-  ROIFilterType::Pointer roiFilter = ROIFilterType::New();
-  roiFilter->SetInput( featureFilter->GetOutput() );
-
-  typedef itk::RegionOfInterestImageFilter<
-    MaskImageType,
-    MaskImageType > MaskROIFilterType;
-  MaskROIFilterType::Pointer maskROIFilter = MaskROIFilterType::New();
-  maskROIFilter->SetInput( clampFilter->GetOutput() );
-  
-  // We need to iterate over the mask to get the pixels to sample
+  // We need to iterate over the mask to get the packed pixels to sample
   typedef itk::ImageRegionConstIteratorWithIndex< MaskImageType >
     MaskIteratorType;
   
@@ -348,81 +441,169 @@ int main(int argc, char *argv[]) {
 			 Eigen::RowMajor> MatrixType;
   MatrixType bag( rois.size(), totalBins );
 
-  // Now we can run the pipeline
-  // Which is way to complex to have here. Wrap the parts up and make it
-  // simpler.
-  for ( size_t i = 0; i < scales.size(); ++i ) {
-    std::cout << "Processing scale " << scales[i] << std::endl;
-    featureFilter->SetSigma(scales[i]);
+  // Crop the image and mask to the part needed for the mask and the ROIs. The
+  // extracted images keep their index, so the ROIs can be used as they are.
+  typedef itk::MaskCrop< ImageType, MaskImageType > MaskCropType;
+  MaskCropType crop;
+  if ( args.cropToMask ) {
     try {
-      // We need to update the largest possible region to make it work
-      // TODO: figure what happens to the regions when looping, because it is
-      // not clear.
-      featureFilter->UpdateLargestPossibleRegion();
+      clampFilter->Update();
     }
     catch ( itk::ExceptionObject &e ) {
-      std::cerr << "Failed to update featureFilter." << std::endl       
-		<< "Scale: " << scales[i] << std::endl
-		<< "RequestedRegion: " << featureFilter->GetOutput()->GetRequestedRegion() << std::endl
-		<< "LargestPossibleRegion: " << featureFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
-		<< "Clamp: LargestPossibleRegion(): " << clampFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
+      std::cerr << "Failed to read mask." << std::endl
 		<< "ExceptionObject: " << e << std::endl;
       return EXIT_FAILURE;
     }
+    const float maxScale = *std::max_element( args.scales.begin(), args.scales.end() );
+    crop = itk::cropToMask( featureFilter.GetPointer(),
+			    imageReader->GetOutput(),
+			    clampFilter->GetOutput(),
+			    maxScale,
+			    rois );
+    if ( crop.Region.GetNumberOfPixels() > 0 ) {
+      std::cout << "Cropping to " << crop.Region.GetIndex() << crop.Region.GetSize()
+		<< std::endl;
+    }
+  }
+
+  // Now we can run the pipeline
+  // The features are organized by scale, so feature k at scale i is
+  // component i*numFeatures + k, which is also the order of the histograms.
+  // The float features of all scales are calculated in one update. They are
+  // planar, so component c is GetFeatureOutput( c ).
+  // With 16 bit storage the scales are calculated one at a time and packed
+  // into packedFeatures with the same order, and the ROIs are read from it.
+  // With bin indices the scales are also calculated one at a time, and
+  // binFeatures[histIdx] has the bins of component histIdx.
+  typedef itk::VectorImage< uint16_t, Dimension > PackedImageType;
+  PackedImageType::Pointer packedFeatures = PackedImageType::New();
+  typedef itk::Image< itk::BinIndexType, Dimension > BinImageType;
+  std::vector< BinImageType::Pointer > binFeatures;
+  featureFilter->SetPyramidSamplesPerSigma( args.pyramidSamplesPerSigma );
+  try {
+    if ( args.halfPrecision ) {
+      itk::computePackedFeatures( featureFilter.GetPointer(),
+				  args.scales,
+				  encoders,
+				  packedFeatures.GetPointer() );
+    }
+    else if ( args.binIndices ) {
+      itk::computeBinFeatures( featureFilter.GetPointer(),
+			       args.scales,
+			       clampFilter->GetOutput(),
+			       histograms,
+			       binFeatures );
+    }
+    else {
+      featureFilter->SetPlanarOutput( true );
+      featureFilter->SetSigmas( args.scales );
+      // We need to update the largest possible region to make it work
+      featureFilter->UpdateLargestPossibleRegion();
+    }
+  }
+  catch ( itk::ExceptionObject &e ) {
+    std::cerr << "Failed to update featureFilter." << std::endl       
+	      << "RequestedRegion: " << featureFilter->GetOutput()->GetRequestedRegion() << std::endl
+	      << "LargestPossibleRegion: " << featureFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
+	      << "Clamp: LargestPossibleRegion(): " << clampFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
+	      << "ExceptionObject: " << e << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( args.halfPrecision ) {
+    size_t numNotPreserved = 0;
+    for ( const auto& encoder : encoders ) {
+      numNotPreserved += encoder.getNumberOfNotPreserved();
+    }
+    if ( numNotPreserved > 0 ) {
+      std::cerr << numNotPreserved << " feature values could not be stored as "
+		<< args.storage << " in their histogram bin" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
     
-    // We process one ROI at a time
-    for ( size_t j = 0; j < rois.size(); ++j ) {
-      roiFilter->SetRegionOfInterest( rois[j] );
-      maskROIFilter->SetRegionOfInterest( rois[j] );
-      try {
-	roiFilter->Update();
-  	maskROIFilter->Update();
+  // The ROIs are dense, so neighbouring ROIs share most of their voxels. The
+  // histograms are updated with the voxels that enter and leave the window
+  // as it moves from ROI to ROI, see SlidingWindowHistograms.h.
+  // Feature histIdx is a plane, which is streamed a line at a time, as are
+  // its bin indices, which need no mask. The packed features are read as
+  // vectors that are decoded and inserted in all histograms at once.
+  const MaskImageType *mask = clampFilter->GetOutput();
+  std::vector< PixelType > decoded( histograms.getNumberOfHistograms() );
+  auto updatePlanar = [&]( const RegionType& region, HistogramBankType& bank, bool remove ) {
+    for ( size_t histIdx = 0; histIdx < bank.getNumberOfHistograms(); ++histIdx ) {
+      auto histogram = bank.getHistogram( histIdx );
+      if ( remove ) {
+	itk::removeMaskedRegion( featureFilter->GetFeatureOutput( histIdx ), mask, region, histogram );
       }
-      catch ( itk::ExceptionObject &e ) {
-	std::cerr << "Failed to update maskROIFilter." << std::endl       
-		  << "ROI: " << rois[j] << std::endl
-		  << "Feature filter region: " << featureFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
-		  << "Clamp filter region: " << clampFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
-		  << "ExceptionObject: " << e << std::endl;
-	return EXIT_FAILURE;
+      else {
+	itk::insertMaskedRegion( featureFilter->GetFeatureOutput( histIdx ), mask, region, histogram );
       }
-      
-      // Setup the mask iterator
-      MaskIteratorType
-	maskIter( maskROIFilter->GetOutput(),
-		  maskROIFilter->GetOutput()->GetRequestedRegion() );
-
-      VectorImageType::Pointer features( roiFilter->GetOutput() );
-  
-      for ( maskIter.GoToBegin(); !maskIter.IsAtEnd(); ++maskIter ) {
-	if ( maskIter.Get() ) {
-	  auto pixel = features->GetPixel( maskIter.GetIndex() );
-	  for ( size_t k = 0; k < pixel.GetSize(); ++k ) {
-	    // We want the features organized by scale
-	    size_t histIdx = i * numFeatures + k;
-	    histograms[histIdx].insert( pixel[k] );
-	  }
-	}
+    }
+  };
+  auto updateBins = [&]( const RegionType& region, HistogramBankType& bank, bool remove ) {
+    for ( size_t histIdx = 0; histIdx < bank.getNumberOfHistograms(); ++histIdx ) {
+      auto histogram = bank.getHistogram( histIdx );
+      if ( remove ) {
+	itk::removeBinRegion( binFeatures[histIdx].GetPointer(), region, histogram );
+      }
+      else {
+	itk::insertBinRegion( binFeatures[histIdx].GetPointer(), region, histogram );
       }
-      
-      // Now we add the histograms to the bag at row j.
-      // We need to use the column range
-      //  [ i*(numFeatures*histSize), (i+1)*(numFeatures*histSize) )
-      for ( size_t k = 0; k < numFeatures; ++k ) {
-	size_t histIdx = i * numFeatures + k;
-	auto frequencies = histograms[histIdx].getFrequencies();
-	histograms[histIdx].resetCounts();
-	size_t colOffset = histIdx * histSize;
-	for ( size_t l = 0; l < frequencies.size(); ++l ) {
-	  bag(j, colOffset + l) = frequencies[l];
+    }
+  };
+  auto updatePacked = [&]( const RegionType& region, HistogramBankType& bank, bool remove ) {
+    if ( !packedFeatures->GetBufferedRegion().IsInside( region ) ) {
+      itkGenericExceptionMacro( "Region " << region << " is not inside the features "
+				<< packedFeatures->GetBufferedRegion() );
+    }
+    MaskIteratorType maskIter( mask, region );
+    for ( maskIter.GoToBegin(); !maskIter.IsAtEnd(); ++maskIter ) {
+      if ( maskIter.Get() ) {
+	auto pixel = packedFeatures->GetPixel( maskIter.GetIndex() );
+	for ( size_t histIdx = 0; histIdx < pixel.GetSize(); ++histIdx ) {
+	  decoded[histIdx] = encoders[histIdx].decode( pixel[histIdx] );
+	}
+	if ( remove ) {
+	  bank.remove( decoded.data() );
+	}
+	else {
+	  bank.insert( decoded.data() );
 	}
       }
     }
+  };
+  typedef itk::SlidingWindowHistograms< RegionType, HistogramBankType > SlidingWindowType;
+  SlidingWindowType window( histograms,
+			    args.halfPrecision
+			    ? typename SlidingWindowType::UpdateFunctionType( updatePacked )
+			    : args.binIndices
+			    ? typename SlidingWindowType::UpdateFunctionType( updateBins )
+			    : typename SlidingWindowType::UpdateFunctionType( updatePlanar ) );
+
+  // We process one ROI at a time
+  for ( size_t j = 0; j < rois.size(); ++j ) {
+    try {
+      // Now we add the histograms to the bag at row j, which is contiguous
+      // since bag is row major.
+      // Histogram histIdx uses the column range
+      //  [ histIdx*histSize, (histIdx+1)*histSize )
+      window.compute( rois[j] ).writeFrequencies( bag.row(j).data() );
+    }
+    catch ( itk::ExceptionObject &e ) {
+      std::cerr << "Failed to make the histograms of a ROI." << std::endl       
+		<< "ROI: " << rois[j] << std::endl
+		<< "Feature filter region: " << featureFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
+		<< "Clamp filter region: " << clampFilter->GetOutput()->GetLargestPossibleRegion() << std::endl
+		<< "ExceptionObject: " << e << std::endl;
+      return EXIT_FAILURE;
+    }
   }
+  std::cout << "Updated " << window.getNumberOfUpdatedVoxels() << " voxels for "
+	    << rois.size() << " ROIs" << std::endl;
   // At this point we should have that bag is a matrix of rois and histograms
   // If I understand Eigen correctly, we can just print the matrix directly
-  std::string fileName = prefix + ".bag";
-  std::string outPath( Path::join( outDirPath, fileName ) );
+  std::string fileName = args.prefix + ".bag";
+  std::string outPath( Path::join( args.outDirPath, fileName ) );
   std::ofstream out( outPath );
   for ( typename MatrixType::Index i = 0; i < bag.rows(); ++i ) {
     for ( typename MatrixType::Index j = 0; j < bag.cols(); ++j ) {
@@ -20,6 +20,7 @@
 
 #include "ife/Filters/ImageToEmphysemaFeaturesFilter.h"
 #include "ife/IO/IO.h"
+#include "ife/IO/ImageComponentType.h"
 #include "ife/IO/ROIReader.h"
 #include "ife/ROI/RegionOfInterestGenerator.h"
 #include "ife/Statistics/DenseHistogram.h"
@@ -27,10 +28,33 @@
 
 const std::string VERSION("0.1");
 
+typedef float PixelType;
+typedef unsigned short MaskPixelType;
+
+// The parsed command line
+struct Arguments {
+  std::string imagePath;
+  std::string maskPath;
+  std::string histPath;
+  std::string outDirPath;
+
+  // Optional
+  std::string roiPath;
+  bool roiHasHeader;
+  std::string roiMaskPath;
+  MaskPixelType roiMaskValue;
+  size_t numROIs;
+  size_t roiSizeX;
+  size_t roiSizeY;
+  size_t roiSizeZ;
+  std::string prefix;
+};
+
+// Make the bag with the image read as ImagePixelType
+template< typename ImagePixelType >
+int makeBag( const Arguments& args );
+
 int main(int argc, char *argv[]) {
-  typedef float PixelType;
-  typedef unsigned short MaskPixelType;
-  
   // Commandline parsing
   TCLAP::CmdLine cmd("Create a bag of instances samples from an image.", ' ', VERSION);
 
@@ -180,29 +204,50 @@ int main(int argc, char *argv[]) {
   }
 
   // Store the arguments
-  const std::string imagePath( imageArg.getValue() );
-  const std::string maskPath( maskArg.getValue() );
-  const std::string histPath( histArg.getValue() );
-  const std::string outDirPath( outDirArg.getValue() );
+  Arguments args;
+  args.imagePath = imageArg.getValue();
+  args.maskPath = maskArg.getValue();
+  args.histPath = histArg.getValue();
+  args.outDirPath = outDirArg.getValue();
 
   // Optional
-  const std::string roiPath( roiArg.getValue() );
-  const bool roiHasHeader( roiHasHeaderArg.getValue() );
-  const std::string roiMaskPath( roiMaskArg.getValue() );
-  const MaskPixelType roiMaskValue( roiMaskValueArg.getValue() );
-  const size_t numROIs( numROIsArg.getValue() );
-  const size_t roiSizeX = roiSizeXArg.getValue();
-  const size_t roiSizeY = roiSizeYArg.getValue();
-  const size_t roiSizeZ = roiSizeZArg.getValue();
-  const std::string prefix( prefixArg.getValue() );
+  args.roiPath = roiArg.getValue();
+  args.roiHasHeader = roiHasHeaderArg.getValue();
+  args.roiMaskPath = roiMaskArg.getValue();
+  args.roiMaskValue = roiMaskValueArg.getValue();
+  args.numROIs = numROIsArg.getValue();
+  args.roiSizeX = roiSizeXArg.getValue();
+  args.roiSizeY = roiSizeYArg.getValue();
+  args.roiSizeZ = roiSizeZArg.getValue();
+  args.prefix = prefixArg.getValue();
   //// Commandline parsing is done ////
 
+  // CT scans are stored as short and are read as short, which saves the
+  // memory of a float copy. Other images are read as float, so their values
+  // are not truncated.
+  itk::ImageIOBase::IOComponentType componentType;
+  try {
+    componentType = itk::readComponentType( args.imagePath );
+  }
+  catch ( itk::ExceptionObject &e ) {
+    std::cerr << "Failed to read image information." << std::endl
+	      << "Image: " << args.imagePath << std::endl
+	      << "ExceptionObject: " << e << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( itk::fitsInShort( componentType ) ) {
+    return makeBag< short >( args );
+  }
+  return makeBag< float >( args );
+}
 
+template< typename ImagePixelType >
+int makeBag( const Arguments& args ) {
   // Some common values/types that are always used.
   const unsigned int Dimension = 3;
 
-  // TODO: Need to consider which pixeltype to use
-  typedef itk::Image< PixelType, Dimension >  ImageType;
+  // The image is read as ImagePixelType, see main
+  typedef itk::Image< ImagePixelType, Dimension >  ImageType;
   typedef itk::Image< MaskPixelType, Dimension >  MaskImageType;
 
   typedef typename ImageType::SizeType SizeType;
@@ -211,15 +256,15 @@ int main(int argc, char *argv[]) {
 
   // Setup the readers
   typedef itk::ImageFileReader< ImageType > ImageReaderType;
-  ImageReaderType::Pointer imageReader = ImageReaderType::New();
-  imageReader->SetFileName( imagePath );
+  typename ImageReaderType::Pointer imageReader = ImageReaderType::New();
+  imageReader->SetFileName( args.imagePath );
 
   typedef itk::ImageFileReader< MaskImageType > MaskReaderType;
   MaskReaderType::Pointer maskReader = MaskReaderType::New();
-  maskReader->SetFileName( maskPath );
+  maskReader->SetFileName( args.maskPath );
 
   MaskReaderType::Pointer roiMaskReader = MaskReaderType::New();
-  roiMaskReader->SetFileName( roiMaskPath );
+  roiMaskReader->SetFileName( args.roiMaskPath );
 
   // Setup a filter that ensures the mask is binary.
   // Consider if this is still necesary
@@ -236,8 +281,8 @@ int main(int argc, char *argv[]) {
     MaskImageType,
     MaskImageType > RoiThresholdFilterType;
   RoiThresholdFilterType::Pointer roiThresholdFilter = RoiThresholdFilterType::New();
-  roiThresholdFilter->SetLowerThreshold( roiMaskValue );
-  roiThresholdFilter->SetUpperThreshold( roiMaskValue );
+  roiThresholdFilter->SetLowerThreshold( args.roiMaskValue );
+  roiThresholdFilter->SetUpperThreshold( args.roiMaskValue );
   roiThresholdFilter->SetInsideValue( 1 );
   roiThresholdFilter->SetOutsideValue( 0 );
   roiThresholdFilter->SetInput( roiMaskReader->GetOutput() );  
@@ -246,23 +291,23 @@ int main(int argc, char *argv[]) {
   // If we have a ROI specification file we use that, otherwise we
   // generate a set of ROIs
   std::vector< RegionType > rois;
-  if ( roiPath.empty() ) {
+  if ( args.roiPath.empty() ) {
     // Generate the ROIs. If we have a ROI mask we use that, otherwise we use the
     // image mask
     typedef itk::RegionOfInterestGenerator< MaskImageType > ROIGeneratorType;    
     ROIGeneratorType roiGenerator( clampFilter->GetOutput() );
 
-    if ( !roiMaskPath.empty() ) {
+    if ( !args.roiMaskPath.empty() ) {
       std::cout << "Using ROI mask." << std::endl;
       roiGenerator.setMask( roiThresholdFilter->GetOutput() );
     }
     
-    SizeType roiSize{ {roiSizeX, roiSizeY, roiSizeZ} };
+    SizeType roiSize{ {args.roiSizeX, args.roiSizeY, args.roiSizeZ} };
     try {
-      rois = roiGenerator.generate( numROIs, roiSize );
+      rois = roiGenerator.generate( args.numROIs, roiSize );
       // We should store the generated ROIs
-      std::string roiFileName = prefix + ".ROIInfo";
-      std::string roiOutPath( Path::join( outDirPath, roiFileName ) );
+      std::string roiFileName = args.prefix + ".ROIInfo";
+      std::string roiOutPath( Path::join( args.outDirPath, roiFileName ) );
       std::ofstream out( roiOutPath );
       for ( auto roi : rois ) {
 	out << roi.GetIndex() << roi.GetSize() << '\n';
@@ -282,12 +327,12 @@ int main(int argc, char *argv[]) {
     // Read the roi specification
     typedef ROIReader< RegionType > ROIReaderType;
     try {
-      rois = ROIReaderType::read( roiPath, roiHasHeader );
+      rois = ROIReaderType::read( args.roiPath, args.roiHasHeader );
       std::cout << "Got " << rois.size() << " rois." << std::endl;
     }
     catch ( std::exception &e ) {
       std::cerr << "Error reading ROIs" << std::endl
-		<< "roiPath: " << roiPath << std::endl
+		<< "roiPath: " << args.roiPath << std::endl
 		<< "exception: " << e.what() << std::endl;
       return EXIT_FAILURE;
     }
@@ -299,9 +344,9 @@ int main(int argc, char *argv[]) {
   std::vector< HistogramType > histograms;
 
   // Read the histogram edge spec
-  std::ifstream isHist( histPath );
+  std::ifstream isHist( args.histPath );
   if ( !isHist.good() ) {
-    std::cerr << "Could not read histogram file '" << histPath << "'" << std::endl;
+    std::cerr << "Could not read histogram file '" << args.histPath << "'" << std::endl;
     return EXIT_FAILURE;
   }
   
@@ -332,7 +377,7 @@ int main(int argc, char *argv[]) {
   // Setup the ROI extraction filter
   // We need one for the intensity and one for the mask
   typedef itk::RegionOfInterestImageFilter< ImageType, ImageType > ROIFilterType;
-  ROIFilterType::Pointer roiFilter = ROIFilterType::New();
+  typename ROIFilterType::Pointer roiFilter = ROIFilterType::New();
   roiFilter->SetInput( imageReader->GetOutput() );
 
   typedef itk::RegionOfInterestImageFilter< MaskImageType, MaskImageType > MaskROIFilterType;
@@ -374,7 +419,7 @@ int main(int argc, char *argv[]) {
       maskIter( maskROIFilter->GetOutput(),
 		maskROIFilter->GetOutput()->GetRequestedRegion() );
 
-    ImageType::Pointer roi( roiFilter->GetOutput() );
+    typename ImageType::Pointer roi( roiFilter->GetOutput() );
     for ( maskIter.GoToBegin(); !maskIter.IsAtEnd(); ++maskIter ) {
       if ( maskIter.Get() ) {
 	histograms[0].insert( roi->GetPixel( maskIter.GetIndex() ) );
@@ -391,8 +436,8 @@ int main(int argc, char *argv[]) {
   }
 
 
-  std::string fileName = prefix + ".bag";
-  std::string outPath( Path::join( outDirPath, fileName ) );
+  std::string fileName = args.prefix + ".bag";
+  std::string outPath( Path::join( args.outDirPath, fileName ) );
   std::ofstream out( outPath );
   for ( typename MatrixType::Index i = 0; i < bag.rows(); ++i ) {
     for ( typename MatrixType::Index j = 0; j < bag.cols(); ++j ) {
@@ -32,6 +32,7 @@
 #include "itkMaskImageFilter.h"
 
 #include "ife/Filters/NormalizedGaussianConvolutionImageFilter.h"
+#include "ife/Util/FeatureArguments.h"
 #include "ife/Util/Path.h"
 
 const std::string VERSION("0.1");
@@ -100,6 +101,9 @@ int main(int argc, char *argv[]) {
 		  false, 
 		  "boolean", 
 		  cmd);
+
+  // How the Gaussian is approximated
+  SmoothingArg smoothingArg( cmd );
   
   
   try {
@@ -118,6 +122,7 @@ int main(int argc, char *argv[]) {
   std::string outDirPath( outDirArg.getValue() );
   std::string prefix( prefixArg.getValue() );
   const bool maskOutput( maskOutputArg.getValue() );
+  const itk::GaussianSmoothingMethod smoothingMethod( smoothingArg.getSmoothingMethod() );
 
   //// Commandline parsing is done ////
 
@@ -143,6 +148,7 @@ int main(int argc, char *argv[]) {
   FilterType::Pointer normConvFilter = FilterType::New();
   normConvFilter->SetInputImage( imageReader->GetOutput() );
   normConvFilter->SetInputCertainty( certaintyReader->GetOutput() );
+  normConvFilter->SetSmoothingMethod( smoothingMethod );
   
   // Setup the writer
   typedef itk::ImageFileWriter< ImageType >  WriterType;